@@ -50,11 +50,14 @@ struct bench_options {
 
   std::string adj_list_dump_file_name;
   std::string edge_list_dump_file_name;
+
+  bool bulk_load{false};
 };
 
 inline void disp_options(const bench_options &option) {
   std::cout << "adj_list_key_name: " << option.adj_list_key_name << std::endl;
   std::cout << "chunk_size: " << option.chunk_size << std::endl;
+  std::cout << "bulk_load: " << static_cast<int>(option.bulk_load) << std::endl;
 
   if (!option.datastore_path_list.empty()) {
     std::cout << "datastore_path_list: " << std::endl;
@@ -83,7 +86,7 @@ inline void disp_options(const bench_options &option) {
 
 inline auto parse_options(int argc, char **argv, bench_options *option) {
   int p;
-  while ((p = ::getopt(argc, argv, "o:k:n:f:s:v:e:a:b:c:r:u:d:D:")) != -1) {
+  while ((p = ::getopt(argc, argv, "o:k:n:f:s:v:e:a:b:c:r:u:d:D:l:")) != -1) {
     switch (p) {
       case 'o':option->datastore_path_list.clear();
         boost::split(option->datastore_path_list, optarg, boost::is_any_of(":"));
@@ -130,6 +133,10 @@ inline auto parse_options(int argc, char **argv, bench_options *option) {
         option->edge_list_dump_file_name = optarg;
         break;
 
+      case 'l': // use the bulk-load API of the adjacency list if it has one
+        option->bulk_load = static_cast<bool>(std::stoi(optarg));
+        break;
+
       default:std::cerr << "Invalid option" << std::endl;
         return false;
     }
@@ -151,7 +158,8 @@ template <typename adjacency_list_type>
 inline auto run_bench_kv_file(const std::vector<std::string> &input_file_name_list,
                               const std::size_t chunk_size,
                               adjacency_list_type *adj_list,
-                              std::ofstream *const ofs_save_edge) {
+                              std::ofstream *const ofs_save_edge,
+                              const bool bulk_load = false) {
 
   using reader_type = utility::pair_reader<typename adjacency_list_type::key_type,
                                            typename adjacency_list_type::value_type>;
@@ -175,7 +183,7 @@ inline auto run_bench_kv_file(const std::vector<std::string> &input_file_name_li
 
     if (count_read == 0) break;
 
-    total_elapsed_time += ingest_key_values(input_storage, adj_list);
+    total_elapsed_time += ingest_key_values(input_storage, adj_list, bulk_load);
 
     if (ofs_save_edge) {
       for (const auto &list : input_storage) {
@@ -198,7 +206,8 @@ template <typename adjacency_list_type>
 inline auto run_bench_rmat_edge(const bench_options::rmat_option &rmat_option,
                                 const std::size_t chunk_size,
                                 adjacency_list_type *adj_list,
-                                std::ofstream *const ofs_save_edge) {
+                                std::ofstream *const ofs_save_edge,
+                                const bool bulk_load = false) {
 
   // -- Initialize rmat edge generators -- //
   using rmat_generator = edge_generator::rmat_edge_generator;
@@ -242,7 +251,7 @@ inline auto run_bench_rmat_edge(const bench_options::rmat_option &rmat_option,
       }
     }
 
-    total_elapsed_time += ingest_key_values(input_storage, adj_list);
+    total_elapsed_time += ingest_key_values(input_storage, adj_list, bulk_load);
 
     if (ofs_save_edge) {
       for (const auto &list : input_storage) {
@@ -301,10 +310,12 @@ void run_bench(const bench_options &options, adjacency_list_type *adj_list) {
   double elapsed_time_sec;
   if (options.input_file_name_list.empty()) {
     std::cout << "Get inputs from the RMAT edge generator" << std::endl;
-    elapsed_time_sec = run_bench_rmat_edge(options.rmat, options.chunk_size, adj_list, &ofs_save_edge);
+    elapsed_time_sec = run_bench_rmat_edge(options.rmat, options.chunk_size, adj_list, &ofs_save_edge,
+                                           options.bulk_load);
   } else {
     std::cout << "Get inputs from key-value files" << std::endl;
-    elapsed_time_sec = run_bench_kv_file(options.input_file_name_list, options.chunk_size, adj_list, &ofs_save_edge);
+    elapsed_time_sec = run_bench_kv_file(options.input_file_name_list, options.chunk_size, adj_list, &ofs_save_edge,
+                                         options.bulk_load);
   }
   std::cout << "\nFinished adj_list (s)\t" << elapsed_time_sec << std::endl;
 
@@ -7,6 +7,7 @@
 #define METALL_BENCH_ADJACENCY_LIST_KERNEL_HPP
 
 #include <iostream>
+#include <type_traits>
 
 #include <metall/detail/utility/time.hpp>
 #include <metall/detail/utility/memory.hpp>
@@ -55,21 +56,45 @@ inline auto allocate_key_value_input_storage() {
   return key_value_input_storage_t<adjacency_list_type>(num_threads);
 }
 
+/// \brief True if adjacency_list_type has bulk_add(), which takes key_value_input_storage_t
+template <typename adjacency_list_type, typename = void>
+struct has_bulk_add : std::false_type {};
+
+template <typename adjacency_list_type>
+struct has_bulk_add<adjacency_list_type,
+                    std::void_t<decltype(std::declval<adjacency_list_type &>().bulk_add(
+                        std::declval<const key_value_input_storage_t<adjacency_list_type> &>()))>>
+    : std::true_type {};
+
+/// \brief Ingests key-value pairs into an adjacency list.
+/// If bulk_load is true and the adjacency list has bulk_add(), the pairs are given to it at once;
+/// otherwise, each thread adds its own pairs one by one.
 template <typename adjacency_list_type>
 inline auto ingest_key_values(const key_value_input_storage_t<adjacency_list_type> &input,
-                              adjacency_list_type *const adj_list) {
+                              adjacency_list_type *const adj_list,
+                              const bool bulk_load = false) {
   print_current_num_page_faults();
 
   std::size_t num_inserted = 0;
   const auto start = util::elapsed_time_sec();
-  OMP_DIRECTIVE(parallel reduction(+:num_inserted))
-  {
-    assert((int)input.size() == (int)omp::get_num_threads());
-    const auto &key_value_list = input.at(omp::get_thread_num());
-    for (std::size_t i = 0; i < key_value_list.size(); ++i) {
-      adj_list->add(key_value_list[i].first, key_value_list[i].second);
+  bool done = false;
+  if constexpr (has_bulk_add<adjacency_list_type>::value) {
+    if (bulk_load) {
+      adj_list->bulk_add(input);
+      for (const auto &key_value_list : input) num_inserted += key_value_list.size();
+      done = true;
+    }
+  }
+  if (!done) {
+    OMP_DIRECTIVE(parallel reduction(+:num_inserted))
+    {
+      assert((int)input.size() == (int)omp::get_num_threads());
+      const auto &key_value_list = input.at(omp::get_thread_num());
+      for (std::size_t i = 0; i < key_value_list.size(); ++i) {
+        adj_list->add(key_value_list[i].first, key_value_list[i].second);
+      }
+      num_inserted += key_value_list.size();
     }
-    num_inserted += key_value_list.size();
   }
   adj_list->sync();
   const auto elapsed_time = util::elapsed_time_sec(start);
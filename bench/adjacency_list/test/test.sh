@@ -81,6 +81,14 @@ main() {
   check_program_exit_status
   cat ${DATA}* >> ${DATASTORE_DIR_ROOT}/adj_ref
   compare "${DATASTORE_DIR_ROOT}/adj_out_reopen" "${DATASTORE_DIR_ROOT}/adj_ref"
+  /bin/rm -f "${DATASTORE_DIR_ROOT}/adj_out_reopen" "${DATASTORE_DIR_ROOT}/adj_ref"
+
+  echo ""
+  echo "BulkLoadTest"
+  ./run_adj_list_bench_metall -o ${DATASTORE_DIR_ROOT}/metall_test_dir_bulk -f $((2**26)) -l 1 -d ${DATASTORE_DIR_ROOT}/adj_out_bulk ${DATA}*
+  check_program_exit_status
+  cat ${DATA}* >> ${DATASTORE_DIR_ROOT}/adj_ref
+  compare "${DATASTORE_DIR_ROOT}/adj_out_bulk" "${DATASTORE_DIR_ROOT}/adj_ref"
 
   /bin/rm -rf ${DATASTORE_DIR_ROOT}
 }
@@ -8,6 +8,7 @@
 
 #include <vector>
 #include <string>
+#include <type_traits>
 #include <unistd.h>
 #include <boost/algorithm/string.hpp>
 
@@ -83,6 +84,14 @@ bool parse_options(int argc, char **argv, bench_options<vertex_id_type> *option)
   return true;
 }
 
+/// \brief True if graph_type has the vertices [0, num_vertices()), e.g., CSR graphs
+template <typename graph_type, typename = void>
+struct has_num_vertices : std::false_type {};
+
+template <typename graph_type>
+struct has_num_vertices<graph_type, std::void_t<decltype(std::declval<const graph_type &>().num_vertices())>>
+    : std::true_type {};
+
 // ---------------------------------------- //
 // Find max ID
 // ---------------------------------------- //
@@ -90,9 +99,13 @@ template <typename graph_type>
 typename graph_type::key_type find_max_id(const graph_type &graph) {
   typename graph_type::key_type max_id = std::numeric_limits<typename graph_type::key_type>::min();
 
-  for (auto source_itr = graph.keys_begin(), source_end = graph.keys_end(); source_itr != source_end; ++source_itr) {
-    const auto &source = source_itr->first;
-    max_id = std::max(max_id, source);
+  if constexpr (has_num_vertices<graph_type>::value) {
+    max_id = graph.num_vertices() - 1;
+  } else {
+    for (auto source_itr = graph.keys_begin(), source_end = graph.keys_end(); source_itr != source_end; ++source_itr) {
+      const auto &source = source_itr->first;
+      max_id = std::max(max_id, source);
+    }
   }
 
   return max_id;
@@ -103,10 +116,18 @@ typename graph_type::key_type find_max_id(const graph_type &graph) {
 // ---------------------------------------- //
 template <typename graph_type>
 typename graph_type::key_type find_root(const graph_type &graph) {
-  for (auto source_itr = graph.keys_begin(), source_end = graph.keys_end(); source_itr != source_end; ++source_itr) {
-    const auto &source = source_itr->first;
-    if (graph.num_values(source) > 0) {
-      return source;
+  if constexpr (has_num_vertices<graph_type>::value) {
+    for (typename graph_type::key_type source = 0; source < graph.num_vertices(); ++source) {
+      if (graph.num_values(source) > 0) {
+        return source;
+      }
+    }
+  } else {
+    for (auto source_itr = graph.keys_begin(), source_end = graph.keys_end(); source_itr != source_end; ++source_itr) {
+      const auto &source = source_itr->first;
+      if (graph.num_values(source) > 0) {
+        return source;
+      }
     }
   }
   std::cerr << "Cannot find a vertex that has an edge" << std::endl;
@@ -154,6 +154,16 @@ run() {
     try_to_get_compiler_ver ${exec_file_name}
     execute ${NUM_THREADS} ${SCHEDULE} ${exec_file_name} -g "${GRAPH_DIR}/${GRAPH_NAME}" -k ${ADJ_LIST_KEY_NAME} -r ${BFS_ROOT} -m ${MAX_VERTEX_ID}
 
+    # Run BFS on the CSR graph built from the adjacency list if there is the executable
+    exec_file_name="./run_bfs_bench_${EXEC_NAME}_csr"
+    if [ -x ${exec_file_name} ]; then
+        echo "" | tee -a ${LOG_FILE}
+        echo "----------------------------------------" | tee -a ${LOG_FILE}
+        echo "BFS with" ${EXEC_NAME} "CSR" | tee -a ${LOG_FILE}
+        echo "----------------------------------------" | tee -a ${LOG_FILE}
+        execute ${NUM_THREADS} ${SCHEDULE} ${exec_file_name} -g "${GRAPH_DIR}/${GRAPH_NAME}" -k ${ADJ_LIST_KEY_NAME} -r ${BFS_ROOT} -m ${MAX_VERTEX_ID}
+    fi
+
 
     if ${NO_CLEANING_FILES_AT_END}; then
         echo "Do not delete the used directory"
@@ -0,0 +1,139 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+// Runs BFS on metall::container::csr_graph.
+// Looks up the CSR graph named '<graph_key_name>_csr' in the data store.
+// If it does not exist, builds it from the adjacency list named graph_key_name
+// that run_adj_list_bench_metall constructed, and stores it in the data store.
+// The edges are read from the banks of the adjacency list directly and in parallel, i.e., are not copied into DRAM.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <algorithm>
+
+#include <metall/metall.hpp>
+#include <metall_container/csr_graph.hpp>
+#include <metall/detail/utility/parallel_for.hpp>
+#include "../data_structure/multithread_adjacency_list.hpp"
+#include "bench_driver.hpp"
+
+using namespace bfs_bench;
+
+using vertex_id_type = uint64_t;
+
+using adjacency_list_type =  data_structure::multithread_adjacency_list<vertex_id_type, vertex_id_type,
+                                                                        typename metall::manager::allocator_type<std::byte>>;
+
+using csr_graph_type = metall::container::csr_graph<vertex_id_type, uint64_t,
+                                                    typename metall::manager::allocator_type<std::byte>>;
+
+/// \brief A forward iterator over the edges of a bank of an adjacency list
+class edge_iterator {
+ public:
+  using key_iterator = adjacency_list_type::const_local_key_iterator;
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = std::pair<vertex_id_type, vertex_id_type>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const value_type *;
+  using reference = value_type;
+
+  edge_iterator(const key_iterator &key_itr, const key_iterator &key_end)
+      : m_key_itr(key_itr),
+        m_key_end(key_end) {
+    priv_skip_empty_lists();
+  }
+
+  value_type operator*() const {
+    return value_type(m_key_itr->first, *m_value_itr);
+  }
+
+  edge_iterator &operator++() {
+    ++m_value_itr;
+    if (m_value_itr == m_key_itr->second.end()) {
+      ++m_key_itr;
+      priv_skip_empty_lists();
+    }
+    return *this;
+  }
+
+  bool operator==(const edge_iterator &other) const {
+    return m_key_itr == other.m_key_itr && (m_key_itr == m_key_end || m_value_itr == other.m_value_itr);
+  }
+
+  bool operator!=(const edge_iterator &other) const {
+    return !(*this == other);
+  }
+
+ private:
+  void priv_skip_empty_lists() {
+    while (m_key_itr != m_key_end && m_key_itr->second.empty()) ++m_key_itr;
+    if (m_key_itr != m_key_end) m_value_itr = m_key_itr->second.begin();
+  }
+
+  key_iterator m_key_itr;
+  key_iterator m_key_end;
+  adjacency_list_type::const_value_iterator m_value_itr{};
+};
+
+csr_graph_type *build_csr_graph(metall::manager &manager, const std::string &csr_key_name,
+                                const std::string &adj_list_key_name) {
+  auto adj_list = manager.find<adjacency_list_type>(adj_list_key_name.c_str()).first;
+  if (!adj_list) {
+    std::cerr << "Cannot find " << adj_list_key_name << std::endl;
+    std::abort();
+  }
+
+  std::cout << "\nBuild CSR graph" << std::endl;
+  const auto start = util::elapsed_time_sec();
+
+  // Each bank of the adjacency list is a partition of the edges, which the threads read in parallel
+  const auto bank_edges = [adj_list](const std::size_t bank_no) {
+    return std::make_pair(edge_iterator(adj_list->keys_begin(bank_no), adj_list->keys_end(bank_no)),
+                          edge_iterator(adj_list->keys_end(bank_no), adj_list->keys_end(bank_no)));
+  };
+  const std::size_t num_threads = util::default_num_threads();
+  std::vector<std::size_t> max_ids(adj_list->num_banks(), 0);
+  util::parallel_for(adj_list->num_banks(), num_threads, [&bank_edges, &max_ids](const std::size_t bank_no) {
+    const auto edges = bank_edges(bank_no);
+    for (auto itr = edges.first; itr != edges.second; ++itr) {
+      const auto edge = *itr;
+      max_ids[bank_no] = std::max<std::size_t>(max_ids[bank_no], std::max(edge.first, edge.second) + 1);
+    }
+  });
+  const std::size_t num_vertices = *std::max_element(max_ids.begin(), max_ids.end());
+
+  auto csr = manager.construct<csr_graph_type>(csr_key_name.c_str())(manager.get_allocator());
+  csr->build_partitioned(num_vertices, adj_list->num_banks(), bank_edges, num_threads);
+  const auto elapsed_time = util::elapsed_time_sec(start);
+  std::cout << "Finished building CSR graph (s)\t" << elapsed_time
+            << "\n#vertices\t" << csr->num_vertices() << "\n#edges\t" << csr->num_edges() << std::endl;
+
+  return csr;
+}
+
+int main(int argc, char *argv[]) {
+
+  bench_options<vertex_id_type> option;
+  if (!parse_options(argc, argv, &option)) {
+    std::abort();
+  }
+
+  {
+    metall::manager manager(metall::open_only, option.graph_file_name_list[0].c_str());
+    const std::string csr_key_name = option.graph_key_name + "_csr";
+    auto csr = manager.find<csr_graph_type>(csr_key_name.c_str()).first;
+    if (!csr) {
+      csr = build_csr_graph(manager, csr_key_name, option.graph_key_name);
+    }
+
+    run_bench(csr->view(), option);
+  }
+
+  return 0;
+}
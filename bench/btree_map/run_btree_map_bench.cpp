@@ -0,0 +1,208 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+// Compares metall::container::btree_map with boost::container::map, both allocated in Metall,
+// on point (insert and find), range scan, and mixed read/write workloads.
+// boost::container::map is not thread-safe, so it is always run with a single thread.
+// Usage:
+// ./run_btree_map_bench -d /path/to/datastore -n 4194304 -q 1048576 -l 100 -w 10 -t 4
+// -d: path to a data store
+// -n: the number of keys
+// -q: the number of range scans
+// -l: the number of elements each range scan visits
+// -w: the percentage of updates in the mixed workload; the others are finds of existing keys
+// -t: the number of threads (the default is the number of hardware threads)
+
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <limits>
+
+#include <boost/container/map.hpp>
+
+#include <metall/metall.hpp>
+#include <metall/detail/utility/time.hpp>
+#include <metall/detail/utility/common.hpp>
+#include <metall_container/btree_map.hpp>
+
+namespace util = metall::detail::utility;
+
+struct option_type {
+  std::string datastore_path{"/tmp/btree_map_bench"};
+  std::size_t num_keys{1ULL << 22ULL};
+  std::size_t num_scans{1ULL << 20ULL};
+  std::size_t scan_length{100};
+  std::size_t write_percentage{10};
+  std::size_t num_threads{std::max(std::thread::hardware_concurrency(), 1U)};
+};
+
+bool parse_option(int argc, char *argv[], option_type *option) {
+  int p;
+  while ((p = ::getopt(argc, argv, "d:n:q:l:w:t:")) != -1) {
+    switch (p) {
+      case 'd':option->datastore_path = optarg;
+        break;
+
+      case 'n':option->num_keys = std::stoull(optarg);
+        break;
+
+      case 'q':option->num_scans = std::stoull(optarg);
+        break;
+
+      case 'l':option->scan_length = std::stoull(optarg);
+        break;
+
+      case 'w':option->write_percentage = std::stoull(optarg);
+        break;
+
+      case 't':option->num_threads = std::stoull(optarg);
+        break;
+
+      default:std::cerr << "Invalid option" << std::endl;
+        return false;
+    }
+  }
+  return true;
+}
+
+using key_type = uint64_t;
+using mapped_type = uint64_t;
+using value_type = std::pair<const key_type, mapped_type>;
+using allocator_type = metall::manager::allocator_type<value_type>;
+
+using btree_map_type = metall::container::btree_map<key_type, mapped_type, std::less<key_type>, allocator_type>;
+using boost_map_type = boost::container::map<key_type, mapped_type, std::less<key_type>, allocator_type>;
+
+/// \brief Calls kernel(key) for every key using num_threads threads and returns the elapsed time
+double run_in_parallel(const std::vector<key_type> &keys, const std::size_t num_threads,
+                       const std::function<void(key_type)> &kernel) {
+  const auto start = util::elapsed_time_sec();
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < num_threads; ++t) {
+    const auto range = util::partial_range(keys.size(), t, num_threads);
+    threads.emplace_back([&keys, &kernel, range]() {
+      for (std::size_t i = range.first; i < range.second; ++i) {
+        kernel(keys[i]);
+      }
+    });
+  }
+  for (auto &th : threads) {
+    th.join();
+  }
+  return util::elapsed_time_sec(start);
+}
+
+struct map_operations {
+  std::function<void(key_type)> insert;
+  std::function<bool(key_type)> find;
+  /// \brief Assigns a value to an existing key
+  std::function<void(key_type)> update;
+  /// \brief Returns the sum of the values of the first scan_length elements whose keys are not less than the key
+  std::function<uint64_t(key_type, std::size_t)> scan;
+};
+
+template <typename map_type>
+void run(const std::string &name, const std::vector<key_type> &keys, const std::vector<key_type> &scan_keys,
+         const std::size_t num_threads, const option_type &option,
+         const std::function<map_operations(map_type &)> &make_operations) {
+  metall::manager::remove(option.datastore_path.c_str());
+  metall::manager manager(metall::create_only, option.datastore_path.c_str());
+  auto *const map = manager.construct<map_type>("map")(manager.get_allocator());
+  const auto operations = make_operations(*map);
+
+  const auto insert_time = run_in_parallel(keys, num_threads, operations.insert);
+
+  std::atomic<std::size_t> num_found(0);
+  const auto find_time = run_in_parallel(keys, num_threads, [&operations, &num_found](const key_type key) {
+    if (operations.find(key)) num_found.fetch_add(1, std::memory_order_relaxed);
+  });
+  if (num_found != keys.size()) {
+    std::cerr << name << ": some keys were not found" << std::endl;
+    std::abort();
+  }
+
+  std::atomic<uint64_t> checksum(0);
+  const auto scan_time = run_in_parallel(scan_keys, num_threads,
+                                         [&operations, &checksum, &option](const key_type key) {
+                                           checksum.fetch_add(operations.scan(key, option.scan_length),
+                                                              std::memory_order_relaxed);
+                                         });
+
+  // Writers and readers of different nodes run at the same time
+  const auto mixed_time = run_in_parallel(keys, num_threads, [&operations, &option](const key_type key) {
+    if ((key >> 32ULL) % 100 < option.write_percentage) {
+      operations.update(key);
+    } else {
+      operations.find(key);
+    }
+  });
+
+  std::cout << name << "\t#threads\t" << num_threads
+            << "\tinsert (s)\t" << insert_time << "\tfind (s)\t" << find_time
+            << "\tscan (s)\t" << scan_time << "\tmixed (s)\t" << mixed_time
+            << "\tchecksum\t" << checksum << std::endl;
+
+  manager.destroy<map_type>("map");
+}
+
+int main(int argc, char *argv[]) {
+  option_type option;
+  if (!parse_option(argc, argv, &option)) {
+    std::abort();
+  }
+
+  std::vector<key_type> keys(option.num_keys);
+  std::mt19937_64 rand_engine(123);
+  for (auto &key : keys) key = rand_engine();
+
+  std::vector<key_type> scan_keys(option.num_scans);
+  for (auto &key : scan_keys) key = rand_engine();
+
+  std::cout << "#keys\t" << option.num_keys << "\t#scans\t" << option.num_scans
+            << "\tscan_length\t" << option.scan_length << std::endl;
+
+  run<btree_map_type>("btree_map", keys, scan_keys, option.num_threads, option, [](btree_map_type &map) {
+    map_operations operations;
+    operations.insert = [&map](const key_type key) { map.insert(std::make_pair(key, key)); };
+    operations.find = [&map](const key_type key) { return map.count(key) == 1; };
+    operations.update = [&map](const key_type key) { map.insert_or_assign(key, key + 1); };
+    operations.scan = [&map](const key_type key, const std::size_t length) {
+      uint64_t sum = 0;
+      std::size_t count = 0;
+      map.for_each(key, std::numeric_limits<key_type>::max(),
+                   [&sum, &count, length](const key_type, const mapped_type value) {
+                     sum += value;
+                     return ++count < length;
+                   });
+      return sum;
+    };
+    return operations;
+  });
+
+  run<boost_map_type>("boost::container::map", keys, scan_keys, 1, option, [](boost_map_type &map) {
+    map_operations operations;
+    operations.insert = [&map](const key_type key) { map.emplace(key, key); };
+    operations.find = [&map](const key_type key) { return map.count(key) == 1; };
+    operations.update = [&map](const key_type key) { map[key] = key + 1; };
+    operations.scan = [&map](const key_type key, const std::size_t length) {
+      uint64_t sum = 0;
+      std::size_t count = 0;
+      for (auto itr = map.lower_bound(key); itr != map.end() && count < length; ++itr, ++count) {
+        sum += itr->second;
+      }
+      return sum;
+    };
+    return operations;
+  });
+
+  metall::manager::remove(option.datastore_path.c_str());
+
+  return 0;
+}
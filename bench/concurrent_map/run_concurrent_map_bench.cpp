@@ -0,0 +1,149 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+// Measures the throughput of mixed reads (count) and writes (insert or edit)
+// to metall::container::concurrent_map and metall::container::concurrent_hash_map allocated in Metall,
+// doubling the number of threads from 1 up to the given number.
+// Two map instances are used at the same time to show that they do not contend with each other.
+// Also measures the time to scan all elements of a map with for_each_parallel() for each number of threads.
+// Usage:
+// ./run_concurrent_map_bench -d /path/to/datastore -n 4194304 -w 10 -t 8
+// -d: path to a data store
+// -n: the number of operations per thread count
+// -w: the percentage of writes
+// -t: the maximum number of threads (the default is the number of hardware threads)
+
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+
+#include <metall/metall.hpp>
+#include <metall/detail/utility/time.hpp>
+#include <metall/detail/utility/common.hpp>
+#include <metall_container/concurrent_map.hpp>
+#include <metall_container/concurrent_hash_map.hpp>
+
+namespace util = metall::detail::utility;
+
+struct option_type {
+  std::string datastore_path{"/tmp/concurrent_map_bench"};
+  std::size_t num_operations{1ULL << 22ULL};
+  std::size_t write_percentage{10};
+  std::size_t max_num_threads{std::max(std::thread::hardware_concurrency(), 1U)};
+};
+
+bool parse_option(int argc, char *argv[], option_type *option) {
+  int p;
+  while ((p = ::getopt(argc, argv, "d:n:w:t:")) != -1) {
+    switch (p) {
+      case 'd':option->datastore_path = optarg;
+        break;
+
+      case 'n':option->num_operations = std::stoull(optarg);
+        break;
+
+      case 'w':option->write_percentage = std::stoull(optarg);
+        break;
+
+      case 't':option->max_num_threads = std::stoull(optarg);
+        break;
+
+      default:std::cerr << "Invalid option" << std::endl;
+        return false;
+    }
+  }
+  return true;
+}
+
+using key_type = uint64_t;
+using mapped_type = uint64_t;
+using value_type = std::pair<const key_type, mapped_type>;
+using allocator_type = metall::manager::allocator_type<value_type>;
+
+using concurrent_map_type = metall::container::concurrent_map<key_type, mapped_type,
+                                                              std::less<key_type>,
+                                                              metall::utility::hash<key_type>,
+                                                              allocator_type>;
+using concurrent_hash_map_type = metall::container::concurrent_hash_map<key_type, mapped_type,
+                                                                        metall::utility::hash<key_type>,
+                                                                        std::equal_to<key_type>,
+                                                                        allocator_type>;
+
+template <typename map_type>
+void run(const std::string &name, const option_type &option) {
+  metall::manager::remove(option.datastore_path.c_str());
+  metall::manager manager(metall::create_only, option.datastore_path.c_str());
+  map_type *const maps[2] = {manager.construct<map_type>("map0")(manager.get_allocator()),
+                             manager.construct<map_type>("map1")(manager.get_allocator())};
+
+  // Half of the key space is inserted in advance so that about a half of the reads succeed
+  const key_type key_space = option.num_operations;
+  for (key_type key = 0; key < key_space; key += 2) {
+    maps[0]->insert(std::make_pair(key, key));
+    maps[1]->insert(std::make_pair(key, key));
+  }
+
+  for (std::size_t num_threads = 1; num_threads <= option.max_num_threads; num_threads *= 2) {
+    const auto start = util::elapsed_time_sec();
+    std::vector<std::thread> threads;
+    std::vector<std::size_t> num_found(num_threads, 0);
+    for (std::size_t t = 0; t < num_threads; ++t) {
+      const auto range = util::partial_range(option.num_operations, t, num_threads);
+      threads.emplace_back([&maps, &option, &num_found, key_space, range, t]() {
+        auto &map = *maps[t % 2];
+        std::mt19937_64 rand_engine(t);
+        std::uniform_int_distribution<key_type> key_dist(0, key_space - 1);
+        std::uniform_int_distribution<std::size_t> op_dist(0, 99);
+        for (std::size_t i = range.first; i < range.second; ++i) {
+          const auto key = key_dist(rand_engine);
+          if (op_dist(rand_engine) < option.write_percentage) {
+            map.edit(key, [](mapped_type &value) { ++value; });
+          } else {
+            num_found[t] += map.count(key);
+          }
+        }
+      });
+    }
+    for (auto &th : threads) {
+      th.join();
+    }
+    const auto elapsed_time = util::elapsed_time_sec(start);
+
+    std::atomic<uint64_t> checksum(0);
+    const auto scan_start = util::elapsed_time_sec();
+    maps[0]->for_each_parallel([&checksum](const auto &element) {
+      checksum.fetch_add(element.second, std::memory_order_relaxed);
+    }, num_threads);
+    const auto scan_time = util::elapsed_time_sec(scan_start);
+
+    std::cout << name << "\t#threads\t" << num_threads
+              << "\twrite (%)\t" << option.write_percentage
+              << "\tthroughput (Mops/s)\t" << (double)option.num_operations / elapsed_time / 1000000.0
+              << "\tscan (s)\t" << scan_time << "\tchecksum\t" << checksum << std::endl;
+  }
+
+  manager.destroy<map_type>("map0");
+  manager.destroy<map_type>("map1");
+}
+
+int main(int argc, char *argv[]) {
+  option_type option;
+  if (!parse_option(argc, argv, &option)) {
+    std::abort();
+  }
+
+  std::cout << "#operations\t" << option.num_operations << std::endl;
+
+  run<concurrent_map_type>("concurrent_map", option);
+  run<concurrent_hash_map_type>("concurrent_hash_map", option);
+
+  metall::manager::remove(option.datastore_path.c_str());
+
+  return 0;
+}
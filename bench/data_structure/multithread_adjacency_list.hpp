@@ -19,6 +19,7 @@
 #include <boost/container/scoped_allocator.hpp>
 
 #include <metall_utility/hash.hpp>
+#include <metall_utility/open_mp.hpp>
 
 namespace data_structure {
 
@@ -97,6 +98,67 @@ class multithread_adjacency_list {
     return true;
   }
 
+  /// \brief Adds many key-value pairs at once without locks.
+  /// First, counting-sorts the inputs by bank into a buffer in DRAM.
+  /// Then, each thread takes whole banks, sorts each bank's pairs by key,
+  /// and appends the values of each key to its list with a single pre-sized insertion.
+  /// Must not be called concurrently with add().
+  /// \tparam key_value_list_type A random access container of key-value pairs.
+  /// \param input_lists Lists of key-value pairs, e.g., one per thread. They are read in parallel.
+  template <typename key_value_list_type>
+  void bulk_add(const std::vector<key_value_list_type> &input_lists) {
+    const std::size_t num_banks = m_bank_table.size();
+    const std::size_t num_lists = input_lists.size();
+
+    // -- Count the pairs of each (bank, list); the counters of a bank are contiguous -- //
+    std::vector<std::size_t> offsets(num_banks * num_lists + 1, 0);
+    OMP_DIRECTIVE(parallel for)
+    for (std::size_t l = 0; l < num_lists; ++l) {
+      for (const auto &kv : input_lists[l]) {
+        ++offsets[bank_index(kv.first) * num_lists + l + 1];
+      }
+    }
+    for (std::size_t i = 1; i < offsets.size(); ++i) offsets[i] += offsets[i - 1];
+
+    // -- Scatter the pairs so that the pairs of each bank are contiguous -- //
+    std::vector<std::pair<key_type, value_type>> buffer(offsets.back());
+    OMP_DIRECTIVE(parallel for)
+    for (std::size_t l = 0; l < num_lists; ++l) {
+      std::vector<std::size_t> cursor(num_banks);
+      for (std::size_t b = 0; b < num_banks; ++b) cursor[b] = offsets[b * num_lists + l];
+      for (const auto &kv : input_lists[l]) {
+        buffer[cursor[bank_index(kv.first)]++] = kv;
+      }
+    }
+
+    // -- Build each bank by a single thread -- //
+    OMP_DIRECTIVE(parallel for schedule(dynamic))
+    for (std::size_t b = 0; b < num_banks; ++b) {
+      const auto first = buffer.begin() + offsets[b * num_lists];
+      const auto last = buffer.begin() + offsets[(b + 1) * num_lists];
+      if (first == last) continue;
+      std::stable_sort(first, last, [](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+
+      auto &table = m_bank_table[b];
+      std::size_t num_new_keys = 0;
+      for (auto itr = first; itr != last; ++itr) {
+        num_new_keys += (itr == first || std::prev(itr)->first != itr->first) && !table.count(itr->first);
+      }
+      table.reserve(table.size() + num_new_keys);
+
+      for (auto run_first = first; run_first != last;) {
+        auto run_last = run_first;
+        while (run_last != last && run_last->first == run_first->first) ++run_last;
+        auto &list = table[run_first->first];
+        list.reserve(list.size() + std::distance(run_first, run_last));
+        for (auto itr = run_first; itr != run_last; ++itr) {
+          list.emplace_back(itr->second);
+        }
+        run_first = run_last;
+      }
+    }
+  }
+
   std::size_t num_keys() const {
     std::size_t count = 0;
     for (auto &table : m_bank_table) {
@@ -152,6 +214,27 @@ class multithread_adjacency_list {
     return m_bank_table.size();
   }
 
+  /// \brief Calls function(key, value) for all key-value pairs of a bank
+  template <typename function_type>
+  void for_each_in_bank(const std::size_t bank_index, const function_type &function) const {
+    assert(bank_index < num_banks());
+    for (const auto &key_and_list : m_bank_table[bank_index]) {
+      for (const auto &value : key_and_list.second) {
+        function(key_and_list.first, value);
+      }
+    }
+  }
+
+  /// \brief Calls function(key, value) for all key-value pairs using OpenMP threads.
+  /// Threads take banks dynamically. Must not be called concurrently with add().
+  template <typename function_type>
+  void for_each_parallel(const function_type &function) const {
+    OMP_DIRECTIVE(parallel for schedule(dynamic))
+    for (std::size_t b = 0; b < num_banks(); ++b) {
+      for_each_in_bank(b, function);
+    }
+  }
+
   /// \brief Call user defined sync function if it is given
   void sync() const {
     if (m_sync_function) {
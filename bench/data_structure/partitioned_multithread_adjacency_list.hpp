@@ -9,6 +9,9 @@
 #include <vector>
 #include <memory>
 #include <cstddef>
+#include <utility>
+
+#include <metall_utility/open_mp.hpp>
 
 namespace data_structure {
 
@@ -53,6 +56,22 @@ class partitioned_multithread_adjacency_list {
     return true;
   }
 
+  /// \brief Adds many key-value pairs at once.
+  /// Splits the inputs by partition and calls bulk_add() of each local adjacency list.
+  template <typename key_value_list_type>
+  void bulk_add(const std::vector<key_value_list_type> &input_lists) {
+    std::vector<std::vector<key_value_list_type>> partitioned_lists(num_partition(),
+                                                                    std::vector<key_value_list_type>(input_lists.size()));
+    for (std::size_t l = 0; l < input_lists.size(); ++l) {
+      for (const auto &kv : input_lists[l]) {
+        partitioned_lists[partition_index(kv.first)][l].push_back(kv);
+      }
+    }
+    for (std::size_t p = 0; p < num_partition(); ++p) {
+      m_global_adjacency_list[p]->bulk_add(partitioned_lists[p]);
+    }
+  }
+
   std::size_t num_keys() const {
     std::size_t count = 0;
     for (auto &local : m_global_adjacency_list) {
@@ -112,6 +131,25 @@ class partitioned_multithread_adjacency_list {
     return key % num_partition();
   }
 
+  /// \brief Calls function(key, value) for all key-value pairs using OpenMP threads.
+  /// Threads take the banks of all local adjacency lists dynamically,
+  /// i.e., the number of parallel tasks does not depend on the number of partitions.
+  /// Must not be called concurrently with add().
+  template <typename function_type>
+  void for_each_parallel(const function_type &function) const {
+    std::vector<std::pair<std::size_t, std::size_t>> tasks; // (partition, bank)
+    for (std::size_t p = 0; p < num_partition(); ++p) {
+      for (std::size_t b = 0; b < m_global_adjacency_list[p]->num_banks(); ++b) {
+        tasks.emplace_back(p, b);
+      }
+    }
+
+    OMP_DIRECTIVE(parallel for schedule(dynamic))
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+      m_global_adjacency_list[tasks[i].first]->for_each_in_bank(tasks[i].second, function);
+    }
+  }
+
   void sync() const {
     for (auto adj_list : m_global_adjacency_list) {
       adj_list->sync();
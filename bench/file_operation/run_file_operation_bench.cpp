@@ -0,0 +1,189 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+// Compares copy() and remove() of a data store with 'cp -r' and 'rm -rf'.
+// Usage:
+// ./run_file_operation_bench -d /path/to/dir -n 1024 -s 8388608 -t 16 -r 2
+// -d: directory to create data stores in
+// -n: the number of block files
+// -s: the size of each block file in bytes
+// -t: the number of threads for copy() and remove() (0 uses the number of hardware threads)
+// -r: the number of repetitions; the order of 'cp -r' and copy() alternates between them
+// The source files are evicted from the page cache before each copy.
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include <metall/metall.hpp>
+#include <metall/detail/utility/file.hpp>
+#include <metall/detail/utility/time.hpp>
+
+namespace util = metall::detail::utility;
+
+struct option_type {
+  std::string dir_path{"/tmp"};
+  std::size_t num_files{256};
+  std::size_t file_size{1ULL << 22ULL};
+  std::size_t num_threads{0};
+  std::size_t num_repeats{2};
+};
+
+bool parse_option(int argc, char *argv[], option_type *option) {
+  int p;
+  while ((p = ::getopt(argc, argv, "d:n:s:t:r:")) != -1) {
+    switch (p) {
+      case 'd':option->dir_path = optarg;
+        break;
+
+      case 'n':option->num_files = std::stoull(optarg);
+        break;
+
+      case 's':option->file_size = std::stoull(optarg);
+        break;
+
+      case 't':option->num_threads = std::stoull(optarg);
+        break;
+
+      case 'r':option->num_repeats = std::stoull(optarg);
+        break;
+
+      default:std::cerr << "Invalid option" << std::endl;
+        return false;
+    }
+  }
+  return true;
+}
+
+std::string block_file_path(const std::string &base_dir_path, const std::size_t n) {
+  return base_dir_path + "/metall_datastore/segment_block-" + std::to_string(n);
+}
+
+// Makes a directory that has the same layout as a data store
+bool create_source(const std::string &base_dir_path, const option_type &option) {
+  const std::string datastore_dir_path = base_dir_path + "/metall_datastore";
+  if (!util::create_directory(datastore_dir_path)) {
+    std::cerr << "Failed to create directory: " << datastore_dir_path << std::endl;
+    return false;
+  }
+  std::vector<char> buf(option.file_size);
+  for (std::size_t i = 0; i < buf.size(); ++i) buf[i] = static_cast<char>(i);
+  for (std::size_t n = 0; n < option.num_files; ++n) {
+    std::ofstream ofs(block_file_path(base_dir_path, n), std::ios::binary);
+    ofs.write(buf.data(), buf.size());
+    if (!ofs) {
+      std::cerr << "Failed to write a file" << std::endl;
+      return false;
+    }
+  }
+  return util::fsync_recursive(datastore_dir_path);
+}
+
+// Evicts the (clean) pages of the source files from the page cache
+// so that each copy reads them from the device
+bool drop_page_cache(const std::string &base_dir_path, const option_type &option) {
+  for (std::size_t n = 0; n < option.num_files; ++n) {
+    const int fd = ::open(block_file_path(base_dir_path, n).c_str(), O_RDONLY);
+    if (fd == -1) {
+      std::cerr << "Failed to open a file" << std::endl;
+      return false;
+    }
+    const int ret = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+    if (ret != 0) {
+      std::cerr << "Failed to evict a file from the page cache" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename function_type>
+double measure(function_type &&function) {
+  const auto start = util::elapsed_time_sec();
+  if (!function()) {
+    std::cerr << "Failed" << std::endl;
+    std::abort();
+  }
+  return util::elapsed_time_sec(start);
+}
+
+int main(int argc, char *argv[]) {
+  option_type option;
+  if (!parse_option(argc, argv, &option)) {
+    std::abort();
+  }
+  const std::string source_path = option.dir_path + "/file_operation_bench_source";
+  const std::string destination_path = option.dir_path + "/file_operation_bench_destination";
+  metall::manager::remove(source_path.c_str());
+  metall::manager::remove(destination_path.c_str());
+
+  std::cout << "Create " << option.num_files << " files of " << option.file_size << " bytes" << std::endl;
+  if (!create_source(source_path, option)) {
+    std::abort();
+  }
+
+  std::size_t last_percent = 0;
+  const auto progress = [&last_percent](const std::size_t done, const std::size_t total) {
+    const std::size_t percent = done * 100 / total;
+    if (percent >= last_percent + 25) {
+      std::cout << "  " << percent << "%" << std::endl;
+      last_percent = percent;
+    }
+  };
+
+  const auto run_commands = [&]() {
+    if (!drop_page_cache(source_path, option)) {
+      std::abort();
+    }
+    const auto cp_time = measure([&]() {
+      const std::string command("cp -r " + source_path + " " + destination_path + " && sync");
+      return std::system(command.c_str()) == 0;
+    });
+    std::cout << "cp -r\t" << cp_time << std::endl;
+
+    const auto rm_time = measure([&]() {
+      const std::string command("rm -rf " + destination_path);
+      return std::system(command.c_str()) == 0;
+    });
+    std::cout << "rm -rf\t" << rm_time << std::endl;
+  };
+
+  const auto run_metall = [&]() {
+    if (!drop_page_cache(source_path, option)) {
+      std::abort();
+    }
+    last_percent = 0;
+    const auto copy_time = measure([&]() {
+      return metall::manager::copy(source_path.c_str(), destination_path.c_str(), option.num_threads, progress);
+    });
+    std::cout << "copy()\t" << copy_time << std::endl;
+
+    last_percent = 0;
+    const auto remove_time = measure([&]() {
+      return metall::manager::remove(destination_path.c_str(), option.num_threads, progress);
+    });
+    std::cout << "remove()\t" << remove_time << std::endl;
+  };
+
+  for (std::size_t r = 0; r < option.num_repeats; ++r) {
+    std::cout << "Repetition " << r << std::endl;
+    if (r % 2 == 0) {
+      run_commands();
+      run_metall();
+    } else {
+      run_metall();
+      run_commands();
+    }
+  }
+
+  metall::manager::remove(source_path.c_str());
+
+  return 0;
+}
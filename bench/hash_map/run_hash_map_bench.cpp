@@ -0,0 +1,153 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+// Compares the insert and find performance of metall::container::concurrent_hash_map
+// with metall::container::concurrent_map and boost::unordered_map, all allocated in Metall.
+// boost::unordered_map is not thread-safe, so it is always run with a single thread.
+// Usage:
+// ./run_hash_map_bench -d /path/to/datastore -n 4194304 -t 4
+// -d: path to a data store
+// -n: the number of keys
+// -t: the number of threads (the default is the number of hardware threads)
+
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <functional>
+
+#include <boost/unordered_map.hpp>
+
+#include <metall/metall.hpp>
+#include <metall/detail/utility/time.hpp>
+#include <metall/detail/utility/common.hpp>
+#include <metall_container/concurrent_map.hpp>
+#include <metall_container/concurrent_hash_map.hpp>
+
+namespace util = metall::detail::utility;
+
+struct option_type {
+  std::string datastore_path{"/tmp/hash_map_bench"};
+  std::size_t num_keys{1ULL << 22ULL};
+  std::size_t num_threads{std::max(std::thread::hardware_concurrency(), 1U)};
+};
+
+bool parse_option(int argc, char *argv[], option_type *option) {
+  int p;
+  while ((p = ::getopt(argc, argv, "d:n:t:")) != -1) {
+    switch (p) {
+      case 'd':option->datastore_path = optarg;
+        break;
+
+      case 'n':option->num_keys = std::stoull(optarg);
+        break;
+
+      case 't':option->num_threads = std::stoull(optarg);
+        break;
+
+      default:std::cerr << "Invalid option" << std::endl;
+        return false;
+    }
+  }
+  return true;
+}
+
+using key_type = uint64_t;
+using mapped_type = uint64_t;
+using value_type = std::pair<const key_type, mapped_type>;
+using allocator_type = metall::manager::allocator_type<value_type>;
+
+using concurrent_hash_map_type = metall::container::concurrent_hash_map<key_type, mapped_type,
+                                                                        metall::utility::hash<key_type>,
+                                                                        std::equal_to<key_type>,
+                                                                        allocator_type>;
+using concurrent_map_type = metall::container::concurrent_map<key_type, mapped_type,
+                                                              std::less<key_type>,
+                                                              metall::utility::hash<key_type>,
+                                                              allocator_type>;
+using unordered_map_type = boost::unordered_map<key_type, mapped_type,
+                                                metall::utility::hash<key_type>,
+                                                std::equal_to<key_type>,
+                                                allocator_type>;
+
+/// \brief Calls kernel(key) for every key using num_threads threads and returns the elapsed time
+double run_in_parallel(const std::vector<key_type> &keys, const std::size_t num_threads,
+                       const std::function<void(key_type)> &kernel) {
+  const auto start = util::elapsed_time_sec();
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < num_threads; ++t) {
+    const auto range = util::partial_range(keys.size(), t, num_threads);
+    threads.emplace_back([&keys, &kernel, range]() {
+      for (std::size_t i = range.first; i < range.second; ++i) {
+        kernel(keys[i]);
+      }
+    });
+  }
+  for (auto &th : threads) {
+    th.join();
+  }
+  return util::elapsed_time_sec(start);
+}
+
+template <typename map_type>
+void run(const std::string &name, const std::vector<key_type> &keys, const std::size_t num_threads,
+         const option_type &option,
+         const std::function<void(map_type &, key_type)> &insert) {
+  metall::manager::remove(option.datastore_path.c_str());
+  metall::manager manager(metall::create_only, option.datastore_path.c_str());
+  auto *const map = manager.construct<map_type>("map")(manager.get_allocator());
+
+  const auto insert_time = run_in_parallel(keys, num_threads, [map, &insert](const key_type key) {
+    insert(*map, key);
+  });
+
+  std::size_t num_found = 0;
+  const auto find_time = run_in_parallel(keys, 1, [map, &num_found](const key_type key) {
+    num_found += map->count(key);
+  });
+  if (num_found != keys.size()) {
+    std::cerr << name << ": some keys were not found" << std::endl;
+    std::abort();
+  }
+
+  std::cout << name << "\t#threads\t" << num_threads
+            << "\tinsert (s)\t" << insert_time << "\tfind (s)\t" << find_time << std::endl;
+
+  manager.destroy<map_type>("map");
+}
+
+int main(int argc, char *argv[]) {
+  option_type option;
+  if (!parse_option(argc, argv, &option)) {
+    std::abort();
+  }
+
+  std::vector<key_type> keys(option.num_keys);
+  std::mt19937_64 rand_engine(123);
+  for (auto &key : keys) key = rand_engine();
+
+  std::cout << "#keys\t" << option.num_keys << std::endl;
+
+  run<concurrent_hash_map_type>("concurrent_hash_map", keys, option.num_threads, option,
+                                [](concurrent_hash_map_type &map, const key_type key) {
+                                  map.insert(std::make_pair(key, key));
+                                });
+
+  run<concurrent_map_type>("concurrent_map", keys, option.num_threads, option,
+                           [](concurrent_map_type &map, const key_type key) {
+                             map.insert(std::make_pair(key, key));
+                           });
+
+  run<unordered_map_type>("boost::unordered_map", keys, 1, option,
+                          [](unordered_map_type &map, const key_type key) {
+                            map.emplace(key, key);
+                          });
+
+  metall::manager::remove(option.datastore_path.c_str());
+
+  return 0;
+}
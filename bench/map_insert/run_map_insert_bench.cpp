@@ -0,0 +1,171 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+// Compares boost::container::map inserts and erases with Metall's STL allocator,
+// which resolves the size class of a node at compile time (allocate<N>()),
+// and with a copy of it that resolves the size class at runtime (allocate(nbytes)).
+// Both allocators go through the same kernel indirection and the same (sized) deallocation.
+// Usage:
+// ./run_map_insert_bench -d /path/to/datastore -n 4194304 -r 3
+// -d: path to a data store
+// -n: the number of inserts
+// -r: the number of repeats
+
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <functional>
+
+#include <boost/container/map.hpp>
+
+#include <metall/metall.hpp>
+#include <metall/detail/utility/time.hpp>
+
+namespace util = metall::detail::utility;
+
+struct option_type {
+  std::string datastore_path{"/tmp/map_insert_bench"};
+  std::size_t num_inserts{1ULL << 22ULL};
+  std::size_t num_repeats{3};
+};
+
+bool parse_option(int argc, char *argv[], option_type *option) {
+  int p;
+  while ((p = ::getopt(argc, argv, "d:n:r:")) != -1) {
+    switch (p) {
+      case 'd':option->datastore_path = optarg;
+        break;
+
+      case 'n':option->num_inserts = std::stoull(optarg);
+        break;
+
+      case 'r':option->num_repeats = std::stoull(optarg);
+        break;
+
+      default:std::cerr << "Invalid option" << std::endl;
+        return false;
+    }
+  }
+  return true;
+}
+
+using kernel_type = metall::manager::manager_kernel_type;
+
+/// \brief Same as Metall's STL allocator, i.e., it holds an offset pointer to the kernel address slot
+/// and allocates and deallocates through the per-thread allocation path of the kernel,
+/// except that the size class is resolved at runtime (allocate(nbytes)) instead of at compile time
+template <typename T>
+class runtime_size_allocator {
+ public:
+  using value_type = T;
+  using pointer = metall::offset_ptr<T>;
+  using const_pointer = metall::offset_ptr<const T>;
+  using void_pointer = metall::offset_ptr<void>;
+  using const_void_pointer = metall::offset_ptr<const void>;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+
+  template <typename T2>
+  struct rebind {
+    using other = runtime_size_allocator<T2>;
+  };
+
+  explicit runtime_size_allocator(kernel_type **const kernel_slot)
+      : m_kernel_slot(kernel_slot) {}
+
+  template <typename T2>
+  runtime_size_allocator(const runtime_size_allocator<T2> &other)
+      : m_kernel_slot(other.kernel_slot()) {}
+
+  pointer allocate(const size_type n) const {
+    const auto &path = kernel_type::fast_allocation_path(kernel_slot());
+    return pointer(reinterpret_cast<T *>(path.segment + path.allocator->allocate(n * sizeof(T))));
+  }
+
+  void deallocate(const pointer ptr, const size_type n) const noexcept {
+    const auto &path = kernel_type::fast_allocation_path(kernel_slot());
+    if (!ptr) return;
+    path.allocator->deallocate(reinterpret_cast<char *>(metall::to_raw_pointer(ptr)) - path.segment, n * sizeof(T));
+  }
+
+  kernel_type **kernel_slot() const {
+    return metall::to_raw_pointer(m_kernel_slot);
+  }
+
+ private:
+  metall::offset_ptr<kernel_type *> m_kernel_slot;
+};
+
+template <typename T1, typename T2>
+bool operator==(const runtime_size_allocator<T1> &lhs, const runtime_size_allocator<T2> &rhs) {
+  return *lhs.kernel_slot() == *rhs.kernel_slot();
+}
+
+template <typename T1, typename T2>
+bool operator!=(const runtime_size_allocator<T1> &lhs, const runtime_size_allocator<T2> &rhs) {
+  return !(lhs == rhs);
+}
+
+using key_type = uint64_t;
+using mapped_type = uint64_t;
+using value_type = std::pair<const key_type, mapped_type>;
+
+template <typename allocator_type>
+using map_type = boost::container::map<key_type, mapped_type, std::less<key_type>, allocator_type>;
+
+template <typename allocator_type>
+void run(const std::string &name, const std::vector<key_type> &keys, const option_type &option,
+         const std::function<allocator_type(metall::manager &)> &make_allocator) {
+  metall::manager::remove(option.datastore_path.c_str());
+  metall::manager manager(metall::create_only, option.datastore_path.c_str());
+  map_type<allocator_type> map(make_allocator(manager));
+
+  double insert_time = 0;
+  double erase_time = 0;
+  for (std::size_t r = 0; r < option.num_repeats; ++r) {
+    const auto insert_start = util::elapsed_time_sec();
+    for (const auto key : keys) {
+      map.emplace(key, key);
+    }
+    insert_time += util::elapsed_time_sec(insert_start);
+
+    const auto erase_start = util::elapsed_time_sec();
+    for (const auto key : keys) {
+      map.erase(key);
+    }
+    erase_time += util::elapsed_time_sec(erase_start);
+  }
+  std::cout << name << "\tinsert (s)\t" << insert_time / option.num_repeats
+            << "\terase (s)\t" << erase_time / option.num_repeats << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  option_type option;
+  if (!parse_option(argc, argv, &option)) {
+    std::abort();
+  }
+
+  std::vector<key_type> keys(option.num_inserts);
+  std::mt19937_64 rand_engine(123);
+  for (auto &key : keys) key = rand_engine();
+
+  std::cout << "#inserts\t" << option.num_inserts << "\t#repeats\t" << option.num_repeats << std::endl;
+
+  using runtime_allocator_type = runtime_size_allocator<value_type>;
+  run<runtime_allocator_type>("allocate(nbytes)", keys, option, [](metall::manager &manager) {
+    return runtime_allocator_type(manager.get_allocator<value_type>().get_pointer_to_manager_kernel());
+  });
+
+  using fixed_allocator_type = metall::manager::allocator_type<value_type>;
+  run<fixed_allocator_type>("allocate<N>()", keys, option, [](metall::manager &manager) {
+    return manager.get_allocator<value_type>();
+  });
+
+  metall::manager::remove(option.datastore_path.c_str());
+
+  return 0;
+}
@@ -0,0 +1,43 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#include <iostream>
+#include <boost/container/map.hpp>
+#include <metall/metall.hpp>
+#include <metall_container/string_pool.hpp>
+
+// Each distinct string is stored once in the pool; the map uses 32-bit handles as its keys instead of strings
+using string_pool_type = metall::container::string_pool<uint32_t, metall::manager::allocator_type<char>>;
+using handle_type = string_pool_type::handle_type;
+using value_type = std::pair<const handle_type, int>;
+using handle_int_map = boost::container::map<handle_type,
+                                             int,
+                                             std::less<handle_type>,
+                                             metall::manager::allocator_type<value_type>>;
+
+int main() {
+  {
+    metall::manager manager(metall::create_only, "/tmp/datastore");
+    auto pool = manager.construct<string_pool_type>("string-pool")(manager.get_allocator<>());
+    auto pmap = manager.construct<handle_int_map>("handle-int-map")(manager.get_allocator<>());
+
+    for (const char *label : {"red", "green", "red", "blue", "red"}) {
+      ++(*pmap)[pool->intern(label)]; // The same string always gets the same handle
+    }
+  }
+
+  {
+    metall::manager manager(metall::open_read_only, "/tmp/datastore");
+    const auto pool = manager.find<string_pool_type>("string-pool").first;
+    const auto pmap = manager.find<handle_int_map>("handle-int-map").first;
+
+    std::cout << pmap->at(pool->find("red")) << std::endl; // Will print "3"
+    for (const auto &elem : *pmap) {
+      std::cout << pool->view(elem.first) << " " << elem.second << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,42 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#include <iostream>
+
+#include <metall/metall.hpp>
+
+int main() {
+  const char *const manager_path = "/tmp/dir_path";
+
+  {
+    metall::manager manager(metall::create_only, manager_path);
+    int *a = manager.construct<int>(metall::unique_instance)(-1);
+
+    for (int i = 0; i < 10; ++i) {
+      *a = i;
+
+      // Only the chunks modified since the previous version are stored
+      // in the data store directory (dir_path/metall_versions/)
+      metall::manager::version_type version;
+      manager.snapshot_version(&version);
+    }
+  }
+
+  for (const auto &info : metall::manager::versions(manager_path)) {
+    std::cout << "Version " << info.version << std::endl;
+  }
+
+  // Remove a version, if needed
+  metall::manager::remove_version(manager_path, 0);
+
+  // Open a version as read only
+  {
+    metall::manager manager(metall::open_read_only, manager_path, 8);
+    const int *a = manager.find<int>(metall::unique_instance).first;
+    std::cout << *a << std::endl; // Print 8
+  }
+
+  return 0;
+}
@@ -8,6 +8,8 @@
 
 #include <cstddef>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <metall/tags.hpp>
 #include <metall/detail/utility/in_place_interface.hpp>
@@ -52,6 +54,11 @@ class basic_manager {
   using construct_iter_proxy = util::named_proxy<manager_kernel_type, T, true>;
 
   using chunk_number_type = chunk_no_type;
+  using reachability_marker_type = typename manager_kernel_type::reachability_marker_type;
+  using version_type = typename manager_kernel_type::version_type;
+  using version_info_type = typename manager_kernel_type::version_info_type;
+  using progress_handler_type = typename manager_kernel_type::progress_handler_type;
+  using stripe_placement = typename manager_kernel_type::stripe_placement;
 
  private:
   // -------------------------------------------------------------------------------- //
@@ -84,6 +91,36 @@ class basic_manager {
     }
   }
 
+  /// \brief Opens a version made by snapshot_version() as read only.
+  /// The chunks of the version and its ancestors are mapped directly; no data is copied.
+  /// \param base_path Path to the data store
+  /// \param version The version number
+  basic_manager(open_read_only_t, const char *base_path, const version_type version,
+                const kernel_allocator_type &allocator = kernel_allocator_type())
+      : m_kernel(allocator) {
+    if (!m_kernel.open_version(base_path, version)) {
+      std::cerr << "Cannot open version " << version << " of " << base_path << std::endl;
+      std::abort();
+    }
+  }
+
+  /// \brief Opens an already created segment as read only at a fixed address.
+  /// The block files are mapped with MAP_SHARED at vm_region_address;
+  /// processes that use the same address share the page cache and see objects at the same addresses.
+  /// The allocator state is not loaded as read-only users never use it.
+  /// \param base_path Path to the data store
+  /// \param vm_region_address The address to map the data store. Must be page aligned
+  /// \param populate If true, prefaults the whole segment (MAP_POPULATE)
+  basic_manager(open_read_only_shared_t, const char *base_path, void *const vm_region_address,
+                const bool populate = false,
+                const kernel_allocator_type &allocator = kernel_allocator_type())
+      : m_kernel(allocator) {
+    if (!m_kernel.open_read_only_shared(base_path, vm_region_address, populate)) {
+      std::cerr << "Cannot open " << base_path << " at " << vm_region_address << std::endl;
+      std::abort();
+    }
+  }
+
   basic_manager(create_only_t, const char *base_path,
                 const kernel_allocator_type &allocator = kernel_allocator_type())
       : m_kernel(allocator) {
@@ -96,6 +133,19 @@ class basic_manager {
     m_kernel.create(base_path, capacity);
   }
 
+  /// \brief Creates a new data store whose application data is striped over multiple directories,
+  /// e.g., one per device. The data store is opened as usual with base_path.
+  /// \param base_path Path to the data store; the management data is stored in it
+  /// \param stripe_dir_paths Directories to place the block files of the application data;
+  /// the files are stored in a new subdirectory unique to the data store, so data stores can share the directories
+  /// \param placement How consecutive block files are placed in the directories
+  basic_manager(create_only_t, const char *base_path, const std::vector<std::string> &stripe_dir_paths,
+                const stripe_placement placement = stripe_placement::round_robin,
+                const kernel_allocator_type &allocator = kernel_allocator_type())
+      : m_kernel(allocator) {
+    m_kernel.create(base_path, stripe_dir_paths, placement);
+  }
+
   basic_manager(open_or_create_t, const char *base_path, const size_type capacity,
                 const kernel_allocator_type &allocator = kernel_allocator_type())
       : m_kernel(allocator) {
@@ -209,6 +259,16 @@ class basic_manager {
     return m_kernel.allocate(nbytes);
   }
 
+  /// \brief Allocates nbytes bytes, where nbytes is known at compile time.
+  /// Faster than allocate(nbytes) as the size class is resolved at compile time.
+  /// The allocated memory can be deallocated by deallocate().
+  /// \tparam nbytes Number of bytes to allocate
+  /// \return Returns a pointer to the allocated memory
+  template <size_type nbytes>
+  void *allocate_fixed() {
+    return m_kernel.template allocate_fixed<nbytes>();
+  }
+
   /// \brief Allocates nbytes bytes. The address of the allocated memory will be a multiple of alignment.
   /// \param nbytes Number of bytes to allocate
   /// \param alignment Alignment size
@@ -236,6 +296,15 @@ class basic_manager {
     m_kernel.flush(synchronous);
   }
 
+  /// \brief Flush data to persistent memory asynchronously.
+  /// Dirty pages are written back using io_uring if it is available.
+  /// The manager must not be closed until the returned future is ready.
+  /// \return Returns an object of std::future
+  /// If succeeded, its get() returns True; other false
+  std::future<bool> flush_async() {
+    return m_kernel.flush_async();
+  }
+
   // -------------------- Utility Methods -------------------- //
   /// \brief Returns a pointer to an object of impl_type class
   /// \return Returns a pointer to an object of impl_type class
@@ -258,36 +327,142 @@ class basic_manager {
     return m_kernel.snapshot(destination_dir_path);
   }
 
-  /// \brief Copies backing files synchronously
+  /// \brief Snapshot the entire data asynchronously.
+  /// Allocations by other threads are blocked and writes to the application data sleep in the SIGSEGV handler
+  /// only while this function flushes the data; the rest of the copy is done in the background using copy-on-write,
+  /// and flush() does not wait for it.
+  /// The application data is write-protected until each part is copied:
+  /// system calls that write into it (e.g., read(2), recv(2), or pread(2) into an object) fail with EFAULT instead
+  /// of raising the fault, and the first write to each part waits for its copy.
+  /// Closing this manager waits for the completion.
+  /// \param destination_dir_path The prefix of the snapshot files
+  /// \return Returns an object of std::future
+  /// If succeeded, its get() returns True; other false
+  std::future<bool> snapshot_async(const char *destination_dir_path) {
+    return m_kernel.snapshot_async(destination_dir_path);
+  }
+
+  /// \brief Makes a version of the current data in the data store.
+  /// All chunks are stored unless Metall is built with METALL_ENABLE_VERSION_TRACKING.
+  /// With it, only the chunks modified since the previous version are stored
+  /// (if it is unknown which chunks were modified, e.g., after a crash, all chunks are stored).
+  /// To know the modified chunks, once a data store has a version, Metall write-protects the application data
+  /// and tracks the first write to each chunk with the SIGSEGV handler while the data store is open:
+  /// system calls that write into the application data (e.g., read(2), recv(2), or pread(2) into an object)
+  /// fail with EFAULT instead of raising the fault, and the first write to each chunk takes a page fault.
+  /// Allocations and writes to the application data must be stopped while this function is called.
+  /// Versions are not included in copies or snapshots of the data store.
+  /// \param version A pointer to store the new version number; can be nullptr
+  /// \return Returns true on success; otherwise, false
+  bool snapshot_version(version_type *const version = nullptr) {
+    return m_kernel.snapshot_version(version);
+  }
+
+  /// \brief Starts caching frequently accessed parts of the application data in another directory,
+  /// e.g., on tmpfs or a faster device.
+  /// A background thread samples accesses and moves hot parts into the directory, remapping them at the same
+  /// addresses; applications keep using the same pointers.
+  /// The data store stays the persistent copy: flush() and close() write the hot parts back to it.
+  /// Tiering stops when this manager is closed.
+  /// \param hot_dir_path Path to the directory to store hot parts in; created if it does not exist
+  /// \param hot_capacity The maximum size of the data stored in the directory
+  /// \return Returns true on success; otherwise, false
+  bool start_tiering(const char *hot_dir_path, const size_type hot_capacity) {
+    return m_kernel.start_tiering(hot_dir_path, hot_capacity);
+  }
+
+  /// \brief Stops caching; the hot parts are moved back to the data store and the hot directory is cleaned up.
+  /// \return Returns true on success; otherwise, false
+  bool stop_tiering() {
+    return m_kernel.stop_tiering();
+  }
+
+  /// \brief Returns the size of the application data cached in the hot directory
+  size_type hot_tier_size() const {
+    return m_kernel.hot_tier_size();
+  }
+
+  /// \brief Returns the versions of a data store
+  /// \param dir_path Path to a data store
+  /// \return Returns the versions in the order they were made
+  static std::vector<version_info_type> versions(const char *dir_path) {
+    return manager_kernel_type::versions(dir_path);
+  }
+
+  /// \brief Removes a version of a data store.
+  /// The chunks of the version that are needed by its descendant versions are moved to them.
+  /// The data store must not be open.
+  /// \param dir_path Path to a data store
+  /// \param version The version number
+  /// \return Returns true on success; otherwise, false
+  static bool remove_version(const char *dir_path, const version_type version) {
+    return manager_kernel_type::remove_version(dir_path, version);
+  }
+
+  /// \brief Copies backing files synchronously.
+  /// The files are copied by multiple threads, cloning them if the file system supports it.
   /// \param source_dir_path
   /// \param destination_dir_path
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \param progress If not empty, called with the number of copied files and the total number of files
   /// \return If succeeded, returns True; other false
-  static bool copy(const char *source_dir_path, const char *destination_dir_path) {
-    return manager_kernel_type::copy(source_dir_path, destination_dir_path);
+  static bool copy(const char *source_dir_path, const char *destination_dir_path, const size_type num_threads = 0,
+                   const progress_handler_type &progress = progress_handler_type()) {
+    return manager_kernel_type::copy(source_dir_path, destination_dir_path, num_threads, progress);
   }
 
   /// \brief Copies backing files asynchronously
   /// \param source_dir_path
   /// \param destination_dir_path
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \param progress If not empty, called with the number of copied files and the total number of files
   /// \return Returns an object of std::future
   /// If succeeded, its get() returns True; other false
-  static auto copy_async(const char *source_dir_path, const char *destination_dir_path) {
-    return manager_kernel_type::copy_async(source_dir_path, destination_dir_path);
+  static auto copy_async(const char *source_dir_path, const char *destination_dir_path,
+                         const size_type num_threads = 0,
+                         const progress_handler_type &progress = progress_handler_type()) {
+    return manager_kernel_type::copy_async(source_dir_path, destination_dir_path, num_threads, progress);
   }
 
-  /// \brief Remove backing files synchronously
+  /// \brief Remove backing files synchronously.
+  /// The files are removed by multiple threads.
   /// \param dir_path
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \param progress If not empty, called with the number of removed files and the total number of files
   /// \return If succeeded, returns True; other false
-  static bool remove(const char *dir_path) {
-    return manager_kernel_type::remove(dir_path);
+  static bool remove(const char *dir_path, const size_type num_threads = 0,
+                     const progress_handler_type &progress = progress_handler_type()) {
+    return manager_kernel_type::remove(dir_path, num_threads, progress);
   }
 
   /// \brief Remove backing files asynchronously
   /// \param dir_path
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \param progress If not empty, called with the number of removed files and the total number of files
   /// \return Returns an object of std::future
   /// If succeeded, its get() returns True; other false
-  static std::future<bool> remove_async(const char *dir_path) {
-    return std::async(std::launch::async, remove, dir_path);
+  static std::future<bool> remove_async(const char *dir_path, const size_type num_threads = 0,
+                                        const progress_handler_type &progress = progress_handler_type()) {
+    return manager_kernel_type::remove_async(dir_path, num_threads, progress);
+  }
+
+  /// \brief Rebuilds the allocator state of a data store that was not closed properly, e.g., due to a crash.
+  /// The named objects and the allocator state stored at the last close (or flush with the operation log) are loaded;
+  /// then, the visitor marks every allocation reachable from the named objects.
+  /// Allocations that are not marked are reclaimed.
+  /// The named objects themselves are marked automatically.
+  /// \tparam visitor_type A function type that takes a reference of reachability_marker_type
+  /// \param base_path Path to the data store
+  /// \param visitor Walks the object graphs, e.g., by following offset_ptr, and calls mark(addr, nbytes)
+  /// for each allocation; nbytes can be omitted for allocations made before the last close.
+  /// mark() returns false if the allocation was already marked, which can be used to stop walking cycles.
+  /// \param num_threads The number of threads used to rebuild the allocator state (0 uses all cores)
+  /// \return Returns true on success; otherwise, false, and the data store is left as it is
+  template <typename visitor_type>
+  static bool recover(const char *base_path, visitor_type &&visitor, const size_type num_threads = 0,
+                      const kernel_allocator_type &allocator = kernel_allocator_type()) {
+    manager_kernel_type kernel(allocator);
+    return kernel.recover(base_path, std::forward<visitor_type>(visitor), num_threads);
   }
 
   /// \brief Check if the backing data store is consistent,
@@ -298,6 +473,30 @@ class basic_manager {
     return manager_kernel_type::consistent(dir_path);
   }
 
+  /// \brief Verifies the checksums of a data store recorded when it was closed, flushed, or snapshotted.
+  /// Checksums are recorded only if Metall is built with METALL_ENABLE_CHECKSUM.
+  /// \param dir_path Path to a data store
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \return Returns true if the data store has checksums and all of them match; otherwise, false.
+  static bool verify(const char *dir_path, const size_type num_threads = 0) {
+    return manager_kernel_type::verify(dir_path, num_threads);
+  }
+
+  /// \brief Compresses the application data of a data store to save storage space.
+  /// The data store must not be open. A compressed data store is opened as usual;
+  /// each part of it is decompressed at its first access, into memory in the read-only mode
+  /// and into the backing files in the read-write mode. Parts that have not been accessed yet are access-protected,
+  /// so system calls that read from or write into them (e.g., write(2) from an object) fail with EFAULT.
+  /// The read-write mode keeps the compressed files until all parts have been decompressed;
+  /// compressing such a data store again merges the modified parts.
+  /// Requires METALL_USE_COMPRESSION.
+  /// \param dir_path Path to a data store
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \return Returns true on success; otherwise, false.
+  static bool compress(const char *dir_path, const size_type num_threads = 0) {
+    return manager_kernel_type::compress(dir_path, num_threads);
+  }
+
   /// \brief Returns the chunk size
   /// \return
   static constexpr size_type chunk_size() {
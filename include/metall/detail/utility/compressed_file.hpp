@@ -0,0 +1,451 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_COMPRESSED_FILE_HPP
+#define METALL_DETAIL_UTILITY_COMPRESSED_FILE_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include <metall/detail/utility/file.hpp>
+#include <metall/detail/utility/parallel_for.hpp>
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+/// \brief Functions to store a file as a sequence of compressed frames.
+/// Frames are compressed independently so that they are compressed and decompressed in parallel.
+/// Frames that contain only zeros are not stored, i.e., holes are kept.
+/// File layout: header | offsets of the frames (num_frames + 1) | compressed frames
+namespace compressed_file {
+
+namespace detail {
+constexpr char k_magic[8] = {'M', 'E', 'T', 'A', 'L', 'L', 'Z', '1'};
+
+struct header {
+  char magic[8];
+  uint64_t file_size; // The size of the original file
+  uint64_t frame_size;
+  uint64_t num_frames;
+};
+
+inline bool pread_all(const int fd, void *const buf, const std::size_t size, const off_t offset) {
+  std::size_t done = 0;
+  while (done < size) {
+    const auto ret = ::pread(fd, static_cast<char *>(buf) + done, size - done, offset + done);
+    if (ret <= 0) {
+      if (ret == -1 && errno == EINTR) continue;
+      return false;
+    }
+    done += ret;
+  }
+  return true;
+}
+
+inline bool pwrite_all(const int fd, const void *const buf, const std::size_t size, const off_t offset) {
+  std::size_t done = 0;
+  while (done < size) {
+    const auto ret = ::pwrite(fd, static_cast<const char *>(buf) + done, size - done, offset + done);
+    if (ret <= 0) {
+      if (ret == -1 && errno == EINTR) continue;
+      return false;
+    }
+    done += ret;
+  }
+  return true;
+}
+
+inline bool all_zero(const char *const data, const std::size_t size) {
+  std::size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    if (word) return false;
+  }
+  for (; i < size; ++i) {
+    if (data[i]) return false;
+  }
+  return true;
+}
+
+inline bool read_index(const int fd, header *const hdr, std::vector<uint64_t> *const offsets) {
+  if (!pread_all(fd, hdr, sizeof(header), 0) || std::memcmp(hdr->magic, k_magic, sizeof(k_magic)) != 0) {
+    return false;
+  }
+  offsets->resize(hdr->num_frames + 1);
+  return pread_all(fd, offsets->data(), offsets->size() * sizeof(uint64_t), sizeof(header));
+}
+
+/// \brief Returns true if [begin, end) of a file is not a hole.
+/// Returns true if the file system does not report holes.
+inline bool has_data(const int fd, const off_t begin, const off_t end) {
+#ifdef SEEK_DATA
+  const off_t data = ::lseek(fd, begin, SEEK_DATA);
+  if (data == -1) return errno != ENXIO;
+  return data < end;
+#else
+  return true;
+#endif
+}
+} // namespace detail
+
+/// \brief Reads the frames of a compressed file one by one, e.g., on demand.
+/// read_frame() does not allocate from the heap so that it can be called in signal handlers.
+class frame_reader {
+ public:
+  frame_reader() = default;
+
+  ~frame_reader() {
+    close();
+  }
+
+  frame_reader(const frame_reader &) = delete;
+  frame_reader &operator=(const frame_reader &) = delete;
+
+  /// \brief Opens a compressed file and loads its frame index
+  /// \return Returns true on success; otherwise, false.
+  bool open(const std::string &path) {
+    close();
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd == -1) {
+      ::perror("open");
+      std::cerr << "Failed to open: " << path << std::endl;
+      return false;
+    }
+    if (!detail::read_index(m_fd, &m_header, &m_offsets)) {
+      std::cerr << "Invalid compressed file: " << path << std::endl;
+      close();
+      return false;
+    }
+    std::size_t max_compressed_size = 0;
+    for (std::size_t i = 0; i < m_header.num_frames; ++i) {
+      max_compressed_size = std::max(max_compressed_size, (std::size_t)(m_offsets[i + 1] - m_offsets[i]));
+    }
+    const auto page_size = (std::size_t)::sysconf(_SC_PAGESIZE);
+    m_work_size = k_zlib_work_size + (max_compressed_size + page_size - 1) / page_size * page_size;
+    return true;
+  }
+
+  void close() {
+    if (m_fd != -1) os_close(m_fd);
+    m_fd = -1;
+    m_offsets.clear();
+  }
+
+  std::size_t file_size() const {
+    return m_header.file_size;
+  }
+
+  std::size_t frame_size() const {
+    return m_header.frame_size;
+  }
+
+  std::size_t num_frames() const {
+    return m_header.num_frames;
+  }
+
+  /// \brief Returns the size of a frame in the original file; only the last frame can be shorter than frame_size()
+  std::size_t frame_length(const std::size_t frame_no) const {
+    return std::min((std::size_t)m_header.frame_size, (std::size_t)m_header.file_size - frame_no * m_header.frame_size);
+  }
+
+  /// \brief Returns true if a frame contains only zeros
+  bool zero_frame(const std::size_t frame_no) const {
+    return m_offsets[frame_no + 1] == m_offsets[frame_no];
+  }
+
+  /// \brief Decompresses a frame. Async-signal-safe; the working memory is mapped for each call.
+  /// \param frame_no The frame number
+  /// \param buf A buffer of frame_length(frame_no) bytes
+  /// \return Returns true on success; otherwise, false.
+  bool read_frame(const std::size_t frame_no, void *const buf) const {
+    const std::size_t length = frame_length(frame_no);
+    if (zero_frame(frame_no)) {
+      std::memset(buf, 0, length);
+      return true;
+    }
+
+    void *const work = ::mmap(nullptr, m_work_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (work == MAP_FAILED) return false;
+    arena zlib_arena{static_cast<char *>(work), static_cast<char *>(work) + k_zlib_work_size};
+    auto *const in = reinterpret_cast<Bytef *>(static_cast<char *>(work) + k_zlib_work_size);
+    const std::size_t compressed_size = m_offsets[frame_no + 1] - m_offsets[frame_no];
+
+    bool ret = detail::pread_all(m_fd, in, compressed_size, m_offsets[frame_no]);
+    if (ret) {
+      z_stream stream{};
+      stream.zalloc = priv_alloc;
+      stream.zfree = priv_free;
+      stream.opaque = &zlib_arena;
+      ret = (::inflateInit(&stream) == Z_OK);
+      if (ret) {
+        stream.next_in = in;
+        stream.avail_in = compressed_size;
+        stream.next_out = static_cast<Bytef *>(buf);
+        stream.avail_out = length;
+        ret = (::inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == length);
+        ::inflateEnd(&stream);
+      }
+    }
+    ::munmap(work, m_work_size);
+    return ret;
+  }
+
+ private:
+  // zlib needs about 7 KB of state and a 32 KB window to inflate a stream
+  static constexpr std::size_t k_zlib_work_size = 1ULL << 16ULL;
+
+  struct arena {
+    char *next;
+    char *end;
+  };
+
+  static voidpf priv_alloc(voidpf opaque, const uInt items, const uInt size) {
+    auto *const a = static_cast<arena *>(opaque);
+    const std::size_t nbytes = ((std::size_t)items * size + 15) / 16 * 16;
+    if ((std::size_t)(a->end - a->next) < nbytes) return Z_NULL;
+    void *const addr = a->next;
+    a->next += nbytes;
+    return addr;
+  }
+
+  static void priv_free(voidpf, voidpf) {}
+
+  int m_fd{-1};
+  detail::header m_header{};
+  std::vector<uint64_t> m_offsets;
+  std::size_t m_work_size{0};
+};
+
+/// \brief Returns the size of the original file
+/// \return Returns -1 on error
+inline ssize_t get_original_size(const std::string &path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1) return -1;
+  detail::header hdr;
+  const bool ret = detail::pread_all(fd, &hdr, sizeof(hdr), 0)
+      && std::memcmp(hdr.magic, detail::k_magic, sizeof(detail::k_magic)) == 0;
+  os_close(fd);
+  return ret ? (ssize_t)hdr.file_size : -1;
+}
+
+/// \brief Compresses a file
+/// \param source_path The file to compress
+/// \param destination_path The compressed file to create; the file is replaced atomically
+/// \param frame_size The size of a frame
+/// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+/// \return Returns true on success; otherwise, false.
+inline bool compress(const std::string &source_path, const std::string &destination_path,
+                     const std::size_t frame_size, std::size_t num_threads = 0) {
+  if (num_threads == 0) num_threads = default_num_threads();
+  const auto file_size = get_file_size(source_path);
+  if (file_size < 0) return false;
+
+  const int src_fd = ::open(source_path.c_str(), O_RDONLY);
+  if (src_fd == -1) {
+    ::perror("open");
+    std::cerr << "Failed to open: " << source_path << std::endl;
+    return false;
+  }
+  const std::string tmp_path = destination_path + ".tmp";
+  const int dst_fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (dst_fd == -1) {
+    ::perror("open");
+    std::cerr << "Failed to create: " << tmp_path << std::endl;
+    os_close(src_fd);
+    return false;
+  }
+
+  detail::header hdr{};
+  std::memcpy(hdr.magic, detail::k_magic, sizeof(detail::k_magic));
+  hdr.file_size = file_size;
+  hdr.frame_size = frame_size;
+  hdr.num_frames = (file_size + frame_size - 1) / frame_size;
+  std::vector<uint64_t> offsets(hdr.num_frames + 1);
+  offsets[0] = sizeof(hdr) + offsets.size() * sizeof(uint64_t);
+
+  // Compress a batch of frames in parallel, then append them in order
+  bool ret = true;
+  const std::size_t batch_size = num_threads * 4;
+  std::vector<std::vector<char>> buffers(batch_size);
+  std::vector<std::vector<Bytef>> compressed(batch_size);
+  for (std::size_t first = 0; first < hdr.num_frames && ret; first += batch_size) {
+    const std::size_t n = std::min(batch_size, (std::size_t)hdr.num_frames - first);
+    std::atomic<bool> failed(false);
+    parallel_for(n, num_threads, [&](const std::size_t i) {
+      const std::size_t frame_no = first + i;
+      const std::size_t size = std::min(frame_size, (std::size_t)file_size - frame_no * frame_size);
+      auto &buf = buffers[i];
+      auto &out = compressed[i];
+      buf.resize(size);
+      if (!detail::pread_all(src_fd, buf.data(), size, frame_no * frame_size)) {
+        failed = true;
+        return;
+      }
+      if (detail::all_zero(buf.data(), size)) {
+        out.clear();
+        return;
+      }
+      uLongf out_size = ::compressBound(size);
+      out.resize(out_size);
+      if (::compress2(out.data(), &out_size, reinterpret_cast<const Bytef *>(buf.data()), size, Z_BEST_SPEED)
+          != Z_OK) {
+        failed = true;
+        return;
+      }
+      out.resize(out_size);
+    });
+    ret = !failed;
+
+    for (std::size_t i = 0; i < n && ret; ++i) {
+      const std::size_t frame_no = first + i;
+      ret = detail::pwrite_all(dst_fd, compressed[i].data(), compressed[i].size(), offsets[frame_no]);
+      offsets[frame_no + 1] = offsets[frame_no] + compressed[i].size();
+    }
+  }
+
+  ret = ret && detail::pwrite_all(dst_fd, &hdr, sizeof(hdr), 0)
+      && detail::pwrite_all(dst_fd, offsets.data(), offsets.size() * sizeof(uint64_t), sizeof(hdr))
+      && os_fsync(dst_fd);
+  os_close(src_fd);
+  os_close(dst_fd);
+
+  if (!ret || ::rename(tmp_path.c_str(), destination_path.c_str()) == -1) {
+    std::cerr << "Failed to compress: " << source_path << std::endl;
+    remove_file(tmp_path);
+    return false;
+  }
+  return true;
+}
+
+/// \brief Decompresses a file into memory
+/// \param path The compressed file
+/// \param addr The address to decompress to; must be filled with zeros
+/// \param size The size of the memory, must be equal to or larger than the original file size
+/// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+/// \return Returns true on success; otherwise, false.
+inline bool decompress(const std::string &path, void *const addr, const std::size_t size,
+                       std::size_t num_threads = 0) {
+  if (num_threads == 0) num_threads = default_num_threads();
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    ::perror("open");
+    std::cerr << "Failed to open: " << path << std::endl;
+    return false;
+  }
+
+  detail::header hdr;
+  std::vector<uint64_t> offsets;
+  if (!detail::read_index(fd, &hdr, &offsets) || hdr.file_size > size) {
+    std::cerr << "Invalid compressed file: " << path << std::endl;
+    os_close(fd);
+    return false;
+  }
+
+  std::atomic<bool> failed(false);
+  parallel_for(hdr.num_frames, num_threads, [&](const std::size_t frame_no) {
+    const std::size_t compressed_size = offsets[frame_no + 1] - offsets[frame_no];
+    if (compressed_size == 0 || failed) return; // Zero frame
+    thread_local std::vector<Bytef> buf;
+    buf.resize(compressed_size);
+    const std::size_t frame_size = std::min((std::size_t)hdr.frame_size,
+                                            (std::size_t)hdr.file_size - frame_no * hdr.frame_size);
+    uLongf out_size = frame_size;
+    if (!detail::pread_all(fd, buf.data(), compressed_size, offsets[frame_no])
+        || ::uncompress(static_cast<Bytef *>(addr) + frame_no * hdr.frame_size, &out_size, buf.data(), compressed_size)
+            != Z_OK || out_size != frame_size) {
+      failed = true;
+    }
+  });
+  os_close(fd);
+
+  if (failed) {
+    std::cerr << "Failed to decompress: " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/// \brief Decompresses a file into another file
+/// \param source_path The compressed file
+/// \param destination_path The file to create; zero frames become holes
+/// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+/// \param fill_holes If true, the destination file is not truncated and
+/// only the frames that are holes in it are decompressed, e.g., the file has the frames loaded on demand
+/// \return Returns true on success; otherwise, false.
+inline bool decompress(const std::string &source_path, const std::string &destination_path,
+                       std::size_t num_threads = 0, const bool fill_holes = false) {
+  if (num_threads == 0) num_threads = default_num_threads();
+  const int src_fd = ::open(source_path.c_str(), O_RDONLY);
+  if (src_fd == -1) {
+    ::perror("open");
+    std::cerr << "Failed to open: " << source_path << std::endl;
+    return false;
+  }
+  detail::header hdr;
+  std::vector<uint64_t> offsets;
+  if (!detail::read_index(src_fd, &hdr, &offsets)) {
+    std::cerr << "Invalid compressed file: " << source_path << std::endl;
+    os_close(src_fd);
+    return false;
+  }
+
+  const int dst_fd = ::open(destination_path.c_str(), O_RDWR | O_CREAT | (fill_holes ? 0 : O_TRUNC), S_IRUSR | S_IWUSR);
+  if (dst_fd == -1 || ::ftruncate(dst_fd, hdr.file_size) == -1) {
+    ::perror("open");
+    std::cerr << "Failed to create: " << destination_path << std::endl;
+    os_close(src_fd);
+    if (dst_fd != -1) os_close(dst_fd);
+    return false;
+  }
+
+  std::atomic<bool> failed(false);
+  parallel_for(hdr.num_frames, num_threads, [&](const std::size_t frame_no) {
+    const std::size_t compressed_size = offsets[frame_no + 1] - offsets[frame_no];
+    if (compressed_size == 0 || failed) return;
+    thread_local std::vector<Bytef> in;
+    thread_local std::vector<Bytef> out;
+    in.resize(compressed_size);
+    const std::size_t frame_size = std::min((std::size_t)hdr.frame_size,
+                                            (std::size_t)hdr.file_size - frame_no * hdr.frame_size);
+    const off_t frame_offset = frame_no * hdr.frame_size;
+    if (fill_holes && detail::has_data(dst_fd, frame_offset, frame_offset + frame_size)) return;
+    out.resize(frame_size);
+    uLongf out_size = frame_size;
+    if (!detail::pread_all(src_fd, in.data(), compressed_size, offsets[frame_no])
+        || ::uncompress(out.data(), &out_size, in.data(), compressed_size) != Z_OK || out_size != frame_size
+        || !detail::pwrite_all(dst_fd, out.data(), frame_size, frame_no * hdr.frame_size)) {
+      failed = true;
+    }
+  });
+
+  const bool ret = !failed && os_fsync(dst_fd);
+  os_close(src_fd);
+  os_close(dst_fd);
+  if (!ret) {
+    std::cerr << "Failed to decompress: " << source_path << std::endl;
+  }
+  return ret;
+}
+
+} // namespace compressed_file
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_COMPRESSED_FILE_HPP
@@ -0,0 +1,326 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_COMPRESSED_FRAME_LOADER_HPP
+#define METALL_DETAIL_UTILITY_COMPRESSED_FRAME_LOADER_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+#include <metall/detail/utility/file.hpp>
+#include <metall/detail/utility/file_clone.hpp>
+#include <metall/detail/utility/futex.hpp>
+#include <metall/detail/utility/parallel_for.hpp>
+#include <metall/detail/utility/write_fault_handler.hpp>
+#include <metall/detail/utility/compressed_file.hpp>
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+/// \brief Decompresses the frames of compressed block files at their first access (SIGSEGV),
+/// so that opening a compressed segment neither inflates the whole segment into memory nor rewrites the block files.
+/// The frames that are not loaded yet are mapped without any access permission;
+/// system calls that access them (e.g., write(2) from the segment) fail with EFAULT until they are loaded.
+/// In the read-write mode, the frames are decompressed into the block file, which is created as a sparse file,
+/// and the compressed file is kept until all frames are loaded;
+/// frames that have data in the block file (i.e., loaded in a previous open) are mapped from it directly.
+/// In the read-only mode, the frames are decompressed into a memfd so that only the accessed ones use memory.
+class compressed_frame_loader : public write_fault_handler {
+ public:
+  explicit compressed_frame_loader(const bool read_only)
+      : m_read_only(read_only) {}
+
+  ~compressed_frame_loader() override {
+    if (m_active) unregister_write_fault_handler(this);
+    for (const auto &b : m_blocks) {
+      if (b->fd != -1) os_close(b->fd);
+      if (b->source_fd != -1) os_close(b->source_fd);
+    }
+  }
+
+  compressed_frame_loader(const compressed_frame_loader &) = delete;
+  compressed_frame_loader &operator=(const compressed_frame_loader &) = delete;
+
+  /// \brief Returns the name of the compressed file of a block file
+  static std::string compressed_file_name(const std::string &block_file_name) {
+    return block_file_name + k_suffix;
+  }
+
+  /// \brief Removes the suffix of compressed files from a file name
+  /// \return Returns true if the file name had the suffix
+  static bool strip_suffix(std::string *const file_name) {
+    const std::size_t length = sizeof(k_suffix) - 1;
+    if (file_name->size() <= length || file_name->compare(file_name->size() - length, length, k_suffix) != 0) {
+      return false;
+    }
+    file_name->resize(file_name->size() - length);
+    return true;
+  }
+
+  /// \brief Checks if a block file is stored compressed
+  /// \param size Set to the original size of the block file; -1 if the compressed file is invalid
+  /// \return Returns true if the compressed file exists
+  static bool find(const std::string &block_file_name, ssize_t *const size) {
+    const auto file_name = compressed_file_name(block_file_name);
+    if (!file_exist(file_name)) return false;
+    *size = compressed_file::get_original_size(file_name);
+    return true;
+  }
+
+  /// \brief Compresses a block file.
+  /// A block file that is already compressed is copied as it is;
+  /// the frames loaded from it in the read-write mode are merged first.
+  /// \param block_file_name The block file
+  /// \param destination_block_file_name The block file to compress into;
+  /// if it is the same as the source, the uncompressed block file is replaced.
+  /// \return Returns true on success; otherwise, false.
+  static bool compress(const std::string &block_file_name, const std::string &destination_block_file_name,
+                       const std::size_t frame_size, const std::size_t num_threads) {
+    const bool in_place = (block_file_name == destination_block_file_name);
+    const auto source_file_name = compressed_file_name(block_file_name);
+    const auto destination_file_name = compressed_file_name(destination_block_file_name);
+    if (file_exist(source_file_name)) {
+      if (!file_exist(block_file_name)) {
+        return in_place || clone_file(source_file_name, destination_file_name, true);
+      }
+      // The block file has the frames loaded in the read-write mode (or all frames if a conversion was interrupted);
+      // fill the rest from the compressed file and compress it again
+      if (!compressed_file::decompress(source_file_name, block_file_name, num_threads, true)) {
+        return false;
+      }
+    }
+    if (!compressed_file::compress(block_file_name, destination_file_name, frame_size, num_threads)) {
+      return false;
+    }
+    return !in_place || remove_file(block_file_name);
+  }
+
+  /// \brief Maps the block files that are stored compressed and starts loading their frames on demand
+  /// \param block_file_names The block files
+  /// \param addrs The addresses to map the block files at
+  /// \param compressed Set to true for the blocks mapped by this loader
+  /// \return Returns true on success; otherwise, false.
+  bool open(const std::vector<std::string> &block_file_names, const std::vector<char *> &addrs,
+            std::vector<bool> *const compressed) {
+    compressed->assign(block_file_names.size(), false);
+    for (std::size_t n = 0; n < block_file_names.size(); ++n) {
+      const auto file_name = compressed_file_name(block_file_names[n]);
+      if (!file_exist(file_name)) continue;
+      if (!add(file_name, block_file_names[n], addrs[n])) return false;
+      (*compressed)[n] = true;
+    }
+    return m_blocks.empty() || start();
+  }
+
+  /// \brief Maps a compressed block file at an address. Must be called before start().
+  bool add(const std::string &compressed_file_name, const std::string &block_file_name, char *const addr) {
+    auto b = std::make_unique<block>();
+    if (!b->reader.open(compressed_file_name)) return false;
+    b->addr = addr;
+    b->compressed_file_name = compressed_file_name;
+    const std::size_t size = b->reader.file_size();
+    const std::size_t num_frames = b->reader.num_frames();
+
+    int loaded_frames_fd; // The file that has the frames loaded in a previous open
+    if (m_read_only) {
+      b->fd = ::memfd_create("metall_compressed_block", MFD_CLOEXEC);
+      b->source_fd = ::open(block_file_name.c_str(), O_RDONLY); // Exists if frames were loaded in the read-write mode
+      loaded_frames_fd = b->source_fd;
+    } else {
+      b->fd = ::open(block_file_name.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+      loaded_frames_fd = b->fd;
+    }
+    struct stat st;
+    if (b->fd == -1 || ::fstat(b->fd, &st) == -1 || ((std::size_t)st.st_size < size && ::ftruncate(b->fd, size) == -1)
+        || ::mmap(addr, size, PROT_NONE, MAP_SHARED | MAP_FIXED, b->fd, 0) == MAP_FAILED) {
+      ::perror("open/ftruncate/mmap");
+      std::cerr << "Failed to map a compressed block file: " << compressed_file_name << std::endl;
+      if (b->fd != -1) os_close(b->fd);
+      if (b->source_fd != -1) os_close(b->source_fd);
+      return false;
+    }
+
+    b->states.reset(new std::atomic<uint32_t>[num_frames]);
+    b->in_source.assign(num_frames, false);
+    for (std::size_t f = 0; f < num_frames; ++f) {
+      const off_t offset = f * b->reader.frame_size();
+      const bool loaded = loaded_frames_fd != -1
+          && compressed_file::detail::has_data(loaded_frames_fd, offset, offset + b->reader.frame_length(f));
+      if (loaded && !m_read_only) {
+        b->states[f].store(k_loaded, std::memory_order_relaxed);
+        if (::mprotect(addr + offset, b->reader.frame_length(f), PROT_READ | PROT_WRITE) == -1) return false;
+      } else {
+        b->states[f].store(k_not_loaded, std::memory_order_relaxed);
+        b->in_source[f] = loaded;
+      }
+    }
+    m_blocks.emplace_back(std::move(b));
+    return true;
+  }
+
+  /// \brief Starts loading frames on demand
+  bool start() {
+    std::sort(m_blocks.begin(), m_blocks.end(), [](const auto &lhs, const auto &rhs) {
+      return lhs->addr < rhs->addr;
+    });
+    m_active = register_write_fault_handler(this);
+    return m_active;
+  }
+
+  /// \brief Loads the frames that overlap with a range using multiple threads
+  void load(char *const addr, const std::size_t length) {
+    for (const auto &b : m_blocks) {
+      char *const begin = std::max(addr, b->addr);
+      char *const end = std::min(addr + length, b->addr + b->reader.file_size());
+      if (begin >= end) continue;
+      const std::size_t first = (begin - b->addr) / b->reader.frame_size();
+      const std::size_t last = (end - b->addr - 1) / b->reader.frame_size();
+      parallel_for(last - first + 1, default_num_threads(), [this, &b, first](const std::size_t i) {
+        priv_load(*b, first + i);
+      });
+    }
+  }
+
+  /// \brief Changes the protection of a range except the frames that are not loaded yet
+  bool protect(char *const addr, const std::size_t length, const bool writable) const {
+    const int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    bool ret = true;
+    const auto protect_range = [&ret, prot](char *const begin, char *const end) {
+      if (begin < end) ret &= (::mprotect(begin, end - begin, prot) == 0);
+    };
+    char *cursor = addr;
+    for (const auto &b : m_blocks) {
+      protect_range(cursor, std::min(b->addr, addr + length));
+      const std::size_t num_frames = b->reader.num_frames();
+      for (std::size_t first = 0; first < num_frames;) {
+        std::size_t last = first;
+        while (last < num_frames && b->states[last].load() == k_loaded) ++last;
+        protect_range(b->addr + first * b->reader.frame_size(),
+                      b->addr + std::min(last * b->reader.frame_size(), (std::size_t)b->reader.file_size()));
+        first = last + 1;
+      }
+      cursor = std::max(cursor, b->addr + b->reader.file_size());
+    }
+    protect_range(cursor, addr + length);
+    return ret;
+  }
+
+  /// \brief Removes the compressed files whose frames have all been loaded into the block files.
+  /// The block files are synchronized first. Only in the read-write mode.
+  bool remove_loaded_compressed_files() {
+    bool ret = true;
+    for (const auto &b : m_blocks) {
+      if (m_read_only || b->compressed_file_name.empty()) continue;
+      bool all_loaded = true;
+      for (std::size_t f = 0; f < b->reader.num_frames() && all_loaded; ++f) {
+        all_loaded = (b->states[f].load() == k_loaded || b->reader.zero_frame(f));
+      }
+      if (!all_loaded) continue;
+      if (!os_fsync(b->fd) || !remove_file(b->compressed_file_name)) {
+        ret = false;
+        continue;
+      }
+      b->compressed_file_name.clear();
+    }
+    return ret;
+  }
+
+  bool handle_write_fault(void *const addr) override {
+    char *const a = static_cast<char *>(addr);
+    const auto itr = std::upper_bound(m_blocks.begin(), m_blocks.end(), a, [](const char *const x, const auto &b) {
+      return x < b->addr;
+    });
+    if (itr == m_blocks.begin()) return false;
+    block &b = **(itr - 1);
+    if (a >= b.addr + b.reader.file_size()) return false;
+    if (priv_load(b, (a - b.addr) / b.reader.frame_size())) return true;
+
+    // The frame has been loaded: the fault is stale (loaded by another thread in the meantime)
+    // or caused by other protection, e.g., a write to the read-only segment; retry only once
+    if (m_last_stale_fault.exchange(addr) == addr) {
+      m_last_stale_fault.store(nullptr);
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  static constexpr char k_suffix[] = ".z";
+  static constexpr uint32_t k_not_loaded = 0;
+  static constexpr uint32_t k_loading = 1;
+  static constexpr uint32_t k_loading_with_waiters = 2;
+  static constexpr uint32_t k_loaded = 3;
+
+  struct block {
+    char *addr{nullptr};
+    std::string compressed_file_name; // Cleared once it is removed
+    int fd{-1}; // The file the frames are decompressed into
+    int source_fd{-1}; // The block file in the read-only mode
+    compressed_file::frame_reader reader;
+    std::unique_ptr<std::atomic<uint32_t>[]> states;
+    std::vector<bool> in_source; // Frames to read from source_fd instead of decompressing
+  };
+
+  /// \brief Loads a frame if it is not loaded yet; waits if another thread is loading it. Async-signal-safe.
+  /// \return Returns false if the frame had been loaded already.
+  bool priv_load(block &b, const std::size_t frame_no) {
+    auto &state = b.states[frame_no];
+    uint32_t current = k_not_loaded;
+    if (state.compare_exchange_strong(current, k_loading)) {
+      if (!priv_decompress(b, frame_no)) {
+        static constexpr char k_message[] = "Failed to decompress a frame of a compressed block file\n";
+        [[maybe_unused]] const auto ret = ::write(STDERR_FILENO, k_message, sizeof(k_message) - 1);
+        std::abort();
+      }
+      if (state.exchange(k_loaded) == k_loading_with_waiters) futex_wake_all(&state);
+      return true;
+    }
+    if (current == k_loaded) return false;
+    for (; current != k_loaded; current = state.load()) {
+      if (current == k_loading && !state.compare_exchange_strong(current, k_loading_with_waiters)) continue;
+      futex_wait(&state, k_loading_with_waiters);
+    }
+    return true;
+  }
+
+  /// \brief Writes a frame into the file mapped at the block and makes it accessible. Async-signal-safe.
+  bool priv_decompress(const block &b, const std::size_t frame_no) const {
+    const std::size_t offset = frame_no * b.reader.frame_size();
+    const std::size_t length = b.reader.frame_length(frame_no);
+    if (b.in_source[frame_no] || !b.reader.zero_frame(frame_no)) { // Zero frames are holes already
+      void *const buf = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (buf == MAP_FAILED) return false;
+      const bool ret = (b.in_source[frame_no] ? compressed_file::detail::pread_all(b.source_fd, buf, length, offset)
+                                              : b.reader.read_frame(frame_no, buf))
+          && compressed_file::detail::pwrite_all(b.fd, buf, length, offset);
+      ::munmap(buf, length);
+      if (!ret) return false;
+    }
+    return ::mprotect(b.addr + offset, length, m_read_only ? PROT_READ : PROT_READ | PROT_WRITE) == 0;
+  }
+
+  const bool m_read_only;
+  bool m_active{false};
+  std::vector<std::unique_ptr<block>> m_blocks;
+  std::atomic<void *> m_last_stale_fault{nullptr};
+};
+
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_COMPRESSED_FRAME_LOADER_HPP
@@ -0,0 +1,247 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_COW_SNAPSHOT_HPP
+#define METALL_DETAIL_UTILITY_COW_SNAPSHOT_HPP
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <utility>
+
+#include <metall/detail/utility/mmap.hpp>
+#include <metall/detail/utility/futex.hpp>
+#include <metall/detail/utility/write_fault_handler.hpp>
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+/// \brief Copies a memory region into files while other threads keep writing to the region.
+/// The region is write-protected and a unit of the region is copied out right before it is written first
+/// (in the SIGSEGV handler) or by run(), whichever comes first.
+/// A writer to a unit being copied by another thread sleeps on a futex until the copy is done.
+/// System calls that write into a protected unit (e.g., read(2)) fail with EFAULT instead of raising a fault.
+class cow_snapshot : public write_fault_handler {
+ public:
+  /// \brief A destination file of a part of the region
+  struct destination {
+    int fd;
+    std::size_t offset; // Offset in the region
+    std::size_t size;
+  };
+
+  /// \brief Constructor
+  /// \param region The address of the region; must be page aligned
+  /// \param size The size of the region
+  /// \param unit_size Copy unit size; must be a multiple of the page size
+  /// \param destinations Destination files that cover the region, in the order of the offsets
+  /// \param data_ranges Pairs of offset and length of the ranges that have to be copied.
+  /// The other ranges are assumed to be filled with zero in the destination files already.
+  cow_snapshot(void *const region, const std::size_t size, const std::size_t unit_size,
+               std::vector<destination> destinations,
+               const std::vector<std::pair<std::size_t, std::size_t>> &data_ranges)
+      : m_region(static_cast<char *>(region)),
+        m_size(size),
+        m_unit_size(unit_size),
+        m_num_units((size + unit_size - 1) / unit_size),
+        m_destinations(std::move(destinations)),
+        m_unit_states(new std::atomic<uint32_t>[m_num_units]),
+        m_failed(false),
+        m_active(false) {
+    for (std::size_t i = 0; i < m_num_units; ++i) {
+      m_unit_states[i].store(k_copied, std::memory_order_relaxed);
+    }
+    for (const auto &range : data_ranges) {
+      if (range.second == 0) continue;
+      const std::size_t last = std::min((range.first + range.second - 1) / m_unit_size, m_num_units - 1);
+      for (std::size_t i = range.first / m_unit_size; i <= last; ++i) {
+        m_unit_states[i].store(k_not_copied, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  ~cow_snapshot() override {
+    if (m_active) {
+      run();
+    }
+  }
+
+  cow_snapshot(const cow_snapshot &) = delete;
+  cow_snapshot &operator=(const cow_snapshot &) = delete;
+  cow_snapshot(cow_snapshot &&) = delete;
+  cow_snapshot &operator=(cow_snapshot &&) = delete;
+
+  /// \brief Write-protects the units to copy, makes the others writable, and starts tracking writes.
+  /// \return Returns false if an error happened;
+  /// in that case, run() can still be called to copy the region (writes must be stopped until it returns).
+  bool start() {
+    if (!register_write_fault_handler(this)) {
+      return false;
+    }
+    m_active = true;
+
+    for (std::size_t first = 0; first < m_num_units;) {
+      const bool to_copy = (m_unit_states[first].load() == k_not_copied);
+      std::size_t last = first;
+      while (last + 1 < m_num_units && (m_unit_states[last + 1].load() == k_not_copied) == to_copy) ++last;
+      char *const addr = m_region + first * m_unit_size;
+      const std::size_t length = priv_unit_range_end(last) - first * m_unit_size;
+      if (!(to_copy ? mprotect_read_only(addr, length) : mprotect_read_write(addr, length))) {
+        run(); // Restores the protection of the units to copy
+        return false;
+      }
+      first = last + 1;
+    }
+    return true;
+  }
+
+  /// \brief Copies the units that have not been copied yet, waits for the copies done by writers,
+  /// synchronizes the destination files, and stops tracking writes.
+  /// \return Returns true on success; otherwise, false.
+  bool run() {
+    constexpr std::size_t k_max_batch_size = 1ULL << 24ULL;
+    const std::size_t max_batch_units = std::max(k_max_batch_size / m_unit_size, (std::size_t)1);
+    for (std::size_t first = 0; first < m_num_units;) {
+      std::size_t last = first;
+      if (!priv_claim(first)) {
+        ++first;
+        continue;
+      }
+      while (last + 1 < m_num_units && last + 1 - first < max_batch_units && priv_claim(last + 1)) ++last;
+      priv_copy_and_release(first, last);
+      first = last + 1;
+    }
+    for (std::size_t i = 0; i < m_num_units; ++i) {
+      priv_wait_copied(i);
+    }
+
+    for (const auto &dst : m_destinations) {
+      if (::fdatasync(dst.fd) == -1) {
+        ::perror("fdatasync");
+        m_failed = true;
+      }
+    }
+
+    if (m_active) {
+      unregister_write_fault_handler(this);
+      m_active = false;
+    }
+
+    return !m_failed.load();
+  }
+
+  /// \brief Copies the unit that contains a faulted address before the write is retried
+  bool handle_write_fault(void *const addr) override {
+    const auto offset = static_cast<char *>(addr) - m_region;
+    if (offset < 0 || static_cast<std::size_t>(offset) >= m_size) return false;
+    priv_copy_unit(offset / m_unit_size);
+    return true;
+  }
+
+  /// \brief Copies the units that overlap with a range if they have not been copied yet.
+  /// Must be called before the range is modified without a write, e.g., freeing file space.
+  void preserve(const void *const addr, const std::size_t nbytes) {
+    const auto offset = static_cast<const char *>(addr) - m_region;
+    if (nbytes == 0 || offset < 0 || static_cast<std::size_t>(offset) >= m_size) return;
+    const std::size_t last = std::min((offset + nbytes - 1) / m_unit_size, m_num_units - 1);
+    for (std::size_t i = offset / m_unit_size; i <= last; ++i) {
+      priv_copy_unit(i);
+    }
+  }
+
+ private:
+  static constexpr uint32_t k_not_copied = 0;
+  static constexpr uint32_t k_copying = 1;
+  static constexpr uint32_t k_copying_with_waiters = 2;
+  static constexpr uint32_t k_copied = 3;
+
+  std::size_t priv_unit_range_end(const std::size_t unit_no) const {
+    return std::min((unit_no + 1) * m_unit_size, m_size);
+  }
+
+  bool priv_claim(const std::size_t unit_no) {
+    uint32_t expected = k_not_copied;
+    return m_unit_states[unit_no].compare_exchange_strong(expected, k_copying);
+  }
+
+  /// \brief Async-signal-safe
+  void priv_copy_unit(const std::size_t unit_no) {
+    if (priv_claim(unit_no)) {
+      priv_copy_and_release(unit_no, unit_no);
+      return;
+    }
+    priv_wait_copied(unit_no); // Another thread is copying the unit
+  }
+
+  /// \brief Sleeps until a claimed unit is copied. Async-signal-safe.
+  void priv_wait_copied(const std::size_t unit_no) {
+    auto &state = m_unit_states[unit_no];
+    for (uint32_t current = state.load(); current != k_copied; current = state.load()) {
+      if (current == k_copying && !state.compare_exchange_strong(current, k_copying_with_waiters)) continue;
+      futex_wait(&state, k_copying_with_waiters);
+    }
+  }
+
+  /// \brief Copies claimed units [first, last] and makes them writable again. Async-signal-safe.
+  void priv_copy_and_release(const std::size_t first, const std::size_t last) {
+    const std::size_t begin = first * m_unit_size;
+    const std::size_t end = priv_unit_range_end(last);
+    if (!priv_write(begin, end - begin)) {
+      m_failed = true;
+    }
+    if (::mprotect(m_region + begin, end - begin, PROT_READ | PROT_WRITE) == -1) {
+      m_failed = true;
+    }
+    for (std::size_t i = first; i <= last; ++i) {
+      if (m_unit_states[i].exchange(k_copied) == k_copying_with_waiters) {
+        futex_wake_all(&m_unit_states[i]);
+      }
+    }
+  }
+
+  /// \brief Writes a range of the region into the destination files. Async-signal-safe.
+  bool priv_write(std::size_t offset, std::size_t length) const {
+    for (const auto &dst : m_destinations) {
+      if (length == 0) break;
+      if (offset < dst.offset || dst.offset + dst.size <= offset) continue;
+      const std::size_t n = std::min(length, dst.offset + dst.size - offset);
+      for (std::size_t written = 0; written < n;) {
+        const ssize_t ret = ::pwrite(dst.fd, m_region + offset + written, n - written, offset - dst.offset + written);
+        if (ret == -1) {
+          if (errno == EINTR) continue;
+          return false;
+        }
+        written += ret;
+      }
+      offset += n;
+      length -= n;
+    }
+    return length == 0;
+  }
+
+  char *const m_region;
+  const std::size_t m_size;
+  const std::size_t m_unit_size;
+  const std::size_t m_num_units;
+  const std::vector<destination> m_destinations;
+  std::unique_ptr<std::atomic<uint32_t>[]> m_unit_states;
+  std::atomic<bool> m_failed;
+  bool m_active;
+};
+
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_COW_SNAPSHOT_HPP
@@ -0,0 +1,175 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_CRC32C_HPP
+#define METALL_DETAIL_UTILITY_CRC32C_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <array>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define METALL_CRC32C_X86_64
+#endif
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+namespace detail {
+
+/// \brief Tables for the slicing-by-8 software implementation (Castagnoli polynomial)
+inline const std::array<std::array<uint32_t, 256>, 8> &crc32c_tables() {
+  static const auto tables = []() {
+    std::array<std::array<uint32_t, 256>, 8> t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int k = 0; k < 8; ++k) {
+        crc = (crc >> 1U) ^ ((crc & 1U) ? 0x82F63B78U : 0U);
+      }
+      t[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+      for (int k = 1; k < 8; ++k) {
+        t[k][i] = (t[k - 1][i] >> 8U) ^ t[0][t[k - 1][i] & 0xFFU];
+      }
+    }
+    return t;
+  }();
+  return tables;
+}
+
+using crc32c_operator = std::array<uint32_t, 32>;
+
+inline uint32_t crc32c_apply(const crc32c_operator &op, uint32_t crc) {
+  uint32_t sum = 0;
+  for (int i = 0; crc; ++i, crc >>= 1U) {
+    if (crc & 1U) sum ^= op[i];
+  }
+  return sum;
+}
+
+inline crc32c_operator crc32c_square(const crc32c_operator &op) {
+  crc32c_operator square{};
+  for (int i = 0; i < 32; ++i) square[i] = crc32c_apply(op, op[i]);
+  return square;
+}
+
+/// \brief Returns the operator that appends 'length' zero bytes to a message in the GF(2) matrix form
+inline crc32c_operator crc32c_zeros_operator(std::size_t length) {
+  crc32c_operator op{}; // Identity
+  for (int i = 0; i < 32; ++i) op[i] = 1U << i;
+
+  crc32c_operator zeros{}; // One zero bit
+  zeros[0] = 0x82F63B78U;
+  for (int i = 1; i < 32; ++i) zeros[i] = 1U << (i - 1);
+  for (int i = 0; i < 3; ++i) zeros = crc32c_square(zeros); // One zero byte
+
+  while (length > 0) {
+    if (length & 1U) {
+      crc32c_operator product{};
+      for (int i = 0; i < 32; ++i) product[i] = crc32c_apply(zeros, op[i]);
+      op = product;
+    }
+    length >>= 1U;
+    if (length > 0) zeros = crc32c_square(zeros);
+  }
+  return op;
+}
+
+inline uint32_t crc32c_software(uint32_t crc, const unsigned char *data, std::size_t length) {
+  const auto &t = crc32c_tables();
+  while (length >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    word ^= crc;
+    crc = t[7][word & 0xFFU] ^ t[6][(word >> 8U) & 0xFFU] ^ t[5][(word >> 16U) & 0xFFU]
+        ^ t[4][(word >> 24U) & 0xFFU] ^ t[3][(word >> 32U) & 0xFFU] ^ t[2][(word >> 40U) & 0xFFU]
+        ^ t[1][(word >> 48U) & 0xFFU] ^ t[0][word >> 56U];
+    data += 8;
+    length -= 8;
+  }
+  while (length-- > 0) {
+    crc = (crc >> 8U) ^ t[0][(crc ^ *data++) & 0xFFU];
+  }
+  return crc;
+}
+
+#ifdef METALL_CRC32C_X86_64
+/// \brief Uses the SSE 4.2 CRC32 instruction.
+/// Processes three independent streams at a time to hide the latency of the instruction.
+__attribute__((target("sse4.2")))
+inline uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, std::size_t length) {
+  constexpr std::size_t k_stream_size = 4096;
+  static const crc32c_operator shift = crc32c_zeros_operator(k_stream_size);
+  uint64_t crc0 = crc;
+  while (length >= k_stream_size * 3) {
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    for (std::size_t i = 0; i < k_stream_size; i += 8) {
+      uint64_t w0, w1, w2;
+      std::memcpy(&w0, data + i, 8);
+      std::memcpy(&w1, data + k_stream_size + i, 8);
+      std::memcpy(&w2, data + k_stream_size * 2 + i, 8);
+      crc0 = _mm_crc32_u64(crc0, w0);
+      crc1 = _mm_crc32_u64(crc1, w1);
+      crc2 = _mm_crc32_u64(crc2, w2);
+    }
+    // Combine the streams: crc(A||B) = shift(crc(A), |B|) ^ crc(B)
+    crc0 = crc32c_apply(shift, static_cast<uint32_t>(crc0)) ^ crc1;
+    crc0 = crc32c_apply(shift, static_cast<uint32_t>(crc0)) ^ crc2;
+    data += k_stream_size * 3;
+    length -= k_stream_size * 3;
+  }
+  while (length >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, 8);
+    crc0 = _mm_crc32_u64(crc0, word);
+    data += 8;
+    length -= 8;
+  }
+  uint32_t crc32 = static_cast<uint32_t>(crc0);
+  while (length-- > 0) {
+    crc32 = _mm_crc32_u8(crc32, *data++);
+  }
+  return crc32;
+}
+#endif
+
+} // namespace detail
+
+/// \brief Combines CRC32C values of two consecutive messages
+/// \param crc1 The CRC of the first message
+/// \param crc2 The CRC of the second message
+/// \param length2 The length of the second message in bytes
+/// \return Returns the CRC of the concatenated message
+inline uint32_t crc32c_combine(const uint32_t crc1, const uint32_t crc2, const std::size_t length2) {
+  return detail::crc32c_apply(detail::crc32c_zeros_operator(length2), crc1) ^ crc2;
+}
+
+/// \brief Computes CRC32C (Castagnoli).
+/// Uses the SSE 4.2 CRC32 instruction if the running CPU supports it.
+/// \param data A pointer to the data
+/// \param length The length of the data in bytes
+/// \param crc A CRC value returned by a previous call to continue the computation
+/// \return Returns the CRC value
+inline uint32_t crc32c(const void *const data, const std::size_t length, const uint32_t crc = 0) {
+  const auto *const bytes = static_cast<const unsigned char *>(data);
+#ifdef METALL_CRC32C_X86_64
+  static const bool sse42 = __builtin_cpu_supports("sse4.2");
+  if (sse42) {
+    return ~detail::crc32c_sse42(~crc, bytes, length);
+  }
+#endif
+  return ~detail::crc32c_software(~crc, bytes, length);
+}
+
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_CRC32C_HPP
@@ -9,6 +9,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/resource.h>
+#include <sys/statvfs.h>
 #include <fcntl.h>
 #include <unistd.h>
 
@@ -217,6 +218,16 @@ inline ssize_t get_actual_file_size(const std::string &file_name) {
   return statbuf.st_blocks * 512LL;
 }
 
+/// \brief Returns the space available to unprivileged users in the file system that contains a path
+/// \return Returns -1 on error
+inline ssize_t get_available_space(const std::string &path) {
+  struct statvfs statbuf;
+  if (::statvfs(path.c_str(), &statbuf) != 0) {
+    return -1;
+  }
+  return (ssize_t)(statbuf.f_bavail * statbuf.f_frsize);
+}
+
 /// \brief Check if a file, any kinds of file including directory, exists
 inline bool file_exist(const std::string &file_name) {
   struct stat statbuf;
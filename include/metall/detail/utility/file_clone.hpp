@@ -111,6 +111,34 @@ inline bool clone_file(const std::string& source_path, const std::string& destin
   return ret;
 }
 
+/// \brief Clones a file sharing its data blocks (reflink) without falling back to a normal copy
+/// \param source_path A path to the file to be cloned
+/// \param destination_path A path to clone to; overwritten if it exists
+/// \return Returns true if the file was cloned; returns false if reflink is not supported or an error happened.
+inline bool reflink_file([[maybe_unused]] const std::string& source_path,
+                         [[maybe_unused]] const std::string& destination_path) {
+#if defined(__linux__) && defined(FICLONE)
+  const int source_fd = ::open(source_path.c_str(), O_RDONLY);
+  if (source_fd == -1) {
+    return false;
+  }
+  const int destination_fd = ::open(destination_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (destination_fd == -1) {
+    os_close(source_fd);
+    return false;
+  }
+  const bool ret = (::ioctl(destination_fd, FICLONE, source_fd) != -1);
+  os_close(source_fd);
+  os_close(destination_fd);
+  return ret;
+#elif defined(__APPLE__)
+  ::unlink(destination_path.c_str());
+  return ::clonefile(source_path.c_str(), destination_path.c_str(), 0) != -1;
+#else
+  return false;
+#endif
+}
+
 } // namespace metall
 } // namespace detail
 } // namespace utility
@@ -0,0 +1,53 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_FUTEX_HPP
+#define METALL_DETAIL_UTILITY_FUTEX_HPP
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <climits>
+#include <atomic>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/futex.h>)
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#if defined(SYS_futex)
+#define METALL_FUTEX_SUPPORTED 1
+#endif
+#endif
+#endif
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+/// \brief Sleeps while a word holds an expected value; can return spuriously, so call it in a loop.
+/// Async-signal-safe; unlike condition variables, it can be used to wait in signal handlers.
+/// Falls back to yielding if futex(2) is not available.
+inline void futex_wait(std::atomic<uint32_t> *const word, const uint32_t expected) {
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Unexpected atomic layout");
+#ifdef METALL_FUTEX_SUPPORTED
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+  if (word->load() == expected) ::sched_yield();
+#endif
+}
+
+/// \brief Wakes up all threads waiting on a word. Async-signal-safe.
+inline void futex_wake_all([[maybe_unused]] std::atomic<uint32_t> *const word) {
+#ifdef METALL_FUTEX_SUPPORTED
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_FUTEX_HPP
@@ -0,0 +1,98 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_INSTANCE_LOCK_REGISTRY_HPP
+#define METALL_DETAIL_UTILITY_INSTANCE_LOCK_REGISTRY_HPP
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <map>
+#include <utility>
+#include <cstdint>
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+/// \brief The registry of the lock tables of metall::utility::mutex::instance_lock_table, keyed by the address of an instance.
+/// The tables of all instance_lock_table types are in one registry
+/// so that the tables of the instances in a data store can be released at once when it is closed.
+class instance_lock_registry {
+ public:
+  /// \brief Returns the table of an instance. Allocates it using make_table() if it does not exist.
+  /// \param type_tag An address unique to the type of the table
+  static std::shared_ptr<void> find_or_create(const void *const instance, const void *const type_tag,
+                                              std::shared_ptr<void> (*const make_table)()) {
+    std::lock_guard<std::mutex> guard(registry_mutex());
+    auto &table = registry()[key_type(instance, type_tag)];
+    if (!table) {
+      table = make_table();
+    }
+    return table;
+  }
+
+  /// \brief Deallocates the table of an instance
+  static void release(const void *const instance, const void *const type_tag) {
+    std::lock_guard<std::mutex> guard(registry_mutex());
+    if (registry().erase(key_type(instance, type_tag))) {
+      invalidate_caches();
+    }
+  }
+
+  /// \brief Deallocates the tables of all instances in [begin, end).
+  /// Containers allocated in Metall are usually not destructed;
+  /// Metall calls this function with the range of a segment when it is closed.
+  static void release_range(const void *const begin, const void *const end) {
+    std::lock_guard<std::mutex> guard(registry_mutex());
+    auto &map = registry();
+    const auto first = map.lower_bound(key_type(begin, nullptr));
+    const auto last = map.lower_bound(key_type(end, nullptr));
+    if (first != last) {
+      map.erase(first, last);
+      invalidate_caches();
+    }
+  }
+
+  /// \brief Returns the number of the registered tables
+  static std::size_t size() {
+    std::lock_guard<std::mutex> guard(registry_mutex());
+    return registry().size();
+  }
+
+  /// \brief Returns a counter incremented every time tables are deallocated;
+  /// tables cached by threads are valid while it does not change
+  static uint64_t epoch() {
+    return epoch_counter().load(std::memory_order_acquire);
+  }
+
+ private:
+  using key_type = std::pair<const void *, const void *>;
+
+  static void invalidate_caches() {
+    epoch_counter().fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  static std::map<key_type, std::shared_ptr<void>> &registry() {
+    static std::map<key_type, std::shared_ptr<void>> instance;
+    return instance;
+  }
+
+  static std::mutex &registry_mutex() {
+    static std::mutex instance;
+    return instance;
+  }
+
+  static std::atomic<uint64_t> &epoch_counter() {
+    static std::atomic<uint64_t> instance{0};
+    return instance;
+  }
+};
+
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_INSTANCE_LOCK_REGISTRY_HPP
@@ -0,0 +1,255 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_IO_URING_HPP
+#define METALL_DETAIL_UTILITY_IO_URING_HPP
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <iostream>
+#include <algorithm>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define METALL_IO_URING_SUPPORTED 1
+#endif
+#endif
+#endif
+
+#if !defined(METALL_IO_URING_SUPPORTED) && defined(METALL_VERBOSE_SYSTEM_SUPPORT_WARNING)
+#warning "io_uring is not supported"
+#endif
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+/// \brief A minimal io_uring wrapper that uses the raw system calls (does not depend on liburing).
+/// Only the submission of file synchronization requests is supported.
+/// This class is not thread-safe.
+class io_uring_queue {
+ public:
+  io_uring_queue() = default;
+
+  ~io_uring_queue() {
+    release();
+  }
+
+  io_uring_queue(const io_uring_queue &) = delete;
+  io_uring_queue &operator=(const io_uring_queue &) = delete;
+  io_uring_queue(io_uring_queue &&) = delete;
+  io_uring_queue &operator=(io_uring_queue &&) = delete;
+
+  /// \brief Sets up an io_uring instance
+  /// \param entries The number of entries in the submission queue
+  /// \return Returns true on success; otherwise, false, e.g., io_uring is not supported by the kernel
+  bool init([[maybe_unused]] const unsigned int entries) {
+#ifdef METALL_IO_URING_SUPPORTED
+    if (initialized()) return true;
+
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    m_ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (m_ring_fd == -1) {
+      return false;
+    }
+
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+    }
+
+    m_sq_ring = ::mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ring == MAP_FAILED) {
+      m_sq_ring = nullptr;
+      release();
+      return false;
+    }
+
+    if (single_mmap) {
+      m_cq_ring = m_sq_ring;
+    } else {
+      m_cq_ring = ::mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         m_ring_fd, IORING_OFF_CQ_RING);
+      if (m_cq_ring == MAP_FAILED) {
+        m_cq_ring = nullptr;
+        release();
+        return false;
+      }
+    }
+
+    m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_ring_fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED) {
+      m_sqes = nullptr;
+      release();
+      return false;
+    }
+
+    char *const sq = static_cast<char *>(m_sq_ring);
+    m_sq_head = reinterpret_cast<uint32_t *>(sq + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+    m_sq_mask = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+    m_sq_array = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+    m_sq_entries = params.sq_entries;
+
+    char *const cq = static_cast<char *>(m_cq_ring);
+    m_cq_head = reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<uint32_t *>(cq + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+    m_cqes = cq + params.cq_off.cqes;
+
+    m_num_unsubmitted = 0;
+
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void release() {
+    if (m_sqes) ::munmap(m_sqes, m_sqes_size);
+    if (m_cq_ring && m_cq_ring != m_sq_ring) ::munmap(m_cq_ring, m_cq_ring_size);
+    if (m_sq_ring) ::munmap(m_sq_ring, m_sq_ring_size);
+    if (m_ring_fd != -1) ::close(m_ring_fd);
+    m_sqes = m_cq_ring = m_sq_ring = nullptr;
+    m_ring_fd = -1;
+    m_sq_entries = 0;
+    m_num_unsubmitted = 0;
+  }
+
+  bool initialized() const {
+    return m_ring_fd != -1;
+  }
+
+  /// \brief Returns the number of entries in the submission queue
+  unsigned int capacity() const {
+    return m_sq_entries;
+  }
+
+  /// \brief Queues a fsync(2) or fdatasync(2) request
+  /// \return Returns false if the submission queue is full
+  bool prepare_fsync([[maybe_unused]] const int fd,
+                     [[maybe_unused]] const bool data_sync,
+                     [[maybe_unused]] const uint64_t user_data) {
+#ifdef METALL_IO_URING_SUPPORTED
+    auto *const sqe = priv_get_sqe();
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd;
+    sqe->fsync_flags = (data_sync) ? IORING_FSYNC_DATASYNC : 0;
+    sqe->user_data = user_data;
+    priv_commit_sqe();
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /// \brief Submits queued requests
+  /// \param wait_nr The number of completions to wait for
+  /// \return Returns the number of submitted requests on success; otherwise, -1
+  int submit([[maybe_unused]] const unsigned int wait_nr) {
+#ifdef METALL_IO_URING_SUPPORTED
+    while (true) {
+      const int ret = static_cast<int>(::syscall(__NR_io_uring_enter, m_ring_fd, m_num_unsubmitted, wait_nr,
+                                                 (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+      if (ret == -1) {
+        if (errno == EINTR) continue;
+        ::perror("io_uring_enter");
+        std::cerr << "errno: " << errno << std::endl;
+        return -1;
+      }
+      m_num_unsubmitted -= std::min(m_num_unsubmitted, static_cast<unsigned int>(ret));
+      return ret;
+    }
+#else
+    return -1;
+#endif
+  }
+
+  /// \brief Pops a completion if there is
+  /// \param result A buffer to store the result of the request (-errno on failure)
+  /// \param user_data A buffer to store the user data given at the submission
+  /// \return Returns true if a completion is popped; otherwise, false
+  bool pop_completion([[maybe_unused]] int32_t *const result, [[maybe_unused]] uint64_t *const user_data) {
+#ifdef METALL_IO_URING_SUPPORTED
+    const uint32_t head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    const auto *const cqe = reinterpret_cast<const struct io_uring_cqe *>(m_cqes) + (head & m_cq_mask);
+    if (result) *result = cqe->res;
+    if (user_data) *user_data = cqe->user_data;
+    __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /// \brief Checks if io_uring is available in the running system
+  static bool available() {
+    io_uring_queue queue;
+    return queue.init(1);
+  }
+
+ private:
+#ifdef METALL_IO_URING_SUPPORTED
+  struct io_uring_sqe *priv_get_sqe() {
+    const uint32_t tail = *m_sq_tail;
+    if (tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries) {
+      return nullptr; // Full
+    }
+    auto *const sqe = static_cast<struct io_uring_sqe *>(m_sqes) + (tail & m_sq_mask);
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  void priv_commit_sqe() {
+    const uint32_t tail = *m_sq_tail;
+    m_sq_array[tail & m_sq_mask] = tail & m_sq_mask;
+    __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++m_num_unsubmitted;
+  }
+#endif
+
+  int m_ring_fd{-1};
+  void *m_sq_ring{nullptr};
+  void *m_cq_ring{nullptr};
+  void *m_sqes{nullptr};
+  std::size_t m_sq_ring_size{0};
+  std::size_t m_cq_ring_size{0};
+  std::size_t m_sqes_size{0};
+
+  uint32_t *m_sq_head{nullptr};
+  uint32_t *m_sq_tail{nullptr};
+  uint32_t *m_sq_array{nullptr};
+  uint32_t m_sq_mask{0};
+  unsigned int m_sq_entries{0};
+  unsigned int m_num_unsubmitted{0};
+
+  uint32_t *m_cq_head{nullptr};
+  uint32_t *m_cq_tail{nullptr};
+  uint32_t m_cq_mask{0};
+  void *m_cqes{nullptr};
+};
+
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_IO_URING_HPP
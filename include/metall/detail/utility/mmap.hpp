@@ -210,6 +210,16 @@ inline bool uncommit_private_pages(void *const addr, const size_t length) {
   return true;
 }
 
+// NOTE: unlike MADV_FREE, the next access to the pages always causes a page fault
+inline bool uncommit_private_pages_immediately(void *const addr, const size_t length) {
+  if (::madvise(addr, length, MADV_DONTNEED) != 0) {
+    // ::perror("madvise MADV_DONTNEED");
+    // std::cerr << "errno: " << errno << std::endl;
+    return false;
+  }
+  return true;
+}
+
 inline bool uncommit_shared_pages(void *const addr, const size_t length) {
   if (::madvise(addr, length, MADV_DONTNEED) != 0) {
     // ::perror("madvise MADV_DONTNEED");
@@ -247,6 +257,26 @@ inline void *reserve_vm_region(const size_t length) {
   return mapped_addr;
 }
 
+/// \brief Reserve a VM region at a specific address
+/// \param addr The address of the region to reserve. Must be page aligned
+/// \param length Length of the region to reserve
+/// \return The address of the reserved region; returns nullptr if the region is (partially) in use
+inline void *reserve_vm_region_at(void *const addr, const size_t length) {
+  static constexpr int map_fixed_noreplace =
+#ifdef MAP_FIXED_NOREPLACE
+      MAP_FIXED_NOREPLACE;
+#else
+      0;
+#endif
+  // Older kernels take the address just as a hint; check the result
+  void *mapped_addr = os_mmap(addr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | map_fixed_noreplace, -1, 0);
+  if (mapped_addr && mapped_addr != addr) {
+    os_munmap(mapped_addr, length);
+    mapped_addr = nullptr;
+  }
+  return mapped_addr;
+}
+
 /// \brief Reserve an aligned VM region
 /// \param alignment Specifies the alignment. Must be a multiple of the system page size
 /// \param length Length of the region to reserve
@@ -271,6 +301,9 @@ inline void *reserve_aligned_vm_region(const size_t alignment, const size_t leng
   }
 
   void *const map_addr = os_mmap(nullptr, length + alignment, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (!map_addr) {
+    return nullptr;
+  }
   void *const aligned_map_addr = reinterpret_cast<void *>(utility::round_up(reinterpret_cast<size_t>(map_addr),
                                                                             alignment));
 
@@ -295,6 +328,31 @@ inline void *reserve_aligned_vm_region(const size_t alignment, const size_t leng
   return aligned_map_addr;
 }
 
+/// \brief Reserve an aligned VM region leaving unused address space after it
+/// so that the region can be grown in place later by reserving the address space right after it.
+/// As the kernel places new mappings at the highest free addresses,
+/// other mappings fill the unused space from its end.
+/// \param alignment Specifies the alignment. Must be a multiple of the system page size
+/// \param length Length of the region to reserve. Must be a multiple of alignment
+/// \param headroom Length of the address space to leave unused after the region;
+/// smaller space is left if the address space is limited
+/// \return The address of the reserved region
+inline void *reserve_growable_vm_region(const size_t alignment, const size_t length, size_t headroom) {
+  headroom = round_down(headroom, alignment);
+  while (true) {
+    char *const addr = static_cast<char *>(reserve_aligned_vm_region(alignment, length + headroom));
+    if (addr) {
+      if (headroom > 0 && !os_munmap(addr + length, headroom)) {
+        os_munmap(addr, length + headroom);
+        return nullptr;
+      }
+      return addr;
+    }
+    if (headroom == 0) return nullptr;
+    headroom = round_down(headroom / 2, alignment);
+  }
+}
+
 class pagemap_reader {
  public:
   static constexpr uint64_t error_value = static_cast<uint64_t>(-1);
@@ -340,6 +398,29 @@ class pagemap_reader {
     return buf;
   }
 
+  /// \brief Reads the pagemap values of contiguous pages at once
+  /// \param page_no The first page number
+  /// \param num_pages The number of pages to read
+  /// \param buf A buffer to store the values
+  /// \return Returns true on success; otherwise, false
+  bool read(const uint64_t page_no, const std::size_t num_pages, uint64_t *const buf) {
+    if (m_fd < 0) {
+      return false;
+    }
+
+    std::size_t done = 0;
+    while (done < num_pages * sizeof(uint64_t)) {
+      const ssize_t ret = ::pread(m_fd, reinterpret_cast<char *>(buf) + done, num_pages * sizeof(uint64_t) - done,
+                                  page_no * sizeof(uint64_t) + done);
+      if (ret <= 0) {
+        return false;
+      }
+      done += ret;
+    }
+
+    return true;
+  }
+
  private:
   int m_fd;
 };
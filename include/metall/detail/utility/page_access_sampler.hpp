@@ -0,0 +1,147 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_PAGE_ACCESS_SAMPLER_HPP
+#define METALL_DETAIL_UTILITY_PAGE_ACCESS_SAMPLER_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include <metall/detail/utility/memory.hpp>
+#include <metall/detail/utility/mmap.hpp>
+#include <metall/detail/utility/file.hpp>
+#include <metall/detail/utility/soft_dirty_page.hpp>
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+/// \brief Counts the pages of memory ranges accessed between sampling rounds without unmapping them.
+/// Uses idle page tracking (accessed bits; needs /sys/kernel/mm/page_idle/bitmap and the PFNs in /proc/self/pagemap)
+/// if it is allowed. Otherwise, uses a probe page per range that is dropped from the page table
+/// and checked at the next round (the returned count is an estimate: all or no pages of the range).
+/// Both methods see reads as well as writes and do not touch the state of the other pages of the process.
+/// This class is not thread-safe.
+class page_access_sampler {
+ public:
+  enum class method_type {
+    idle_page,
+    probe
+  };
+
+  page_access_sampler() {
+    m_page_size = std::max<ssize_t>(get_page_size(), 1);
+    m_idle_bitmap_fd = ::open("/sys/kernel/mm/page_idle/bitmap", O_RDWR);
+    if (m_idle_bitmap_fd != -1 && priv_pfn_available()) {
+      m_method = method_type::idle_page;
+    } else {
+      if (m_idle_bitmap_fd != -1) os_close(m_idle_bitmap_fd);
+      m_idle_bitmap_fd = -1;
+      m_method = method_type::probe;
+    }
+  }
+
+  ~page_access_sampler() {
+    if (m_idle_bitmap_fd != -1) os_close(m_idle_bitmap_fd);
+  }
+
+  page_access_sampler(const page_access_sampler &) = delete;
+  page_access_sampler &operator=(const page_access_sampler &) = delete;
+  page_access_sampler(page_access_sampler &&) = delete;
+  page_access_sampler &operator=(page_access_sampler &&) = delete;
+
+  method_type method() const {
+    return m_method;
+  }
+
+  /// \brief Returns the number of pages of a range accessed since the previous round and
+  /// starts tracking the range for the next round.
+  /// Nothing is counted in the first round.
+  std::size_t sample(char *const addr, const std::size_t length) {
+    const std::size_t num_pages = length / m_page_size;
+    if (num_pages == 0) return 0;
+    const uint64_t first_page_no = reinterpret_cast<uint64_t>(addr) / m_page_size;
+
+    if (m_method == method_type::probe) {
+      std::size_t num_accessed = 0;
+      if (m_round > 0) {
+        const uint64_t value = m_pagemap.at(first_page_no + priv_probe(addr, num_pages, m_round - 1));
+        if (value != pagemap_reader::error_value && check_present_page(value)) num_accessed = num_pages;
+      }
+      uncommit_shared_pages(addr + priv_probe(addr, num_pages, m_round) * m_page_size, m_page_size);
+      return num_accessed;
+    }
+
+    m_buf.resize(num_pages);
+    if (!m_pagemap.read(first_page_no, num_pages, m_buf.data())) return 0;
+    return priv_sample_idle_pages();
+  }
+
+  /// \brief Finishes a round; call after sample() was called for all ranges
+  void end_round() {
+    ++m_round;
+  }
+
+ private:
+  static constexpr uint64_t k_pfn_mask = (1ULL << 55ULL) - 1;
+
+  /// \brief PFNs are shown as 0 without CAP_SYS_ADMIN
+  bool priv_pfn_available() {
+    auto *const page = static_cast<char *>(map_anonymous_write_mode(nullptr, m_page_size));
+    if (!page) return false;
+    page[0] = 1;
+    const uint64_t value = m_pagemap.at(reinterpret_cast<uint64_t>(page) / m_page_size);
+    munmap(page, m_page_size, false);
+    return value != pagemap_reader::error_value && check_present_page(value) && (value & k_pfn_mask) != 0;
+  }
+
+  /// \brief Counts the present pages in m_buf whose idle bits were cleared, i.e., accessed,
+  /// and sets their idle bits again
+  std::size_t priv_sample_idle_pages() {
+    m_pfns.clear();
+    for (const auto value : m_buf) {
+      if (check_present_page(value) && (value & k_pfn_mask) != 0) m_pfns.push_back(value & k_pfn_mask);
+    }
+    std::sort(m_pfns.begin(), m_pfns.end());
+
+    std::size_t num_accessed = 0;
+    for (std::size_t i = 0; i < m_pfns.size();) {
+      const uint64_t word_no = m_pfns[i] / 64;
+      uint64_t mask = 0;
+      for (; i < m_pfns.size() && m_pfns[i] / 64 == word_no; ++i) mask |= 1ULL << (m_pfns[i] % 64);
+      uint64_t word = 0;
+      if (::pread(m_idle_bitmap_fd, &word, sizeof(word), word_no * sizeof(word)) != sizeof(word)) continue;
+      if (m_round > 0) num_accessed += __builtin_popcountll(mask & ~word);
+      [[maybe_unused]] const auto ret = ::pwrite(m_idle_bitmap_fd, &mask, sizeof(mask), word_no * sizeof(mask));
+    }
+    return num_accessed;
+  }
+
+  /// \brief Picks a page of a range pseudo-randomly for each round
+  static std::size_t priv_probe(const char *const addr, const std::size_t num_pages, const uint64_t round) {
+    uint64_t x = reinterpret_cast<uint64_t>(addr) + round * 0x9E3779B97F4A7C15ULL; // splitmix64
+    x = (x ^ (x >> 30ULL)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27ULL)) * 0x94D049BB133111EBULL;
+    return (x ^ (x >> 31ULL)) % num_pages;
+  }
+
+  std::size_t m_page_size{0};
+  method_type m_method{method_type::probe};
+  int m_idle_bitmap_fd{-1};
+  uint64_t m_round{0};
+  pagemap_reader m_pagemap;
+  std::vector<uint64_t> m_buf;
+  std::vector<uint64_t> m_pfns;
+};
+
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_PAGE_ACCESS_SAMPLER_HPP
@@ -0,0 +1,315 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_PARALLEL_FILE_OPERATION_HPP
+#define METALL_DETAIL_UTILITY_PARALLEL_FILE_OPERATION_HPP
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <algorithm>
+
+#include <metall/detail/utility/file.hpp>
+#include <metall/detail/utility/file_clone.hpp>
+#include <metall/detail/utility/parallel_for.hpp>
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+/// \brief Called after each file is processed with the number of processed files and the total number of files.
+/// Calls are serialized.
+using file_operation_progress_handler = std::function<void(std::size_t, std::size_t)>;
+
+namespace parallel_file_operation_detail {
+
+/// \brief Lists the files and directories under a directory recursively.
+/// Paths are relative to the directory; directories are listed before their contents.
+inline bool list_directory_recursive(const std::string &top_dir_path, std::vector<std::string> *const files,
+                                     std::vector<std::string> *const directories) {
+  std::vector<std::string> stack{std::string()};
+  while (!stack.empty()) {
+    const std::string relative_dir = stack.back();
+    stack.pop_back();
+    const std::string dir_path = relative_dir.empty() ? top_dir_path : top_dir_path + "/" + relative_dir;
+
+    DIR *const dir = ::opendir(dir_path.c_str());
+    if (!dir) {
+      ::perror("opendir");
+      std::cerr << "Cannot open directory: " << dir_path << std::endl;
+      return false;
+    }
+    while (const dirent *const entry = ::readdir(dir)) {
+      const std::string name(entry->d_name);
+      if (name == "." || name == "..") continue;
+      const std::string relative_path = relative_dir.empty() ? name : relative_dir + "/" + name;
+      bool is_dir = (entry->d_type == DT_DIR);
+      if (entry->d_type == DT_UNKNOWN) { // Some file systems do not fill d_type
+        struct stat statbuf;
+        if (::lstat((top_dir_path + "/" + relative_path).c_str(), &statbuf) != 0) {
+          ::closedir(dir);
+          return false;
+        }
+        is_dir = S_ISDIR(statbuf.st_mode);
+      }
+      if (is_dir) {
+        directories->push_back(relative_path);
+        stack.push_back(relative_path);
+      } else {
+        files->push_back(relative_path);
+      }
+    }
+    ::closedir(dir);
+  }
+  return true;
+}
+
+/// \brief Runs a function for each item using multiple threads.
+/// Each thread takes the next item when it finishes one so that large files do not make threads idle.
+/// \return Returns true if the function returned true for all items.
+template <typename function_type>
+inline bool for_each_parallel(const std::size_t num_items, std::size_t num_threads, function_type &&function,
+                              const file_operation_progress_handler &progress) {
+  if (num_threads == 0) num_threads = default_num_threads();
+
+  std::atomic<std::size_t> next_item(0);
+  std::atomic<bool> success(true);
+  std::mutex progress_mutex;
+  std::size_t num_done = 0;
+  parallel_run(std::min(num_threads, num_items), [&](const std::size_t) {
+    while (success.load(std::memory_order_relaxed)) {
+      const std::size_t item = next_item.fetch_add(1);
+      if (item >= num_items) break;
+      if (!function(item)) {
+        success = false;
+        break;
+      }
+      if (progress) {
+        std::lock_guard<std::mutex> guard(progress_mutex);
+        progress(++num_done, num_items);
+      }
+    }
+  });
+  return success.load();
+}
+
+/// \brief Copies a regular file keeping its holes.
+/// Data ranges are found with SEEK_DATA/SEEK_HOLE if supported and copied with copy_file_range() if available.
+inline bool copy_sparse_file(const std::string &source_path, const std::string &destination_path) {
+  const int src_fd = ::open(source_path.c_str(), O_RDONLY);
+  if (src_fd == -1) {
+    ::perror("open");
+    std::cerr << "Cannot open: " << source_path << std::endl;
+    return false;
+  }
+  struct stat statbuf;
+  if (::fstat(src_fd, &statbuf) != 0) {
+    ::perror("fstat");
+    os_close(src_fd);
+    return false;
+  }
+  const int dst_fd = ::open(destination_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, statbuf.st_mode & 0777);
+  if (dst_fd == -1) {
+    ::perror("open");
+    std::cerr << "Cannot create: " << destination_path << std::endl;
+    os_close(src_fd);
+    return false;
+  }
+  const off_t file_size = statbuf.st_size;
+  bool ret = (::ftruncate(dst_fd, file_size) == 0);
+
+  std::vector<char> buf;
+  off_t offset = 0;
+  while (ret && offset < file_size) {
+    off_t data_begin = offset;
+    off_t data_end = file_size;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    data_begin = ::lseek(src_fd, offset, SEEK_DATA);
+    if (data_begin == -1) {
+      if (errno == ENXIO) break; // No more data
+      data_begin = offset; // Not supported; copy everything
+    } else {
+      data_end = ::lseek(src_fd, data_begin, SEEK_HOLE);
+      if (data_end == -1) data_end = file_size;
+    }
+#endif
+
+    off_t in_offset = data_begin;
+    while (ret && in_offset < data_end) {
+      const std::size_t length = std::min<off_t>(data_end - in_offset, 1 << 30);
+      ssize_t copied = -1;
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+      loff_t in = in_offset;
+      loff_t out = in_offset;
+      copied = ::copy_file_range(src_fd, &in, dst_fd, &out, length, 0);
+#endif
+      if (copied <= 0) { // Not supported across the file systems; use read and write
+        buf.resize(std::min<std::size_t>(length, 1 << 22));
+        copied = ::pread(src_fd, buf.data(), buf.size(), in_offset);
+        if (copied > 0 && ::pwrite(dst_fd, buf.data(), copied, in_offset) != copied) copied = -1;
+      }
+      if (copied <= 0) {
+        ::perror("copy");
+        std::cerr << "Failed to copy: " << source_path << " -> " << destination_path << std::endl;
+        ret = false;
+        break;
+      }
+      in_offset += copied;
+    }
+    offset = data_end;
+  }
+
+  ret &= os_close(src_fd);
+  ret &= os_close(dst_fd);
+  return ret;
+}
+
+/// \brief Copies a file, cloning it (reflink) if the file system supports it
+inline bool copy_one_file(const std::string &source_path, const std::string &destination_path, const bool sync) {
+  if (!reflink_file(source_path, destination_path) && !copy_sparse_file(source_path, destination_path)) {
+    return false;
+  }
+  return !sync || fsync(destination_path);
+}
+
+} // namespace parallel_file_operation_detail
+
+/// \brief Copies files in parallel.
+/// Files are cloned (reflink) if supported; otherwise, copied keeping their holes.
+/// \param files Pairs of the source and destination paths
+/// \param num_threads The number of threads; if 0, uses the number of hardware threads
+/// \param sync If true, flushes the copied files
+/// \param progress Called after each file is copied, if not empty
+/// \return Returns true on success; otherwise, false.
+inline bool copy_files_parallel(const std::vector<std::pair<std::string, std::string>> &files,
+                                const std::size_t num_threads, const bool sync,
+                                const file_operation_progress_handler &progress = {}) {
+  return parallel_file_operation_detail::for_each_parallel(
+      files.size(), num_threads,
+      [&](const std::size_t i) {
+        return parallel_file_operation_detail::copy_one_file(files[i].first, files[i].second, sync);
+      },
+      progress);
+}
+
+/// \brief Removes files in parallel. Missing files are ignored.
+/// \param num_threads The number of threads; if 0, uses the number of hardware threads
+/// \param progress Called after each file is removed, if not empty
+/// \return Returns true on success; otherwise, false.
+inline bool remove_files_parallel(const std::vector<std::string> &files, const std::size_t num_threads,
+                                  const file_operation_progress_handler &progress = {}) {
+  return parallel_file_operation_detail::for_each_parallel(
+      files.size(), num_threads,
+      [&](const std::size_t i) {
+        if (::unlink(files[i].c_str()) != 0 && errno != ENOENT) {
+          ::perror("unlink");
+          std::cerr << "Failed to remove: " << files[i] << std::endl;
+          return false;
+        }
+        return true;
+      },
+      progress);
+}
+
+/// \brief Copies a directory recursively, copying the files in parallel.
+/// Files are cloned (reflink) if supported; otherwise, copied keeping their holes.
+/// \param source_dir_path A path to the directory to copy
+/// \param destination_dir_path A path to copy to; the directory is created if it does not exist
+/// and its files are overwritten
+/// \param num_threads The number of threads; if 0, uses the number of hardware threads
+/// \param sync If true, flushes the copied files
+/// \param progress Called after each file is copied, if not empty
+/// \return Returns true on success; otherwise, false.
+inline bool copy_directory_parallel(const std::string &source_dir_path, const std::string &destination_dir_path,
+                                    const std::size_t num_threads, const bool sync,
+                                    const file_operation_progress_handler &progress = {}) {
+  std::vector<std::string> files;
+  std::vector<std::string> directories;
+  if (!parallel_file_operation_detail::list_directory_recursive(source_dir_path, &files, &directories)) {
+    return false;
+  }
+
+  // Directories are created serially in the order of the list, i.e., parents first
+  if (!directory_exist(destination_dir_path) && !create_directory(destination_dir_path)) {
+    std::cerr << "Failed to create directory: " << destination_dir_path << std::endl;
+    return false;
+  }
+  for (const auto &dir : directories) {
+    const auto path = destination_dir_path + "/" + dir;
+    if (!directory_exist(path) && !create_directory(path)) {
+      std::cerr << "Failed to create directory: " << path << std::endl;
+      return false;
+    }
+  }
+
+  std::vector<std::pair<std::string, std::string>> file_pairs;
+  file_pairs.reserve(files.size());
+  for (const auto &file : files) {
+    file_pairs.emplace_back(source_dir_path + "/" + file, destination_dir_path + "/" + file);
+  }
+  if (!copy_files_parallel(file_pairs, num_threads, sync, progress)) {
+    return false;
+  }
+
+  if (sync) {
+    // Makes the new directory entries durable
+    for (const auto &dir : directories) {
+      if (!fsync(destination_dir_path + "/" + dir)) return false;
+    }
+    return fsync_recursive(destination_dir_path);
+  }
+  return true;
+}
+
+/// \brief Removes a directory recursively, removing the files in parallel
+/// \param dir_path A path to the directory to remove
+/// \param num_threads The number of threads; if 0, uses the number of hardware threads
+/// \param progress Called after each file is removed, if not empty
+/// \return Returns true on success; otherwise, false.
+inline bool remove_directory_parallel(const std::string &dir_path, const std::size_t num_threads,
+                                      const file_operation_progress_handler &progress = {}) {
+  std::vector<std::string> files;
+  std::vector<std::string> directories;
+  if (!parallel_file_operation_detail::list_directory_recursive(dir_path, &files, &directories)) {
+    return false;
+  }
+
+  for (auto &file : files) file = dir_path + "/" + file;
+  if (!remove_files_parallel(files, num_threads, progress)) {
+    return false;
+  }
+
+  // Children are removed before their parents
+  for (auto itr = directories.rbegin(); itr != directories.rend(); ++itr) {
+    const auto path = dir_path + "/" + *itr;
+    if (::rmdir(path.c_str()) != 0 && errno != ENOENT) {
+      ::perror("rmdir");
+      std::cerr << "Failed to remove: " << path << std::endl;
+      return false;
+    }
+  }
+  if (::rmdir(dir_path.c_str()) != 0 && errno != ENOENT) {
+    ::perror("rmdir");
+    std::cerr << "Failed to remove: " << dir_path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_PARALLEL_FILE_OPERATION_HPP
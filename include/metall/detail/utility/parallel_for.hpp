@@ -0,0 +1,68 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_PARALLEL_FOR_HPP
+#define METALL_DETAIL_UTILITY_PARALLEL_FOR_HPP
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+/// \brief Returns the number of threads used when the number is not specified
+inline std::size_t default_num_threads() {
+  return std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+/// \brief Calls function(thread_no) with num_threads threads, including the calling thread,
+/// and waits for them. num_threads == 0 is treated as 1.
+template <typename function_type>
+inline void parallel_run(const std::size_t num_threads, function_type &&function) {
+  const std::size_t n = std::max(num_threads, (std::size_t)1);
+  std::vector<std::thread> threads;
+  threads.reserve(n - 1);
+  for (std::size_t t = 1; t < n; ++t) {
+    threads.emplace_back([&function, t]() { function(t); });
+  }
+  function(0);
+  for (auto &th : threads) {
+    th.join();
+  }
+}
+
+/// \brief Calls function(i) for [0, n) using up to num_threads threads.
+/// Each thread takes the next item when it finishes one, i.e., items of different costs do not make threads idle.
+/// num_threads == 0 is treated as 1.
+template <typename function_type>
+inline void parallel_for(const std::size_t n, const std::size_t num_threads, function_type &&function) {
+  if (n == 0) return;
+  std::atomic<std::size_t> next(0);
+  parallel_run(std::min(num_threads, n), [&next, n, &function](const std::size_t) {
+    for (std::size_t i = next.fetch_add(1); i < n; i = next.fetch_add(1)) {
+      function(i);
+    }
+  });
+}
+
+/// \brief Calls function(thread_no, begin, end) for num_threads disjoint, contiguous ranges of [0, n) in parallel.
+/// Some ranges can be empty. num_threads == 0 is treated as 1.
+template <typename function_type>
+inline void parallel_for_ranges(const std::size_t n, const std::size_t num_threads, function_type &&function) {
+  const std::size_t num_ranges = std::max(num_threads, (std::size_t)1);
+  parallel_run(num_ranges, [n, num_ranges, &function](const std::size_t t) {
+    function(t, n * t / num_ranges, n * (t + 1) / num_ranges);
+  });
+}
+
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_PARALLEL_FOR_HPP
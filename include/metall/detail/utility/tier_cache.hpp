@@ -0,0 +1,422 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_TIER_CACHE_HPP
+#define METALL_DETAIL_UTILITY_TIER_CACHE_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+#include <metall/detail/utility/file.hpp>
+#include <metall/detail/utility/mmap.hpp>
+#include <metall/detail/utility/futex.hpp>
+#include <metall/detail/utility/page_access_sampler.hpp>
+#include <metall/detail/utility/write_fault_handler.hpp>
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+/// \brief Caches frequently accessed parts of a file-backed memory region in files in another directory,
+/// e.g., on tmpfs or a faster device.
+/// The region is divided into units. Periodically, a background thread samples the accessed pages of each unit
+/// (see page_access_sampler) and moves the hottest units into the files in the hot directory,
+/// remapping them at the same addresses. Writes to a unit being moved wait until it is remapped.
+/// The original (cold) files stay the persistent copy; write_back() copies the hot units back to them.
+class tier_cache {
+ public:
+  /// \brief Returns false to skip a migration round, e.g., while the region is write-protected by another component
+  using migration_filter = std::function<bool()>;
+
+  /// \brief Called with the offset and the length of a unit before it is remapped
+  using remap_handler = std::function<void(std::size_t, std::size_t)>;
+
+  /// \brief Constructor
+  /// \param unit_size The size of a unit; must be a multiple of the page size
+  explicit tier_cache(const std::size_t unit_size)
+      : m_unit_size(unit_size) {}
+
+  ~tier_cache() {
+    stop();
+  }
+
+  tier_cache(const tier_cache &) = delete;
+  tier_cache &operator=(const tier_cache &) = delete;
+
+  /// \brief Starts caching the units of the files added by add_file().
+  /// \param region The address of the region
+  /// \param hot_dir_path A path to the directory to store hot units in; created if it does not exist
+  /// \param capacity The maximum total size of the hot units
+  /// \param interval_ms The interval of the migration rounds in milliseconds
+  /// \param can_migrate Checked at each migration round
+  /// \param on_remap Called before a unit is remapped
+  /// \return Returns true on success; otherwise, false.
+  bool start(void *const region, const std::string &hot_dir_path, const std::size_t capacity,
+             const std::size_t interval_ms, migration_filter can_migrate, remap_handler on_remap) {
+    if (m_running) return false;
+    if (!directory_exist(hot_dir_path) && !create_directory(hot_dir_path)) {
+      std::cerr << "Failed to create directory: " << hot_dir_path << std::endl;
+      return false;
+    }
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_region = static_cast<char *>(region);
+    m_hot_dir_path = hot_dir_path;
+    m_capacity = capacity;
+    m_interval_ms = interval_ms;
+    m_can_migrate = std::move(can_migrate);
+    m_on_remap = std::move(on_remap);
+    m_hot_size = 0;
+    if (!register_write_fault_handler(&m_guard)) return false;
+    m_sampler = std::make_unique<page_access_sampler>();
+    m_stop = false;
+    m_running = true;
+    m_migrator = std::thread([this]() { priv_run_migrator(); });
+    return true;
+  }
+
+  /// \brief Stops caching; moves all hot units back to the cold files and removes the files in the hot directory.
+  /// \return Returns true on success; otherwise, false.
+  bool stop() {
+    if (!m_running) return false;
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+    m_migrator.join();
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    bool ret = true;
+    for (auto &unit : m_units) {
+      if (unit.hot) ret &= priv_migrate(unit, false);
+    }
+    for (auto &f : m_files) {
+      if (f.hot_fd != -1) {
+        ret &= os_close(f.hot_fd);
+        ret &= remove_file(priv_make_hot_file_name(f.path));
+      }
+      if (f.cold_fd != -1) ret &= os_close(f.cold_fd);
+      f.hot_fd = -1;
+      f.cold_fd = -1;
+    }
+    for (auto &u : m_units) u.heat = 0;
+    unregister_write_fault_handler(&m_guard);
+    m_sampler.reset();
+    m_running = false;
+    return ret;
+  }
+
+  /// \brief Returns true if start() has been called and stop() has not
+  bool running() const {
+    return m_running;
+  }
+
+  /// \brief Adds a cold file mapped in the region and divides it into units.
+  /// Files can be added regardless of whether caching is running.
+  /// The hot file of a cold file has the same name in the hot directory.
+  /// \param file_path The path of the cold file
+  /// \param offset The offset in the region the file is mapped at
+  /// \param size The size of the file
+  void add_file(const std::string &file_path, const std::size_t offset, const std::size_t size) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    const std::size_t file_no = m_files.size();
+    m_files.emplace_back(file{file_path, size, -1, -1});
+    for (std::size_t off = 0; off < size; off += m_unit_size) {
+      m_units.emplace_back(unit{file_no, off, offset + off, std::min(m_unit_size, size - off), 0, false});
+    }
+  }
+
+  /// \brief Stops caching and forgets the files added so far
+  bool reset() {
+    const bool ret = !m_running || stop();
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_files.clear();
+    m_units.clear();
+    return ret;
+  }
+
+  /// \brief Returns the total size of the hot units
+  std::size_t hot_size() const {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_hot_size;
+  }
+
+  /// \brief Prevents units from being moved until the returned lock is released
+  std::unique_lock<std::mutex> hold() {
+    return std::unique_lock<std::mutex>(m_mutex);
+  }
+
+  /// \brief Makes writes to the last moved unit fail instead of waiting for the migration,
+  /// e.g., before the region is write-protected by another component
+  void clear_guard() {
+    m_guard.clear();
+  }
+
+  /// \brief Copies the hot units into the cold files. The caller must hold the lock returned by hold().
+  /// \param sync If true, synchronizes the cold files
+  /// \return Returns true on success; otherwise, false.
+  bool write_back(const bool sync) {
+    bool ret = true;
+    std::vector<bool> written(m_files.size(), false);
+    for (const auto &unit : m_units) {
+      if (!unit.hot) continue;
+      ret &= priv_copy_file_range(m_files[unit.file_no].hot_fd, priv_cold_fd(unit.file_no),
+                                  unit.file_offset, unit.length);
+      written[unit.file_no] = true;
+    }
+    for (std::size_t n = 0; n < written.size() && sync; ++n) {
+      if (written[n]) ret &= os_fsync(m_files[n].cold_fd);
+    }
+    return ret;
+  }
+
+ private:
+  struct file {
+    std::string path;
+    std::size_t size;
+    int hot_fd; // -1 if not created
+    int cold_fd; // -1 if not opened
+  };
+
+  struct unit {
+    std::size_t file_no;
+    std::size_t file_offset;
+    std::size_t offset; // Offset in the region
+    std::size_t length;
+    std::size_t heat;
+    bool hot;
+  };
+
+  /// \brief Makes writes to a unit being moved wait until it is remapped
+  class migration_guard : public write_fault_handler {
+   public:
+    void begin(char *const addr, const std::size_t length) {
+      m_migrating.store(1);
+      m_end.store(addr + length);
+      m_begin.store(addr);
+    }
+
+    void end() {
+      m_migrating.store(0);
+      futex_wake_all(&m_migrating);
+    }
+
+    void clear() {
+      m_begin.store(nullptr);
+      m_end.store(nullptr);
+    }
+
+    bool handle_write_fault(void *const addr) override {
+      const char *const a = static_cast<char *>(addr);
+      if (a < m_begin.load() || m_end.load() <= a) return false;
+      // The range is kept after the migration so that faults raised during it are retried
+      while (m_migrating.load() == 1) futex_wait(&m_migrating, 1);
+      return true;
+    }
+
+   private:
+    std::atomic<char *> m_begin{nullptr};
+    std::atomic<char *> m_end{nullptr};
+    std::atomic<uint32_t> m_migrating{0};
+  };
+
+  std::string priv_make_hot_file_name(const std::string &file_path) const {
+    return m_hot_dir_path + "/" + file_path.substr(file_path.find_last_of('/') + 1);
+  }
+
+  /// \brief Returns the file descriptor of a file in the hot directory; creates the file if needed
+  int priv_hot_fd(const std::size_t file_no) {
+    auto &f = m_files[file_no];
+    if (f.hot_fd != -1) return f.hot_fd;
+    const auto file_name = priv_make_hot_file_name(f.path);
+    const int fd = ::open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1 || ::ftruncate(fd, f.size) == -1) {
+      ::perror("open/ftruncate");
+      std::cerr << "Failed to create a file: " << file_name << std::endl;
+      if (fd != -1) os_close(fd);
+      return -1;
+    }
+    f.hot_fd = fd;
+    return fd;
+  }
+
+  int priv_cold_fd(const std::size_t file_no) {
+    auto &f = m_files[file_no];
+    if (f.cold_fd != -1) return f.cold_fd;
+    f.cold_fd = ::open(f.path.c_str(), O_RDWR);
+    if (f.cold_fd == -1) {
+      ::perror("open");
+      std::cerr << "Failed to open a file: " << f.path << std::endl;
+    }
+    return f.cold_fd;
+  }
+
+  /// \brief Copies a range between files through the page cache, i.e., including writes to mapped pages.
+  /// Holes in the source are punched in the destination.
+  bool priv_copy_file_range(const int source_fd, const int destination_fd,
+                            const std::size_t offset, const std::size_t length) const {
+    std::vector<char> buf;
+    const off_t end = offset + length;
+    off_t off = offset;
+    while (off < end) {
+      off_t data_begin = off;
+      off_t data_end = end;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+      data_begin = ::lseek(source_fd, off, SEEK_DATA);
+      if (data_begin == -1 && errno == ENXIO) {
+        data_begin = end; // No more data
+      } else if (data_begin == -1) {
+        data_begin = off; // Not supported; copy everything
+      } else {
+        data_begin = std::min(data_begin, end);
+        data_end = ::lseek(source_fd, data_begin, SEEK_HOLE);
+        data_end = (data_end == -1) ? end : std::min(data_end, end);
+      }
+#endif
+      if (off < data_begin) {
+        free_file_space(destination_fd, off, data_begin - off);
+      }
+      for (off = data_begin; off < data_end;) {
+        ssize_t copied = -1;
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+        loff_t in = off;
+        loff_t out = off;
+        copied = ::copy_file_range(source_fd, &in, destination_fd, &out, data_end - off, 0);
+#endif
+        if (copied <= 0) { // Not supported across the file systems; use read and write
+          buf.resize(std::min<std::size_t>(data_end - off, m_unit_size));
+          copied = ::pread(source_fd, buf.data(), buf.size(), off);
+          if (copied > 0 && ::pwrite(destination_fd, buf.data(), copied, off) != copied) copied = -1;
+        }
+        if (copied <= 0) {
+          ::perror("copy");
+          return false;
+        }
+        off += copied;
+      }
+    }
+    return true;
+  }
+
+  /// \brief Moves a unit into the hot directory (promote is true) or back to the cold file.
+  /// Writes to the unit wait while it is copied and remapped.
+  bool priv_migrate(unit &u, const bool promote) {
+    const int source_fd = promote ? priv_cold_fd(u.file_no) : priv_hot_fd(u.file_no);
+    const int destination_fd = promote ? priv_hot_fd(u.file_no) : priv_cold_fd(u.file_no);
+    if (source_fd == -1 || destination_fd == -1) return false;
+
+    char *const addr = m_region + u.offset;
+    if (m_on_remap) m_on_remap(u.offset, u.length);
+    m_guard.begin(addr, u.length);
+    bool ret = mprotect_read_only(addr, u.length)
+        && priv_copy_file_range(source_fd, destination_fd, u.file_offset, u.length)
+        && os_mmap(addr, u.length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                   destination_fd, u.file_offset) != nullptr;
+    if (!ret) {
+      std::cerr << "Failed to move a unit at offset " << u.offset << std::endl;
+      mprotect_read_write(addr, u.length); // Keeps using the source
+    }
+    m_guard.end();
+    if (!ret) return false;
+
+    if (!promote) {
+      free_file_space(source_fd, u.file_offset, u.length);
+    }
+    u.hot = promote;
+    if (promote) {
+      m_hot_size += u.length;
+    } else {
+      m_hot_size -= u.length;
+    }
+    return true;
+  }
+
+  /// \brief Counts the pages of each unit accessed since the last call (see page_access_sampler)
+  void priv_sample() {
+    for (auto &u : m_units) {
+      u.heat = u.heat / 2 + m_sampler->sample(m_region + u.offset, u.length);
+    }
+    m_sampler->end_round();
+  }
+
+  /// \brief Moves the hottest units into the hot directory.
+  /// If the hot directory is full, a hot unit is swapped out only if it is much colder than the candidate.
+  void priv_migrate_hottest() {
+    std::vector<unit *> cold_units;
+    std::vector<unit *> hot_units;
+    for (auto &u : m_units) {
+      if (u.hot) {
+        hot_units.push_back(&u);
+      } else if (u.heat > 0) {
+        cold_units.push_back(&u);
+      }
+    }
+    std::sort(cold_units.begin(), cold_units.end(), [](auto *a, auto *b) { return a->heat > b->heat; });
+    std::sort(hot_units.begin(), hot_units.end(), [](auto *a, auto *b) { return a->heat < b->heat; });
+
+    std::size_t num_demoted = 0;
+    for (auto *const u : cold_units) {
+      while (m_hot_size + u->length > m_capacity && num_demoted < hot_units.size()
+          && hot_units[num_demoted]->heat * 2 < u->heat) {
+        if (!priv_migrate(*hot_units[num_demoted], false)) return;
+        ++num_demoted;
+      }
+      if (m_hot_size + u->length > m_capacity) break;
+      if (!priv_migrate(*u, true)) return;
+    }
+  }
+
+  void priv_run_migrator() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_cv.wait_for(lock, std::chrono::milliseconds(m_interval_ms), [this] { return m_stop; })) {
+      if (m_can_migrate && !m_can_migrate()) continue;
+      priv_sample();
+      priv_migrate_hottest();
+    }
+  }
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::thread m_migrator;
+  bool m_stop{false};
+  std::atomic<bool> m_running{false};
+  char *m_region{nullptr};
+  std::string m_hot_dir_path;
+  std::size_t m_capacity{0};
+  const std::size_t m_unit_size;
+  std::size_t m_interval_ms{0};
+  std::size_t m_hot_size{0};
+  migration_filter m_can_migrate;
+  remap_handler m_on_remap;
+  std::vector<file> m_files;
+  std::vector<unit> m_units;
+  migration_guard m_guard;
+  std::unique_ptr<page_access_sampler> m_sampler;
+};
+
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_TIER_CACHE_HPP
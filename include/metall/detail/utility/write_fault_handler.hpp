@@ -0,0 +1,166 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_WRITE_FAULT_HANDLER_HPP
+#define METALL_DETAIL_UTILITY_WRITE_FAULT_HANDLER_HPP
+
+#include <signal.h>
+#include <sched.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+
+#include <metall/detail/utility/futex.hpp>
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+/// \brief Interface of objects that write-protect memory regions and handle the write faults (SIGSEGV) in them.
+/// Handlers are registered to a process-wide dispatcher; every registered handler is called for each fault.
+class write_fault_handler {
+ public:
+  virtual ~write_fault_handler() = default;
+
+  /// \brief Called in the signal handler; must be async-signal-safe.
+  /// \param addr The faulted address
+  /// \return Returns true if the fault happened in a region the handler protects;
+  /// the faulted access is retried if any handler returns true.
+  virtual bool handle_write_fault(void *addr) = 0;
+};
+
+namespace detail {
+class write_fault_dispatcher {
+ public:
+  static constexpr int k_max_num_handlers = 64;
+
+  static write_fault_dispatcher &instance() {
+    static write_fault_dispatcher dispatcher;
+    return dispatcher;
+  }
+
+  bool add(write_fault_handler *const handler) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (!priv_install()) return false;
+    for (auto &slot : m_handlers) {
+      write_fault_handler *expected = nullptr;
+      if (slot.compare_exchange_strong(expected, handler)) return true;
+    }
+    return false;
+  }
+
+  void remove(write_fault_handler *const handler) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    for (auto &slot : m_handlers) {
+      write_fault_handler *expected = handler;
+      slot.compare_exchange_strong(expected, nullptr);
+    }
+    while (m_num_running.load() > 0) ::sched_yield(); // Wait for the running dispatches that could see the handler
+  }
+
+  bool freeze() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (!priv_install()) return false;
+    ++m_num_freezes;
+    return true;
+  }
+
+  void thaw() {
+    if (m_num_freezes.fetch_sub(1) == 1) {
+      futex_wake_all(&m_num_freezes);
+    }
+  }
+
+ private:
+  write_fault_dispatcher() = default;
+
+  bool priv_install() {
+    if (m_installed) return true;
+    struct sigaction action{};
+    action.sa_sigaction = dispatch;
+    ::sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    if (::sigaction(SIGSEGV, &action, &m_previous_action) == -1) {
+      ::perror("sigaction");
+      return false;
+    }
+    m_installed = true; // Keep it installed as other handlers could have been installed on top of it
+    return true;
+  }
+
+  static void dispatch(const int signal, siginfo_t *const info, void *const context) {
+    auto &self = instance();
+    const int saved_errno = errno;
+    // Handlers see the protection made by the freezing thread only after it is done
+    for (uint32_t n = self.m_num_freezes.load(); n != 0; n = self.m_num_freezes.load()) {
+      futex_wait(&self.m_num_freezes, n);
+    }
+    ++self.m_num_running;
+    bool handled = false;
+    for (auto &slot : self.m_handlers) {
+      if (auto *const handler = slot.load()) {
+        handled |= handler->handle_write_fault(info->si_addr);
+      }
+    }
+    --self.m_num_running;
+    errno = saved_errno;
+    if (handled) return;
+
+    // Not caused by the handlers; forward to the previous handler
+    const auto &previous = self.m_previous_action;
+    if (previous.sa_flags & SA_SIGINFO) {
+      previous.sa_sigaction(signal, info, context);
+    } else if (previous.sa_handler == SIG_DFL || previous.sa_handler == SIG_IGN) {
+      ::signal(signal, SIG_DFL); // The fault happens again with the default action
+    } else {
+      previous.sa_handler(signal);
+    }
+  }
+
+  std::mutex m_mutex;
+  bool m_installed{false};
+  struct sigaction m_previous_action{};
+  std::atomic<write_fault_handler *> m_handlers[k_max_num_handlers]{};
+  std::atomic<int> m_num_running{0};
+  std::atomic<uint32_t> m_num_freezes{0};
+};
+} // namespace detail
+
+/// \brief Registers a write fault handler.
+/// Installs the SIGSEGV handler of the dispatcher at the first call.
+/// \return Returns true on success; otherwise, false.
+inline bool register_write_fault_handler(write_fault_handler *const handler) {
+  return detail::write_fault_dispatcher::instance().add(handler);
+}
+
+/// \brief Unregisters a write fault handler.
+/// When this function returns, the handler is not called anymore.
+inline void unregister_write_fault_handler(write_fault_handler *const handler) {
+  detail::write_fault_dispatcher::instance().remove(handler);
+}
+
+/// \brief Makes write faults wait (sleep) until thaw_write_faults() is called,
+/// e.g., while a region is write-protected to be flushed.
+/// Then, the handlers are called with the protection made in the meantime.
+/// Faults in any region, including unrelated ones, wait;
+/// the calling thread must not write to protected regions until it calls thaw_write_faults().
+/// \return Returns true on success; otherwise, false.
+inline bool freeze_write_faults() {
+  return detail::write_fault_dispatcher::instance().freeze();
+}
+
+/// \brief Lets the write faults held by freeze_write_faults() go on
+inline void thaw_write_faults() {
+  detail::write_fault_dispatcher::instance().thaw();
+}
+
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_WRITE_FAULT_HANDLER_HPP
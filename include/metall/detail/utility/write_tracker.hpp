@@ -0,0 +1,194 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_UTILITY_WRITE_TRACKER_HPP
+#define METALL_DETAIL_UTILITY_WRITE_TRACKER_HPP
+
+#include <sys/mman.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <algorithm>
+
+#include <metall/detail/utility/common.hpp>
+#include <metall/detail/utility/memory.hpp>
+#include <metall/detail/utility/mmap.hpp>
+#include <metall/detail/utility/write_fault_handler.hpp>
+
+namespace metall {
+namespace detail {
+namespace utility {
+
+/// \brief Tracks the parts of a memory region written since a point using write protection.
+/// The region is divided into granules; a clean granule is write-protected and
+/// becomes dirty (and writable) at the first write fault.
+/// Unlike the soft-dirty bits, the dirty state is not lost when the kernel reclaims file-backed pages.
+/// System calls that write into a clean granule (e.g., read(2)) fail with EFAULT instead of raising a fault.
+class write_tracker : public write_fault_handler {
+ public:
+  /// \brief Constructor
+  /// \param region The address of the region; must be page aligned
+  /// \param capacity The maximum size of the region
+  /// \param granularity The size of a granule; must be a multiple of the page size
+  write_tracker(void *const region, const std::size_t capacity, const std::size_t granularity)
+      : m_region(static_cast<char *>(region)),
+        m_granularity(granularity),
+        m_max_num_granules((capacity + granularity - 1) / granularity),
+        m_num_tracked_granules(0),
+        m_states(nullptr),
+        m_active(false) {
+    // Pages of the state array are committed lazily; zero means dirty
+    m_states = static_cast<std::atomic<uint8_t> *>(map_anonymous_write_mode(nullptr, priv_states_size()));
+  }
+
+  ~write_tracker() override {
+    stop();
+    if (m_states) {
+      munmap(m_states, priv_states_size(), false);
+    }
+  }
+
+  write_tracker(const write_tracker &) = delete;
+  write_tracker &operator=(const write_tracker &) = delete;
+  write_tracker(write_tracker &&) = delete;
+  write_tracker &operator=(write_tracker &&) = delete;
+
+  /// \brief Starts handling write faults. All granules are dirty at first.
+  /// \return Returns true on success; otherwise, false.
+  bool start() {
+    if (!m_states) return false;
+    if (!m_active) {
+      m_active = register_write_fault_handler(this);
+    }
+    return m_active;
+  }
+
+  /// \brief Makes the granules in [0, size) writable and stops handling write faults.
+  void stop() {
+    if (!m_active) return;
+    priv_protect_clean_granules(false);
+    unregister_write_fault_handler(this);
+    m_active = false;
+    m_num_tracked_granules = 0;
+  }
+
+  bool active() const {
+    return m_active;
+  }
+
+  /// \brief Marks the granules in [0, size) as clean and write-protects them.
+  /// Must not be called while the region is written.
+  /// \param size The size of the region to track; granules beyond it are always dirty
+  /// \return Returns true on success; otherwise, false.
+  bool clean(const std::size_t size) {
+    if (!m_active) return false;
+    const std::size_t num_granules = std::min(size / m_granularity, m_max_num_granules);
+    for (std::size_t i = num_granules; i < m_num_tracked_granules; ++i) {
+      m_states[i].store(k_dirty);
+    }
+    for (std::size_t i = 0; i < num_granules; ++i) {
+      m_states[i].store(k_clean);
+    }
+    m_num_tracked_granules = num_granules;
+    if (num_granules > 0 && !mprotect_read_only(m_region, num_granules * m_granularity)) {
+      mark_all_dirty();
+      return false;
+    }
+    return true;
+  }
+
+  /// \brief Returns true if a granule could have been written since the last clean()
+  bool dirty(const std::size_t granule_no) const {
+    return granule_no >= m_num_tracked_granules || m_states[granule_no].load() == k_dirty;
+  }
+
+  /// \brief Marks granules as dirty, e.g., their contents are changed without writes.
+  /// Makes the clean ones writable; the protection of the dirty ones is not changed.
+  void mark_dirty(const std::size_t offset, const std::size_t length) {
+    if (length == 0) return;
+    const std::size_t last = std::min((offset + length - 1) / m_granularity + 1, m_num_tracked_granules);
+    for (std::size_t i = offset / m_granularity; i < last; ++i) {
+      if (m_states[i].exchange(k_dirty) == k_clean) {
+        mprotect_read_write(m_region + i * m_granularity, m_granularity);
+      }
+    }
+  }
+
+  /// \brief Marks all granules as dirty and makes them writable
+  /// \param make_writable If false, the protection is left to the caller, e.g., another handler protects the region
+  void mark_all_dirty(const bool make_writable = true) {
+    for (std::size_t i = 0; i < m_num_tracked_granules; ++i) {
+      m_states[i].store(k_dirty);
+    }
+    if (make_writable) {
+      priv_protect_clean_granules(false);
+    }
+  }
+
+  /// \brief Write-protects the clean granules again, e.g., after the protection of the region was changed.
+  /// Must not be called while the region is written.
+  bool protect_clean_granules() {
+    return priv_protect_clean_granules(true);
+  }
+
+  std::size_t granularity() const {
+    return m_granularity;
+  }
+
+  bool handle_write_fault(void *const addr) override {
+    const auto offset = static_cast<char *>(addr) - m_region;
+    if (offset < 0) return false;
+    const std::size_t granule_no = offset / m_granularity;
+    if (granule_no >= m_num_tracked_granules) return false;
+    if (m_states[granule_no].exchange(k_dirty) == k_clean) {
+      ::mprotect(m_region + granule_no * m_granularity, m_granularity, PROT_READ | PROT_WRITE);
+    }
+    // A dirty granule is writable unless another thread is unprotecting it or another handler protects it;
+    // the access is retried in either case
+    return true;
+  }
+
+ private:
+  static constexpr uint8_t k_dirty = 0;
+  static constexpr uint8_t k_clean = 1;
+
+  std::size_t priv_states_size() const {
+    return std::max((std::size_t)round_up(m_max_num_granules, get_page_size()), (std::size_t)get_page_size());
+  }
+
+  /// \brief Changes the protection of the clean granules; the others are made writable
+  bool priv_protect_clean_granules(const bool protect) {
+    if (m_num_tracked_granules == 0) return true;
+    if (!mprotect_read_write(m_region, m_num_tracked_granules * m_granularity)) return false;
+    if (!protect) return true;
+
+    bool ret = true;
+    for (std::size_t first = 0; first < m_num_tracked_granules;) {
+      if (m_states[first].load() != k_clean) {
+        ++first;
+        continue;
+      }
+      std::size_t last = first;
+      while (last + 1 < m_num_tracked_granules && m_states[last + 1].load() == k_clean) ++last;
+      ret &= mprotect_read_only(m_region + first * m_granularity, (last - first + 1) * m_granularity);
+      first = last + 1;
+    }
+    return ret;
+  }
+
+  char *const m_region;
+  const std::size_t m_granularity;
+  const std::size_t m_max_num_granules;
+  std::size_t m_num_tracked_granules;
+  std::atomic<uint8_t> *m_states;
+  bool m_active;
+};
+
+} // namespace utility
+} // namespace detail
+} // namespace metall
+
+#endif //METALL_DETAIL_UTILITY_WRITE_TRACKER_HPP
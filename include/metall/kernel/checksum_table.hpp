@@ -0,0 +1,279 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_KERNEL_CHECKSUM_TABLE_HPP
+#define METALL_KERNEL_CHECKSUM_TABLE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+
+#include <metall/detail/utility/file.hpp>
+#include <metall/detail/utility/crc32c.hpp>
+#include <metall/detail/utility/parallel_for.hpp>
+
+namespace metall {
+namespace kernel {
+
+namespace {
+namespace util = metall::detail::utility;
+}
+
+/// \brief Checksums (CRC32C) of the application data segment and the management data files of a data store.
+/// The segment is divided into blocks of a fixed size; each block has its own checksum
+/// so that only modified blocks are rehashed and corrupted blocks are pinpointed.
+/// Checksums are computed using multiple threads.
+class checksum_table {
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Public types and static values
+  // -------------------------------------------------------------------------------- //
+  using checksum_type = uint32_t;
+
+  // -------------------------------------------------------------------------------- //
+  // Constructor & assign operator
+  // -------------------------------------------------------------------------------- //
+  explicit checksum_table(const std::size_t block_size)
+      : m_block_size(block_size),
+        m_block_checksums(),
+        m_file_checksums() {}
+
+  ~checksum_table() = default;
+  checksum_table(const checksum_table &) = default;
+  checksum_table(checksum_table &&) noexcept = default;
+  checksum_table &operator=(const checksum_table &) = default;
+  checksum_table &operator=(checksum_table &&) noexcept = default;
+
+  // -------------------------------------------------------------------------------- //
+  // Public methods
+  // -------------------------------------------------------------------------------- //
+  /// \brief Computes the checksums of segment blocks.
+  /// \param segment The address of the segment
+  /// \param segment_size The size of the segment; the remainder of the block size is ignored
+  /// \param need_update A function that takes a block number and returns true if the block has to be rehashed;
+  /// blocks that do not have a checksum yet are always hashed
+  /// \param num_threads The number of threads to use
+  template <typename predicate_type>
+  void update_blocks(const void *const segment, const std::size_t segment_size, predicate_type &&need_update,
+                     const std::size_t num_threads) {
+    const std::size_t num_blocks = segment_size / m_block_size;
+    const std::size_t num_old_blocks = std::min(m_block_checksums.size(), num_blocks);
+    m_block_checksums.resize(num_blocks, 0);
+
+    std::vector<std::size_t> targets;
+    for (std::size_t block_no = 0; block_no < num_blocks; ++block_no) {
+      if (block_no >= num_old_blocks || need_update(block_no)) {
+        targets.push_back(block_no);
+      }
+    }
+    compute_blocks(segment, targets, num_threads, [this](const std::size_t block_no, const checksum_type checksum) {
+      m_block_checksums[block_no] = checksum;
+    });
+  }
+
+  /// \brief Computes and records the checksum of a file
+  /// \param name The name to record the checksum with
+  /// \param path The path to the file
+  /// \return Returns true on success; otherwise, false.
+  bool update_file(const std::string &name, const std::string &path) {
+    checksum_type checksum;
+    if (!compute_file(path, &checksum)) {
+      return false;
+    }
+    m_file_checksums[name] = checksum;
+    return true;
+  }
+
+  std::size_t block_size() const {
+    return m_block_size;
+  }
+
+  std::size_t num_blocks() const {
+    return m_block_checksums.size();
+  }
+
+  checksum_type block_checksum(const std::size_t block_no) const {
+    return m_block_checksums[block_no];
+  }
+
+  const std::map<std::string, checksum_type> &file_checksums() const {
+    return m_file_checksums;
+  }
+
+  void clear() {
+    m_block_checksums.clear();
+    m_file_checksums.clear();
+  }
+
+  /// \brief Compares the checksums of segment blocks and files with the actual data.
+  /// \param segment The address of the segment
+  /// \param segment_size The size of the segment
+  /// \param make_file_path A function that takes a name given to update_file() and returns the path to the file
+  /// \param num_threads The number of threads to use
+  /// \return Returns true if all checksums match; otherwise, false.
+  template <typename path_function_type>
+  bool verify(const void *const segment, const std::size_t segment_size, path_function_type &&make_file_path,
+              const std::size_t num_threads) const {
+    bool ret = true;
+    if (segment_size / m_block_size != m_block_checksums.size()) {
+      std::cerr << "The segment size does not match: " << segment_size << " bytes vs "
+                << m_block_checksums.size() << " blocks" << std::endl;
+      return false;
+    }
+
+    std::vector<std::size_t> targets(m_block_checksums.size());
+    for (std::size_t i = 0; i < targets.size(); ++i) targets[i] = i;
+    std::vector<std::size_t> corrupted_blocks;
+    std::mutex mutex;
+    compute_blocks(segment, targets, num_threads,
+                   [this, &corrupted_blocks, &mutex](const std::size_t block_no, const checksum_type checksum) {
+                     if (checksum != m_block_checksums[block_no]) {
+                       std::lock_guard<std::mutex> guard(mutex);
+                       corrupted_blocks.push_back(block_no);
+                     }
+                   });
+    std::sort(corrupted_blocks.begin(), corrupted_blocks.end());
+    for (const auto block_no : corrupted_blocks) {
+      std::cerr << "Checksum mismatch in segment block " << block_no
+                << " (offset " << block_no * m_block_size << ")" << std::endl;
+      ret = false;
+    }
+
+    for (const auto &[name, expected] : m_file_checksums) {
+      checksum_type checksum;
+      if (!compute_file(make_file_path(name), &checksum) || checksum != expected) {
+        std::cerr << "Checksum mismatch in " << name << std::endl;
+        ret = false;
+      }
+    }
+
+    return ret;
+  }
+
+  /// \brief Writes the checksums to a file
+  /// \param path The path to the file
+  /// \return Returns true on success; otherwise, false.
+  bool serialize(const std::string &path) const {
+    std::ofstream ofs(path);
+    if (!ofs.is_open()) {
+      std::cerr << "Cannot open: " << path << std::endl;
+      return false;
+    }
+
+    ofs << m_block_size << " " << m_block_checksums.size() << " " << m_file_checksums.size() << "\n";
+    for (const auto checksum : m_block_checksums) {
+      ofs << checksum << "\n";
+    }
+    for (const auto &[name, checksum] : m_file_checksums) {
+      ofs << name << " " << checksum << "\n";
+    }
+    ofs.close();
+    if (!ofs) {
+      std::cerr << "Failed to write checksums: " << path << std::endl;
+      return false;
+    }
+
+    return util::fsync(path);
+  }
+
+  /// \brief Reads checksums from a file
+  /// \param path The path to the file
+  /// \return Returns true on success; otherwise, false.
+  bool deserialize(const std::string &path) {
+    std::ifstream ifs(path);
+    if (!ifs.is_open()) {
+      std::cerr << "Cannot open: " << path << std::endl;
+      return false;
+    }
+
+    std::size_t block_size;
+    std::size_t num_blocks;
+    std::size_t num_files;
+    if (!(ifs >> block_size >> num_blocks >> num_files)) {
+      std::cerr << "Cannot read a file: " << path << std::endl;
+      return false;
+    }
+    if (block_size != m_block_size) {
+      std::cerr << "Block size does not match: " << block_size << " != " << m_block_size << std::endl;
+      return false;
+    }
+
+    clear();
+    m_block_checksums.resize(num_blocks);
+    for (auto &checksum : m_block_checksums) {
+      if (!(ifs >> checksum)) {
+        std::cerr << "Cannot read a file: " << path << std::endl;
+        clear();
+        return false;
+      }
+    }
+    for (std::size_t i = 0; i < num_files; ++i) {
+      std::string name;
+      checksum_type checksum;
+      if (!(ifs >> name >> checksum)) {
+        std::cerr << "Cannot read a file: " << path << std::endl;
+        clear();
+        return false;
+      }
+      m_file_checksums[name] = checksum;
+    }
+
+    return true;
+  }
+
+ private:
+  // -------------------------------------------------------------------------------- //
+  // Private methods
+  // -------------------------------------------------------------------------------- //
+  /// \brief Computes the checksums of blocks in parallel.
+  /// Threads take consecutive blocks so that the data is read sequentially.
+  template <typename callback_type>
+  void compute_blocks(const void *const segment, const std::vector<std::size_t> &targets,
+                      const std::size_t num_threads, callback_type &&callback) const {
+    const auto *const base = static_cast<const char *>(segment);
+    util::parallel_for(targets.size(), num_threads, [&](const std::size_t i) {
+      const std::size_t block_no = targets[i];
+      callback(block_no, util::crc32c(base + block_no * m_block_size, m_block_size));
+    });
+  }
+
+  static bool compute_file(const std::string &path, checksum_type *const checksum) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs.is_open()) {
+      std::cerr << "Cannot open: " << path << std::endl;
+      return false;
+    }
+    std::vector<char> buf(1ULL << 20ULL);
+    checksum_type crc = 0;
+    while (ifs) {
+      ifs.read(buf.data(), buf.size());
+      crc = util::crc32c(buf.data(), ifs.gcount(), crc);
+    }
+    if (ifs.bad()) {
+      std::cerr << "Failed to read: " << path << std::endl;
+      return false;
+    }
+    *checksum = crc;
+    return true;
+  }
+
+  // -------------------------------------------------------------------------------- //
+  // Private fields
+  // -------------------------------------------------------------------------------- //
+  std::size_t m_block_size;
+  std::vector<checksum_type> m_block_checksums;
+  std::map<std::string, checksum_type> m_file_checksums;
+};
+
+} // namespace kernel
+} // namespace metall
+
+#endif //METALL_KERNEL_CHECKSUM_TABLE_HPP
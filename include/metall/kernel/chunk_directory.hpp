@@ -12,6 +12,7 @@
 #include <fstream>
 #include <cassert>
 #include <memory>
+#include <utility>
 
 #include <metall/detail/utility/common.hpp>
 #include <metall/detail/utility/mmap.hpp>
@@ -121,6 +122,21 @@ class chunk_directory {
     m_end_chunk_no = 0;
   }
 
+  /// \brief Exchanges the contents with another chunk directory.
+  /// \param other Another chunk directory
+  void swap(chunk_directory &other) noexcept {
+    using std::swap;
+    swap(m_table, other.m_table);
+    swap(m_max_num_chunks, other.m_max_num_chunks);
+    swap(m_end_chunk_no, other.m_end_chunk_no);
+    swap(m_multilayer_bitset_allocator, other.m_multilayer_bitset_allocator);
+  }
+
+  /// \brief Returns a copy of the allocator.
+  allocator_type get_allocator() const {
+    return allocator_type(m_multilayer_bitset_allocator);
+  }
+
   /// \brief
   /// \param bin_no
   /// \return
@@ -138,6 +154,37 @@ class chunk_directory {
     return inserted_chunk_no;
   }
 
+  /// \brief Inserts a chunk at the given position, e.g., to redo an operation.
+  /// Existing chunks in the range are overwritten.
+  /// \param chunk_no The (head) chunk number to insert
+  /// \param bin_no
+  void insert_at(const chunk_no_type chunk_no, const bin_no_type bin_no) {
+    const std::size_t num_chunks = (bin_no < bin_no_mngr::num_small_bins()) ? 1 :
+                                   (bin_no_mngr::to_object_size(bin_no) + k_chunk_size - 1) / k_chunk_size;
+    if (chunk_no + num_chunks > m_max_num_chunks) {
+      std::cerr << "Chunk number is out of range: " << chunk_no << std::endl;
+      std::abort();
+    }
+
+    for (chunk_no_type offset = 0; offset < num_chunks; ++offset) {
+      auto &entry = m_table[chunk_no + offset];
+      if (entry.type == chunk_type::small_chunk) {
+        entry.slot_occupancy.free(slots(chunk_no + offset), m_multilayer_bitset_allocator);
+      }
+      entry.num_occupied_slots = 0;
+      entry.bin_no = bin_no;
+      entry.type = (offset == 0) ? chunk_type::large_chunk_head : chunk_type::large_chunk_tail;
+    }
+
+    if (bin_no < bin_no_mngr::num_small_bins()) {
+      m_table[chunk_no].type = chunk_type::small_chunk;
+      m_table[chunk_no].slot_occupancy.allocate(calc_num_slots(bin_no_mngr::to_object_size(bin_no)),
+                                                m_multilayer_bitset_allocator);
+    }
+
+    m_end_chunk_no = std::max(static_cast<std::size_t>(chunk_no) + num_chunks, m_end_chunk_no);
+  }
+
   /// \brief
   /// \param chunk_no
   void erase(const chunk_no_type chunk_no) {
@@ -189,6 +236,20 @@ class chunk_directory {
     return empty_slot_no;
   }
 
+  /// \brief Marks the given slot, e.g., to redo an operation.
+  /// \param chunk_no
+  /// \param slot_no
+  /// \return Returns false if the slot has already been marked
+  bool mark_slot(const chunk_no_type chunk_no, const slot_no_type slot_no) {
+    assert(chunk_no < size());
+    assert(m_table[chunk_no].type == chunk_type::small_chunk);
+
+    if (slot_marked(chunk_no, slot_no)) return false;
+    m_table[chunk_no].slot_occupancy.set(slots(chunk_no), slot_no);
+    ++m_table[chunk_no].num_occupied_slots;
+    return true;
+  }
+
   /// \brief
   /// \param chunk_no
   /// \param slot_no
@@ -253,6 +314,13 @@ class chunk_directory {
     return (m_table[chunk_no].type == chunk_type::empty);
   }
 
+  /// \brief
+  /// \param chunk_no
+  /// \return Returns true if the chunk is a small chunk or the first chunk of a large object
+  bool head_chunk(const chunk_no_type chunk_no) const {
+    return (m_table[chunk_no].type == chunk_type::small_chunk || m_table[chunk_no].type == chunk_type::large_chunk_head);
+  }
+
   /// \brief
   /// \param chunk_no
   /// \return
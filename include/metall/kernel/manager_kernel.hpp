@@ -14,26 +14,42 @@
 #include <future>
 #include <vector>
 #include <map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 #include <metall/offset_ptr.hpp>
 #include <metall/kernel/manager_kernel_fwd.hpp>
 #include <metall/kernel/segment_header.hpp>
 #include <metall/kernel/segment_allocator.hpp>
 #include <metall/kernel/named_object_directory.hpp>
+#include <metall/kernel/operation_log.hpp>
+#include <metall/kernel/reachability_marker.hpp>
+#include <metall/kernel/checksum_table.hpp>
+#include <metall/kernel/version_catalog.hpp>
 #include <metall/detail/utility/common.hpp>
 #include <metall/detail/utility/in_place_interface.hpp>
 #include <metall/detail/utility/array_construct.hpp>
 #include <metall/detail/utility/file.hpp>
 #include <metall/detail/utility/file_clone.hpp>
+#include <metall/detail/utility/parallel_file_operation.hpp>
+#include <metall/detail/utility/parallel_for.hpp>
 #include <metall/detail/utility/char_ptr_holder.hpp>
 #include <metall/detail/utility/soft_dirty_page.hpp>
+#include <metall/detail/utility/instance_lock_registry.hpp>
 
 #ifdef METALL_USE_UMAP
 #include <metall/kernel/segment_storage/umap_segment_storage.hpp>
+#elif defined(METALL_USE_USERFAULTFD)
+#include <metall/kernel/segment_storage/userfaultfd_segment_storage.hpp>
 #else
 #include <metall/kernel/segment_storage/multifile_backed_segment_storage.hpp>
 #endif
 
+#if defined(METALL_USE_COMPRESSION) && (defined(METALL_USE_UMAP) || defined(METALL_USE_USERFAULTFD))
+#error "METALL_USE_COMPRESSION is supported only by the default segment storage"
+#endif
+
 #define ENABLE_MUTEX_IN_METALL_MANAGER_KERNEL 1
 #if ENABLE_MUTEX_IN_METALL_MANAGER_KERNEL
 #include <metall/detail/utility/mutex.hpp>
@@ -64,6 +80,21 @@ class manager_kernel {
   static constexpr size_type k_chunk_size = _chunk_size;
   using internal_data_allocator_type = _internal_data_allocator_type;
 
+  using reachability_marker_type = reachability_marker<difference_type, size_type, k_chunk_size>;
+
+  using version_type = version_catalog::version_type;
+  using version_info_type = version_catalog::version_info;
+  static constexpr version_type k_no_version = version_catalog::k_no_version;
+
+  /// \brief Called with the number of processed files and the total number of files by copy() and remove()
+  using progress_handler_type = util::file_operation_progress_handler;
+
+  /// \brief How block files are placed in the directories given to create()
+  enum class stripe_placement {
+    round_robin, // Same number of blocks in each directory
+    capacity // In proportion to the available space of the file systems at creation
+  };
+
  private:
   // -------------------------------------------------------------------------------- //
   // Private types and static values
@@ -87,6 +118,8 @@ class manager_kernel {
   using segment_storage_type =
 #ifdef METALL_USE_UMAP
   umap_segment_storage<difference_type, size_type>;
+#elif defined(METALL_USE_USERFAULTFD)
+  userfaultfd_segment_storage<difference_type, size_type>;
 #else
   multifile_backed_segment_storage<difference_type, size_type>;
 #endif
@@ -104,6 +137,17 @@ class manager_kernel {
 
   static constexpr const char *k_properly_closed_mark_file_name = "properly_closed_mark";
 
+  static constexpr const char *k_operation_log_file_name = "operation_log";
+
+  static constexpr const char *k_checksum_file_name = "checksums";
+
+  // For versions
+  static constexpr const char *k_version_dir_name = "metall_versions";
+
+  // Write trackers of the segment storage
+  static constexpr size_type k_checksum_write_tracker = 0;
+  static constexpr size_type k_version_write_tracker = 1;
+
 #if ENABLE_MUTEX_IN_METALL_MANAGER_KERNEL
   using mutex_type = util::mutex;
   using lock_guard_type = util::mutex_lock_guard;
@@ -132,10 +176,57 @@ class manager_kernel {
   void create(const char *base_dir_path, size_type vm_reserve_size = k_default_vm_reserve_size);
 
   /// \brief Expect to be called by a single thread
+  /// The block files of the application data are striped over multiple directories, e.g., one per device,
+  /// so that synchronization, snapshots, and page-ins use the bandwidth of all of them.
+  /// The management data is stored in base_dir_path.
+  /// \param base_dir_path
+  /// \param stripe_dir_paths The directories to place the block files (in a subdirectory unique to the data store)
+  /// \param placement How consecutive block files are placed in the directories
+  /// \param vm_reserve_size
+  void create(const char *base_dir_path, const std::vector<std::string> &stripe_dir_paths,
+              stripe_placement placement, size_type vm_reserve_size = k_default_vm_reserve_size);
+
+  /// \brief Expect to be called by a single thread
+  /// In the read-only mode, only the named object directory is loaded;
+  /// the allocator state is loaded on demand, e.g., by profile().
+  /// If METALL_ENABLE_OPERATION_LOG is defined and the data store was not closed properly,
+  /// the management data is recovered by replaying the operation log.
   /// \param base_dir_path
   /// \return
   bool open(const char *base_dir_path, bool read_only, size_type vm_reserve_size = k_default_vm_reserve_size);
 
+  /// \brief Opens an already created data store with the read-only mode at a fixed address.
+  /// Processes that open the same data store at the same address share the page cache
+  /// and see the objects at the same addresses.
+  /// Expect to be called by a single thread
+  /// \param base_dir_path
+  /// \param vm_region_address The address to map the data store. Must be page aligned
+  /// \param populate If true, prefaults the whole segment
+  /// \return Returns false if there is no data store or the address range is already in use
+  bool open_read_only_shared(const char *base_dir_path, void *vm_region_address, bool populate);
+
+  /// \brief Opens a version of a data store with the read-only mode.
+  /// The chunks of the version are mapped from the version and its ancestors directly.
+  /// Expect to be called by a single thread
+  /// \param base_dir_path
+  /// \param version A version made by snapshot_version()
+  /// \return Returns false if the version does not exist or cannot be mapped, e.g., a file of it is missing;
+  /// the kernel is left unopened
+  bool open_version(const char *base_dir_path, version_type version);
+
+  /// \brief Rebuilds the allocator state of a data store, e.g., one that was not closed properly.
+  /// Starting from the last serialized named objects, the visitor marks all allocations reachable from them;
+  /// the other allocations are reclaimed.
+  /// Named objects constructed after the last serialization are not recovered.
+  /// Expect to be called by a single thread
+  /// \tparam visitor_type A function type that takes a reference of reachability_marker_type
+  /// \param base_dir_path
+  /// \param visitor Walks the object graphs and calls mark() of the given marker for each allocation
+  /// \param num_threads The number of threads used to rebuild the allocator state (0 uses all cores)
+  /// \return Returns true on success; otherwise, false, and the data store is left as it is
+  template <typename visitor_type>
+  bool recover(const char *base_dir_path, visitor_type &&visitor, size_type num_threads);
+
   /// \brief Expect to be called by a single thread
   void close();
 
@@ -144,6 +235,11 @@ class manager_kernel {
   /// otherwise, performs asynchronous operation.
   void flush(bool synchronous);
 
+  /// \brief Flush data to persistent memory asynchronously
+  /// \return Returns an object of std::future
+  /// If succeeded, its get() returns True; other false
+  std::future<bool> flush_async();
+
   /// \brief Allocates memory space
   /// \param nbytes
   /// \return
@@ -152,10 +248,37 @@ class manager_kernel {
   // \TODO: implement
   void *allocate_aligned(size_type nbytes, size_type alignment);
 
+  /// \brief Allocates memory space of a size known at compile time.
+  /// Unlike allocate(), the bin number is resolved at compile time.
+  /// \tparam nbytes The size to allocate
+  /// \return Returns a pointer to the allocated memory; nullptr in the read-only mode
+  template <size_type nbytes>
+  void *allocate_fixed();
+
   /// \brief Deallocates
   /// \param addr
   void deallocate(void *addr);
 
+  /// \brief Deallocates memory space whose size is known, e.g., by an STL allocator.
+  /// The bin number is computed from the size; debug builds check it against the chunk directory.
+  /// \param addr The address of the memory space
+  /// \param nbytes The size given when it was allocated
+  void deallocate(void *addr, size_type nbytes);
+
+  /// \brief What the allocation fast path of STL allocators needs to allocate without going through a kernel
+  struct fast_allocation_path_type {
+    manager_kernel *const *kernel_slot{nullptr}; // The address in the segment header that holds the kernel address
+    uint64_t generation{0};
+    segment_memory_allocator *allocator{nullptr}; // nullptr in the read-only mode
+    char *segment{nullptr};
+  };
+
+  /// \brief Resolves the fast allocation path through the kernel address stored in a segment header.
+  /// The result is cached per thread; the cache is invalidated when any kernel maps or unmaps a segment header.
+  /// \param kernel_slot The address in the segment header that holds the kernel address
+  /// \return The fast allocation path of the kernel
+  static const fast_allocation_path_type &fast_allocation_path(manager_kernel *const *kernel_slot);
+
   /// \brief Finds an already constructed object
   /// \tparam T
   /// \param name
@@ -194,29 +317,101 @@ class manager_kernel {
   /// \return
   bool snapshot(const char *destination_dir_path);
 
-  /// \brief Copies backing files synchronously
+  /// \brief Takes a snapshot asynchronously.
+  /// Allocations are blocked while the management data is captured and the segment is flushed;
+  /// writes are held in the fault handler meanwhile.
+  /// Then, the application data is copied in the background using copy-on-write so that writers can continue.
+  /// \param destination_dir_path Path to store a snapshot
+  /// \return Returns an object of std::future
+  /// If succeeded, its get() returns True; other false
+  std::future<bool> snapshot_async(const char *destination_dir_path);
+
+  /// \brief Records the current state as a new version in the version catalog of the data store.
+  /// If METALL_ENABLE_VERSION_TRACKING is defined, only the chunks modified since the parent version,
+  /// i.e., the last version made from this data store, are stored; otherwise, all chunks are stored.
+  /// Allocations and writes must be stopped until this function returns.
+  /// \param version If not nullptr, the number of the new version is stored
+  /// \return Returns true on success; otherwise, false.
+  bool snapshot_version(version_type *version);
+
+  /// \brief Starts caching frequently accessed chunks of the application data in another directory,
+  /// e.g., on tmpfs or a faster device. The data store stays the persistent copy.
+  /// \param hot_dir_path Path to the directory to store hot chunks in
+  /// \param hot_capacity The maximum size of the data stored in the directory
+  /// \return Returns true on success; otherwise, false.
+  bool start_tiering(const char *hot_dir_path, size_type hot_capacity);
+
+  /// \brief Stops caching and moves the hot chunks back to the data store
+  /// \return Returns true on success; otherwise, false.
+  bool stop_tiering();
+
+  /// \brief Returns the size of the application data cached in the hot directory
+  size_type hot_tier_size() const;
+
+  /// \brief Lists the versions of a data store
+  /// \param dir_path Path to a data store
+  /// \return Returns the versions in the order they were made
+  static std::vector<version_info_type> versions(const char *dir_path);
+
+  /// \brief Removes a version of a data store that is not open.
+  /// The chunks that the children of the version take from it are moved to the children.
+  /// \param dir_path Path to a data store
+  /// \param version The version to remove
+  /// \return Returns true on success; otherwise, false.
+  static bool remove_version(const char *dir_path, version_type version);
+
+  /// \brief Copies backing files synchronously.
+  /// The files are copied by multiple threads.
   /// \param source_dir_path
   /// \param destination_dir_path
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \param progress If not empty, called with the number of copied files and the total number of files
   /// \return If succeeded, returns True; other false
-  static bool copy(const char *source_dir_path, const char *destination_dir_path);
+  static bool copy(const char *source_dir_path, const char *destination_dir_path, size_type num_threads = 0,
+                   const progress_handler_type &progress = progress_handler_type());
 
   /// \brief Copies backing files asynchronously
   /// \param source_dir_path
   /// \param destination_dir_path
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \param progress If not empty, called with the number of copied files and the total number of files
   /// \return Returns an object of std::future
   /// If succeeded, its get() returns True; other false
-  static std::future<bool> copy_async(const char *source_dir_path, const char *destination_dir_path);
+  static std::future<bool> copy_async(const char *source_dir_path, const char *destination_dir_path,
+                                      size_type num_threads = 0,
+                                      const progress_handler_type &progress = progress_handler_type());
 
-  /// \brief Remove backing files synchronously
+  /// \brief Remove backing files synchronously.
+  /// The files are removed by multiple threads.
   /// \param dir_path
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \param progress If not empty, called with the number of removed files and the total number of files
   /// \return If succeeded, returns True; other false
-  static bool remove(const char *dir_path);
+  static bool remove(const char *dir_path, size_type num_threads = 0,
+                     const progress_handler_type &progress = progress_handler_type());
 
   /// \brief Remove backing files asynchronously
   /// \param dir_path
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \param progress If not empty, called with the number of removed files and the total number of files
   /// \return Returns an object of std::future
   /// If succeeded, its get() returns True; other false
-  static std::future<bool> remove_async(const char *dir_path);
+  static std::future<bool> remove_async(const char *dir_path, size_type num_threads = 0,
+                                        const progress_handler_type &progress = progress_handler_type());
+
+  /// \brief Verifies the checksums of a data store recorded when it was closed or snapshotted.
+  /// Reads the whole data store using multiple threads.
+  /// \param dir_path Path to a data store
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \return Returns true if the data store has checksums and all of them match; otherwise, false.
+  static bool verify(const char *dir_path, size_type num_threads = 0);
+
+  /// \brief Compresses the application data of a data store that is not open.
+  /// Requires METALL_USE_COMPRESSION.
+  /// \param dir_path Path to a data store
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \return Returns true on success; otherwise, false.
+  static bool compress(const char *dir_path, size_type num_threads = 0);
 
   /// \brief Check if the backing data store is consistent,
   /// i.e. it was closed properly.
@@ -240,6 +435,9 @@ class manager_kernel {
 
   bool priv_initialized() const;
 
+  bool priv_open(const char *base_dir_path, bool read_only, size_type vm_reserve_size,
+                 void *vm_region_address, bool populate);
+
   static bool priv_properly_closed(const std::string &base_dir_path);
   static bool priv_mark_properly_closed(const std::string &base_dir_path);
   static bool priv_unmark_properly_closed(const std::string &base_dir_path);
@@ -252,21 +450,46 @@ class manager_kernel {
                                   util::in_place_interface &table);
 
   // ---------------------------------------- For segment ---------------------------------------- //
-  bool priv_reserve_vm_region(size_type nbytes);
+  bool priv_reserve_vm_region(size_type nbytes, void *addr = nullptr);
   bool priv_release_vm_region();
+  void priv_destroy_segment_storage();
   bool priv_allocate_segment_header(void *addr);
   bool priv_deallocate_segment_header();
 
   // ---------------------------------------- For serializing/deserializing ---------------------------------------- //
   bool priv_serialize_management_data();
-  bool priv_deserialize_management_data();
+  bool priv_serialize_management_data(const std::string &base_dir_path);
+  bool priv_deserialize_management_data(bool load_allocator = true);
+  bool priv_load_segment_memory_allocator();
+
+  /// \brief Incremented when a segment header is mapped or unmapped
+  static std::atomic<uint64_t> &priv_segment_header_generation();
+
+  // ---------------------------------------- For operation log ---------------------------------------- //
+  bool priv_start_operation_log();
+  bool priv_replay_operation_log(bool read_only);
+
+  // ---------------------------------------- For checksum ---------------------------------------- //
+  bool priv_start_checksum_tracking(bool load_checksums);
+  /// \param reset_tracking If false, the blocks modified so far are recomputed at the next call again
+  bool priv_record_checksums(const std::string &base_dir_path, bool reset_tracking = true);
+
+  // ---------------------------------------- For versions ---------------------------------------- //
+  static std::string priv_make_version_dir_path(const std::string &base_dir_path);
+  bool priv_start_version_tracking(bool load_modified_chunks);
+  bool priv_store_version_head();
 
   // ---------------------------------------- File operations ---------------------------------------- //
   /// \brief Copies all backing files using reflink if possible
-  static bool priv_copy_data_store(const std::string &src_dir_path, const std::string &dst_dir_path, bool overwrite);
+  static std::vector<size_type> priv_make_stripe_weights(const std::vector<std::string> &stripe_dir_paths,
+                                                        stripe_placement placement);
+  static bool priv_copy_data_store(const std::string &src_dir_path, const std::string &dst_dir_path, bool overwrite,
+                                   size_type num_threads = 0,
+                                   const progress_handler_type &progress = progress_handler_type());
 
   /// \brief Removes all backing files
-  static bool priv_remove_data_store(const std::string &dir_path);
+  static bool priv_remove_data_store(const std::string &dir_path, size_type num_threads = 0,
+                                     const progress_handler_type &progress = progress_handler_type());
 
   // -------------------------------------------------------------------------------- //
   // Private fields
@@ -279,9 +502,20 @@ class manager_kernel {
   named_object_directory_type m_named_object_directory;
   segment_storage_type m_segment_storage;
   segment_memory_allocator m_segment_memory_allocator;
+  bool m_segment_memory_allocator_loaded;
+#ifdef METALL_ENABLE_OPERATION_LOG
+  operation_log m_operation_log;
+#endif
+#ifdef METALL_ENABLE_CHECKSUM
+  checksum_table m_checksum_table;
+#endif
+  version_type m_parent_version;
+  /// \brief True if the operation log was replayed only in memory, i.e., opened with the read-only mode
+  bool m_recovered_in_memory_only;
 
 #if ENABLE_MUTEX_IN_METALL_MANAGER_KERNEL
   mutex_type m_named_object_directory_mutex;
+  mutex_type m_segment_memory_allocator_load_mutex;
 #endif
 };
 
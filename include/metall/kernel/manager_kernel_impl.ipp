@@ -24,18 +24,29 @@ manager_kernel(const manager_kernel<chnk_no, chnk_sz, alloc_t>::internal_data_al
       m_segment_header(nullptr),
       m_named_object_directory(allocator),
       m_segment_storage(),
-      m_segment_memory_allocator(&m_segment_storage, allocator)
+      m_segment_memory_allocator(&m_segment_storage, allocator),
+      m_segment_memory_allocator_loaded(false)
+#ifdef METALL_ENABLE_CHECKSUM
+    , m_checksum_table(k_chunk_size)
+#endif
+    , m_parent_version(k_no_version),
+      m_recovered_in_memory_only(false)
 #if ENABLE_MUTEX_IN_METALL_MANAGER_KERNEL
-    , m_named_object_directory_mutex()
+    , m_named_object_directory_mutex(),
+      m_segment_memory_allocator_load_mutex()
 #endif
 {}
 
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 manager_kernel<chnk_no, chnk_sz, alloc_t>::~manager_kernel() {
+  if (m_base_dir_path.empty()) return; // Not opened
+
   close();
 
+  // A data store recovered with the read-only mode still needs the operation log;
+  // it becomes consistent only after a read-write open stores the recovered state.
   // This function must be called at the last line
-  priv_mark_properly_closed(m_base_dir_path);
+  if (!m_recovered_in_memory_only) priv_mark_properly_closed(m_base_dir_path);
 }
 
 // -------------------------------------------------------------------------------- //
@@ -43,6 +54,14 @@ manager_kernel<chnk_no, chnk_sz, alloc_t>::~manager_kernel() {
 // -------------------------------------------------------------------------------- //
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 void manager_kernel<chnk_no, chnk_sz, alloc_t>::create(const char *base_dir_path, const size_type vm_reserve_size) {
+  create(base_dir_path, std::vector<std::string>(), stripe_placement::round_robin, vm_reserve_size);
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+void manager_kernel<chnk_no, chnk_sz, alloc_t>::create(const char *base_dir_path,
+                                                       const std::vector<std::string> &stripe_dir_paths,
+                                                       const stripe_placement placement,
+                                                       const size_type vm_reserve_size) {
   if (vm_reserve_size > k_max_segment_size) {
     std::cerr << "Too large VM region size is requested " << vm_reserve_size << " byte." << std::endl;
     std::abort();
@@ -56,6 +75,13 @@ void manager_kernel<chnk_no, chnk_sz, alloc_t>::create(const char *base_dir_path
     std::abort();
   }
 
+  // Versions of an old data store are not valid anymore
+  const auto version_dir_path = priv_make_version_dir_path(m_base_dir_path);
+  if (util::directory_exist(version_dir_path) && !util::remove_file(version_dir_path)) {
+    std::cerr << "Failed to remove old versions: " << version_dir_path << std::endl;
+    std::abort();
+  }
+
   if (!priv_reserve_vm_region(vm_reserve_size)) {
     std::abort();
   }
@@ -69,28 +95,115 @@ void manager_kernel<chnk_no, chnk_sz, alloc_t>::create(const char *base_dir_path
   if (!m_segment_storage.create(priv_make_file_name(m_base_dir_path, k_segment_prefix),
                                 m_vm_region_size - size_for_header,
                                 static_cast<char *>(m_vm_region) + size_for_header,
-                                k_initial_segment_size)) {
+                                k_initial_segment_size,
+                                stripe_dir_paths,
+                                priv_make_stripe_weights(stripe_dir_paths, placement))) {
     std::cerr << "Cannot create application data segment" << std::endl;
     std::abort();
   }
+  m_segment_memory_allocator_loaded = true; // Starts with the empty state
+
+  if (!priv_start_checksum_tracking(false)) {
+    std::abort();
+  }
+
+#ifdef METALL_ENABLE_OPERATION_LOG
+  // The log is replayed on top of the serialized management data; store the empty state first
+  if (!priv_serialize_management_data() || !priv_start_operation_log()) {
+    std::abort();
+  }
+#endif
 }
 
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 bool manager_kernel<chnk_no, chnk_sz, alloc_t>::open(const char *base_dir_path,
                                                      const bool read_only,
                                                      const size_type vm_reserve_size) {
-  if (!m_segment_storage.openable(priv_make_file_name(base_dir_path, k_segment_prefix))) {
-    return false; // This is not an fatal error due to the open_or_create mode
+  return priv_open(base_dir_path, read_only, vm_reserve_size, nullptr, false);
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::open_read_only_shared(const char *base_dir_path,
+                                                                      void *const vm_region_address,
+                                                                      const bool populate) {
+  if (!vm_region_address) {
+    std::cerr << "The address to map the data store is not given" << std::endl;
+    return false;
   }
 
-  if (!priv_properly_closed(base_dir_path)) {
-    std::cerr << "Backing data store was not closed properly. The data might have been collapsed." << std::endl;
-    std::abort();
+  // Reserve only the required size as the segment is never extended
+  const auto segment_size = segment_storage_type::get_size(priv_make_file_name(base_dir_path, k_segment_prefix));
+  const size_type vm_reserve_size = util::round_up(sizeof(segment_header_type), util::get_page_size()) + segment_size;
+  return priv_open(base_dir_path, true, vm_reserve_size, vm_region_address, populate);
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::open_version(const char *base_dir_path, const version_type version) {
+  version_catalog catalog(priv_make_version_dir_path(base_dir_path), k_chunk_size);
+  std::vector<version_catalog::chunk_location> locations;
+  if (!catalog.load() || !catalog.locate(version, &locations)) {
+    return false;
+  }
+  const auto version_dir_path = catalog.version_dir_path(version);
+  if (!priv_properly_closed(version_dir_path)) {
+    std::cerr << "Version " << version << " is not complete" << std::endl;
+    return false;
+  }
+
+  if (!priv_reserve_vm_region(k_default_vm_reserve_size)) {
+    return false;
+  }
+
+  if (!priv_allocate_segment_header(m_vm_region)) {
+    priv_release_vm_region();
+    return false;
+  }
+
+  std::vector<typename segment_storage_type::overlay_part> parts;
+  parts.reserve(locations.size());
+  for (const auto &location : locations) {
+    parts.emplace_back(typename segment_storage_type::overlay_part{location.path, location.offset});
+  }
+  const size_type offset = m_segment_header_size
+      + (reinterpret_cast<char *>(m_segment_header) - reinterpret_cast<char *>(m_vm_region));
+  if (!m_segment_storage.open_overlay(parts, k_chunk_size, m_vm_region_size - offset,
+                                      static_cast<char *>(m_vm_region) + offset)) {
+    std::cerr << "Failed to map the chunks of version " << version << std::endl;
+    priv_deallocate_segment_header();
+    priv_release_vm_region();
+    return false;
   }
 
+  // The management data of the version is stored in its directory
+  m_base_dir_path = version_dir_path;
+  if (!priv_deserialize_management_data(false)) {
+    std::cerr << "Failed to load the management data of version " << version << std::endl;
+    priv_destroy_segment_storage();
+    priv_deallocate_segment_header();
+    priv_release_vm_region();
+    m_base_dir_path.clear();
+    return false;
+  }
+
+  return true;
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+template <typename visitor_type>
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::recover(const char *base_dir_path,
+                                                        visitor_type &&visitor,
+                                                        size_type num_threads) {
+  if (!m_segment_storage.openable(priv_make_file_name(base_dir_path, k_segment_prefix))) {
+    return false;
+  }
+  if (num_threads == 0) {
+    num_threads = util::default_num_threads();
+  }
+
+  const bool properly_closed = priv_properly_closed(base_dir_path);
   m_base_dir_path = base_dir_path;
 
-  if (!priv_reserve_vm_region(vm_reserve_size)) {
+  if (!priv_reserve_vm_region(k_default_vm_reserve_size)) {
     std::abort();
   }
 
@@ -98,9 +211,8 @@ bool manager_kernel<chnk_no, chnk_sz, alloc_t>::open(const char *base_dir_path,
     std::abort();
   }
 
-  // Clear the consistent mark before opening with the write mode
-  if (!read_only && !priv_unmark_properly_closed(m_base_dir_path)) {
-    std::cerr << "Failed to erase the properly close mark before opening" << std::endl;
+  if (!priv_unmark_properly_closed(m_base_dir_path) && properly_closed) {
+    std::cerr << "Failed to erase the properly close mark before recovering" << std::endl;
     std::abort();
   }
 
@@ -109,15 +221,54 @@ bool manager_kernel<chnk_no, chnk_sz, alloc_t>::open(const char *base_dir_path,
   if (!m_segment_storage.open(priv_make_file_name(m_base_dir_path, k_segment_prefix),
                               m_vm_region_size - offset,
                               static_cast<char *>(m_vm_region) + offset,
-                              read_only)) {
+                              false)) {
     std::abort();
   }
 
-  if (!priv_deserialize_management_data()) {
-    std::abort();
+  // The last serialized allocator state tells the sizes of allocations made before it
+  bool succeeded = priv_deserialize_management_data(true);
+  typename segment_memory_allocator::chunk_range_list_type unused_chunks;
+  if (succeeded) {
+    auto size_hint = [this](const difference_type offset) -> size_type {
+      return m_segment_memory_allocator.allocation_size(offset);
+    };
+    auto name_lookup = [this](const char *const name) -> difference_type {
+      const auto iterator = m_named_object_directory.find(name);
+      return (iterator == m_named_object_directory.end()) ? -1 : std::get<1>(iterator->second);
+    };
+    // Use more shards than threads to reduce lock contention and balance the load
+    reachability_marker_type marker(m_segment_storage.get_segment(), m_segment_storage.size(),
+                                    size_hint, name_lookup, num_threads * 16);
+    visitor(marker);
+
+    // Named objects are the roots
+    for (const auto &item : m_named_object_directory) {
+      marker.mark(static_cast<char *>(m_segment_storage.get_segment()) + std::get<1>(item.second));
+    }
+
+    if (marker.num_errors() > 0) {
+      std::cerr << marker.num_errors() << " invalid allocations were marked" << std::endl;
+      succeeded = false;
+    } else {
+      auto lists = marker.extract();
+      succeeded = m_segment_memory_allocator.rebuild(lists, num_threads, &unused_chunks);
+    }
   }
 
-  return true;
+  if (succeeded && priv_serialize_management_data()) {
+    // Discard the unreachable data only after the new allocator state is stored
+    m_segment_memory_allocator.free_chunks(unused_chunks);
+    return true; // The properly closed mark is put when this kernel is destructed
+  }
+
+  // Leave the data store as it was
+  std::cerr << "Failed to recover " << base_dir_path << std::endl;
+  priv_destroy_segment_storage();
+  priv_deallocate_segment_header();
+  priv_release_vm_region();
+  if (properly_closed) priv_mark_properly_closed(m_base_dir_path);
+  m_base_dir_path.clear();
+  return false;
 }
 
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
@@ -125,7 +276,20 @@ void manager_kernel<chnk_no, chnk_sz, alloc_t>::close() {
   if (priv_initialized()) {
     priv_serialize_management_data();
     m_segment_storage.sync(true);
-    m_segment_storage.destroy();
+    if (!m_segment_storage.read_only()) {
+      priv_record_checksums(m_base_dir_path);
+      priv_store_version_head();
+    }
+#ifdef METALL_ENABLE_OPERATION_LOG
+    // The log is no longer needed as the management data was serialized
+    m_segment_memory_allocator.set_operation_log(nullptr);
+    m_operation_log.clear();
+    m_operation_log.close();
+#endif
+    // Containers in the segment are not destructed; release their locks allocated in DRAM
+    const auto segment = static_cast<const char *>(m_segment_storage.get_segment());
+    util::instance_lock_registry::release_range(segment, segment + m_segment_storage.size());
+    priv_destroy_segment_storage();
     priv_deallocate_segment_header();
     priv_release_vm_region();
   }
@@ -135,6 +299,21 @@ template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 void manager_kernel<chnk_no, chnk_sz, alloc_t>::flush(const bool synchronous) {
   assert(priv_initialized());
   m_segment_storage.sync(synchronous);
+  if (!m_segment_storage.read_only()) {
+    priv_record_checksums(m_base_dir_path);
+  }
+#ifdef METALL_ENABLE_OPERATION_LOG
+  m_operation_log.commit();
+#endif
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+std::future<bool> manager_kernel<chnk_no, chnk_sz, alloc_t>::flush_async() {
+  assert(priv_initialized());
+#ifdef METALL_ENABLE_OPERATION_LOG
+  m_operation_log.commit();
+#endif
+  return m_segment_storage.sync_async();
 }
 
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
@@ -163,6 +342,19 @@ allocate_aligned(const manager_kernel<chnk_no, chnk_sz, alloc_t>::size_type nbyt
   return static_cast<char *>(m_segment_storage.get_segment()) + offset;
 }
 
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+template <typename manager_kernel<chnk_no, chnk_sz, alloc_t>::size_type nbytes>
+void *
+manager_kernel<chnk_no, chnk_sz, alloc_t>::allocate_fixed() {
+  assert(priv_initialized());
+  if (m_segment_storage.read_only()) return nullptr;
+
+  const auto offset = m_segment_memory_allocator.template allocate<nbytes>();
+  assert(offset >= 0);
+  assert(offset + nbytes <= m_segment_storage.size());
+  return static_cast<char *>(m_segment_storage.get_segment()) + offset;
+}
+
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 void manager_kernel<chnk_no, chnk_sz, alloc_t>::deallocate(void *addr) {
   assert(priv_initialized());
@@ -172,6 +364,31 @@ void manager_kernel<chnk_no, chnk_sz, alloc_t>::deallocate(void *addr) {
   m_segment_memory_allocator.deallocate(offset);
 }
 
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+void manager_kernel<chnk_no, chnk_sz, alloc_t>::deallocate(void *addr, const size_type nbytes) {
+  assert(priv_initialized());
+  if (m_segment_storage.read_only()) return;
+  if (!addr) return;
+  const difference_type offset = static_cast<char *>(addr) - static_cast<char *>(m_segment_storage.get_segment());
+  m_segment_memory_allocator.deallocate(offset, nbytes);
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+const typename manager_kernel<chnk_no, chnk_sz, alloc_t>::fast_allocation_path_type &
+manager_kernel<chnk_no, chnk_sz, alloc_t>::fast_allocation_path(manager_kernel *const *const kernel_slot) {
+  thread_local fast_allocation_path_type path;
+  const uint64_t generation = priv_segment_header_generation().load(std::memory_order_acquire);
+  if (path.kernel_slot != kernel_slot || path.generation != generation) {
+    manager_kernel *const kernel = *kernel_slot;
+    assert(kernel && kernel->priv_initialized());
+    path.kernel_slot = kernel_slot;
+    path.generation = generation;
+    path.allocator = kernel->m_segment_storage.read_only() ? nullptr : &kernel->m_segment_memory_allocator;
+    path.segment = static_cast<char *>(kernel->m_segment_storage.get_segment());
+  }
+  return path;
+}
+
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 template <typename T>
 std::pair<T *, typename manager_kernel<chnk_no, chnk_sz, alloc_t>::size_type>
@@ -223,6 +440,9 @@ bool manager_kernel<chnk_no, chnk_sz, alloc_t>::destroy(char_ptr_holder_type nam
     const size_type length = std::get<2>(iterator->second);
 
     m_named_object_directory.erase(iterator);
+#ifdef METALL_ENABLE_OPERATION_LOG
+    m_operation_log.log_named_object_erase(raw_name);
+#endif
 
     // TODO: might be able to free the lock here ?
 
@@ -266,38 +486,238 @@ manager_kernel<chnk_no, chnk_sz, alloc_t>::get_segment_header() const {
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 bool manager_kernel<chnk_no, chnk_sz, alloc_t>::snapshot(const char *destination_base_dir_path) {
   assert(priv_initialized());
+  if (m_segment_storage.overlay()) {
+    std::cerr << "Cannot take a snapshot of a version" << std::endl;
+    return false;
+  }
   m_segment_storage.sync(true);
   priv_serialize_management_data();
+  if (!m_segment_storage.read_only() && !priv_record_checksums(m_base_dir_path)) {
+    return false;
+  }
   if (!priv_copy_data_store(m_base_dir_path, destination_base_dir_path, true)) {
     return false;
   }
+#ifdef METALL_USE_COMPRESSION
+  const auto destination_segment_path = priv_make_file_name(destination_base_dir_path, k_segment_prefix);
+  if (!segment_storage_type::compress(destination_segment_path, destination_segment_path)) {
+    return false;
+  }
+#endif
   if (!priv_mark_properly_closed(destination_base_dir_path)) {
     return false;
   }
   return true;
 }
 
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+std::future<bool> manager_kernel<chnk_no, chnk_sz, alloc_t>::snapshot_async(const char *destination_base_dir_path) {
+  assert(priv_initialized());
+  const std::string destination(destination_base_dir_path);
+
+  if (m_segment_storage.overlay()) {
+    std::cerr << "Cannot take a snapshot of a version" << std::endl;
+    std::promise<bool> promise;
+    promise.set_value(false);
+    return promise.get_future();
+  }
+
+  if (m_segment_storage.read_only()) { // The data store is not modified
+    return std::async(std::launch::async, [source = m_base_dir_path, destination]() {
+      return priv_copy_data_store(source, destination, true) && priv_mark_properly_closed(destination);
+    });
+  }
+
+  // Remove an old snapshot as it could have more block files
+  const std::string destination_datastore_dir_path = priv_make_datastore_dir_path(destination);
+  if (util::directory_exist(destination_datastore_dir_path)
+      && !util::remove_directory_parallel(destination_datastore_dir_path, 0)) {
+    std::cerr << "Failed to remove an old data store: " << destination_datastore_dir_path << std::endl;
+    std::promise<bool> promise;
+    promise.set_value(false);
+    return promise.get_future();
+  }
+
+  // Quiesce allocations until the management data and the segment are captured at the same point
+#if ENABLE_MUTEX_IN_METALL_MANAGER_KERNEL
+  lock_guard_type guard(m_named_object_directory_mutex);
+#endif
+  m_segment_memory_allocator.lock();
+  if (!priv_init_datastore_directory(destination) || !priv_serialize_management_data(destination)) {
+    m_segment_memory_allocator.unlock();
+    std::promise<bool> promise;
+    promise.set_value(false);
+    return promise.get_future();
+  }
+  // The checksums are computed while the writes are held; the tracking is not reset as it is for the data store
+  auto segment_copy = m_segment_storage.snapshot_async(priv_make_file_name(destination, k_segment_prefix),
+                                                       [this, &destination]() {
+                                                         return priv_record_checksums(destination, false);
+                                                       });
+  m_segment_memory_allocator.unlock();
+  return std::async(std::launch::async, [segment_copy = std::move(segment_copy), destination]() mutable {
+    if (!segment_copy.get()) {
+      return false;
+    }
+#ifdef METALL_USE_COMPRESSION
+    // Compress after the copy so that writers are not blocked for longer
+    const auto destination_segment_path = priv_make_file_name(destination, k_segment_prefix);
+    if (!segment_storage_type::compress(destination_segment_path, destination_segment_path)) {
+      return false;
+    }
+#endif
+    return priv_mark_properly_closed(destination);
+  });
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::snapshot_version(version_type *const version) {
+  assert(priv_initialized());
+  if (m_segment_storage.read_only()) {
+    std::cerr << "Cannot make a version in the read-only mode" << std::endl;
+    return false;
+  }
+
+  const auto version_dir_path = priv_make_version_dir_path(m_base_dir_path);
+  if (!util::directory_exist(version_dir_path) && !util::create_directory(version_dir_path)) {
+    std::cerr << "Failed to create directory: " << version_dir_path << std::endl;
+    return false;
+  }
+  version_catalog catalog(version_dir_path, k_chunk_size);
+  if (!catalog.load()) {
+    return false;
+  }
+  if (m_parent_version != k_no_version && !catalog.find(m_parent_version)) {
+    m_parent_version = k_no_version; // Removed by remove_version(); store the whole segment
+  }
+
+  // The management data is stored in the version directory as in a data store
+  const version_type new_version = catalog.next_version();
+  const auto new_version_dir_path = catalog.version_dir_path(new_version);
+  if (!priv_init_datastore_directory(new_version_dir_path) || !priv_serialize_management_data(new_version_dir_path)
+      || !priv_mark_properly_closed(new_version_dir_path)) {
+    return false;
+  }
+  m_segment_storage.load_all(); // The chunks are written from the segment with pwrite(2)
+  if (!catalog.add(new_version, m_parent_version, m_segment_storage.get_segment(), m_segment_storage.size(),
+                   [this](const size_type chunk_no) {
+                     return m_segment_storage.written(chunk_no, k_version_write_tracker);
+                   })) {
+    return false;
+  }
+
+  // Track the chunks modified from now on
+  m_parent_version = new_version;
+#ifdef METALL_ENABLE_VERSION_TRACKING
+  if (m_segment_storage.start_write_tracking(k_chunk_size)) {
+    m_segment_storage.reset_write_tracking(k_version_write_tracker);
+  }
+#endif
+  if (!catalog.store_head(m_parent_version, nullptr)) {
+    return false;
+  }
+
+  if (version) *version = new_version;
+  return true;
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+std::vector<typename manager_kernel<chnk_no, chnk_sz, alloc_t>::version_info_type>
+manager_kernel<chnk_no, chnk_sz, alloc_t>::versions(const char *dir_path) {
+  version_catalog catalog(priv_make_version_dir_path(dir_path), k_chunk_size);
+  if (!catalog.load()) {
+    return {};
+  }
+  return catalog.versions();
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::remove_version(const char *dir_path, const version_type version) {
+  if (!priv_properly_closed(dir_path)) {
+    std::cerr << "Backing data store is open or was not closed properly: " << dir_path << std::endl;
+    return false;
+  }
+
+  version_catalog catalog(priv_make_version_dir_path(dir_path), k_chunk_size);
+  version_type head_parent;
+  bool known;
+  std::vector<uint64_t> modified_chunks;
+  if (!catalog.load() || !catalog.load_head(&head_parent, &known, &modified_chunks)) {
+    return false;
+  }
+  const auto *const info = catalog.find(version);
+  if (!info) {
+    std::cerr << "Version does not exist: " << version << std::endl;
+    return false;
+  }
+  const version_type parent = info->parent;
+
+  std::vector<uint64_t> removed_chunks;
+  if (!catalog.remove(version, &removed_chunks)) {
+    return false;
+  }
+
+  // The data store differs from the new parent also in the chunks of the removed version
+  if (head_parent == version) {
+    if (known) {
+      modified_chunks.insert(modified_chunks.end(), removed_chunks.begin(), removed_chunks.end());
+      std::sort(modified_chunks.begin(), modified_chunks.end());
+      modified_chunks.erase(std::unique(modified_chunks.begin(), modified_chunks.end()), modified_chunks.end());
+    }
+    return catalog.store_head(parent, known ? &modified_chunks : nullptr);
+  }
+  return true;
+}
+
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 bool manager_kernel<chnk_no, chnk_sz, alloc_t>::copy(const char *source_base_dir_path,
-                                                     const char *destination_base_dir_path) {
-  return priv_copy_data_store(source_base_dir_path, destination_base_dir_path, true);
+                                                     const char *destination_base_dir_path,
+                                                     const size_type num_threads,
+                                                     const progress_handler_type &progress) {
+  return priv_copy_data_store(source_base_dir_path, destination_base_dir_path, true, num_threads, progress);
 }
 
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 std::future<bool>
 manager_kernel<chnk_no, chnk_sz, alloc_t>::copy_async(const char *source_dir_path,
-                                                      const char *destination_dir_path) {
-  return std::async(std::launch::async, copy, source_dir_path, destination_dir_path);
+                                                      const char *destination_dir_path,
+                                                      const size_type num_threads,
+                                                      const progress_handler_type &progress) {
+  return std::async(std::launch::async, [source = std::string(source_dir_path),
+      destination = std::string(destination_dir_path), num_threads, progress]() {
+    return copy(source.c_str(), destination.c_str(), num_threads, progress);
+  });
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::remove(const char *dir_path, const size_type num_threads,
+                                                       const progress_handler_type &progress) {
+  return priv_remove_data_store(dir_path, num_threads, progress);
 }
 
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
-bool manager_kernel<chnk_no, chnk_sz, alloc_t>::remove(const char *dir_path) {
-  return priv_remove_data_store(dir_path);
+std::future<bool> manager_kernel<chnk_no, chnk_sz, alloc_t>::remove_async(const char *dir_path,
+                                                                          const size_type num_threads,
+                                                                          const progress_handler_type &progress) {
+  return std::async(std::launch::async, [path = std::string(dir_path), num_threads, progress]() {
+    return remove(path.c_str(), num_threads, progress);
+  });
 }
 
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
-std::future<bool> manager_kernel<chnk_no, chnk_sz, alloc_t>::remove_async(const char *dir_path) {
-  return std::async(std::launch::async, remove, dir_path);
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::compress([[maybe_unused]] const char *dir_path,
+                                                         [[maybe_unused]] const size_type num_threads) {
+#ifdef METALL_USE_COMPRESSION
+  if (!priv_properly_closed(dir_path)) {
+    std::cerr << "Backing data store was not closed properly: " << dir_path << std::endl;
+    return false;
+  }
+  const auto segment_path = priv_make_file_name(dir_path, k_segment_prefix);
+  return segment_storage_type::compress(segment_path, segment_path, num_threads);
+#else
+  std::cerr << "Metall is not built with METALL_USE_COMPRESSION" << std::endl;
+  return false;
+#endif
 }
 
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
@@ -305,6 +725,73 @@ bool manager_kernel<chnk_no, chnk_sz, alloc_t>::consistent(const char *dir_path)
   return priv_properly_closed(dir_path);
 }
 
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::start_tiering(const char *hot_dir_path, const size_type hot_capacity) {
+  assert(priv_initialized());
+  if (m_segment_storage.read_only() || m_segment_storage.overlay()) {
+    std::cerr << "Cannot start tiering in the read-only mode" << std::endl;
+    return false;
+  }
+  return m_segment_storage.start_tiering(hot_dir_path, hot_capacity);
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::stop_tiering() {
+  assert(priv_initialized());
+  return m_segment_storage.stop_tiering();
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+typename manager_kernel<chnk_no, chnk_sz, alloc_t>::size_type
+manager_kernel<chnk_no, chnk_sz, alloc_t>::hot_tier_size() const {
+  assert(priv_initialized());
+  return m_segment_storage.hot_tier_size();
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::verify(const char *dir_path, size_type num_threads) {
+  if (!priv_properly_closed(dir_path)) {
+    std::cerr << "Backing data store was not closed properly: " << dir_path << std::endl;
+    return false;
+  }
+
+  const auto checksum_file_path = priv_make_file_name(dir_path, k_checksum_file_name);
+  if (!util::file_exist(checksum_file_path)) {
+    std::cerr << "No checksums were recorded: " << dir_path << std::endl;
+    return false;
+  }
+  checksum_table table(k_chunk_size);
+  if (!table.deserialize(checksum_file_path)) {
+    return false;
+  }
+
+  if (num_threads == 0) {
+    num_threads = util::default_num_threads();
+  }
+
+  // Map the segment in read-only mode without the rest of the management data
+  const auto segment_path = priv_make_file_name(dir_path, k_segment_prefix);
+  segment_storage_type storage;
+  const auto vm_region_size = util::round_up(segment_storage_type::get_size(segment_path), storage.page_size());
+  void *const vm_region = util::reserve_aligned_vm_region(storage.page_size(), vm_region_size);
+  if (!vm_region) {
+    std::cerr << "Cannot reserve a VM region " << vm_region_size << " bytes" << std::endl;
+    return false;
+  }
+  if (!storage.open(segment_path, vm_region_size, vm_region, true)) {
+    util::munmap(vm_region, vm_region_size, false);
+    return false;
+  }
+
+  const bool ret = table.verify(storage.get_segment(), storage.size(),
+                                [dir_path](const std::string &name) { return priv_make_file_name(dir_path, name); },
+                                num_threads);
+  storage.destroy();
+  util::munmap(vm_region, vm_region_size, false);
+
+  return ret;
+}
+
 // -------------------------------------------------------------------------------- //
 // Private methods
 // -------------------------------------------------------------------------------- //
@@ -350,6 +837,96 @@ bool manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_initialized() const {
   return (m_vm_region && m_vm_region_size > 0 && m_segment_header && m_segment_storage.size() > 0);
 }
 
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_open(const char *base_dir_path,
+                                                          const bool read_only,
+                                                          const size_type vm_reserve_size,
+                                                          void *const vm_region_address,
+                                                          const bool populate) {
+  if (!m_segment_storage.openable(priv_make_file_name(base_dir_path, k_segment_prefix))) {
+    return false; // This is not an fatal error due to the open_or_create mode
+  }
+
+  bool recover = false;
+  if (!priv_properly_closed(base_dir_path)) {
+#ifdef METALL_ENABLE_OPERATION_LOG
+    recover = util::file_exist(priv_make_file_name(base_dir_path, k_operation_log_file_name));
+#endif
+    if (!recover) {
+      std::cerr << "Backing data store was not closed properly. The data might have been collapsed." << std::endl;
+      std::abort();
+    }
+    std::cerr << "Backing data store was not closed properly. Recovering by replaying the operation log" << std::endl;
+  }
+
+  m_base_dir_path = base_dir_path;
+
+  if (!priv_reserve_vm_region(vm_reserve_size, vm_region_address)) {
+    if (vm_region_address) {
+      return false; // The address range could be used by others
+    }
+    std::abort();
+  }
+
+  if (!priv_allocate_segment_header(m_vm_region)) {
+    std::abort();
+  }
+
+  // Clear the consistent mark before opening with the write mode
+  if (!read_only && !priv_unmark_properly_closed(m_base_dir_path)) {
+    std::cerr << "Failed to erase the properly close mark before opening" << std::endl;
+    std::abort();
+  }
+
+  const size_type offset = m_segment_header_size
+      + (reinterpret_cast<char *>(m_segment_header) - reinterpret_cast<char *>(m_vm_region));
+  if (!m_segment_storage.open(priv_make_file_name(m_base_dir_path, k_segment_prefix),
+                              m_vm_region_size - offset,
+                              static_cast<char *>(m_vm_region) + offset,
+                              read_only,
+                              populate)) {
+    std::abort();
+  }
+
+  // Read-only users never touch the allocator state; defer loading it, which takes time proportional to the data size
+  if (!priv_deserialize_management_data(!read_only || recover)) {
+    std::abort();
+  }
+
+  if (recover) {
+    if (!priv_replay_operation_log(read_only)) {
+      std::cerr << "Failed to replay the operation log" << std::endl;
+      std::abort();
+    }
+    // Store the recovered state so that the log can start over
+    if (!read_only && !priv_serialize_management_data()) {
+      std::abort();
+    }
+    m_recovered_in_memory_only = read_only;
+    if (read_only) {
+      std::cerr << "The recovered state is not stored with the read-only mode; "
+                   "open the data store with the write mode to store it" << std::endl;
+    }
+  }
+
+  // The recorded checksums are valid only if the data store was closed properly
+  if (!read_only && !priv_start_checksum_tracking(!recover)) {
+    std::abort();
+  }
+
+  if (!read_only && !priv_start_version_tracking(!recover)) {
+    std::abort();
+  }
+
+#ifdef METALL_ENABLE_OPERATION_LOG
+  if (!read_only && !priv_start_operation_log()) {
+    std::abort();
+  }
+#endif
+
+  return true;
+}
+
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 bool manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_properly_closed(const std::string &base_dir_path) {
   return util::file_exist(priv_make_file_name(base_dir_path, k_properly_closed_mark_file_name));
@@ -367,12 +944,25 @@ bool manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_unmark_properly_closed(cons
 
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 bool
-manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_reserve_vm_region(const size_type nbytes) {
+manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_reserve_vm_region(const size_type nbytes, void *const addr) {
   // Align to the page size of the mmap implementation, which could be different from the system page size 
   const auto alignment = m_segment_storage.page_size();
   assert(alignment > 0);
   m_vm_region_size = util::round_up(nbytes, alignment);
-  m_vm_region = util::reserve_aligned_vm_region(alignment, m_vm_region_size);
+  if (addr) {
+    if (reinterpret_cast<uint64_t>(addr) % alignment != 0) {
+      std::cerr << "The VM region address is not aligned to " << alignment << std::endl;
+      m_vm_region_size = 0;
+      return false;
+    }
+    m_vm_region = util::reserve_vm_region_at(addr, m_vm_region_size);
+  } else {
+    // If a smaller region than the default is requested, e.g., due to a limited address space,
+    // leave the rest of the default size unused after the region so that the segment storage can grow it in place
+    const size_type headroom = (m_vm_region_size < k_default_vm_reserve_size) ?
+                               k_default_vm_reserve_size - m_vm_region_size : 0;
+    m_vm_region = util::reserve_growable_vm_region(alignment, m_vm_region_size, headroom);
+  }
   if (!m_vm_region) {
     std::cerr << "Cannot reserve a VM region " << nbytes << " bytes" << std::endl;
     m_vm_region_size = 0;
@@ -383,6 +973,17 @@ manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_reserve_vm_region(const size_typ
   return true;
 }
 
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+void
+manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_destroy_segment_storage() {
+  // The segment storage could have grown the VM region to extend the segment
+  if (m_segment_storage.get_segment()) {
+    m_vm_region_size = (static_cast<char *>(m_segment_storage.get_segment()) - static_cast<char *>(m_vm_region))
+        + m_segment_storage.vm_region_size();
+  }
+  m_segment_storage.destroy();
+}
+
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 bool
 manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_release_vm_region() {
@@ -414,13 +1015,21 @@ manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_allocate_segment_header(void *co
 
   new(m_segment_header) segment_header_type();
   m_segment_header->manager_kernel_address = this;
+  priv_segment_header_generation().fetch_add(1, std::memory_order_acq_rel);
 
   return true;
 }
 
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+std::atomic<uint64_t> &manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_segment_header_generation() {
+  static std::atomic<uint64_t> generation{1}; // Cached paths start with 0
+  return generation;
+}
+
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 bool
 manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_deallocate_segment_header() {
+  priv_segment_header_generation().fetch_add(1, std::memory_order_acq_rel);
   m_segment_header->~segment_header_type();
   const auto ret = util::munmap(m_segment_header, m_segment_header_size, false);
   m_segment_header = nullptr;
@@ -464,6 +1073,10 @@ priv_generic_named_construct(const char_type *const name,
       std::cerr << "Failed to insert a new name: " << name << std::endl;
       return nullptr;
     }
+#ifdef METALL_ENABLE_OPERATION_LOG
+    m_operation_log.log_named_object_insert(name, static_cast<char *>(ptr)
+        - static_cast<char *>(m_segment_storage.get_segment()), num);
+#endif
 
     util::array_construct(ptr, num, table);
   }
@@ -475,16 +1088,22 @@ priv_generic_named_construct(const char_type *const name,
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 bool
 manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_serialize_management_data() {
+  return priv_serialize_management_data(m_base_dir_path);
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool
+manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_serialize_management_data(const std::string &base_dir_path) {
   assert(priv_initialized());
 
   if (m_segment_storage.read_only()) return false;
 
-  if (!m_named_object_directory.serialize(priv_make_file_name(m_base_dir_path,
+  if (!m_named_object_directory.serialize(priv_make_file_name(base_dir_path,
                                                               k_named_object_directory_prefix).c_str())) {
     std::cerr << "Failed to serialize named object directory" << std::endl;
     return false;
   }
-  if (!m_segment_memory_allocator.serialize(priv_make_file_name(m_base_dir_path, k_segment_memory_allocator_prefix))) {
+  if (!m_segment_memory_allocator.serialize(priv_make_file_name(base_dir_path, k_segment_memory_allocator_prefix))) {
     return false;
   }
 
@@ -493,25 +1112,195 @@ manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_serialize_management_data() {
 
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 bool
-manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_deserialize_management_data() {
+manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_deserialize_management_data(const bool load_allocator) {
   if (!m_named_object_directory.deserialize(priv_make_file_name(m_base_dir_path,
                                                                 k_named_object_directory_prefix).c_str())) {
     std::cerr << "Failed to deserialize named object directory" << std::endl;
     return false;
   }
+  if (load_allocator && !priv_load_segment_memory_allocator()) {
+    return false;
+  }
+  return true;
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool
+manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_load_segment_memory_allocator() {
+#if ENABLE_MUTEX_IN_METALL_MANAGER_KERNEL
+  lock_guard_type guard(m_segment_memory_allocator_load_mutex);
+#endif
+  if (m_segment_memory_allocator_loaded) return true;
+
   if (!m_segment_memory_allocator.deserialize(priv_make_file_name(m_base_dir_path,
                                                                   k_segment_memory_allocator_prefix))) {
     return false;
   }
+  m_segment_memory_allocator_loaded = true;
+  return true;
+}
+
+// ---------------------------------------- For operation log ---------------------------------------- //
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool
+manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_start_operation_log() {
+#ifdef METALL_ENABLE_OPERATION_LOG
+  // The serialized management data holds all operations so far
+  if (!m_operation_log.open(priv_make_file_name(m_base_dir_path, k_operation_log_file_name))) {
+    return false;
+  }
+  m_segment_memory_allocator.set_operation_log(&m_operation_log);
+#endif
+  return true;
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool
+manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_replay_operation_log([[maybe_unused]] const bool read_only) {
+#ifdef METALL_ENABLE_OPERATION_LOG
+  const auto redo = [this](const operation_log::record &rec) -> bool {
+    if (rec.type == operation_log::record_type::named_object_insert
+        || rec.type == operation_log::record_type::named_object_erase) {
+      const auto iterator = m_named_object_directory.find(rec.name);
+      if (iterator != m_named_object_directory.end()) {
+        m_named_object_directory.erase(iterator);
+      }
+      if (rec.type == operation_log::record_type::named_object_insert) {
+        return m_named_object_directory.insert(rec.name, rec.value0, rec.value1);
+      }
+      return true;
+    }
+    return m_segment_memory_allocator.redo(rec);
+  };
+
+  if (!operation_log::replay(priv_make_file_name(m_base_dir_path, k_operation_log_file_name), redo, !read_only)) {
+    return false;
+  }
+  m_segment_memory_allocator.finish_redo();
+  return true;
+#else
+  return false;
+#endif
+}
+
+// ---------------------------------------- For checksum ---------------------------------------- //
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool
+manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_start_checksum_tracking([[maybe_unused]] const bool load_checksums) {
+#ifdef METALL_ENABLE_CHECKSUM
+  m_checksum_table.clear();
+  if (!m_segment_storage.start_write_tracking(k_chunk_size)) {
+    std::cerr << "Failed to start tracking writes; checksums are recomputed entirely" << std::endl;
+    return true;
+  }
+
+  // Only the chunks written from now on are rehashed if the recorded checksums are available
+  const auto checksum_file_path = priv_make_file_name(m_base_dir_path, k_checksum_file_name);
+  if (load_checksums && util::file_exist(checksum_file_path) && m_checksum_table.deserialize(checksum_file_path)) {
+    m_segment_storage.reset_write_tracking(k_checksum_write_tracker);
+  } else {
+    m_checksum_table.clear();
+  }
+#endif
   return true;
 }
 
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool
+manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_record_checksums([[maybe_unused]] const std::string &base_dir_path,
+                                                                  [[maybe_unused]] const bool reset_tracking) {
+#ifdef METALL_ENABLE_CHECKSUM
+  const size_type num_threads = util::default_num_threads();
+  m_checksum_table.update_blocks(m_segment_storage.get_segment(), m_segment_storage.size(),
+                                 [this](const size_type block_no) {
+                                   return m_segment_storage.written(block_no, k_checksum_write_tracker);
+                                 },
+                                 num_threads);
+  if (reset_tracking) {
+    m_segment_storage.reset_write_tracking(k_checksum_write_tracker);
+  }
+
+  // Management data files are recorded with their paths relative to the datastore directory
+  const auto datastore_dir_path = priv_make_datastore_dir_path(base_dir_path) + "/";
+  auto file_paths
+      = segment_memory_allocator::serialized_files(priv_make_file_name(base_dir_path,
+                                                                       k_segment_memory_allocator_prefix));
+  file_paths.push_back(priv_make_file_name(base_dir_path, k_named_object_directory_prefix));
+  for (const auto &path : file_paths) {
+    if (!m_checksum_table.update_file(path.substr(datastore_dir_path.size()), path)) {
+      return false;
+    }
+  }
+
+  if (!m_checksum_table.serialize(priv_make_file_name(base_dir_path, k_checksum_file_name))) {
+    std::cerr << "Failed to record checksums" << std::endl;
+    return false;
+  }
+#endif
+  return true;
+}
+
+// ---------------------------------------- For versions ---------------------------------------- //
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+std::string
+manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_make_version_dir_path(const std::string &base_dir_path) {
+  return base_dir_path + "/" + k_version_dir_name;
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_start_version_tracking(
+    [[maybe_unused]] const bool load_modified_chunks) {
+  version_catalog catalog(priv_make_version_dir_path(m_base_dir_path), k_chunk_size);
+  bool known;
+  std::vector<uint64_t> modified_chunks;
+  if (!catalog.load_head(&m_parent_version, &known, &modified_chunks)) {
+    m_parent_version = k_no_version;
+    return true; // The next version will store the whole segment
+  }
+  if (m_parent_version == k_no_version) {
+    return true; // No version has been made
+  }
+
+#ifdef METALL_ENABLE_VERSION_TRACKING
+  // The chunks modified before this open are given by the head state
+  if (known && load_modified_chunks && m_segment_storage.start_write_tracking(k_chunk_size)) {
+    m_segment_storage.reset_write_tracking(k_version_write_tracker);
+    for (const auto chunk_no : modified_chunks) {
+      m_segment_storage.mark_written(chunk_no, k_version_write_tracker);
+    }
+  }
+#endif
+
+  // The modified chunks are unknown if this process crashes or writes are not tracked
+  return catalog.store_head(m_parent_version, nullptr);
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+bool manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_store_version_head() {
+#ifdef METALL_ENABLE_VERSION_TRACKING
+  if (m_parent_version == k_no_version) return true;
+
+  std::vector<uint64_t> modified_chunks;
+  for (size_type chunk_no = 0; chunk_no < m_segment_storage.size() / k_chunk_size; ++chunk_no) {
+    if (m_segment_storage.written(chunk_no, k_version_write_tracker)) {
+      modified_chunks.push_back(chunk_no);
+    }
+  }
+  version_catalog catalog(priv_make_version_dir_path(m_base_dir_path), k_chunk_size);
+  return catalog.store_head(m_parent_version, &modified_chunks);
+#else
+  return true; // The head state stored at the open tells that the modified chunks are unknown
+#endif
+}
+
 // ---------------------------------------- File operations ---------------------------------------- //
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 bool
 manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_copy_data_store(const std::string &src_base_dir_path,
                                                                 const std::string &dst_base_dir_path,
-                                                                [[maybe_unused]] const bool overwrite) {
+                                                                const bool overwrite,
+                                                                const size_type num_threads,
+                                                                const progress_handler_type &progress) {
   const std::string src_datastore_dir_path = priv_make_datastore_dir_path(src_base_dir_path);
   if (!util::directory_exist(src_datastore_dir_path)) {
     std::cerr << "Source directory does not exist: " << src_datastore_dir_path << std::endl;
@@ -525,19 +1314,80 @@ manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_copy_data_store(const std::strin
     }
   }
 
+  // Files that are not in the source, e.g., extra block files, must not remain
   const std::string dst_datastore_dir_path = priv_make_datastore_dir_path(dst_base_dir_path);
+  if (util::directory_exist(dst_datastore_dir_path)) {
+    if (!overwrite) {
+      std::cerr << "Destination data store already exists: " << dst_datastore_dir_path << std::endl;
+      return false;
+    }
+    if (!util::remove_directory_parallel(dst_datastore_dir_path, num_threads)) {
+      return false;
+    }
+  }
+
+  if (!util::copy_directory_parallel(src_datastore_dir_path, dst_datastore_dir_path, num_threads, true, progress)) {
+    return false;
+  }
 
-  assert(*(src_datastore_dir_path.end()) != '/');
-  return util::clone_file(src_datastore_dir_path, dst_datastore_dir_path, true);
+  // Gather striped block files into the destination
+  const auto src_segment_path = priv_make_file_name(src_base_dir_path, k_segment_prefix);
+  if (segment_storage_type::striped(src_segment_path)) {
+    std::vector<std::pair<std::string, std::string>> files;
+    for (const auto &path : segment_storage_type::striped_block_files(src_segment_path)) {
+      files.emplace_back(path, dst_datastore_dir_path + path.substr(path.find_last_of('/')));
+    }
+    const auto dst_stripe_file_path
+        = segment_storage_type::stripe_file_name(priv_make_file_name(dst_base_dir_path, k_segment_prefix));
+    if (!util::copy_files_parallel(files, num_threads, true)
+        || (util::file_exist(dst_stripe_file_path) && !util::remove_file(dst_stripe_file_path))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
+std::vector<typename manager_kernel<chnk_no, chnk_sz, alloc_t>::size_type>
+manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_make_stripe_weights(const std::vector<std::string> &stripe_dir_paths,
+                                                                    const stripe_placement placement) {
+  if (placement != stripe_placement::capacity || stripe_dir_paths.empty()) {
+    return {}; // Round-robin
+  }
+
+  // Quantize the available spaces so that a round of the placement is short
+  constexpr size_type k_max_weight = 16;
+  std::vector<double> spaces;
+  for (const auto &path : stripe_dir_paths) {
+    if (!util::directory_exist(path) && !util::create_directory(path)) {
+      std::cerr << "Failed to create directory: " << path << std::endl;
+      return {};
+    }
+    spaces.push_back(std::max<double>(util::get_available_space(path), 0));
+  }
+  const double max_space = *std::max_element(spaces.begin(), spaces.end());
+  std::vector<size_type> weights;
+  for (const auto space : spaces) {
+    weights.push_back(std::max<size_type>(1, (max_space > 0) ? std::llround(space / max_space * k_max_weight) : 1));
+  }
+  return weights;
 }
 
 template <typename chnk_no, std::size_t chnk_sz, typename alloc_t>
 bool
-manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_remove_data_store(const std::string &dir_path) {
+manager_kernel<chnk_no, chnk_sz, alloc_t>::priv_remove_data_store(const std::string &dir_path,
+                                                                  const size_type num_threads,
+                                                                  const progress_handler_type &progress) {
   if (!util::directory_exist(dir_path)) {
     return false;
   }
-  return util::remove_file(dir_path);
+  const auto segment_path = priv_make_file_name(dir_path, k_segment_prefix);
+  if (segment_storage_type::striped(segment_path)
+      && (!util::remove_files_parallel(segment_storage_type::striped_block_files(segment_path), num_threads)
+          || !segment_storage_type::remove_stripes(segment_path))) {
+    return false;
+  }
+  return util::remove_directory_parallel(dir_path, num_threads, progress);
 }
 
 } // namespace kernel
@@ -14,7 +14,14 @@ namespace kernel {
 template <typename chunk_no_type, std::size_t k_chunk_size, typename allocator_type>
 template <typename out_stream_type>
 void manager_kernel<chunk_no_type, k_chunk_size, allocator_type>::profile(out_stream_type *log_out) const {
-  m_segment_memory_allocator.profile(log_out);
+  // The allocator state is not loaded at open in the read-only mode and
+  // profiling the allocator clears its object cache
+  auto *const self = const_cast<self_type *>(this);
+  if (!self->priv_load_segment_memory_allocator()) {
+    std::cerr << "Failed to load the allocator state" << std::endl;
+    return;
+  }
+  self->m_segment_memory_allocator.profile(log_out);
 }
 
 } // namespace kernel
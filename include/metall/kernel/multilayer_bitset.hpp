@@ -166,6 +166,18 @@ class multilayer_bitset {
     }
   }
 
+  /// \brief Sets the given bit
+  void set(const std::size_t num_bits, const ssize_t bit_no) {
+    const std::size_t num_bits_power2 = util::next_power_of_2(num_bits);
+    if (num_bits_power2 <= k_num_bits_in_block) {
+      bs::set(&m_data.block, bit_no);
+    } else {
+      const std::size_t idx = util::log2_dynamic(num_bits_power2);
+      set_in_multilayers(mlbs::k_num_layers_table[idx], mlbs::k_num_index_blocks_table[idx],
+                         mlbs::k_num_blocks_table[idx], bit_no);
+    }
+  }
+
   /// \brief Resets the given bit
   void reset(const std::size_t num_bits, const ssize_t bit_no) {
     const std::size_t num_bits_power2 = util::next_power_of_2(num_bits);
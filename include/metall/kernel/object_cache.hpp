@@ -140,6 +140,19 @@ class object_cache {
     return true;
   }
 
+  /// \brief Locks all caches so that the other threads cannot use them until unlock_all() is called
+  void lock_all() {
+#if ENABLE_MUTEX_IN_METALL_OBJECT_CACHE
+    for (auto &mutex : m_mutex) mutex.lock();
+#endif
+  }
+
+  void unlock_all() {
+#if ENABLE_MUTEX_IN_METALL_OBJECT_CACHE
+    for (auto &mutex : m_mutex) mutex.unlock();
+#endif
+  }
+
   void clear() {
     for (auto& table : m_cache_table) {
       table.clear();
@@ -0,0 +1,467 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_KERNEL_OPERATION_LOG_HPP
+#define METALL_KERNEL_OPERATION_LOG_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <functional>
+
+#include <metall/detail/utility/file.hpp>
+
+#ifndef METALL_OPERATION_LOG_BUFFER_SIZE
+#define METALL_OPERATION_LOG_BUFFER_SIZE (1ULL << 16ULL)
+#endif
+
+namespace metall {
+namespace kernel {
+
+namespace {
+namespace util = metall::detail::utility;
+}
+
+/// \brief Append-only log of the mutations to the management data (chunk directory and named object directory).
+/// Records are appended to one of multiple buffers chosen by the calling thread so that threads rarely contend.
+/// A full buffer is handed to a background thread that writes it to the file as a batch;
+/// commit() writes all buffered records and waits until they reach the storage (group commit).
+/// Each record has a sequence number taken while the caller holds the lock that orders the mutation;
+/// replay sorts the records by it and stops at the first missing number
+/// so that the replayed operations are always a prefix of the logged ones.
+/// Each batch has a checksum; a partially written batch at the end of the file is discarded at replay.
+/// Every record is an absolute assignment (e.g., 'chunk X holds bin B' or 'slot S of chunk X is used')
+/// so that replaying the whole log on top of any management data serialized after the log was started
+/// produces the state at the last committed batch.
+/// This class is thread-safe.
+class operation_log {
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Public types and static values
+  // -------------------------------------------------------------------------------- //
+  enum class record_type : uint8_t {
+    chunk_insert = 1,
+    chunk_erase = 2,
+    slot_mark = 3,
+    slot_unmark = 4,
+    named_object_insert = 5,
+    named_object_erase = 6
+  };
+
+  /// \brief A replayed record.
+  /// chunk_insert: (value0, value1) = (chunk no, bin no)
+  /// chunk_erase: value0 = chunk no
+  /// slot_mark and slot_unmark: (value0, value1) = (chunk no, slot no)
+  /// named_object_insert: (name, value0, value1) = (name, offset, length)
+  /// named_object_erase: name
+  struct record {
+    uint64_t sequence_no;
+    record_type type;
+    uint64_t value0;
+    uint64_t value1;
+    std::string name;
+  };
+
+ private:
+  // -------------------------------------------------------------------------------- //
+  // Private types and static values
+  // -------------------------------------------------------------------------------- //
+  static constexpr uint64_t k_batch_magic = 0x4d45544c4c4f4732ULL; // "METLLOG2"
+
+  struct batch_header {
+    uint64_t magic;
+    uint64_t payload_size;
+    uint64_t checksum;
+  };
+
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Constructor & assign operator
+  // -------------------------------------------------------------------------------- //
+  /// \brief Constructor
+  /// \param buffer_size The size of each buffer in byte
+  /// \param num_buffers The number of buffers; if 0, uses the number of hardware threads
+  explicit operation_log(const std::size_t buffer_size = METALL_OPERATION_LOG_BUFFER_SIZE,
+                         const std::size_t num_buffers = 0)
+      : m_buffer_size(buffer_size),
+        m_num_buffers(std::max(num_buffers > 0 ? num_buffers : (std::size_t)std::thread::hardware_concurrency(),
+                               (std::size_t)1)),
+        m_buffers(new buffer_type[m_num_buffers]) {}
+
+  ~operation_log() {
+    close();
+  }
+
+  operation_log(const operation_log &) = delete;
+  operation_log &operator=(const operation_log &) = delete;
+  operation_log(operation_log &&) = delete;
+  operation_log &operator=(operation_log &&) = delete;
+
+  // -------------------------------------------------------------------------------- //
+  // Public methods
+  // -------------------------------------------------------------------------------- //
+  /// \brief Creates a log file to append records; an existing file is truncated.
+  /// Sequence numbers start over from 0.
+  /// \param path A path to the log file
+  /// \return Returns true on success; otherwise, false
+  bool open(const std::string &path) {
+    close();
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_TRUNC, 0644);
+    if (m_fd == -1) {
+      ::perror("open");
+      std::cerr << "Cannot open the operation log: " << path << std::endl;
+      return false;
+    }
+    m_next_sequence_no = 0;
+    m_stop_writer = false;
+    m_writer = std::thread([this]() { priv_writer_main(); });
+    return true;
+  }
+
+  /// \brief Commits buffered records and closes the file.
+  void close() {
+    if (!is_open()) return;
+    {
+      std::lock_guard<std::mutex> guard(m_full_batches_mutex);
+      m_stop_writer = true;
+    }
+    m_full_batches_cv.notify_all();
+    m_writer.join();
+    commit();
+    util::os_close(m_fd);
+    m_fd = -1;
+  }
+
+  bool is_open() const {
+    return m_fd != -1;
+  }
+
+  /// \brief Writes buffered records to the file and waits until they reach the storage.
+  /// \return Returns true on success; otherwise, false
+  bool commit() {
+    std::lock_guard<std::mutex> write_lock(m_write_mutex);
+    if (!is_open()) return true;
+
+    // Batches taken by the writer thread have already been written as it holds the write lock during the I/O
+    std::vector<std::vector<char>> batches;
+    {
+      std::lock_guard<std::mutex> guard(m_full_batches_mutex);
+      batches.swap(m_full_batches);
+    }
+    m_full_batches_cv.notify_all(); // Wakes up threads waiting for the queue to drain
+    for (std::size_t i = 0; i < m_num_buffers; ++i) {
+      std::lock_guard<std::mutex> guard(m_buffers[i].mutex);
+      if (m_buffers[i].records.empty()) continue;
+      batches.emplace_back();
+      batches.back().swap(m_buffers[i].records);
+    }
+
+    bool ret = true;
+    for (const auto &batch : batches) {
+      ret &= priv_write_batch(batch);
+    }
+    if (::fdatasync(m_fd) != 0) {
+      ::perror("fdatasync");
+      return false;
+    }
+    return ret;
+  }
+
+  /// \brief Discards all records, e.g., after the management data is serialized.
+  /// \return Returns true on success; otherwise, false
+  /// No record must be appended concurrently.
+  bool clear() {
+    std::lock_guard<std::mutex> write_lock(m_write_mutex);
+    {
+      std::lock_guard<std::mutex> guard(m_full_batches_mutex);
+      m_full_batches.clear();
+    }
+    m_full_batches_cv.notify_all();
+    for (std::size_t i = 0; i < m_num_buffers; ++i) {
+      std::lock_guard<std::mutex> guard(m_buffers[i].mutex);
+      m_buffers[i].records.clear();
+    }
+    m_next_sequence_no = 0;
+    if (!is_open()) return true;
+    if (::ftruncate(m_fd, 0) != 0 || !util::os_fsync(m_fd)) {
+      ::perror("ftruncate");
+      std::cerr << "Cannot clear the operation log" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  void log_chunk_insert(const uint64_t chunk_no, const uint64_t bin_no) {
+    priv_append(record_type::chunk_insert, chunk_no, bin_no);
+  }
+
+  void log_chunk_erase(const uint64_t chunk_no) {
+    priv_append(record_type::chunk_erase, chunk_no, 0);
+  }
+
+  void log_slot_mark(const uint64_t chunk_no, const uint64_t slot_no) {
+    priv_append(record_type::slot_mark, chunk_no, slot_no);
+  }
+
+  void log_slot_unmark(const uint64_t chunk_no, const uint64_t slot_no) {
+    priv_append(record_type::slot_unmark, chunk_no, slot_no);
+  }
+
+  void log_named_object_insert(const std::string &name, const uint64_t offset, const uint64_t length) {
+    priv_append(record_type::named_object_insert, offset, length, &name);
+  }
+
+  void log_named_object_erase(const std::string &name) {
+    priv_append(record_type::named_object_erase, 0, 0, &name);
+  }
+
+  /// \brief Replays committed records in a log file in the order of their sequence numbers.
+  /// A torn or corrupted batch and everything after it are ignored;
+  /// so are the records after the first missing sequence number.
+  /// \tparam visitor_type A function type that takes a const reference of record and returns bool
+  /// \param path A path to the log file
+  /// \param visitor Called for each record in the logged order; returning false stops the replay as an error
+  /// \param truncate If true, truncates the ignored part from the file
+  /// so that new records are appended right after the last valid batch
+  /// \return Returns true on success; otherwise, false
+  template <typename visitor_type>
+  static bool replay(const std::string &path, visitor_type &&visitor, const bool truncate = true) {
+    const int fd = ::open(path.c_str(), truncate ? O_RDWR : O_RDONLY);
+    if (fd == -1) {
+      ::perror("open");
+      std::cerr << "Cannot open the operation log: " << path << std::endl;
+      return false;
+    }
+
+    const ssize_t file_size = util::get_file_size(path);
+    bool succeeded = true;
+    off_t valid_size = 0;
+    std::vector<char> payload;
+    std::vector<record> records;
+    while (true) {
+      batch_header header;
+      if (!priv_read_fully(fd, &header, sizeof(header), valid_size)
+          || header.magic != k_batch_magic
+          || header.payload_size > static_cast<uint64_t>(file_size - valid_size - sizeof(header))) {
+        break;
+      }
+      payload.resize(header.payload_size);
+      if (!priv_read_fully(fd, payload.data(), payload.size(), valid_size + sizeof(header))
+          || priv_checksum(payload.data(), payload.size()) != header.checksum) {
+        break;
+      }
+
+      std::size_t pos = 0;
+      while (pos < payload.size()) {
+        records.emplace_back();
+        if (!priv_decode(payload, &pos, &records.back())) {
+          std::cerr << "Invalid record in the operation log: " << path << std::endl;
+          succeeded = false;
+          break;
+        }
+      }
+      if (!succeeded) break;
+      valid_size += sizeof(header) + header.payload_size;
+    }
+
+    if (succeeded) {
+      std::sort(records.begin(), records.end(),
+                [](const record &lhs, const record &rhs) { return lhs.sequence_no < rhs.sequence_no; });
+      for (std::size_t i = 0; i < records.size() && records[i].sequence_no == i; ++i) {
+        if (!visitor(static_cast<const record &>(records[i]))) {
+          succeeded = false;
+          break;
+        }
+      }
+    }
+
+    if (succeeded && truncate && ::ftruncate(fd, valid_size) != 0) {
+      ::perror("ftruncate");
+      succeeded = false;
+    }
+    util::os_close(fd);
+
+    return succeeded;
+  }
+
+ private:
+  // -------------------------------------------------------------------------------- //
+  // Private methods
+  // -------------------------------------------------------------------------------- //
+  struct buffer_type {
+    std::mutex mutex;
+    std::vector<char> records;
+  };
+
+  void priv_append(const record_type type, const uint64_t value0, const uint64_t value1,
+                   const std::string *const name = nullptr) {
+    if (!is_open()) return;
+
+    thread_local static const std::size_t hashed_thread_id = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    auto &buffer = m_buffers[hashed_thread_id % m_num_buffers];
+    std::vector<char> full_batch;
+    {
+      std::lock_guard<std::mutex> guard(buffer.mutex);
+      const uint64_t sequence_no = m_next_sequence_no.fetch_add(1, std::memory_order_relaxed);
+      priv_push(&buffer.records, &sequence_no, sizeof(sequence_no));
+      buffer.records.push_back(static_cast<char>(type));
+      if (name) {
+        const auto length = static_cast<uint32_t>(name->size());
+        priv_push(&buffer.records, &length, sizeof(length));
+        priv_push(&buffer.records, name->data(), name->size());
+      }
+      if (type != record_type::named_object_erase) {
+        priv_push(&buffer.records, &value0, sizeof(value0));
+        if (type != record_type::chunk_erase) priv_push(&buffer.records, &value1, sizeof(value1));
+      }
+      if (buffer.records.size() < m_buffer_size) return;
+      full_batch.swap(buffer.records);
+    }
+
+    // Hand the batch over to the writer thread; wait only if it falls far behind
+    std::unique_lock<std::mutex> lock(m_full_batches_mutex);
+    m_full_batches_cv.wait(lock, [this] { return m_full_batches.size() < m_num_buffers * 2 || m_stop_writer; });
+    m_full_batches.emplace_back(std::move(full_batch));
+    m_full_batches_cv.notify_all();
+  }
+
+  static void priv_push(std::vector<char> *const buffer, const void *const data, const std::size_t size) {
+    const auto *const p = static_cast<const char *>(data);
+    buffer->insert(buffer->end(), p, p + size);
+  }
+
+  /// \brief Writes full batches in the background.
+  /// Batches are not synchronized with the storage until commit() is called.
+  void priv_writer_main() {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(m_full_batches_mutex);
+        m_full_batches_cv.wait(lock, [this] { return !m_full_batches.empty() || m_stop_writer; });
+        if (m_stop_writer) return; // close() commits the rest
+      }
+
+      // Take the batches holding the write lock so that commit() does not miss batches in flight
+      std::lock_guard<std::mutex> write_lock(m_write_mutex);
+      std::vector<std::vector<char>> batches;
+      {
+        std::lock_guard<std::mutex> guard(m_full_batches_mutex);
+        batches.swap(m_full_batches);
+      }
+      m_full_batches_cv.notify_all();
+      for (const auto &batch : batches) {
+        priv_write_batch(batch);
+      }
+    }
+  }
+
+  /// \brief Writes a batch to the file. The caller must hold the write lock.
+  bool priv_write_batch(const std::vector<char> &batch) {
+    if (batch.empty()) return true;
+    const batch_header header{k_batch_magic, batch.size(), priv_checksum(batch.data(), batch.size())};
+    if (!priv_write_fully(m_fd, &header, sizeof(header)) || !priv_write_fully(m_fd, batch.data(), batch.size())) {
+      std::cerr << "Cannot write the operation log" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  static bool priv_decode(const std::vector<char> &payload, std::size_t *const pos, record *const rec) {
+    auto pop = [&payload, pos](void *const out, const std::size_t size) {
+      if (*pos + size > payload.size()) return false;
+      std::memcpy(out, payload.data() + *pos, size);
+      *pos += size;
+      return true;
+    };
+
+    if (!pop(&rec->sequence_no, sizeof(rec->sequence_no))) return false;
+    uint8_t type;
+    if (!pop(&type, sizeof(type))) return false;
+    if (type < static_cast<uint8_t>(record_type::chunk_insert)
+        || static_cast<uint8_t>(record_type::named_object_erase) < type) {
+      return false;
+    }
+    rec->type = static_cast<record_type>(type);
+    rec->value0 = rec->value1 = 0;
+    rec->name.clear();
+
+    if (rec->type == record_type::named_object_insert || rec->type == record_type::named_object_erase) {
+      uint32_t length;
+      if (!pop(&length, sizeof(length)) || *pos + length > payload.size()) return false;
+      rec->name.assign(payload.data() + *pos, length);
+      *pos += length;
+    }
+    if (rec->type != record_type::named_object_erase) {
+      if (!pop(&rec->value0, sizeof(rec->value0))) return false;
+      if (rec->type != record_type::chunk_erase && !pop(&rec->value1, sizeof(rec->value1))) return false;
+    }
+    return true;
+  }
+
+  /// \brief FNV-1a
+  static uint64_t priv_checksum(const char *const data, const std::size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (std::size_t i = 0; i < size; ++i) {
+      hash ^= static_cast<unsigned char>(data[i]);
+      hash *= 0x100000001b3ULL;
+    }
+    return hash;
+  }
+
+  static bool priv_write_fully(const int fd, const void *const buf, const std::size_t size) {
+    std::size_t written = 0;
+    while (written < size) {
+      const ssize_t ret = ::write(fd, static_cast<const char *>(buf) + written, size - written);
+      if (ret == -1) {
+        if (errno == EINTR) continue;
+        ::perror("write");
+        return false;
+      }
+      written += ret;
+    }
+    return true;
+  }
+
+  static bool priv_read_fully(const int fd, void *const buf, const std::size_t size, const off_t offset) {
+    std::size_t read = 0;
+    while (read < size) {
+      const ssize_t ret = ::pread(fd, static_cast<char *>(buf) + read, size - read, offset + read);
+      if (ret == -1 && errno == EINTR) continue;
+      if (ret <= 0) return false;
+      read += ret;
+    }
+    return true;
+  }
+
+  // -------------------------------------------------------------------------------- //
+  // Private fields
+  // -------------------------------------------------------------------------------- //
+  int m_fd{-1};
+  std::size_t m_buffer_size;
+  std::size_t m_num_buffers;
+  std::unique_ptr<buffer_type[]> m_buffers;
+  std::atomic<uint64_t> m_next_sequence_no{0};
+  std::mutex m_write_mutex; // Serializes writes to the file
+  std::mutex m_full_batches_mutex;
+  std::condition_variable m_full_batches_cv;
+  std::vector<std::vector<char>> m_full_batches;
+  std::thread m_writer;
+  bool m_stop_writer{false};
+};
+
+} // namespace kernel
+} // namespace metall
+
+#endif //METALL_KERNEL_OPERATION_LOG_HPP
@@ -0,0 +1,142 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_KERNEL_REACHABILITY_MARKER_HPP
+#define METALL_KERNEL_REACHABILITY_MARKER_HPP
+
+#include <iostream>
+#include <functional>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+namespace metall {
+namespace kernel {
+
+/// \brief Collects allocations reachable from named objects to rebuild the allocator state.
+/// Given to the visitor of recover(); the visitor walks the object graphs and marks every allocation it reaches.
+/// mark() is thread-safe so that a visitor can walk graphs using multiple threads.
+/// \tparam difference_type Offset type in the segment
+/// \tparam size_type Size type
+/// \tparam k_chunk_size Chunk size of the allocator; marks are grouped by chunk
+template <typename difference_type, typename size_type, std::size_t k_chunk_size>
+class reachability_marker {
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Public types and static values
+  // -------------------------------------------------------------------------------- //
+  /// \brief Returns the size of the allocation at a given offset recorded in the last serialized state (0 if unknown)
+  using size_hint_function = std::function<size_type(difference_type)>;
+  /// \brief Returns the offset of a named object or -1 if there is no object with the name
+  using name_lookup_function = std::function<difference_type(const char *)>;
+  /// \brief Marked allocations (offset, object size) per group of chunks
+  using mark_list_type = std::vector<std::pair<difference_type, size_type>>;
+
+ private:
+  // -------------------------------------------------------------------------------- //
+  // Private types and static values
+  // -------------------------------------------------------------------------------- //
+  struct shard_type {
+    std::mutex mutex;
+    std::unordered_map<difference_type, size_type> marks;
+  };
+
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Constructor & assign operator
+  // -------------------------------------------------------------------------------- //
+  reachability_marker(void *const segment, const size_type segment_size,
+                      size_hint_function size_hint, name_lookup_function name_lookup,
+                      const std::size_t num_shards)
+      : m_segment(static_cast<char *>(segment)),
+        m_segment_size(segment_size),
+        m_size_hint(std::move(size_hint)),
+        m_name_lookup(std::move(name_lookup)),
+        m_shards(std::max(num_shards, (std::size_t)1)),
+        m_num_errors(0) {}
+
+  ~reachability_marker() = default;
+  reachability_marker(const reachability_marker &) = delete;
+  reachability_marker &operator=(const reachability_marker &) = delete;
+  reachability_marker(reachability_marker &&) = delete;
+  reachability_marker &operator=(reachability_marker &&) = delete;
+
+  // -------------------------------------------------------------------------------- //
+  // Public methods
+  // -------------------------------------------------------------------------------- //
+  /// \brief Finds a named object in the last serialized state
+  /// \tparam T Type of the object
+  /// \param name Name of the object
+  /// \return Returns a pointer to the object or nullptr
+  template <typename T>
+  T *find(const char *const name) const {
+    const difference_type offset = m_name_lookup(name);
+    if (offset < 0) return nullptr;
+    return reinterpret_cast<T *>(m_segment + offset);
+  }
+
+  /// \brief Marks an allocation as reachable
+  /// \param addr The address returned by allocate() or an allocator
+  /// \param nbytes The size given to allocate();
+  /// can be 0 if the allocation was done before the last serialization (e.g., close())
+  /// \return Returns true if the allocation was not marked yet, i.e., the visitor has to walk it;
+  /// returns false if it was already marked or it is invalid
+  bool mark(const void *const addr, const size_type nbytes = 0) {
+    const difference_type offset = static_cast<const char *>(addr) - m_segment;
+    if (!addr || offset < 0 || static_cast<size_type>(offset) >= m_segment_size) {
+      std::cerr << "Address is out of the segment: " << addr << std::endl;
+      ++m_num_errors;
+      return false;
+    }
+
+    const size_type size = (nbytes > 0) ? nbytes : m_size_hint(offset);
+    if (size == 0) {
+      std::cerr << "The size of the allocation at " << addr << " is unknown" << std::endl;
+      ++m_num_errors;
+      return false;
+    }
+
+    auto &shard = m_shards[(offset / k_chunk_size) % m_shards.size()];
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    return shard.marks.emplace(offset, size).second;
+  }
+
+  /// \brief Returns the number of invalid marks
+  std::size_t num_errors() const {
+    return m_num_errors.load();
+  }
+
+  /// \brief Moves marked allocations out.
+  /// Every chunk is covered by exactly one list, i.e., lists can be processed in parallel.
+  /// \return Returns lists of marked allocations (not sorted)
+  std::vector<mark_list_type> extract() {
+    std::vector<mark_list_type> lists(m_shards.size());
+    for (std::size_t i = 0; i < m_shards.size(); ++i) {
+      std::lock_guard<std::mutex> guard(m_shards[i].mutex);
+      lists[i].assign(m_shards[i].marks.begin(), m_shards[i].marks.end());
+      m_shards[i].marks.clear();
+    }
+    return lists;
+  }
+
+ private:
+  // -------------------------------------------------------------------------------- //
+  // Private fields
+  // -------------------------------------------------------------------------------- //
+  char *m_segment;
+  size_type m_segment_size;
+  size_hint_function m_size_hint;
+  name_lookup_function m_name_lookup;
+  std::vector<shard_type> m_shards;
+  std::atomic<std::size_t> m_num_errors;
+};
+
+} // namespace kernel
+} // namespace metall
+
+#endif //METALL_KERNEL_REACHABILITY_MARKER_HPP
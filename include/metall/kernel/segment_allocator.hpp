@@ -13,12 +13,18 @@
 #include <memory>
 #include <future>
 #include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 #include <metall/kernel/bin_number_manager.hpp>
 #include <metall/kernel/bin_directory.hpp>
 #include <metall/kernel/chunk_directory.hpp>
 #include <metall/kernel/object_size_manager.hpp>
+#include <metall/kernel/operation_log.hpp>
 #include <metall/detail/utility/char_ptr_holder.hpp>
+#include <metall/detail/utility/parallel_for.hpp>
 
 #define ENABLE_MUTEX_IN_METALL_SEGMENT_ALLOCATOR 1
 #if ENABLE_MUTEX_IN_METALL_SEGMENT_ALLOCATOR
@@ -90,7 +96,8 @@ class segment_allocator {
                              const internal_data_allocator_type &allocator = internal_data_allocator_type())
       : m_non_full_chunk_bin(allocator),
         m_chunk_directory(allocator),
-        m_segment_storage(segment_storage)
+        m_segment_storage(segment_storage),
+        m_operation_log(nullptr)
 #ifndef METALL_DISABLE_OBJECT_CACHE
       , m_object_cache(allocator)
 #endif
@@ -129,6 +136,26 @@ class segment_allocator {
     return offset;
   }
 
+  /// \brief Allocates memory space of a size known at compile time
+  /// \tparam nbytes The size to allocate; its bin number is resolved at compile time
+  /// \return The offset of the allocated memory space
+  template <size_type nbytes>
+  difference_type allocate() {
+    constexpr bin_no_type bin_no = bin_no_mngr::to_bin_no(nbytes);
+    static_assert(nbytes <= bin_no_mngr::to_object_size(bin_no_mngr::num_bins() - 1), "Too large object size");
+
+    difference_type offset;
+    if constexpr (priv_small_object_bin(bin_no)) {
+      offset = priv_allocate_small_object(bin_no);
+    } else {
+      offset = priv_allocate_large_object(bin_no);
+    }
+    assert(offset >= 0);
+    assert((difference_type)offset < (difference_type)size());
+
+    return offset;
+  }
+
   // \TODO: implement
   difference_type allocate_aligned([[maybe_unused]] const size_type nbytes, [[maybe_unused]] const size_type alignment) {
     assert(false);
@@ -151,16 +178,64 @@ class segment_allocator {
     }
   }
 
+  /// \brief Deallocates memory space whose size is known.
+  /// The bin number is computed from the size without looking up the chunk directory;
+  /// the size must be the one given when the memory space was allocated.
+  /// \param offset The offset of the memory space
+  /// \param nbytes The size given when it was allocated
+  void deallocate(const difference_type offset, const size_type nbytes) {
+    assert(offset >= 0);
+    assert((difference_type)offset < (difference_type)size());
+
+    const bin_no_type bin_no = bin_no_mngr::to_bin_no(nbytes);
+#ifndef NDEBUG
+    if (bin_no != m_chunk_directory.bin_no(offset / k_chunk_size)) {
+      std::cerr << "Deallocation size " << nbytes << " does not match the allocation at offset " << offset
+                << std::endl;
+      assert(false);
+    }
+#endif
+
+    if (priv_small_object_bin(bin_no)) {
+      priv_deallocate_small_object(offset, bin_no);
+    } else {
+      priv_deallocate_large_object(offset / k_chunk_size, bin_no);
+    }
+  }
+
   /// \brief
   /// \return Returns the size of the segment range being used
   size_type size() const {
     return m_chunk_directory.size() * k_chunk_size;
   }
 
-  bool serialize(const std::string &base_path) {
+  /// \brief Blocks allocations and deallocations by other threads until unlock() is called,
+  /// e.g., to take a snapshot. The object cache is cleared; serialize() can be called while locked.
+  void lock() {
 #ifndef METALL_DISABLE_OBJECT_CACHE
+    m_object_cache.lock_all();
     priv_clear_object_cache();
 #endif
+#if ENABLE_MUTEX_IN_METALL_SEGMENT_ALLOCATOR
+    for (auto &mutex : m_bin_mutex) mutex.lock();
+    m_chunk_mutex.lock();
+#endif
+  }
+
+  void unlock() {
+#if ENABLE_MUTEX_IN_METALL_SEGMENT_ALLOCATOR
+    m_chunk_mutex.unlock();
+    for (auto &mutex : m_bin_mutex) mutex.unlock();
+#endif
+#ifndef METALL_DISABLE_OBJECT_CACHE
+    m_object_cache.unlock_all();
+#endif
+  }
+
+  bool serialize(const std::string &base_path) {
+#ifndef METALL_DISABLE_OBJECT_CACHE
+    priv_clear_object_cache(); // Does not lock anything if the cache is empty, e.g., lock() was called
+#endif
 
     if (!m_non_full_chunk_bin.serialize(priv_make_file_name(base_path, k_non_full_chunk_bin_file_name).c_str())) {
       std::cerr << "Failed to serialize bin directory" << std::endl;
@@ -173,6 +248,12 @@ class segment_allocator {
     return true;
   }
 
+  /// \brief Returns the paths of the files written by serialize()
+  static std::vector<std::string> serialized_files(const std::string &base_path) {
+    return {priv_make_file_name(base_path, k_non_full_chunk_bin_file_name),
+            priv_make_file_name(base_path, k_chunk_directory_file_name)};
+  }
+
   bool deserialize(const std::string &base_path) {
     if (!m_non_full_chunk_bin.deserialize(priv_make_file_name(base_path, k_non_full_chunk_bin_file_name).c_str())) {
       std::cerr << "Failed to deserialize bin directory" << std::endl;
@@ -185,8 +266,220 @@ class segment_allocator {
     return true;
   }
 
+  /// \brief Records the following chunk and slot mutations into the given log.
+  /// \param log A pointer to an opened log or nullptr to stop logging
+  void set_operation_log(operation_log *const log) {
+    m_operation_log = log;
+  }
+
+  /// \brief Redoes a chunk or slot mutation recorded in an operation log.
+  /// Records that do not match the current state are ignored,
+  /// as later records in the same log bring the chunk to its final state.
+  /// finish_redo() must be called after all records are redone.
+  /// \param rec A record to redo
+  /// \return Returns false if the record is invalid
+  bool redo(const operation_log::record &rec) {
+    const auto chunk_no = static_cast<chunk_no_type>(rec.value0);
+    switch (rec.type) {
+      case operation_log::record_type::chunk_insert:
+        if (rec.value1 >= bin_no_mngr::num_bins()) return false;
+        m_chunk_directory.insert_at(chunk_no, static_cast<bin_no_type>(rec.value1));
+        return true;
+
+      case operation_log::record_type::chunk_erase:
+        if (chunk_no < m_chunk_directory.size()) m_chunk_directory.erase(chunk_no);
+        return true;
+
+      case operation_log::record_type::slot_mark:
+      case operation_log::record_type::slot_unmark: {
+        if (chunk_no >= m_chunk_directory.size() || m_chunk_directory.empty_chunk(chunk_no)
+            || !priv_small_object_bin(m_chunk_directory.bin_no(chunk_no))
+            || rec.value1 >= m_chunk_directory.slots(chunk_no)) {
+          return true;
+        }
+        const auto slot_no = static_cast<chunk_slot_no_type>(rec.value1);
+        if (rec.type == operation_log::record_type::slot_mark) {
+          m_chunk_directory.mark_slot(chunk_no, slot_no);
+        } else if (m_chunk_directory.slot_marked(chunk_no, slot_no)) {
+          m_chunk_directory.unmark_slot(chunk_no, slot_no);
+        }
+        return true;
+      }
+
+      default:
+        return false;
+    }
+  }
+
+  /// \brief Rebuilds the non-full chunk bin from the chunk directory after redoing operations.
+  void finish_redo() {
+    m_non_full_chunk_bin.clear();
+    for (chunk_no_type chunk_no = 0; chunk_no < m_chunk_directory.size(); ++chunk_no) {
+      if (m_chunk_directory.empty_chunk(chunk_no)) continue;
+      const bin_no_type bin_no = m_chunk_directory.bin_no(chunk_no);
+      if (priv_small_object_bin(bin_no) && !m_chunk_directory.all_slots_marked(chunk_no)) {
+        m_non_full_chunk_bin.insert(bin_no, chunk_no);
+      }
+    }
+    if (m_chunk_directory.size() > 0) {
+      priv_extend_segment(0, m_chunk_directory.size());
+    }
+  }
+
+  /// \brief Returns the size of the allocation that starts at the given offset.
+  /// \param offset
+  /// \return Returns 0 if no allocation starts at the offset
+  size_type allocation_size(const difference_type offset) const {
+    const chunk_no_type chunk_no = offset / k_chunk_size;
+    if (offset < 0 || chunk_no >= m_chunk_directory.size() || !m_chunk_directory.head_chunk(chunk_no)) {
+      return 0;
+    }
+    const bin_no_type bin_no = m_chunk_directory.bin_no(chunk_no);
+    const size_type object_size = bin_no_mngr::to_object_size(bin_no);
+    if ((priv_small_object_bin(bin_no) && (offset % k_chunk_size) % object_size != 0)
+        || (!priv_small_object_bin(bin_no) && offset % k_chunk_size != 0)) {
+      return 0;
+    }
+    return object_size;
+  }
+
+  /// \brief A list of pairs of the head chunk number and the number of chunks.
+  using chunk_range_list_type = std::vector<std::pair<chunk_no_type, size_type>>;
+
+  /// \brief Rebuilds the allocator state so that only the given allocations are in use.
+  /// Chunks are processed in parallel.
+  /// The allocator state is not changed if this function returns false.
+  /// The file space of the chunks that are no longer in use is not freed by this function;
+  /// call free_chunks() with unused_chunks once the new state is safely stored.
+  /// \tparam mark_list_type A container of pairs of the offset and the size of an allocation
+  /// \param lists Lists of allocations; allocations in the same chunk must be in the same list
+  /// \param num_threads The number of threads to use
+  /// \param unused_chunks The chunks that are no longer in use are stored in this list
+  /// \return Returns false if the allocations overlap each other or are not valid allocations
+  template <typename mark_list_type>
+  bool rebuild(std::vector<mark_list_type> &lists, const std::size_t num_threads,
+               chunk_range_list_type *const unused_chunks) {
+    struct chunk_plan {
+      chunk_no_type chunk_no;
+      bin_no_type bin_no;
+      std::size_t begin; // Position of the first allocation in the list
+      std::size_t end;
+    };
+    std::vector<std::vector<chunk_plan>> plans(lists.size());
+    std::atomic<bool> valid(true);
+    const std::size_t max_num_chunks = k_max_size / k_chunk_size;
+
+    // Group allocations by chunk
+    util::parallel_for(lists.size(), num_threads, [&lists, &plans, &valid, max_num_chunks](const std::size_t i) {
+      auto &list = lists[i];
+      std::sort(list.begin(), list.end());
+      for (std::size_t pos = 0; pos < list.size() && valid.load();) {
+        const auto offset = list[pos].first;
+        const auto chunk_no = static_cast<chunk_no_type>(offset / k_chunk_size);
+        const auto bin_no = bin_no_mngr::to_bin_no(list[pos].second);
+        if (offset < 0 || bin_no >= bin_no_mngr::num_bins()
+            || chunk_no + priv_num_chunks(bin_no) > max_num_chunks) {
+          std::cerr << "Invalid allocation at offset " << offset << std::endl;
+          valid.store(false);
+          break;
+        }
+        if (!priv_small_object_bin(bin_no)) {
+          if (offset % k_chunk_size != 0) {
+            std::cerr << "Invalid large allocation at offset " << offset << std::endl;
+            valid.store(false);
+          }
+          plans[i].push_back(chunk_plan{chunk_no, bin_no, pos, pos + 1});
+          ++pos;
+          continue;
+        }
+
+        const size_type object_size = bin_no_mngr::to_object_size(bin_no);
+        std::size_t end = pos;
+        for (; end < list.size() && list[end].first / k_chunk_size == chunk_no; ++end) {
+          if (bin_no_mngr::to_bin_no(list[end].second) != bin_no || (list[end].first % k_chunk_size) % object_size != 0) {
+            std::cerr << "Allocations of different sizes in chunk " << chunk_no << std::endl;
+            valid.store(false);
+            break;
+          }
+        }
+        plans[i].push_back(chunk_plan{chunk_no, bin_no, pos, end});
+        pos = end;
+      }
+    });
+    if (!valid.load()) return false;
+
+    // A chunk can be used by only one allocation group
+    chunk_range_list_type used_chunks;
+    for (const auto &plan_list : plans) {
+      for (const auto &plan : plan_list) {
+        used_chunks.emplace_back(plan.chunk_no, priv_num_chunks(plan.bin_no));
+      }
+    }
+    std::sort(used_chunks.begin(), used_chunks.end());
+    for (std::size_t i = 1; i < used_chunks.size(); ++i) {
+      if (used_chunks[i - 1].first + used_chunks[i - 1].second > used_chunks[i].first) {
+        std::cerr << "Allocations overlap in chunk " << used_chunks[i].first << std::endl;
+        return false;
+      }
+    }
+
+    // Build a new chunk directory; the current state is kept until all steps succeed
+    chunk_directory_type new_directory(m_chunk_directory.get_allocator());
+    new_directory.allocate(max_num_chunks);
+    for (const auto &plan_list : plans) {
+      for (const auto &plan : plan_list) {
+        new_directory.insert_at(plan.chunk_no, plan.bin_no);
+      }
+    }
+
+    // Mark slots; each thread touches different chunks
+    util::parallel_for(lists.size(), num_threads, [&lists, &plans, &new_directory](const std::size_t i) {
+      for (const auto &plan : plans[i]) {
+        if (!priv_small_object_bin(plan.bin_no)) continue;
+        const size_type object_size = bin_no_mngr::to_object_size(plan.bin_no);
+        for (std::size_t pos = plan.begin; pos < plan.end; ++pos) {
+          const auto slot_no = static_cast<chunk_slot_no_type>((lists[i][pos].first % k_chunk_size) / object_size);
+          new_directory.mark_slot(plan.chunk_no, slot_no);
+        }
+      }
+    });
+
+    // Find the chunks that are no longer used
+    unused_chunks->clear();
+    const size_type num_segment_chunks = m_segment_storage->size() / k_chunk_size;
+    for (chunk_no_type chunk_no = 0; chunk_no < num_segment_chunks;) {
+      if (chunk_no < new_directory.size() && !new_directory.empty_chunk(chunk_no)) {
+        ++chunk_no;
+        continue;
+      }
+      chunk_no_type end = chunk_no + 1;
+      while (end < num_segment_chunks && (end >= new_directory.size() || new_directory.empty_chunk(end))) {
+        ++end;
+      }
+      unused_chunks->emplace_back(chunk_no, end - chunk_no);
+      chunk_no = end;
+    }
+
+#ifndef METALL_DISABLE_OBJECT_CACHE
+    m_object_cache.clear();
+#endif
+    m_chunk_directory.swap(new_directory);
+    finish_redo();
+
+    return true;
+  }
+
+  /// \brief Frees the file space of chunks, e.g., the ones returned by rebuild().
+  /// \param chunks A list of pairs of the head chunk number and the number of chunks
+  void free_chunks(const chunk_range_list_type &chunks) {
+    for (const auto &range : chunks) {
+      priv_free_chunk(range.first, range.second);
+    }
+  }
+
+  /// \brief Outputs profile information. The object cache is cleared.
   template <typename out_stream_type>
-  void profile(out_stream_type *log_out) const {
+  void profile(out_stream_type *log_out) {
 #ifndef METALL_DISABLE_OBJECT_CACHE
     priv_clear_object_cache();
 #endif
@@ -241,11 +534,15 @@ class segment_allocator {
   // -------------------------------------------------------------------------------- //
   // Private methods (not designed to be used by the base class)
   // -------------------------------------------------------------------------------- //
-  bool priv_small_object_bin(const bin_no_type bin_no) const {
+  static constexpr bool priv_small_object_bin(const bin_no_type bin_no) {
     return bin_no < k_num_small_bins;
   }
 
-  std::string priv_make_file_name(const std::string &base_name, const std::string &item_name) {
+  static constexpr std::size_t priv_num_chunks(const bin_no_type bin_no) {
+    return priv_small_object_bin(bin_no) ? 1 : (bin_no_mngr::to_object_size(bin_no) + k_chunk_size - 1) / k_chunk_size;
+  }
+
+  static std::string priv_make_file_name(const std::string &base_name, const std::string &item_name) {
     return base_name + "_" + item_name;
   }
 
@@ -289,6 +586,7 @@ class segment_allocator {
         lock_guard_type chunk_guard(m_chunk_mutex);
 #endif
         new_chunk_no = m_chunk_directory.insert(bin_no);
+        if (m_operation_log) m_operation_log->log_chunk_insert(new_chunk_no, bin_no);
         priv_extend_segment(new_chunk_no, 1);
         m_non_full_chunk_bin.insert(bin_no, new_chunk_no);
       }
@@ -299,6 +597,7 @@ class segment_allocator {
 
     assert(!m_chunk_directory.all_slots_marked(chunk_no));
     const chunk_slot_no_type chunk_slot_no = m_chunk_directory.find_and_mark_slot(chunk_no);
+    if (m_operation_log) m_operation_log->log_slot_mark(chunk_no, chunk_slot_no);
 
     if (m_chunk_directory.all_slots_marked(chunk_no)) {
       m_non_full_chunk_bin.pop(bin_no);
@@ -313,6 +612,7 @@ class segment_allocator {
     lock_guard_type chunk_guard(m_chunk_mutex);
 #endif
     const chunk_no_type new_chunk_no = m_chunk_directory.insert(bin_no);
+    if (m_operation_log) m_operation_log->log_chunk_insert(new_chunk_no, bin_no);
     const std::size_t num_chunks = (bin_no_mngr::to_object_size(bin_no) + k_chunk_size - 1) / k_chunk_size;
     priv_extend_segment(new_chunk_no, num_chunks);
     const difference_type offset = k_chunk_size * new_chunk_no;
@@ -366,6 +666,7 @@ class segment_allocator {
     const auto slot_no = static_cast<chunk_slot_no_type>((offset % k_chunk_size) / object_size);
     const bool was_full = m_chunk_directory.all_slots_marked(chunk_no);
     m_chunk_directory.unmark_slot(chunk_no, slot_no);
+    if (m_operation_log) m_operation_log->log_slot_unmark(chunk_no, slot_no);
     if (was_full) {
       m_non_full_chunk_bin.insert(bin_no, chunk_no);
     } else if (m_chunk_directory.all_slots_unmarked(chunk_no)) {
@@ -375,6 +676,7 @@ class segment_allocator {
         lock_guard_type chunk_guard(m_chunk_mutex);
 #endif
         m_chunk_directory.erase(chunk_no);
+        if (m_operation_log) m_operation_log->log_chunk_erase(chunk_no);
         priv_free_chunk(chunk_no, 1);
       }
       m_non_full_chunk_bin.erase(bin_no, chunk_no);
@@ -447,6 +749,7 @@ class segment_allocator {
     lock_guard_type chunk_guard(m_chunk_mutex);
 #endif
     m_chunk_directory.erase(chunk_no);
+    if (m_operation_log) m_operation_log->log_chunk_erase(chunk_no);
     const std::size_t num_chunks = (bin_no_mngr::to_object_size(bin_no) + k_chunk_size - 1) / k_chunk_size;
     priv_free_chunk(chunk_no, num_chunks);
   }
@@ -479,6 +782,7 @@ class segment_allocator {
   non_full_chunk_bin_type m_non_full_chunk_bin;
   chunk_directory_type m_chunk_directory;
   segment_storage_type *m_segment_storage;
+  operation_log *m_operation_log;
 
 #ifndef METALL_DISABLE_OBJECT_CACHE
   small_object_cache_type m_object_cache;
@@ -9,8 +9,58 @@
 #include <string>
 #include <iostream>
 #include <cassert>
+#include <cstring>
+#include <vector>
+#include <future>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <memory>
+#include <map>
+#include <numeric>
+#include <chrono>
+#include <random>
+#include <dirent.h>
 #include <metall/detail/utility/file.hpp>
+#include <metall/detail/utility/file_clone.hpp>
 #include <metall/detail/utility/mmap.hpp>
+#include <metall/detail/utility/parallel_for.hpp>
+#include <metall/detail/utility/io_uring.hpp>
+#include <metall/detail/utility/soft_dirty_page.hpp>
+#include <metall/detail/utility/tier_cache.hpp>
+#include <metall/detail/utility/cow_snapshot.hpp>
+#include <metall/detail/utility/write_tracker.hpp>
+#include <metall/detail/utility/write_fault_handler.hpp>
+#ifdef METALL_USE_COMPRESSION
+#include <metall/detail/utility/compressed_frame_loader.hpp>
+#endif
+
+#ifndef METALL_MAX_NUM_OPEN_THREADS
+#define METALL_MAX_NUM_OPEN_THREADS 16
+#endif
+
+#ifndef METALL_IO_URING_QUEUE_DEPTH
+#define METALL_IO_URING_QUEUE_DEPTH 256
+#endif
+
+#ifndef METALL_SNAPSHOT_COPY_UNIT_SIZE
+#define METALL_SNAPSHOT_COPY_UNIT_SIZE (1ULL << 16ULL)
+#endif
+
+#ifndef METALL_COMPRESSION_FRAME_SIZE
+#define METALL_COMPRESSION_FRAME_SIZE (1ULL << 20ULL)
+#endif
+
+#ifndef METALL_TIERING_UNIT_SIZE
+#define METALL_TIERING_UNIT_SIZE (1ULL << 21ULL)
+#endif
+
+#ifndef METALL_TIERING_INTERVAL_MS
+#define METALL_TIERING_INTERVAL_MS 1000
+#endif
 
 namespace metall {
 namespace kernel {
@@ -21,6 +71,18 @@ namespace util = metall::detail::utility;
 
 /// \brief Segment storage that uses mutiple backing files
 /// The current implementation does not delete files even though that are empty
+/// Asynchronous synchronization (sync_async()) writes back dirty pages using io_uring if it is available;
+/// if METALL_USE_IO_URING_SYNC is defined, sync(false) also uses it.
+/// Asynchronous snapshot (snapshot_async()) clones the block files using reflink if the file system supports it;
+/// otherwise, it write-protects the segment and copies each range before it is modified.
+/// Write tracking (start_write_tracking()) tells which parts of the segment were modified using write protection.
+/// If METALL_USE_COMPRESSION is defined, block files can be stored compressed (compress());
+/// the frames of compressed blocks are decompressed on their first access,
+/// into memory in the read-only mode and into the block files in the read-write mode.
+/// Block files can be striped over multiple directories, e.g., on different devices (see create());
+/// the directories are stored in a file next to the base path and
+/// consecutive blocks are placed in the directories by (weighted) round-robin.
+/// Frequently accessed parts of the segment can be cached in another directory, e.g., on tmpfs (see start_tiering()).
 template <typename different_type, typename size_type>
 class multifile_backed_segment_storage {
 
@@ -50,46 +112,81 @@ class multifile_backed_segment_storage {
   multifile_backed_segment_storage(const multifile_backed_segment_storage &) = delete;
   multifile_backed_segment_storage &operator=(const multifile_backed_segment_storage &) = delete;
 
-  multifile_backed_segment_storage(multifile_backed_segment_storage &&other) noexcept :
-      m_system_page_size(other.m_system_page_size),
-      m_num_blocks(other.m_num_blocks),
-      m_vm_region_size(other.m_vm_region_size),
-      m_current_segment_size(other.m_current_segment_size),
-      m_segment(other.m_segment),
-      m_base_path(other.m_base_path),
-      m_read_only(other.m_read_only),
-      m_free_file_space(other.m_free_file_space) {
-    other.priv_reset();
-  }
-
-  multifile_backed_segment_storage &operator=(multifile_backed_segment_storage &&other) noexcept {
-    m_system_page_size = other.m_system_page_size;
-    m_num_blocks = other.m_num_blocks;
-    m_vm_region_size = other.m_vm_region_size;
-    m_current_segment_size = other.m_current_segment_size;
-    m_segment = other.m_segment;
-    m_base_path = other.m_base_path;
-    m_read_only = other.m_read_only;
-    m_free_file_space = other.m_free_file_space;
-
-    other.priv_reset();
-
-    return (*this);
-  }
+  // The background threads, the fault handlers, and the snapshots hold 'this' or the segment
+  multifile_backed_segment_storage(multifile_backed_segment_storage &&) = delete;
+  multifile_backed_segment_storage &operator=(multifile_backed_segment_storage &&) = delete;
 
   /// -------------------------------------------------------------------------------- ///
   /// Public methods
   /// -------------------------------------------------------------------------------- ///
   /// \brief Check if there is a file that can be opened
   static bool openable(const std::string &base_path) {
-    const auto file_name = priv_make_file_name(base_path, 0);
+    std::vector<std::string> block_dirs;
+    if (!priv_load_block_dirs(base_path, &block_dirs)) return false;
+    const auto file_name = priv_make_block_file_name(base_path, block_dirs, 0);
+#ifdef METALL_USE_COMPRESSION
+    if (util::file_exist(util::compressed_frame_loader::compressed_file_name(file_name))) return true;
+#endif
     return util::file_exist(file_name);
   }
 
+  /// \brief Gets the size of an existing segment
+  /// \return Returns 0 if there is no segment
+  static size_type get_size(const std::string &base_path) {
+    size_type size = 0;
+    for (const auto block_size : priv_find_block_files(base_path)) {
+      size += block_size;
+    }
+    return size;
+  }
+
+  /// \brief Returns true if the block files of a segment are striped over other directories
+  static bool striped(const std::string &base_path) {
+    return util::file_exist(priv_make_stripe_file_name(base_path));
+  }
+
+  /// \brief Returns the paths of the block files of a segment that are placed in other directories
+  /// (including compressed ones), in the order of the block numbers
+  static std::vector<std::string> striped_block_files(const std::string &base_path) {
+    std::vector<std::string> block_dirs;
+    std::vector<std::string> paths;
+    if (!priv_load_block_dirs(base_path, &block_dirs) || block_dirs.empty()) return paths;
+    for (size_type n = 0;; ++n) {
+      const auto file_name = priv_make_block_file_name(base_path, block_dirs, n);
+      bool found = false;
+      for (const auto &path : {file_name, file_name + ".z"}) {
+        if (util::file_exist(path)) {
+          paths.push_back(path);
+          found = true;
+        }
+      }
+      if (!found) break;
+    }
+    return paths;
+  }
+
+  /// \brief Returns the name of the file that lists the directories of striped block files
+  static std::string stripe_file_name(const std::string &base_path) {
+    return priv_make_stripe_file_name(base_path);
+  }
+
+  /// \brief Removes the striped block files of a segment, the directories made for them, and the stripe file
+  static bool remove_stripes(const std::string &base_path) {
+    return priv_remove_stripes(base_path);
+  }
+
+  /// \brief Creates a new segment
+  /// \param stripe_dir_paths If not empty, the block files are placed in these directories instead of next to
+  /// the base path. The block files are stored in a new directory, unique to the segment, in each of them;
+  /// multiple data stores can share the directories.
+  /// \param stripe_weights The number of consecutive blocks placed in each directory in a round;
+  /// all 1 (round-robin) if empty
   bool create(const std::string &base_path,
               const size_type vm_region_size,
               void *const vm_region,
-              const size_type initial_segment_size) {
+              const size_type initial_segment_size,
+              const std::vector<std::string> &stripe_dir_paths = {},
+              const std::vector<size_type> &stripe_weights = {}) {
     assert(!priv_inited());
 
 
@@ -105,20 +202,32 @@ class multifile_backed_segment_storage {
     m_segment = vm_region;
     m_read_only = false;
 
+    if (!priv_create_stripes(m_base_path, stripe_dir_paths, stripe_weights)
+        || !priv_load_block_dirs(m_base_path, &m_block_dirs)) {
+      priv_reset();
+      return false;
+    }
+
     const auto segment_size = std::min(vm_region_size, initial_segment_size);
-    if (!priv_create_and_map_file(m_base_path, 0, segment_size, m_segment)) {
+    m_block_fds.push_back(-1);
+    if (!priv_create_and_map_file(0, segment_size, m_segment, &m_block_fds[0])) {
       priv_reset();
       return false;
     }
+    m_block_offsets.push_back(0);
     m_current_segment_size += segment_size;
     m_num_blocks = 1;
+    m_tier_cache.add_file(priv_make_block_file_name(0), 0, segment_size);
 
     priv_test_file_space_free(base_path);
 
     return true;
   }
 
-  bool open(const std::string &base_path, const size_type vm_region_size, void *const vm_region, const bool read_only) {
+  /// \brief Opens an existing segment
+  /// \param populate If true, prefaults the mapped pages (MAP_POPULATE)
+  bool open(const std::string &base_path, const size_type vm_region_size, void *const vm_region, const bool read_only,
+            const bool populate = false) {
     assert(!priv_inited());
 
     // TODO: align those values to pge size
@@ -131,21 +240,47 @@ class multifile_backed_segment_storage {
     m_vm_region_size = vm_region_size;
     m_segment = vm_region;
     m_read_only = read_only;
+    if (!priv_load_block_dirs(m_base_path, &m_block_dirs)) {
+      std::abort(); // Fatal error
+    }
 
-    m_num_blocks = 0;
-    while (true) {
-      const auto file_name = priv_make_file_name(m_base_path, m_num_blocks);
-      if (!util::file_exist(file_name)) {
-        break;
-      }
+    const auto block_sizes = priv_find_block_files(m_base_path);
+    std::vector<size_type> block_offsets(block_sizes.size(), 0);
+    for (size_type n = 0; n < block_sizes.size(); ++n) {
+      assert(block_sizes[n] % page_size() == 0);
+      block_offsets[n] = m_current_segment_size;
+      m_current_segment_size += block_sizes[n];
+    }
+    if (m_current_segment_size > m_vm_region_size && !priv_grow_vm_region(m_current_segment_size)) {
+      std::cerr << "VM region is too small to open the segment" << std::endl;
+      std::abort(); // Fatal error
+    }
 
-      const auto file_size = util::get_file_size(file_name);
-      assert(file_size % page_size() == 0);
-      if (!priv_map_file(file_name, file_size, static_cast<char *>(m_segment) + m_current_segment_size, read_only)) {
-        std::abort(); // Fatal error
+    std::vector<bool> compressed(block_sizes.size(), false); // Mapped by the frame loader
+#ifdef METALL_USE_COMPRESSION
+    if (!priv_open_frame_loader(block_offsets, &compressed)) {
+      std::abort(); // Fatal error
+    }
+#endif
+
+    // As the offsets of the blocks are known, map them in parallel.
+    // Use threads regardless of the number of cores as opening files on a (parallel) file system is I/O bound
+    const size_type num_threads = std::min((size_type)METALL_MAX_NUM_OPEN_THREADS, (size_type)block_sizes.size());
+    m_block_fds.assign(block_sizes.size(), -1);
+    util::parallel_run(num_threads, [&](const size_type first_block_no) {
+      for (size_type n = first_block_no; n < block_sizes.size(); n += num_threads) {
+        if (compressed[n]) continue;
+        if (!priv_map_file(priv_make_block_file_name(n), block_sizes[n],
+                           static_cast<char *>(m_segment) + block_offsets[n], read_only, populate,
+                           read_only ? nullptr : &m_block_fds[n])) {
+          std::abort(); // Fatal error
+        }
       }
-      m_current_segment_size += file_size;
-      ++m_num_blocks;
+    });
+    m_num_blocks = block_sizes.size();
+    m_block_offsets = block_offsets;
+    for (size_type n = 0; n < m_num_blocks && !read_only; ++n) {
+      m_tier_cache.add_file(priv_make_block_file_name(n), block_offsets[n], block_sizes[n]);
     }
 
     if (!read_only) {
@@ -155,15 +290,67 @@ class multifile_backed_segment_storage {
     return m_num_blocks > 0;
   }
 
-  bool extend(const size_type new_segment_size) {
-    assert(priv_inited());
+  /// \brief A part of a segment opened by open_overlay()
+  struct overlay_part {
+    std::string path; // The file that contains the part; empty if the part is filled with zeros
+    size_type offset; // The offset in the file; must be a multiple of the page size
+  };
+
+  /// \brief Opens a segment in the read-only mode whose parts are stored in different files.
+  /// Each part is mapped directly from its file; nothing is copied.
+  /// \param parts The parts of the segment in order
+  /// \param part_size The size of a part; must be a multiple of the page size
+  bool open_overlay(const std::vector<overlay_part> &parts, const size_type part_size,
+                    const size_type vm_region_size, void *const vm_region) {
+    assert(!priv_inited());
+    const size_type segment_size = parts.size() * part_size;
+    if (vm_region_size % page_size() != 0 || (uint64_t)vm_region % page_size() != 0 || part_size % page_size() != 0
+        || segment_size > vm_region_size || parts.empty()) {
+      std::cerr << "Invalid argument to open segment" << std::endl;
+      return false;
+    }
 
-    if (m_read_only) {
+    m_base_path = parts.front().path.empty() ? std::string("overlay") : parts.front().path;
+    m_vm_region_size = vm_region_size;
+    m_segment = vm_region;
+    m_read_only = true;
+    m_overlay = true;
+
+    if (!util::os_mmap(m_segment, segment_size, PROT_READ, MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED, -1, 0)) {
+      priv_reset();
       return false;
     }
 
-    if (new_segment_size > m_vm_region_size) {
-      std::cerr << "Requested segment size is too big" << std::endl;
+    // Map consecutive parts in the same file at once
+    for (size_type first = 0; first < parts.size();) {
+      size_type last = first + 1;
+      while (last < parts.size() && parts[last].path == parts[first].path
+          && parts[last].offset == parts[first].offset + (last - first) * part_size) {
+        ++last;
+      }
+      if (!parts[first].path.empty()) {
+        const auto ret = util::map_file_read_mode(parts[first].path, static_cast<char *>(m_segment) + first * part_size,
+                                                  (last - first) * part_size, parts[first].offset, MAP_FIXED);
+        if (ret.first == -1 || !ret.second) {
+          std::cerr << "Failed to map a file: " << parts[first].path << std::endl;
+          util::map_with_prot_none(m_segment, segment_size);
+          priv_reset();
+          return false;
+        }
+        util::os_close(ret.first);
+      }
+      first = last;
+    }
+    m_current_segment_size = segment_size;
+    m_num_blocks = 1;
+
+    return true;
+  }
+
+  bool extend(const size_type new_segment_size) {
+    assert(priv_inited());
+
+    if (m_read_only) {
       return false;
     }
 
@@ -171,13 +358,23 @@ class multifile_backed_segment_storage {
       return true; // Already enough segment size
     }
 
-    if (!priv_create_and_map_file(m_base_path,
-                                  m_num_blocks,
+    if (new_segment_size > m_vm_region_size && !priv_grow_vm_region(new_segment_size)) {
+      std::cerr << "Requested segment size is too big" << std::endl;
+      return false;
+    }
+
+    int fd = -1;
+    if (!priv_create_and_map_file(m_num_blocks,
                                   new_segment_size - m_current_segment_size,
-                                  static_cast<char *>(m_segment) + m_current_segment_size)) {
+                                  static_cast<char *>(m_segment) + m_current_segment_size,
+                                  &fd)) {
       priv_reset();
       return false;
     }
+    m_tier_cache.add_file(priv_make_block_file_name(m_num_blocks), m_current_segment_size,
+                          new_segment_size - m_current_segment_size);
+    m_block_fds.push_back(fd);
+    m_block_offsets.push_back(m_current_segment_size);
     ++m_num_blocks;
     m_current_segment_size = new_segment_size;
 
@@ -188,18 +385,154 @@ class multifile_backed_segment_storage {
     priv_destroy_segment();
   }
 
+  /// \brief Writes back the segment; does not wait for an asynchronous snapshot being taken.
   void sync(const bool sync) {
+#ifdef METALL_USE_IO_URING_SYNC
+    if (!sync) {
+      priv_start_async_sync(); // Does not wait for the completion
+      return;
+    }
+#endif
+    priv_wait_async_syncs();
     priv_sync_segment(sync);
   }
 
+  /// \brief Writes back dirty pages asynchronously.
+  /// Dirty pages are written back by io_uring with many requests in flight if it is available;
+  /// otherwise, msync(2) is called in another thread.
+  /// This storage must not be destroyed until the returned future is ready.
+  /// \return Returns an object of std::future
+  /// If succeeded, its get() returns True; other false
+  std::future<bool> sync_async() {
+    return priv_start_async_sync();
+  }
+
+  /// \brief Copies the segment into block files with another base path while letting writers continue.
+  /// While this function flushes the segment and starts the snapshot, writes to the segment sleep in the fault handler;
+  /// system calls that write into the segment (e.g., read(2)) fail with EFAULT
+  /// until the units they write to are copied.
+  /// This storage must not be destroyed until the returned future is ready.
+  /// \param destination_base_path The base path of the destination block files
+  /// \param on_frozen Called while the writes are held, i.e., the segment has the data of the snapshot;
+  /// must not write to the segment. The snapshot fails if it returns false.
+  /// \return Returns an object of std::future
+  /// If succeeded, its get() returns True; other false
+  std::future<bool> snapshot_async(const std::string &destination_base_path,
+                                   const std::function<bool()> &on_frozen = [] { return true; }) {
+    return priv_start_snapshot(destination_base_path, on_frozen);
+  }
+
+#ifdef METALL_USE_COMPRESSION
+  /// \brief Compresses the block files of a closed segment.
+  /// Block files that are already compressed are copied as they are;
+  /// the frames loaded from them in the read-write mode are merged first.
+  /// \param source_base_path The base path of the segment
+  /// \param destination_base_path The base path of the compressed segment;
+  /// if it is the same as the source, the uncompressed block files are replaced.
+  /// \param num_threads The number of threads to use; if 0, uses the number of hardware threads
+  /// \return Returns true on success; otherwise, false.
+  static bool compress(const std::string &source_base_path, const std::string &destination_base_path,
+                       const size_type num_threads = 0) {
+    std::vector<std::string> source_block_dirs;
+    std::vector<std::string> destination_block_dirs;
+    if (!priv_load_block_dirs(source_base_path, &source_block_dirs)
+        || !priv_load_block_dirs(destination_base_path, &destination_block_dirs)) {
+      return false;
+    }
+    const auto num_blocks = priv_find_block_files(source_base_path).size();
+    for (size_type n = 0; n < num_blocks; ++n) {
+      if (!util::compressed_frame_loader::compress(
+              priv_make_block_file_name(source_base_path, source_block_dirs, n),
+              priv_make_block_file_name(destination_base_path, destination_block_dirs, n),
+              METALL_COMPRESSION_FRAME_SIZE, num_threads)) {
+        return false;
+      }
+    }
+    return true;
+  }
+#endif
+
   void free_region(const different_type offset, const size_type nbytes) {
     priv_free_region(offset, nbytes);
   }
 
+  /// \brief Loads the parts of the segment that are loaded on demand, i.e., the frames of compressed block files,
+  /// so that system calls can access the whole segment.
+  void load_all() {
+#ifdef METALL_USE_COMPRESSION
+    if (m_frame_loader) {
+      m_frame_loader->load(static_cast<char *>(m_segment), m_current_segment_size);
+    }
+#endif
+  }
+
+  /// \brief Starts tracking the parts of the segment modified since the last reset_write_tracking() call.
+  /// The frames of compressed block files are loaded first (see load_all()).
+  /// Multiple trackers, identified by numbers, share the write protection;
+  /// each tracker has its own point to compare with.
+  /// Writes must be stopped while this function and reset_write_tracking() are called.
+  /// \param granularity The size of a tracked part; must be a multiple of the page size
+  /// \return Returns true on success; otherwise, false.
+  bool start_write_tracking(const size_type granularity) {
+    if (!priv_inited() || m_read_only || granularity % page_size() != 0) return false;
+    if (m_write_tracker) return m_write_tracker->granularity() == granularity;
+    load_all(); // The tracker changes the protection of the whole segment
+    const auto tier_hold = m_tier_cache.hold(); // The migrator marks the moved units in the tracker
+    m_write_tracker = std::make_unique<util::write_tracker>(m_segment, m_vm_region_size, granularity);
+    if (!m_write_tracker->start()) {
+      m_write_tracker.reset();
+      return false;
+    }
+    return true;
+  }
+
+  /// \brief Returns true if a part of the segment could have been modified since the last reset_write_tracking() call.
+  /// Always returns true if the write tracking has not been started or the tracker has not been reset.
+  /// \param part_no The part number, i.e., the offset divided by the granularity given to start_write_tracking()
+  /// \param tracker_no The tracker number
+  bool written(const size_type part_no, const size_type tracker_no = 0) const {
+    if (!m_write_tracker || m_write_tracker->dirty(part_no)) return true;
+    const auto itr = m_written_parts.find(tracker_no);
+    return itr == m_written_parts.end() || (part_no < itr->second.size() && itr->second[part_no]);
+  }
+
+  /// \brief Marks a part as modified for a tracker, e.g., it was modified before the tracking started.
+  void mark_written(const size_type part_no, const size_type tracker_no = 0) {
+    const auto itr = m_written_parts.find(tracker_no);
+    if (itr == m_written_parts.end()) return; // All parts are modified already
+    if (itr->second.size() <= part_no) itr->second.resize(part_no + 1, false);
+    itr->second[part_no] = true;
+  }
+
+  /// \brief Marks all parts of the current segment as not modified for a tracker.
+  /// \param tracker_no The tracker number
+  bool reset_write_tracking(const size_type tracker_no = 0) {
+    if (!m_write_tracker) return false;
+    const auto tier_hold = m_tier_cache.hold(); // Units must not be remapped while they are protected
+
+    // The other trackers keep the parts modified so far
+    const size_type num_parts = m_current_segment_size / m_write_tracker->granularity();
+    for (auto &[no, parts] : m_written_parts) {
+      if (no == tracker_no) continue;
+      parts.resize(std::max(parts.size(), num_parts), false);
+      for (size_type i = 0; i < num_parts; ++i) {
+        if (m_write_tracker->dirty(i)) parts[i] = true;
+      }
+    }
+    m_written_parts[tracker_no].assign(num_parts, false);
+
+    return m_write_tracker->clean(m_current_segment_size);
+  }
+
   void *get_segment() const {
     return m_segment;
   }
 
+  /// \brief Returns the size of the VM region, which can grow in extend()
+  size_type vm_region_size() const {
+    return m_vm_region_size;
+  }
+
   size_type size() const {
     return m_current_segment_size;
   }
@@ -212,6 +545,52 @@ class multifile_backed_segment_storage {
     return m_read_only;
   }
 
+  /// \brief Returns true if the segment was opened by open_overlay()
+  bool overlay() const {
+    return m_overlay;
+  }
+
+  /// \brief Starts caching frequently accessed parts of the segment in another directory,
+  /// e.g., on tmpfs or a faster device.
+  /// The segment is divided into units of METALL_TIERING_UNIT_SIZE bytes.
+  /// Every METALL_TIERING_INTERVAL_MS milliseconds, a background thread samples the accessed pages of each unit and
+  /// moves the hottest units into files in the hot directory, remapping them at the same addresses.
+  /// Accesses are sampled with idle page tracking if available;
+  /// otherwise, by dropping one page of each unit from the page table per interval.
+  /// The block files stay the persistent copy; sync() writes the hot units back to them.
+  /// \param hot_dir_path A path to the directory to store hot units in; created if it does not exist
+  /// \param hot_capacity The maximum total size of the hot units
+  /// \return Returns true on success; otherwise, false.
+  bool start_tiering(const std::string &hot_dir_path, const size_type hot_capacity) {
+    if (!priv_inited() || m_read_only || m_overlay) return false;
+    load_all(); // Units are copied from the block files
+    return m_tier_cache.start(
+        m_segment, hot_dir_path, hot_capacity, METALL_TIERING_INTERVAL_MS,
+        // Remapping would drop the write protection made by the snapshot
+        [this] { return !std::atomic_load(&m_cow_snapshot); },
+        [this](const size_type offset, const size_type length) {
+          // Clean granules are made writable first so that the tracker does not unprotect the unit
+          // during the migration; they are not protected after being remapped anyway
+          if (m_write_tracker) m_write_tracker->mark_dirty(offset, length);
+        });
+  }
+
+  /// \brief Stops caching; moves all hot units back to the block files and removes the files in the hot directory.
+  /// \return Returns true on success; otherwise, false.
+  bool stop_tiering() {
+    return m_tier_cache.stop();
+  }
+
+  /// \brief Returns true if start_tiering() has been called and stop_tiering() has not
+  bool tiering() const {
+    return m_tier_cache.running();
+  }
+
+  /// \brief Returns the total size of the units in the hot directory
+  size_type hot_tier_size() const {
+    return m_tier_cache.hot_size();
+  }
+
  private:
   // -------------------------------------------------------------------------------- //
   // Private types and static values
@@ -224,12 +603,270 @@ class multifile_backed_segment_storage {
     return base_path + "_block-" + std::to_string(n);
   }
 
+  // ---------------------------------------- Striping ---------------------------------------- //
+  static constexpr const char *k_stripe_dir_infix = "_stripe-";
+
+  static std::string priv_make_stripe_file_name(const std::string &base_path) {
+    return base_path + "_stripes";
+  }
+
+  static std::string priv_make_block_file_name(const std::string &base_path,
+                                               const std::vector<std::string> &block_dirs,
+                                               const size_type n) {
+    if (block_dirs.empty()) return priv_make_file_name(base_path, n);
+    const auto pos = base_path.find_last_of('/');
+    const std::string name = (pos == std::string::npos) ? base_path : base_path.substr(pos + 1);
+    return priv_make_file_name(block_dirs[n % block_dirs.size()] + "/" + name, n);
+  }
+
+  std::string priv_make_block_file_name(const size_type n) const {
+    return priv_make_block_file_name(m_base_path, m_block_dirs, n);
+  }
+
+  /// \brief Loads the directories of striped block files.
+  /// The directories are expanded into one round using smooth weighted round-robin
+  /// so that the blocks of a directory are spread over the round.
+  static bool priv_load_block_dirs(const std::string &base_path, std::vector<std::string> *const block_dirs) {
+    block_dirs->clear();
+    const auto file_name = priv_make_stripe_file_name(base_path);
+    if (!util::file_exist(file_name)) return true;
+
+    std::ifstream ifs(file_name);
+    std::vector<std::pair<std::string, int64_t>> stripes;
+    int64_t weight;
+    std::string dir_path;
+    while (ifs >> weight && std::getline(ifs >> std::ws, dir_path)) {
+      if (weight <= 0) break;
+      stripes.emplace_back(dir_path, weight);
+    }
+    if (!ifs.eof() || stripes.empty()) {
+      std::cerr << "Invalid stripe file: " << file_name << std::endl;
+      return false;
+    }
+
+    int64_t total_weight = 0;
+    for (const auto &stripe : stripes) total_weight += stripe.second;
+    std::vector<int64_t> current(stripes.size(), 0);
+    for (int64_t i = 0; i < total_weight; ++i) {
+      std::size_t selected = 0;
+      for (std::size_t d = 0; d < stripes.size(); ++d) {
+        current[d] += stripes[d].second;
+        if (current[d] > current[selected]) selected = d;
+      }
+      current[selected] -= total_weight;
+      block_dirs->push_back(stripes[selected].first);
+    }
+    return true;
+  }
+
+  /// \brief Makes a directory unique to the segment in each stripe directory and stores their paths.
+  /// The block files of the old segment at the base path are removed.
+  static bool priv_create_stripes(const std::string &base_path, const std::vector<std::string> &dir_paths,
+                                  std::vector<size_type> weights) {
+    if (!priv_remove_stripes(base_path)) {
+      return false;
+    }
+    if (dir_paths.empty()) return true;
+
+    if (weights.empty()) weights.assign(dir_paths.size(), 1);
+    if (weights.size() != dir_paths.size()
+        || std::find(weights.begin(), weights.end(), 0) != weights.end()) {
+      std::cerr << "Invalid weights of stripe directories" << std::endl;
+      return false;
+    }
+    const auto gcd = std::accumulate(weights.begin(), weights.end(), size_type(0),
+                                     [](const size_type a, const size_type b) { return std::gcd(a, b); });
+
+    const std::string name = priv_make_stripe_dir_name(base_path);
+    const auto file_name = priv_make_stripe_file_name(base_path);
+    std::ofstream ofs(file_name);
+    for (size_type d = 0; d < dir_paths.size(); ++d) {
+      if (!util::directory_exist(dir_paths[d]) && !util::create_directory(dir_paths[d])) {
+        std::cerr << "Failed to create directory: " << dir_paths[d] << std::endl;
+        return false;
+      }
+      const std::string stripe_dir_path = dir_paths[d] + "/" + name;
+      if (::mkdir(stripe_dir_path.c_str(), 0777) != 0) {
+        ::perror("mkdir");
+        std::cerr << "Failed to create directory: " << stripe_dir_path << std::endl;
+        return false;
+      }
+      ofs << weights[d] / gcd << " " << stripe_dir_path << "\n";
+    }
+    ofs.close();
+    if (!ofs) {
+      std::cerr << "Failed to write a file: " << file_name << std::endl;
+      return false;
+    }
+    return util::fsync(file_name);
+  }
+
+  /// \brief Returns a new name for the directories that store the block files of a segment,
+  /// e.g., segment_stripe-0123456789abcdef
+  static std::string priv_make_stripe_dir_name(const std::string &base_path) {
+    const auto pos = base_path.find_last_of('/');
+    const std::string name = (pos == std::string::npos) ? base_path : base_path.substr(pos + 1);
+    std::random_device device;
+    const uint64_t id = (uint64_t(device()) << 32ULL) ^ device();
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(id));
+    return name + k_stripe_dir_infix + buf;
+  }
+
+  /// \brief Removes the striped block files of a segment, the directories that contain them, and the stripe file.
+  /// Directories that were not made by priv_create_stripes() are kept.
+  static bool priv_remove_stripes(const std::string &base_path) {
+    const auto file_name = priv_make_stripe_file_name(base_path);
+    if (!util::file_exist(file_name)) return true;
+
+    bool ret = true;
+    for (const auto &path : striped_block_files(base_path)) {
+      ret &= util::remove_file(path);
+    }
+    std::vector<std::string> dir_paths;
+    if (!priv_load_block_dirs(base_path, &dir_paths)) return false;
+    std::sort(dir_paths.begin(), dir_paths.end());
+    dir_paths.erase(std::unique(dir_paths.begin(), dir_paths.end()), dir_paths.end());
+    for (const auto &dir_path : dir_paths) {
+      if (dir_path.find(k_stripe_dir_infix, dir_path.find_last_of('/')) == std::string::npos) continue;
+      if (::rmdir(dir_path.c_str()) != 0 && errno != ENOENT) {
+        ::perror("rmdir");
+        std::cerr << "Failed to remove directory: " << dir_path << std::endl;
+        ret = false;
+      }
+    }
+    return util::remove_file(file_name) && ret;
+  }
+
+#ifdef METALL_USE_COMPRESSION
+  /// \brief Maps the compressed block files with the frame loader
+  /// \param compressed Set to true for the blocks mapped by the frame loader
+  bool priv_open_frame_loader(const std::vector<size_type> &block_offsets, std::vector<bool> *const compressed) {
+    std::vector<std::string> block_file_names;
+    std::vector<char *> addrs;
+    for (size_type n = 0; n < block_offsets.size(); ++n) {
+      block_file_names.push_back(priv_make_block_file_name(n));
+      addrs.push_back(static_cast<char *>(m_segment) + block_offsets[n]);
+    }
+    m_frame_loader = std::make_unique<util::compressed_frame_loader>(m_read_only);
+    if (!m_frame_loader->open(block_file_names, addrs, compressed)) return false;
+    if (std::find(compressed->begin(), compressed->end(), true) == compressed->end()) {
+      m_frame_loader.reset(); // No compressed block
+    }
+    return true;
+  }
+#endif
+
+  /// \brief Changes the protection of the whole segment except the compressed frames that are not loaded yet
+  bool priv_protect_segment(const bool writable) {
+#ifdef METALL_USE_COMPRESSION
+    if (m_frame_loader) {
+      return m_frame_loader->protect(static_cast<char *>(m_segment), m_current_segment_size, writable);
+    }
+#endif
+    return writable ? util::mprotect_read_write(m_segment, m_current_segment_size)
+                    : util::mprotect_read_only(m_segment, m_current_segment_size);
+  }
+
+  /// \brief Finds the block files of a segment using a single directory listing
+  /// (falls back to checking each file if the Filesystem library is not available).
+  /// \return Returns the sizes of the blocks in the order of the block numbers.
+  /// Stops at the first missing block number.
+  static std::vector<size_type> priv_find_block_files(const std::string &base_path) {
+    std::vector<size_type> block_sizes;
+    std::vector<std::string> block_dirs;
+    if (!priv_load_block_dirs(base_path, &block_dirs)) return block_sizes;
+    if (!block_dirs.empty()) { // Striped; the files are in multiple directories
+      for (size_type block_no = 0;; ++block_no) {
+        const auto file_name = priv_make_block_file_name(base_path, block_dirs, block_no);
+#ifdef METALL_USE_COMPRESSION
+        if (ssize_t size; util::compressed_frame_loader::find(file_name, &size)) {
+          if (size < 0) return {};
+          block_sizes.push_back(size);
+          continue;
+        }
+#endif
+        if (!util::file_exist(file_name)) break;
+        block_sizes.push_back(util::get_file_size(file_name));
+      }
+      return block_sizes;
+    }
+
+#ifdef __cpp_lib_filesystem
+    namespace fs = std::filesystem;
+    const fs::path base(base_path);
+    const std::string prefix = base.filename().string() + "_block-";
+    std::vector<ssize_t> found_sizes; // -1 means missing
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(base.parent_path(), ec)) {
+      std::string name = entry.path().filename().string();
+#ifdef METALL_USE_COMPRESSION
+      const bool compressed = util::compressed_frame_loader::strip_suffix(&name);
+#endif
+      if (name.compare(0, prefix.size(), prefix) != 0 || name.size() == prefix.size()
+          || name.find_first_not_of("0123456789", prefix.size()) != std::string::npos) {
+        continue;
+      }
+      const size_type block_no = std::stoull(name.substr(prefix.size()));
+      if (found_sizes.size() <= block_no) {
+        found_sizes.resize(block_no + 1, -1);
+      }
+#ifdef METALL_USE_COMPRESSION
+      if (compressed) {
+        // The compressed file has priority over an uncompressed one left by an interrupted conversion
+        found_sizes[block_no] = util::compressed_file::get_original_size(entry.path().string());
+        if (found_sizes[block_no] < 0) {
+          std::cerr << "Invalid compressed block file: " << entry.path().string() << std::endl;
+          return {};
+        }
+        continue;
+      }
+      if (found_sizes[block_no] >= 0) continue;
+#endif
+      found_sizes[block_no] = entry.file_size(ec);
+      if (ec) break;
+    }
+    if (ec) {
+      std::cerr << "Failed to list the block files: " << ec.message() << std::endl;
+      return {};
+    }
+    for (const auto size : found_sizes) {
+      if (size < 0) break;
+      block_sizes.push_back(size);
+    }
+#else
+    for (size_type block_no = 0;; ++block_no) {
+      const auto file_name = priv_make_file_name(base_path, block_no);
+#ifdef METALL_USE_COMPRESSION
+      if (ssize_t size; util::compressed_frame_loader::find(file_name, &size)) {
+        if (size < 0) return {};
+        block_sizes.push_back(size);
+        continue;
+      }
+#endif
+      if (!util::file_exist(file_name)) {
+        break;
+      }
+      block_sizes.push_back(util::get_file_size(file_name));
+    }
+#endif
+    return block_sizes;
+  }
+
   void priv_reset() {
-    m_system_page_size = 0;
+    for (const auto fd : m_block_fds) {
+      if (fd != -1) util::os_close(fd);
+    }
+    m_block_fds.clear();
+    // Keeps the system page size so that the storage can be opened again, e.g., after open_overlay() failed
     m_num_blocks = 0;
     m_vm_region_size = 0;
     m_current_segment_size = 0;
     m_segment = nullptr;
+    m_block_dirs.clear();
+    m_block_offsets.clear();
+    m_overlay = false;
+    m_tier_cache.reset();
     // m_read_only = false;
   }
 
@@ -238,13 +875,30 @@ class multifile_backed_segment_storage {
         && m_segment && !m_base_path.empty());
   }
 
-  bool priv_create_and_map_file(const std::string &base_path,
-                                const size_type block_number,
+  /// \brief Reserves the address space right after the VM region so that the segment grows at the same address.
+  /// Tries to double the region first so that the following extensions do not need to reserve again.
+  /// Fails only if the address space after the region is in use (or exhausted).
+  bool priv_grow_vm_region(const size_type required_size) {
+    char *const region_end = static_cast<char *>(m_segment) + m_vm_region_size;
+    for (const size_type size : {std::max(required_size, m_vm_region_size * 2), required_size}) {
+      const size_type length = util::round_up(size - m_vm_region_size, page_size());
+      if (util::reserve_vm_region_at(region_end, length)) {
+        m_vm_region_size += length;
+        return true;
+      }
+    }
+    std::cerr << "Cannot reserve the address space after the VM region" << std::endl;
+    return false;
+  }
+
+  /// \param fd If not nullptr, the file descriptor of the block file is kept open and stored in it
+  bool priv_create_and_map_file(const size_type block_number,
                                 const size_type file_size,
-                                void *const addr) const {
+                                void *const addr,
+                                int *const fd = nullptr) const {
     assert(!m_segment || static_cast<char *>(m_segment) + m_current_segment_size <= addr);
 
-    const std::string file_name = priv_make_file_name(base_path, block_number);
+    const std::string file_name = priv_make_block_file_name(block_number);
     if (!util::create_file(file_name)) return false;
     if (!util::extend_file_size(file_name, file_size)) return false;
     if (static_cast<size_type>(util::get_file_size(file_name)) < file_size) {
@@ -252,13 +906,15 @@ class multifile_backed_segment_storage {
       std::abort();
     }
 
-    if (!priv_map_file(file_name, file_size, addr, false)) {
+    if (!priv_map_file(file_name, file_size, addr, false, false, fd)) {
       return false;
     }
     return true;
   }
 
-  bool priv_map_file(const std::string &path, const size_type file_size, void *const addr, const bool read_only) const {
+  /// \param fd If not nullptr, the file descriptor is kept open and stored in it instead of being closed
+  bool priv_map_file(const std::string &path, const size_type file_size, void *const addr, const bool read_only,
+                     const bool populate = false, int *const fd = nullptr) const {
     assert(!path.empty());
     assert(file_size > 0);
     assert(addr);
@@ -270,9 +926,15 @@ class multifile_backed_segment_storage {
         0;
 #endif
 
+    const int map_populate =
+#ifdef MAP_POPULATE
+        (populate) ? MAP_POPULATE : 0;
+#else
+        0;
+#endif
     const auto ret = (read_only) ?
-                     util::map_file_read_mode(path, addr, file_size, 0, MAP_FIXED) :
-                     util::map_file_write_mode(path, addr, file_size, 0, MAP_FIXED | map_nosync);
+                     util::map_file_read_mode(path, addr, file_size, 0, MAP_FIXED | map_populate) :
+                     util::map_file_write_mode(path, addr, file_size, 0, MAP_FIXED | map_nosync | map_populate);
     if (ret.first == -1 || !ret.second) {
       std::cerr << "Failed to map a file: " << path << std::endl;
       if (ret.first == -1) {
@@ -281,12 +943,29 @@ class multifile_backed_segment_storage {
       return false;
     }
 
+    if (fd) {
+      *fd = ret.first;
+      return true;
+    }
     return util::os_close(ret.first);
   }
 
   void priv_destroy_segment() {
     if (!priv_inited()) return;
 
+    priv_wait_snapshots();
+    priv_wait_async_syncs();
+    m_tier_cache.reset();
+    m_write_tracker.reset();
+    m_written_parts.clear();
+    m_overlay = false;
+#ifdef METALL_USE_COMPRESSION
+    if (m_frame_loader) {
+      m_frame_loader->remove_loaded_compressed_files();
+      m_frame_loader.reset();
+    }
+#endif
+
     util::map_with_prot_none(m_segment, m_current_segment_size);
     // NOTE: the VM region will be unmapped by manager_kernel
 
@@ -296,19 +975,330 @@ class multifile_backed_segment_storage {
   void priv_sync_segment(const bool sync) {
     if (!priv_inited() || m_read_only) return;
 
+    const auto tier_hold = m_tier_cache.hold();
+    if (std::atomic_load(&m_cow_snapshot)) {
+      // Keep the protection made by the snapshot; writers do not wait for it
+      if (!priv_msync_blocks(sync) || !m_tier_cache.write_back(sync)) {
+        std::cerr << "Failed to msync the segment" << std::endl;
+        std::abort();
+      }
+      return;
+    }
+    m_tier_cache.clear_guard(); // Writes during msync must not be retried
     // Protect the region to detect unexpected write by application during msync
-    if (!util::mprotect_read_only(m_segment, m_current_segment_size)) {
+    if (!priv_protect_segment(false)) {
      std::cerr << "Failed to protection the segment with the read only mode" << std::endl;
      std::abort();
     }
-    if (!util::os_msync(m_segment, m_current_segment_size, sync)) {
+    if (!priv_msync_blocks(sync)) {
       std::cerr << "Failed to msync the segment" << std::endl;
       std::abort();
     }
-    if (!util::mprotect_read_write(m_segment, m_current_segment_size)) {
+    if (!m_tier_cache.write_back(sync)) {
+      std::cerr << "Failed to write back the hot units" << std::endl;
+      std::abort();
+    }
+    if (!priv_protect_segment(true)) {
       std::cerr << "Failed to set the segment to readable and writable" << std::endl;
       std::abort();
     }
+    if (m_write_tracker && !m_write_tracker->protect_clean_granules()) {
+      m_write_tracker->mark_all_dirty();
+    }
+  }
+
+  /// \brief Calls msync for the whole segment.
+  /// If the block files are striped, the blocks in each directory are synchronized by a thread
+  /// so that the devices write back in parallel.
+  bool priv_msync_blocks(const bool sync) {
+    const size_type num_dirs = std::min(m_block_dirs.size(), (size_type)m_num_blocks);
+    if (num_dirs <= 1 || m_block_offsets.size() != m_num_blocks) {
+      return util::os_msync(m_segment, m_current_segment_size, sync);
+    }
+
+    std::atomic<bool> ret(true);
+    const auto sync_blocks = [&](const std::string &dir) {
+      for (size_type n = 0; n < m_num_blocks; ++n) {
+        if (m_block_dirs[n % m_block_dirs.size()] != dir) continue;
+        const size_type end = (n + 1 < m_num_blocks) ? m_block_offsets[n + 1] : m_current_segment_size;
+        if (!util::os_msync(static_cast<char *>(m_segment) + m_block_offsets[n], end - m_block_offsets[n], sync)) {
+          ret = false;
+        }
+      }
+    };
+    std::vector<std::string> dirs(m_block_dirs.begin(), m_block_dirs.end());
+    std::sort(dirs.begin(), dirs.end());
+    dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+    util::parallel_run(dirs.size(), [&sync_blocks, &dirs](const std::size_t i) { sync_blocks(dirs[i]); });
+    return ret.load();
+  }
+
+  // ---------------------------------------- Asynchronous synchronization ---------------------------------------- //
+  std::future<bool> priv_start_async_sync() {
+    std::promise<bool> promise;
+    auto future = promise.get_future();
+    if (!priv_inited() || m_read_only) {
+      promise.set_value(true);
+      return future;
+    }
+
+    std::lock_guard<std::mutex> guard(m_async_sync_mutex);
+    if (m_num_async_syncs == 0) {
+      // All previous threads have finished their work
+      for (auto &th : m_async_sync_threads) th.join();
+      m_async_sync_threads.clear();
+    }
+    ++m_num_async_syncs;
+    // Take the current state in the caller thread as extend() could be called after this function returns
+    // The block files are closed only after the asynchronous synchronizations finish
+    m_async_sync_threads.emplace_back([this, promise = std::move(promise), fds = m_block_fds,
+                                          segment_size = m_current_segment_size]() mutable {
+      promise.set_value(priv_async_sync_segment(fds, segment_size));
+      std::lock_guard<std::mutex> guard(m_async_sync_mutex);
+      --m_num_async_syncs;
+      m_async_sync_cv.notify_all();
+    });
+
+    return future;
+  }
+
+  /// \brief Waits for the asynchronous synchronizations and joins their threads
+  void priv_wait_async_syncs() {
+    std::vector<std::thread> threads;
+    {
+      std::unique_lock<std::mutex> lock(m_async_sync_mutex);
+      m_async_sync_cv.wait(lock, [this] { return m_num_async_syncs == 0; });
+      threads.swap(m_async_sync_threads);
+    }
+    for (auto &th : threads) th.join();
+  }
+
+  /// \brief Writes back the block files using the file descriptors held since they were mapped
+  /// \param fds The file descriptors of the block files; -1 if a block file is not held, e.g., compressed
+  bool priv_async_sync_segment(const std::vector<int> &fds, const size_type segment_size) {
+    // Uses one io_uring instance at a time
+    std::lock_guard<std::mutex> guard(m_io_uring_mutex);
+
+    if (m_tier_cache.running()) {
+      const auto tier_hold = m_tier_cache.hold();
+      if (!m_tier_cache.write_back(true)) return false;
+    }
+
+    if (fds.empty() || std::find(fds.begin(), fds.end(), -1) != fds.end()
+        || (!m_io_uring.initialized() && !m_io_uring.init(METALL_IO_URING_QUEUE_DEPTH))) {
+      return util::os_msync(m_segment, segment_size, true); // Fall back to msync
+    }
+
+    if (!priv_submit_io_uring_sync_requests(fds)) {
+      m_io_uring.release(); // The ring could have unfinished requests
+      return util::os_msync(m_segment, segment_size, true);
+    }
+    return true;
+  }
+
+  /// \brief Calls fdatasync for every block file with all requests in flight so that
+  /// the block files (e.g., on different devices) are written back in parallel.
+  /// fdatasync also writes back the pages dirtied through the mapping.
+  bool priv_submit_io_uring_sync_requests(const std::vector<int> &fds) {
+    bool ret = true;
+    size_type num_queued = 0;
+    size_type num_in_flight = 0;
+    while (num_queued < fds.size() || num_in_flight > 0) {
+      while (num_queued < fds.size() && m_io_uring.prepare_fsync(fds[num_queued], true, num_queued)) {
+        ++num_queued;
+        ++num_in_flight;
+      }
+      if (m_io_uring.submit(1) == -1) {
+        return false;
+      }
+      int32_t result;
+      while (m_io_uring.pop_completion(&result, nullptr)) {
+        --num_in_flight;
+        if (result < 0) {
+          std::cerr << "Failed to sync a block file: " << ::strerror(-result) << std::endl;
+          ret = false;
+        }
+      }
+    }
+    return ret;
+  }
+
+  // ---------------------------------------- Asynchronous snapshot ---------------------------------------- //
+  std::future<bool> priv_start_snapshot(const std::string &destination_base_path,
+                                        const std::function<bool()> &on_frozen) {
+    std::promise<bool> promise;
+    auto future = promise.get_future();
+    if (!priv_inited()) {
+      promise.set_value(false);
+      return future;
+    }
+
+    priv_wait_snapshots(); // Takes one snapshot at a time
+    if (!m_read_only) {
+      load_all(); // The block files and the whole segment are copied
+    }
+    auto tier_hold = m_tier_cache.hold(); // Units are not moved while the snapshot is taken
+
+    std::shared_ptr<util::cow_snapshot> snapshot;
+    std::vector<int> fds;
+    if (m_read_only) { // No write happens; clone or copy in the background
+      if (!on_frozen()) {
+        promise.set_value(false);
+        return future;
+      }
+      bool cloned = true;
+      for (size_type n = 0; n < m_num_blocks && cloned; ++n) {
+        cloned = util::reflink_file(priv_make_block_file_name(n), priv_make_file_name(destination_base_path, n));
+      }
+      if (!cloned) {
+        snapshot = priv_prepare_cow_snapshot(destination_base_path, &fds);
+      }
+      if (!cloned && !snapshot) {
+        promise.set_value(false);
+        return future;
+      }
+    } else {
+      // Hold writes until the snapshot starts instead of failing them
+      if (!util::freeze_write_faults()) {
+        promise.set_value(false);
+        return future;
+      }
+      m_tier_cache.clear_guard(); // The guard must not let writes through
+      if (!priv_protect_segment(false)) {
+        std::cerr << "Failed to protection the segment with the read only mode" << std::endl;
+        std::abort();
+      }
+      // Make the block files up to date for reflink and finding holes
+      if (!priv_msync_blocks(true) || !m_tier_cache.write_back(true)) {
+        std::cerr << "Failed to msync the segment" << std::endl;
+        std::abort();
+      }
+
+      // Try reflink first; the file system keeps the cloned blocks unchanged
+      bool ret = on_frozen();
+      bool cloned = ret;
+      for (size_type n = 0; n < m_num_blocks && cloned; ++n) {
+        cloned = util::reflink_file(priv_make_block_file_name(n), priv_make_file_name(destination_base_path, n));
+      }
+      if (ret && !cloned) {
+        snapshot = priv_prepare_cow_snapshot(destination_base_path, &fds);
+        ret = !!snapshot;
+      }
+      if (snapshot) {
+        if (m_write_tracker) {
+          m_write_tracker->mark_all_dirty(false); // Writable parts made by the snapshot are not tracked
+        }
+        if (!snapshot->start()) {
+          // Copy the segment before letting the writes go as they cannot be tracked
+          ret = snapshot->run();
+          for (const auto fd : fds) util::os_close(fd);
+          snapshot.reset();
+          cloned = false;
+          priv_protect_segment(true);
+        } else {
+          std::atomic_store(&m_cow_snapshot, snapshot);
+        }
+      } else {
+        if (!priv_protect_segment(true)) {
+          std::cerr << "Failed to set the segment to readable and writable" << std::endl;
+          std::abort();
+        }
+        if (m_write_tracker && !m_write_tracker->protect_clean_granules()) {
+          m_write_tracker->mark_all_dirty();
+        }
+      }
+      util::thaw_write_faults();
+
+      if (!snapshot && !cloned) {
+        promise.set_value(ret);
+        return future;
+      }
+    }
+    tier_hold.unlock();
+
+    {
+      std::lock_guard<std::mutex> guard(m_snapshot_mutex);
+      ++m_num_snapshots;
+    }
+    std::thread([this, promise = std::move(promise), snapshot = std::move(snapshot), fds = std::move(fds),
+                    destination_base_path, num_blocks = m_num_blocks]() mutable {
+      bool ret = true;
+      if (snapshot) {
+        ret = snapshot->run();
+        std::atomic_store(&m_cow_snapshot, std::shared_ptr<util::cow_snapshot>());
+        for (const auto fd : fds) {
+          ret &= util::os_close(fd);
+        }
+      } else {
+        for (size_type n = 0; n < num_blocks; ++n) {
+          ret &= util::fsync(priv_make_file_name(destination_base_path, n));
+        }
+      }
+      promise.set_value(ret);
+      std::lock_guard<std::mutex> guard(m_snapshot_mutex);
+      --m_num_snapshots;
+      m_snapshot_cv.notify_all(); // Notify holding the lock as 'this' could be destroyed right after unlocking it
+    }).detach();
+
+    return future;
+  }
+
+  /// \brief Creates the destination block files and finds the ranges that contain data
+  std::shared_ptr<util::cow_snapshot> priv_prepare_cow_snapshot(const std::string &destination_base_path,
+                                                                std::vector<int> *const fds) const {
+    std::vector<util::cow_snapshot::destination> destinations;
+    std::vector<std::pair<std::size_t, std::size_t>> data_ranges;
+    size_type block_offset = 0;
+    for (size_type n = 0; n < m_num_blocks; ++n) {
+      const auto source_file_name = priv_make_block_file_name(n);
+      const auto block_size = util::get_file_size(source_file_name);
+      const auto file_name = priv_make_file_name(destination_base_path, n);
+      const int fd = ::open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+      if (fd == -1 || block_size < 0 || ::ftruncate(fd, block_size) == -1) {
+        std::cerr << "Failed to create a snapshot file: " << file_name << std::endl;
+        if (fd != -1) util::os_close(fd);
+        for (const auto f : *fds) util::os_close(f);
+        fds->clear();
+        return nullptr;
+      }
+      fds->push_back(fd);
+      destinations.emplace_back(util::cow_snapshot::destination{fd, block_offset, (std::size_t)block_size});
+      priv_find_data_ranges(source_file_name, block_offset, block_size, &data_ranges);
+      block_offset += block_size;
+    }
+
+    return std::make_shared<util::cow_snapshot>(m_segment, block_offset, METALL_SNAPSHOT_COPY_UNIT_SIZE,
+                                                std::move(destinations), data_ranges);
+  }
+
+  /// \brief Finds the ranges of a block file that are not holes.
+  /// Falls back to the whole file if SEEK_DATA is not supported.
+  static void priv_find_data_ranges(const std::string &file_name, const size_type block_offset,
+                                    const size_type block_size,
+                                    std::vector<std::pair<std::size_t, std::size_t>> *const data_ranges) {
+#ifdef SEEK_DATA
+    const int fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd != -1) {
+      off_t offset = 0;
+      while (offset < (off_t)block_size) {
+        const off_t data = ::lseek(fd, offset, SEEK_DATA);
+        if (data == -1) break; // No more data (ENXIO) or not supported
+        const off_t hole = ::lseek(fd, data, SEEK_HOLE);
+        const off_t end = (hole == -1) ? (off_t)block_size : std::min(hole, (off_t)block_size);
+        data_ranges->emplace_back(block_offset + data, end - data);
+        offset = end;
+      }
+      const bool supported = (offset > 0 || errno == ENXIO);
+      util::os_close(fd);
+      if (supported) return;
+    }
+#endif
+    data_ranges->emplace_back(block_offset, block_size);
+  }
+
+  void priv_wait_snapshots() {
+    std::unique_lock<std::mutex> lock(m_snapshot_mutex);
+    m_snapshot_cv.wait(lock, [this] { return m_num_snapshots == 0; });
   }
 
   bool priv_free_region(const different_type offset, const size_type nbytes) {
@@ -316,6 +1306,20 @@ class multifile_backed_segment_storage {
 
     if (offset + nbytes > m_current_segment_size) return false;
 
+#ifdef METALL_USE_COMPRESSION
+    if (m_frame_loader) {
+      // Frames not loaded yet cannot be freed as they are mapped without any permission
+      m_frame_loader->load(static_cast<char *>(m_segment) + offset, nbytes);
+    }
+#endif
+    // The freed range has to be copied first if a snapshot is being taken
+    if (const auto snapshot = std::atomic_load(&m_cow_snapshot)) {
+      snapshot->preserve(static_cast<char *>(m_segment) + offset, nbytes);
+    }
+    if (m_write_tracker) {
+      m_write_tracker->mark_dirty(offset, nbytes);
+    }
+
     if (m_free_file_space)
       return util::uncommit_file_backed_pages(static_cast<char *>(m_segment) + offset, nbytes);
     else
@@ -384,6 +1388,35 @@ class multifile_backed_segment_storage {
   std::string m_base_path;
   bool m_read_only;
   bool m_free_file_space{true};
+
+  // For asynchronous synchronization
+  std::mutex m_async_sync_mutex;
+  std::condition_variable m_async_sync_cv;
+  size_type m_num_async_syncs{0};
+  std::vector<std::thread> m_async_sync_threads;
+  std::mutex m_io_uring_mutex;
+  util::io_uring_queue m_io_uring;
+  std::vector<int> m_block_fds; // The block files kept open for synchronization; -1 if not opened
+
+  // For asynchronous snapshot
+  std::mutex m_snapshot_mutex;
+  std::condition_variable m_snapshot_cv;
+  size_type m_num_snapshots{0};
+  std::shared_ptr<util::cow_snapshot> m_cow_snapshot;
+
+  std::unique_ptr<util::write_tracker> m_write_tracker;
+  std::map<size_type, std::vector<bool>> m_written_parts; // Parts modified before other trackers were reset
+
+  bool m_overlay{false};
+
+  std::vector<std::string> m_block_dirs; // The directory of block n is m_block_dirs[n % size]; empty if not striped
+  std::vector<size_type> m_block_offsets;
+
+  util::tier_cache m_tier_cache{METALL_TIERING_UNIT_SIZE};
+
+#ifdef METALL_USE_COMPRESSION
+  std::unique_ptr<util::compressed_frame_loader> m_frame_loader;
+#endif
 };
 
 } // namespace kernel
@@ -16,6 +16,7 @@
 #include <umap/umap.h>
 
 #include <string>
+#include <vector>
 #include <iostream>
 #include <cassert>
 #include <metall/detail/utility/file.hpp>
@@ -95,11 +96,18 @@ class umap_segment_storage {
     return util::file_exist(file_name);
   }
 
+  /// \brief Creates a new segment. Striping block files is not supported.
   bool create(const std::string &base_path,
               const size_type vm_region_size,
               void *const vm_region,
-              const size_type initial_segment_size) {
+              const size_type initial_segment_size,
+              const std::vector<std::string> &stripe_dir_paths = {},
+              [[maybe_unused]] const std::vector<size_type> &stripe_weights = {}) {
     assert(!priv_inited());
+    if (!stripe_dir_paths.empty()) {
+      std::cerr << "Striping block files is not supported" << std::endl;
+      return false;
+    }
 
 
     // TODO: align those values to pge size
@@ -209,6 +217,11 @@ class umap_segment_storage {
     return m_segment;
   }
 
+  /// \brief Returns the size of the VM region; it does not grow in this storage
+  size_type vm_region_size() const {
+    return m_vm_region_size;
+  }
+
   size_type size() const {
     return m_current_segment_size;
   }
@@ -221,6 +234,59 @@ class umap_segment_storage {
     return m_read_only;
   }
 
+  /// \brief Write tracking is not supported; all parts are considered as modified
+  bool start_write_tracking(const size_type) {
+    return false;
+  }
+
+  bool written(const size_type, const size_type = 0) const {
+    return true;
+  }
+
+  void mark_written(const size_type, const size_type = 0) {}
+
+  bool reset_write_tracking(const size_type = 0) {
+    return false;
+  }
+
+  /// \brief Overlay opens are not supported
+  bool overlay() const {
+    return false;
+  }
+
+  /// \brief Tiering is not supported
+  bool start_tiering(const std::string &, const size_type) {
+    return false;
+  }
+
+  bool stop_tiering() {
+    return false;
+  }
+
+  bool tiering() const {
+    return false;
+  }
+
+  size_type hot_tier_size() const {
+    return 0;
+  }
+
+  static bool striped(const std::string &) {
+    return false;
+  }
+
+  static std::vector<std::string> striped_block_files(const std::string &) {
+    return {};
+  }
+
+  static std::string stripe_file_name(const std::string &base_path) {
+    return base_path + "_stripes";
+  }
+
+  static bool remove_stripes(const std::string &) {
+    return true;
+  }
+
  private:
   // -------------------------------------------------------------------------------- //
   // Private types and static values
@@ -0,0 +1,952 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_DETAIL_SEGMENT_STORAGE_USERFAULTFD_STORAGE_HPP
+#define METALL_DETAIL_SEGMENT_STORAGE_USERFAULTFD_STORAGE_HPP
+
+#ifndef __linux__
+#error "userfaultfd_segment_storage is supported only on Linux"
+#endif
+
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <linux/userfaultfd.h>
+#include <poll.h>
+
+#include <string>
+#include <iostream>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <future>
+#include <functional>
+#include <limits>
+
+#include <metall/detail/utility/file.hpp>
+#include <metall/detail/utility/mmap.hpp>
+
+#ifndef METALL_USERFAULTFD_BUFFER_SIZE
+#define METALL_USERFAULTFD_BUFFER_SIZE (1ULL << 30ULL)
+#endif
+
+#ifndef METALL_USERFAULTFD_PAGE_SIZE
+#define METALL_USERFAULTFD_PAGE_SIZE (1ULL << 16ULL)
+#endif
+
+namespace metall {
+namespace kernel {
+
+namespace {
+namespace util = metall::detail::utility;
+}
+
+/// \brief Segment storage that manages its own page buffer using userfaultfd(2).
+/// The segment is mapped as anonymous memory and page faults are served by a handler thread
+/// that reads data from the backing block files using pread(2).
+/// The number of resident pages is bounded by the buffer size;
+/// the CLOCK algorithm selects victim pages and dirty victims are written back before being dropped.
+/// Dirty pages are detected with the userfaultfd write-protect mode (Linux 5.7 or later).
+/// A writeback thread writes dirty pages back asynchronously.
+template <typename different_type, typename size_type>
+class userfaultfd_segment_storage {
+
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Constructor & assign operator
+  // -------------------------------------------------------------------------------- //
+  /// \brief Constructor
+  /// \param buffer_size The maximum size of the page buffer in byte.
+  /// \param uffd_page_size The granularity of page fault handling in byte.
+  /// Must be a multiple of the system page size.
+  explicit userfaultfd_segment_storage(const size_type buffer_size = METALL_USERFAULTFD_BUFFER_SIZE,
+                                       const size_type uffd_page_size = METALL_USERFAULTFD_PAGE_SIZE)
+      : m_page_size(0),
+        m_buffer_capacity(0),
+        m_vm_region_size(0),
+        m_current_segment_size(0),
+        m_segment(nullptr),
+        m_base_path(),
+        m_read_only(),
+        m_blocks(),
+        m_uffd(-1),
+        m_stop_event_fd(-1),
+        m_mutex(),
+        m_page_to_frame(),
+        m_frames(),
+        m_free_frames(),
+        m_clock_hand(0),
+        m_num_dirty_pages(0),
+        m_staging_buffer(),
+        m_fault_handler(),
+        m_writeback_thread(),
+        m_writeback_cv(),
+        m_writeback_requested(false),
+        m_stop_threads(false) {
+    if (!priv_init_page_size(uffd_page_size)) {
+      std::abort();
+    }
+    m_buffer_capacity = std::max((size_type)1, buffer_size / m_page_size);
+  }
+
+  ~userfaultfd_segment_storage() {
+    sync(true);
+    destroy();
+  }
+
+  userfaultfd_segment_storage(const userfaultfd_segment_storage &) = delete;
+  userfaultfd_segment_storage &operator=(const userfaultfd_segment_storage &) = delete;
+
+  // The fault handler thread holds 'this'
+  userfaultfd_segment_storage(userfaultfd_segment_storage &&) = delete;
+  userfaultfd_segment_storage &operator=(userfaultfd_segment_storage &&) = delete;
+
+  /// -------------------------------------------------------------------------------- ///
+  /// Public methods
+  /// -------------------------------------------------------------------------------- ///
+  /// \brief Check if there is a file that can be opened
+  static bool openable(const std::string &base_path) {
+    const auto file_name = priv_make_file_name(base_path, 0);
+    return util::file_exist(file_name);
+  }
+
+  /// \brief Gets the size of an existing segment
+  /// \return Returns 0 if there is no segment
+  static size_type get_size(const std::string &base_path) {
+    size_type size = 0;
+    for (size_type block_no = 0;; ++block_no) {
+      const auto file_name = priv_make_file_name(base_path, block_no);
+      if (!util::file_exist(file_name)) {
+        break;
+      }
+      size += util::get_file_size(file_name);
+    }
+    return size;
+  }
+
+  /// \brief Creates a new segment. Striping block files is not supported.
+  bool create(const std::string &base_path,
+              const size_type vm_region_size,
+              void *const vm_region,
+              const size_type initial_segment_size,
+              const std::vector<std::string> &stripe_dir_paths = {},
+              [[maybe_unused]] const std::vector<size_type> &stripe_weights = {}) {
+    assert(!priv_inited());
+    if (!stripe_dir_paths.empty()) {
+      std::cerr << "Striping block files is not supported" << std::endl;
+      return false;
+    }
+
+    if (initial_segment_size % page_size() != 0 || vm_region_size % page_size() != 0
+        || (uint64_t)vm_region % page_size() != 0) {
+      std::cerr << "Invalid argument to crete application data segment" << std::endl;
+      std::abort();
+    }
+
+    m_base_path = base_path;
+    m_vm_region_size = vm_region_size;
+    m_segment = vm_region;
+    m_read_only = false;
+
+    if (!priv_open_userfaultfd()) {
+      priv_reset();
+      return false;
+    }
+
+    const auto segment_size = std::min(vm_region_size, initial_segment_size);
+    if (!priv_create_block_file(0, segment_size) || !priv_map_and_register(0, segment_size)) {
+      priv_close_all();
+      priv_reset();
+      return false;
+    }
+    m_current_segment_size = segment_size;
+    m_page_to_frame.resize(m_current_segment_size / page_size(), 0);
+
+    priv_start_threads();
+
+    return true;
+  }
+
+  /// \brief Opens an existing segment
+  /// \param populate Not supported; pages are always read on demand
+  bool open(const std::string &base_path, const size_type vm_region_size, void *const vm_region, const bool read_only,
+            [[maybe_unused]] const bool populate = false) {
+    assert(!priv_inited());
+
+    if (vm_region_size % page_size() != 0 || (uint64_t)vm_region % page_size() != 0) {
+      std::cerr << "Invalid argument to open segment" << std::endl;
+      std::abort(); // Fatal error
+    }
+
+    m_base_path = base_path;
+    m_vm_region_size = vm_region_size;
+    m_segment = vm_region;
+    m_read_only = read_only;
+
+    if (!priv_open_userfaultfd()) {
+      priv_reset();
+      return false;
+    }
+
+    for (size_type block_no = 0;; ++block_no) {
+      const auto file_name = priv_make_file_name(m_base_path, block_no);
+      if (!util::file_exist(file_name)) {
+        break;
+      }
+
+      const auto file_size = util::get_file_size(file_name);
+      assert(file_size % page_size() == 0);
+      if (m_current_segment_size + file_size > m_vm_region_size) {
+        std::cerr << "VM region is too small to open the segment" << std::endl;
+        std::abort(); // Fatal error
+      }
+      if (!priv_open_block_file(file_name, m_current_segment_size, file_size)) {
+        std::abort(); // Fatal error
+      }
+      m_current_segment_size += file_size;
+    }
+
+    if (m_blocks.empty() || !priv_map_and_register(0, m_current_segment_size)) {
+      priv_close_all();
+      priv_reset();
+      return false;
+    }
+    m_page_to_frame.resize(m_current_segment_size / page_size(), 0);
+
+    priv_start_threads();
+
+    return true;
+  }
+
+  bool extend(const size_type new_segment_size) {
+    assert(priv_inited());
+
+    if (m_read_only) {
+      return false;
+    }
+
+    if (new_segment_size > m_vm_region_size) {
+      std::cerr << "Requested segment size is too big" << std::endl;
+      return false;
+    }
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (new_segment_size <= m_current_segment_size) {
+      return true; // Already enough segment size
+    }
+
+    const size_type size = util::round_up(new_segment_size - m_current_segment_size, page_size());
+    if (!priv_create_block_file(m_current_segment_size, size)
+        || !priv_map_and_register(m_current_segment_size, size)) {
+      return false;
+    }
+    m_current_segment_size += size;
+    m_page_to_frame.resize(m_current_segment_size / page_size(), 0);
+
+    return true;
+  }
+
+  void destroy() {
+    priv_destroy_segment();
+  }
+
+  void sync(const bool sync) {
+    priv_sync_segment(sync);
+  }
+
+  /// \brief Writes back dirty pages and synchronizes the block files asynchronously.
+  /// This storage must not be destroyed until the returned future is ready.
+  /// \return Returns an object of std::future
+  /// If succeeded, its get() returns True; other false
+  std::future<bool> sync_async() {
+    return std::async(std::launch::async, [this]() -> bool {
+      priv_sync_segment(true);
+      return true;
+    });
+  }
+
+  void free_region(const different_type offset, const size_type nbytes) {
+    priv_free_region(offset, nbytes);
+  }
+
+  void *get_segment() const {
+    return m_segment;
+  }
+
+  /// \brief Returns the size of the VM region; it does not grow in this storage
+  size_type vm_region_size() const {
+    return m_vm_region_size;
+  }
+
+  size_type size() const {
+    return m_current_segment_size;
+  }
+
+  size_type page_size() const {
+    return m_page_size;
+  }
+
+  bool read_only() const {
+    return m_read_only;
+  }
+
+  /// \brief Write tracking is not supported; all parts are considered as modified
+  bool start_write_tracking(const size_type) {
+    return false;
+  }
+
+  bool written(const size_type, const size_type = 0) const {
+    return true;
+  }
+
+  void mark_written(const size_type, const size_type = 0) {}
+
+  bool reset_write_tracking(const size_type = 0) {
+    return false;
+  }
+
+  /// \brief Pages are served by the fault handler thread also for system calls
+  /// (userfaultfd is opened without UFFD_USER_MODE_ONLY); nothing to load
+  void load_all() {}
+
+  /// \brief Copy-on-write snapshots are not supported; the block files are copied before this function returns.
+  /// Writes to the segment must be stopped until this function returns.
+  /// \param destination_base_path The base path of the destination block files
+  /// \param on_frozen Called after the segment is synchronized; the snapshot fails if it returns false
+  /// \return Returns an object of std::future that is ready
+  std::future<bool> snapshot_async(const std::string &destination_base_path,
+                                   const std::function<bool()> &on_frozen = [] { return true; }) {
+    std::promise<bool> promise;
+    priv_sync_segment(true);
+    bool ret = on_frozen();
+    for (size_type n = 0; n < m_blocks.size() && ret; ++n) {
+      ret = util::copy_file(priv_make_file_name(m_base_path, n), priv_make_file_name(destination_base_path, n));
+    }
+    promise.set_value(ret);
+    return promise.get_future();
+  }
+
+  struct overlay_part {
+    std::string path;
+    size_type offset;
+  };
+
+  /// \brief Overlay opens are not supported
+  bool open_overlay(const std::vector<overlay_part> &, const size_type, const size_type, void *const) {
+    std::cerr << "The userfaultfd segment storage does not support opening versions" << std::endl;
+    return false;
+  }
+
+  bool overlay() const {
+    return false;
+  }
+
+  /// \brief Tiering is not supported
+  bool start_tiering(const std::string &, const size_type) {
+    return false;
+  }
+
+  bool stop_tiering() {
+    return false;
+  }
+
+  bool tiering() const {
+    return false;
+  }
+
+  size_type hot_tier_size() const {
+    return 0;
+  }
+
+  static bool striped(const std::string &) {
+    return false;
+  }
+
+  static std::vector<std::string> striped_block_files(const std::string &) {
+    return {};
+  }
+
+  static std::string stripe_file_name(const std::string &base_path) {
+    return base_path + "_stripes";
+  }
+
+  static bool remove_stripes(const std::string &) {
+    return true;
+  }
+
+  /// \brief Returns the maximum number of pages that can reside in the page buffer
+  size_type buffer_capacity() const {
+    return m_buffer_capacity;
+  }
+
+  /// \brief Returns the number of pages that currently reside in the page buffer
+  size_type num_resident_pages() const {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_frames.size() - m_free_frames.size();
+  }
+
+ private:
+  // -------------------------------------------------------------------------------- //
+  // Private types and static values
+  // -------------------------------------------------------------------------------- //
+  static constexpr uint32_t k_not_resident = 0;
+  static constexpr size_type k_invalid_page_no = std::numeric_limits<size_type>::max();
+
+  enum frame_flag : uint8_t {
+    referenced = 1,
+    dirty = 2
+  };
+
+  struct block_type {
+    int fd;
+    size_type offset; // Offset in the segment
+    size_type size;
+  };
+
+  struct frame_type {
+    size_type page_no;
+    uint8_t flags;
+  };
+
+  // -------------------------------------------------------------------------------- //
+  // Private methods (not designed to be used by the base class)
+  // -------------------------------------------------------------------------------- //
+  static std::string priv_make_file_name(const std::string &base_path, const size_type n) {
+    return base_path + "_block-" + std::to_string(n);
+  }
+
+  void priv_reset() {
+    m_vm_region_size = 0;
+    m_current_segment_size = 0;
+    m_segment = nullptr;
+    m_blocks.clear();
+    m_page_to_frame.clear();
+    m_frames.clear();
+    m_free_frames.clear();
+    m_clock_hand = 0;
+    m_num_dirty_pages = 0;
+  }
+
+  bool priv_inited() const {
+    return (m_page_size > 0 && !m_blocks.empty() && m_vm_region_size > 0 && m_current_segment_size > 0
+        && m_segment && !m_base_path.empty() && m_uffd != -1);
+  }
+
+  bool priv_init_page_size(const size_type uffd_page_size) {
+    const ssize_t system_page_size = util::get_page_size();
+    if (system_page_size == -1) {
+      std::cerr << "Failed to get system pagesize" << std::endl;
+      return false;
+    }
+    if (uffd_page_size == 0 || uffd_page_size % system_page_size != 0) {
+      std::cerr << "userfaultfd page size must be a multiple of the system page size: " << uffd_page_size << std::endl;
+      return false;
+    }
+    m_page_size = uffd_page_size;
+    return true;
+  }
+
+  // ---------------------------------------- userfaultfd ---------------------------------------- //
+  bool priv_open_userfaultfd() {
+    // Not UFFD_USER_MODE_ONLY: page faults raised by system calls, e.g., pwrite(2) from the segment, must be served too
+    m_uffd = ::syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (m_uffd == -1) {
+      ::perror("userfaultfd");
+      std::cerr << "errno: " << errno << std::endl;
+      return false;
+    }
+
+    struct uffdio_api api{};
+    api.api = UFFD_API;
+    api.features = (m_read_only) ? 0 : UFFD_FEATURE_PAGEFAULT_FLAG_WP;
+    if (::ioctl(m_uffd, UFFDIO_API, &api) == -1) {
+      ::perror("ioctl UFFDIO_API");
+      std::cerr << "errno: " << errno << std::endl;
+      if (!m_read_only) std::cerr << "The userfaultfd write-protect mode may not be supported" << std::endl;
+      util::os_close(m_uffd);
+      m_uffd = -1;
+      return false;
+    }
+
+    m_stop_event_fd = ::eventfd(0, EFD_CLOEXEC);
+    if (m_stop_event_fd == -1) {
+      ::perror("eventfd");
+      util::os_close(m_uffd);
+      m_uffd = -1;
+      return false;
+    }
+
+    return true;
+  }
+
+  bool priv_map_and_register(const size_type offset, const size_type length) {
+    void *const addr = static_cast<char *>(m_segment) + offset;
+    const int prot = PROT_READ | (m_read_only ? 0 : PROT_WRITE);
+    if (util::os_mmap(addr, length, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0) != addr) {
+      std::cerr << "Failed to map an anonymous region" << std::endl;
+      return false;
+    }
+
+    struct uffdio_register reg{};
+    reg.range.start = reinterpret_cast<uint64_t>(addr);
+    reg.range.len = length;
+    reg.mode = UFFDIO_REGISTER_MODE_MISSING | (m_read_only ? 0 : UFFDIO_REGISTER_MODE_WP);
+    if (::ioctl(m_uffd, UFFDIO_REGISTER, &reg) == -1) {
+      ::perror("ioctl UFFDIO_REGISTER");
+      std::cerr << "errno: " << errno << std::endl;
+      util::map_with_prot_none(addr, length);
+      return false;
+    }
+
+    return true;
+  }
+
+  bool priv_unregister(const size_type offset, const size_type length) {
+    struct uffdio_range range{};
+    range.start = reinterpret_cast<uint64_t>(static_cast<char *>(m_segment) + offset);
+    range.len = length;
+    if (::ioctl(m_uffd, UFFDIO_UNREGISTER, &range) == -1) {
+      ::perror("ioctl UFFDIO_UNREGISTER");
+      return false;
+    }
+    return true;
+  }
+
+  bool priv_write_protect(const size_type page_no, const bool protect) {
+    struct uffdio_writeprotect wp{};
+    wp.range.start = reinterpret_cast<uint64_t>(priv_page_address(page_no));
+    wp.range.len = page_size();
+    wp.mode = (protect) ? UFFDIO_WRITEPROTECT_MODE_WP : 0;
+    if (::ioctl(m_uffd, UFFDIO_WRITEPROTECT, &wp) == -1) {
+      ::perror("ioctl UFFDIO_WRITEPROTECT");
+      std::cerr << "errno: " << errno << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool priv_wake(const size_type page_no) {
+    struct uffdio_range range{};
+    range.start = reinterpret_cast<uint64_t>(priv_page_address(page_no));
+    range.len = page_size();
+    if (::ioctl(m_uffd, UFFDIO_WAKE, &range) == -1) {
+      ::perror("ioctl UFFDIO_WAKE");
+      return false;
+    }
+    return true;
+  }
+
+  // ---------------------------------------- Block files ---------------------------------------- //
+  bool priv_create_block_file(const size_type offset, const size_type file_size) {
+    const std::string file_name = priv_make_file_name(m_base_path, m_blocks.size());
+    if (!util::create_file(file_name)) return false;
+    if (!util::extend_file_size(file_name, file_size)) return false;
+    if (static_cast<size_type>(util::get_file_size(file_name)) < file_size) {
+      std::cerr << "Failed to create and extend file: " << file_name << std::endl;
+      std::abort();
+    }
+    return priv_open_block_file(file_name, offset, file_size);
+  }
+
+  bool priv_open_block_file(const std::string &file_name, const size_type offset, const size_type file_size) {
+    const int fd = ::open(file_name.c_str(), m_read_only ? O_RDONLY : O_RDWR);
+    if (fd == -1) {
+      ::perror("open");
+      std::cerr << "errno: " << errno << std::endl;
+      return false;
+    }
+    m_blocks.emplace_back(block_type{fd, offset, file_size});
+    return true;
+  }
+
+  const block_type &priv_find_block(const size_type offset) const {
+    auto itr = std::upper_bound(m_blocks.begin(), m_blocks.end(), offset,
+                                [](const size_type off, const block_type &block) { return off < block.offset; });
+    assert(itr != m_blocks.begin());
+    --itr;
+    assert(itr->offset <= offset && offset < itr->offset + itr->size);
+    return *itr;
+  }
+
+  void *priv_page_address(const size_type page_no) const {
+    return static_cast<char *>(m_segment) + page_no * page_size();
+  }
+
+  bool priv_read_page(const block_type &block, const size_type page_no, void *const buf) const {
+    const size_type offset = page_no * page_size();
+    size_type done = 0;
+    while (done < page_size()) {
+      const ssize_t ret = ::pread(block.fd, static_cast<char *>(buf) + done, page_size() - done,
+                                  offset - block.offset + done);
+      if (ret == -1) {
+        ::perror("pread");
+        return false;
+      }
+      if (ret == 0) { // Beyond the end of file
+        std::fill(static_cast<char *>(buf) + done, static_cast<char *>(buf) + page_size(), 0);
+        break;
+      }
+      done += ret;
+    }
+    return true;
+  }
+
+  bool priv_write_page(const size_type page_no) const {
+    const size_type offset = page_no * page_size();
+    const auto &block = priv_find_block(offset);
+    const char *const buf = static_cast<const char *>(priv_page_address(page_no));
+    size_type done = 0;
+    while (done < page_size()) {
+      const ssize_t ret = ::pwrite(block.fd, buf + done, page_size() - done, offset - block.offset + done);
+      if (ret == -1) {
+        ::perror("pwrite");
+        return false;
+      }
+      done += ret;
+    }
+    return true;
+  }
+
+  void priv_close_all() {
+    for (auto &block : m_blocks) {
+      util::os_close(block.fd);
+    }
+    m_blocks.clear();
+    if (m_uffd != -1) util::os_close(m_uffd);
+    m_uffd = -1;
+    if (m_stop_event_fd != -1) util::os_close(m_stop_event_fd);
+    m_stop_event_fd = -1;
+  }
+
+  // ---------------------------------------- Page buffer ---------------------------------------- //
+  /// \brief Returns a frame to place a new page, evicting a page if the buffer is full.
+  /// The caller must hold m_mutex.
+  uint32_t priv_acquire_frame() {
+    if (!m_free_frames.empty()) {
+      const auto frame_no = m_free_frames.back();
+      m_free_frames.pop_back();
+      return frame_no;
+    }
+
+    if (m_frames.size() < m_buffer_capacity) {
+      m_frames.emplace_back(frame_type{k_invalid_page_no, 0});
+      return static_cast<uint32_t>(m_frames.size() - 1);
+    }
+
+    // CLOCK: give referenced pages a second chance
+    while (true) {
+      m_clock_hand = (m_clock_hand + 1) % m_frames.size();
+      auto &frame = m_frames[m_clock_hand];
+      assert(frame.page_no != k_invalid_page_no); // All frames are used
+      if (frame.flags & frame_flag::referenced) {
+        frame.flags &= ~frame_flag::referenced;
+        continue;
+      }
+      priv_evict_frame(m_clock_hand);
+      m_free_frames.pop_back(); // Reuse the evicted frame
+      return static_cast<uint32_t>(m_clock_hand);
+    }
+  }
+
+  /// \brief Writes back a page if it is dirty and drops it from the buffer.
+  /// The caller must hold m_mutex.
+  void priv_evict_frame(const size_type frame_no) {
+    auto &frame = m_frames[frame_no];
+    assert(frame.page_no != k_invalid_page_no);
+
+    if (frame.flags & frame_flag::dirty) {
+      priv_writeback_frame(frame);
+    }
+
+    // The next access to the page causes a missing page fault again
+    if (!util::uncommit_private_pages_immediately(priv_page_address(frame.page_no), page_size())) {
+      std::cerr << "Failed to drop a page from the page buffer" << std::endl;
+      std::abort();
+    }
+
+    m_page_to_frame[frame.page_no] = k_not_resident;
+    frame.page_no = k_invalid_page_no;
+    frame.flags = 0;
+    m_free_frames.push_back(static_cast<uint32_t>(frame_no));
+  }
+
+  /// \brief Write-protects a dirty page and writes it back to its block file.
+  /// The caller must hold m_mutex.
+  void priv_writeback_frame(frame_type &frame) {
+    assert(frame.flags & frame_flag::dirty);
+    // Write-protect first so that concurrent writes are blocked (and detected) during the writeback
+    if (!priv_write_protect(frame.page_no, true) || !priv_write_page(frame.page_no)) {
+      std::cerr << "Failed to write back a page" << std::endl;
+      std::abort();
+    }
+    frame.flags &= ~frame_flag::dirty;
+    --m_num_dirty_pages;
+  }
+
+  // ---------------------------------------- Fault handling ---------------------------------------- //
+  void priv_start_threads() {
+    m_stop_threads = false;
+    m_staging_buffer.reset(new char[page_size()]);
+    m_fault_handler = std::thread([this]() { priv_fault_handler_main(); });
+    if (!m_read_only) {
+      m_writeback_thread = std::thread([this]() { priv_writeback_main(); });
+    }
+  }
+
+  void priv_stop_threads() {
+    m_stop_threads = true;
+    if (m_fault_handler.joinable()) {
+      const uint64_t one = 1;
+      if (::write(m_stop_event_fd, &one, sizeof(one)) != sizeof(one)) {
+        ::perror("write");
+      }
+      m_fault_handler.join();
+    }
+    if (m_writeback_thread.joinable()) {
+      {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_writeback_requested = true;
+      }
+      m_writeback_cv.notify_all();
+      m_writeback_thread.join();
+    }
+  }
+
+  void priv_fault_handler_main() {
+    while (!m_stop_threads) {
+      struct pollfd fds[2];
+      fds[0].fd = m_uffd;
+      fds[0].events = POLLIN;
+      fds[1].fd = m_stop_event_fd;
+      fds[1].events = POLLIN;
+      if (::poll(fds, 2, -1) == -1) {
+        if (errno == EINTR) continue;
+        ::perror("poll");
+        std::abort();
+      }
+      if (fds[1].revents & POLLIN) break;
+      if (!(fds[0].revents & POLLIN)) continue;
+
+      struct uffd_msg msg{};
+      const ssize_t ret = ::read(m_uffd, &msg, sizeof(msg));
+      if (ret == -1) {
+        if (errno == EAGAIN) continue;
+        ::perror("read userfaultfd");
+        std::abort();
+      }
+      if (ret != sizeof(msg) || msg.event != UFFD_EVENT_PAGEFAULT) continue;
+
+      priv_handle_page_fault(msg.arg.pagefault.address, msg.arg.pagefault.flags);
+    }
+  }
+
+  void priv_handle_page_fault(const uint64_t address, const uint64_t flags) {
+    const size_type page_no = (address - reinterpret_cast<uint64_t>(m_segment)) / page_size();
+    const bool write_fault = flags & UFFD_PAGEFAULT_FLAG_WRITE;
+
+    uint32_t new_frame_no = 0;
+    block_type block{};
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      assert(page_no < m_page_to_frame.size());
+
+      const auto frame_no = m_page_to_frame[page_no];
+      if (frame_no != k_not_resident) {
+        auto &frame = m_frames[frame_no - 1];
+        frame.flags |= frame_flag::referenced;
+        if (flags & UFFD_PAGEFAULT_FLAG_WP) { // First write to a clean page
+          if (!(frame.flags & frame_flag::dirty)) {
+            frame.flags |= frame_flag::dirty;
+            ++m_num_dirty_pages;
+          }
+          if (!priv_write_protect(page_no, false)) std::abort(); // Also wakes up the faulting thread
+        } else {
+          priv_wake(page_no); // Another fault has already filled the page
+        }
+        return;
+      }
+
+      // Only this thread acquires frames, so the reserved frame stays unused until it is registered below.
+      // A victim page is still written back under the lock;
+      // the writeback thread keeps enough clean pages so that it is rare.
+      new_frame_no = priv_acquire_frame();
+      block = priv_find_block(page_no * page_size()); // m_blocks may grow while the lock is released
+    }
+
+    // Read the page without holding the lock so that the writeback thread and the other operations
+    // are not blocked by the I/O
+    if (!priv_read_page(block, page_no, m_staging_buffer.get())) {
+      std::cerr << "Failed to read a page from the block file" << std::endl;
+      std::abort();
+    }
+
+    struct uffdio_copy copy{};
+    copy.dst = reinterpret_cast<uint64_t>(priv_page_address(page_no));
+    copy.src = reinterpret_cast<uint64_t>(m_staging_buffer.get());
+    copy.len = page_size();
+    // Map clean pages as write-protected to detect the first write to them.
+    // The faulting thread is woken up after the frame is registered below;
+    // otherwise, a page written right before sync() could be missed as it is not known to be dirty yet.
+    copy.mode = ((!m_read_only && !write_fault) ? UFFDIO_COPY_MODE_WP : 0) | UFFDIO_COPY_MODE_DONTWAKE;
+    if (::ioctl(m_uffd, UFFDIO_COPY, &copy) == -1 && errno != EEXIST) {
+      ::perror("ioctl UFFDIO_COPY");
+      std::cerr << "errno: " << errno << std::endl;
+      std::abort();
+    }
+
+    bool request_writeback = false;
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      auto &frame = m_frames[new_frame_no];
+      frame.page_no = page_no;
+      frame.flags = frame_flag::referenced;
+      if (!m_read_only && write_fault) {
+        frame.flags |= frame_flag::dirty;
+        ++m_num_dirty_pages;
+      }
+      m_page_to_frame[page_no] = new_frame_no + 1;
+
+      // Keep enough clean pages so that evictions rarely have to write back
+      request_writeback = (m_num_dirty_pages > m_buffer_capacity / 2) && !m_writeback_requested;
+      if (request_writeback) m_writeback_requested = true;
+    }
+    if (!priv_wake(page_no)) std::abort();
+
+    if (request_writeback) m_writeback_cv.notify_one();
+  }
+
+  // ---------------------------------------- Writeback ---------------------------------------- //
+  void priv_writeback_main() {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_writeback_cv.wait(lock, [this] { return m_writeback_requested || m_stop_threads; });
+        if (m_stop_threads) return;
+      }
+      priv_writeback_all_dirty_frames();
+      {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_writeback_requested = false;
+      }
+      m_writeback_cv.notify_all();
+    }
+  }
+
+  /// \brief Writes back dirty pages one by one so that page faults can be served in between
+  void priv_writeback_all_dirty_frames() {
+    for (size_type frame_no = 0;; ++frame_no) {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      if (frame_no >= m_frames.size()) break;
+      auto &frame = m_frames[frame_no];
+      if (frame.page_no != k_invalid_page_no && (frame.flags & frame_flag::dirty)) {
+        priv_writeback_frame(frame);
+      }
+    }
+  }
+
+  void priv_sync_segment(const bool sync) {
+    if (!priv_inited() || m_read_only) return;
+
+    if (!sync) {
+      {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_writeback_requested = true;
+      }
+      m_writeback_cv.notify_one();
+      return;
+    }
+
+    priv_writeback_all_dirty_frames();
+    for (const auto &block : m_blocks) {
+      if (!util::os_fsync(block.fd)) {
+        std::cerr << "Failed to fsync a block file" << std::endl;
+        std::abort();
+      }
+    }
+  }
+
+  void priv_destroy_segment() {
+    if (!priv_inited()) return;
+
+    priv_stop_threads();
+    priv_unregister(0, m_current_segment_size);
+    util::map_with_prot_none(m_segment, m_current_segment_size);
+    // NOTE: the VM region will be unmapped by manager_kernel
+
+    priv_close_all();
+    priv_reset();
+  }
+
+  bool priv_free_region(const different_type offset, const size_type nbytes) {
+    if (!priv_inited() || m_read_only) return false;
+
+    if (offset + nbytes > m_current_segment_size) return false;
+    if (offset % page_size() != 0 || nbytes % page_size() != 0) return false;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    for (size_type page_no = offset / page_size(); page_no < (offset + nbytes) / page_size(); ++page_no) {
+      const auto frame_no = m_page_to_frame[page_no];
+      if (frame_no == k_not_resident) continue;
+      auto &frame = m_frames[frame_no - 1];
+      if (frame.flags & frame_flag::dirty) --m_num_dirty_pages;
+      frame.flags = 0; // Drop without writing back
+      frame.page_no = k_invalid_page_no;
+      m_free_frames.push_back(frame_no - 1);
+      m_page_to_frame[page_no] = k_not_resident;
+    }
+    util::uncommit_private_pages_immediately(static_cast<char *>(m_segment) + offset, nbytes);
+
+#ifndef METALL_DISABLE_FREE_FILE_SPACE
+    // Free the file space
+    for (size_type off = offset; off < offset + nbytes;) {
+      const auto &block = priv_find_block(off);
+      const size_type len = std::min(offset + nbytes, block.offset + block.size) - off;
+      util::free_file_space(block.fd, off - block.offset, len);
+      off += len;
+    }
+#endif
+
+    return true;
+  }
+
+  /// -------------------------------------------------------------------------------- ///
+  /// Private fields
+  /// -------------------------------------------------------------------------------- ///
+  size_type m_page_size{0};
+  size_type m_buffer_capacity{0};
+  size_type m_vm_region_size{0};
+  size_type m_current_segment_size{0};
+  void *m_segment{nullptr};
+  std::string m_base_path;
+  bool m_read_only;
+  std::vector<block_type> m_blocks;
+  int m_uffd{-1};
+  int m_stop_event_fd{-1};
+
+  // Page buffer
+  mutable std::mutex m_mutex;
+  std::vector<uint32_t> m_page_to_frame; // Frame number + 1; 0 means the page is not resident
+  std::vector<frame_type> m_frames;
+  std::vector<uint32_t> m_free_frames;
+  size_type m_clock_hand{0};
+  size_type m_num_dirty_pages{0};
+  std::unique_ptr<char[]> m_staging_buffer;
+
+  // Threads
+  std::thread m_fault_handler;
+  std::thread m_writeback_thread;
+  std::condition_variable m_writeback_cv;
+  bool m_writeback_requested{false};
+  std::atomic<bool> m_stop_threads{false};
+};
+
+} // namespace kernel
+} // namespace metall
+#endif //METALL_DETAIL_SEGMENT_STORAGE_USERFAULTFD_STORAGE_HPP
@@ -0,0 +1,477 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_KERNEL_VERSION_CATALOG_HPP
+#define METALL_KERNEL_VERSION_CATALOG_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <limits>
+#include <algorithm>
+
+#include <metall/detail/utility/file.hpp>
+
+namespace metall {
+namespace kernel {
+
+namespace {
+namespace util = metall::detail::utility;
+}
+
+/// \brief Catalog of the versions of a data store.
+/// A version stores only the chunks of the segment that were modified since its parent version (a delta);
+/// the other chunks are taken from the ancestors.
+/// Each version has its own directory that contains the delta files;
+/// the catalog file lists the versions and their parents.
+/// Version numbers are not reused after versions are removed.
+class version_catalog {
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Public types and static values
+  // -------------------------------------------------------------------------------- //
+  using version_type = uint64_t;
+  static constexpr version_type k_no_version = std::numeric_limits<version_type>::max();
+
+  struct version_info {
+    version_type version;
+    version_type parent; // k_no_version if the version has no parent
+    uint64_t segment_size;
+  };
+
+  /// \brief The location of a chunk of a version; the path is empty if the chunk is filled with zeros
+  struct chunk_location {
+    std::string path;
+    uint64_t offset;
+  };
+
+  // -------------------------------------------------------------------------------- //
+  // Constructor & assign operator
+  // -------------------------------------------------------------------------------- //
+  /// \param dir_path The directory to store the catalog and versions
+  /// \param chunk_size The size of a chunk; must be a multiple of the page size
+  version_catalog(std::string dir_path, const std::size_t chunk_size)
+      : m_dir_path(std::move(dir_path)),
+        m_chunk_size(chunk_size),
+        m_versions(),
+        m_next_version(0) {}
+
+  // -------------------------------------------------------------------------------- //
+  // Public methods
+  // -------------------------------------------------------------------------------- //
+  /// \brief Loads the catalog. A missing catalog means no version.
+  /// \return Returns true on success; otherwise, false.
+  bool load() {
+    m_versions.clear();
+    m_next_version = 0;
+    const auto path = priv_catalog_file_path();
+    if (!util::file_exist(path)) return true;
+
+    std::ifstream ifs(path);
+    if (!ifs.is_open()) {
+      std::cerr << "Cannot open: " << path << std::endl;
+      return false;
+    }
+    if (!(ifs >> m_next_version)) {
+      std::cerr << "Cannot read a file: " << path << std::endl;
+      return false;
+    }
+    version_info info;
+    int64_t parent;
+    while (ifs >> info.version >> parent >> info.segment_size) {
+      info.parent = (parent < 0) ? k_no_version : parent;
+      m_versions.push_back(info);
+    }
+    if (!ifs.eof()) {
+      std::cerr << "Cannot read a file: " << path << std::endl;
+      m_versions.clear();
+      return false;
+    }
+    return true;
+  }
+
+  const std::vector<version_info> &versions() const {
+    return m_versions;
+  }
+
+  const version_info *find(const version_type version) const {
+    const auto itr = std::find_if(m_versions.begin(), m_versions.end(),
+                                  [version](const version_info &info) { return info.version == version; });
+    return (itr == m_versions.end()) ? nullptr : &(*itr);
+  }
+
+  /// \brief Returns the number for a new version
+  version_type next_version() const {
+    return m_next_version;
+  }
+
+  /// \brief Returns the directory of a version.
+  /// Files other than the delta can be stored in it before add() is called.
+  std::string version_dir_path(const version_type version) const {
+    return m_dir_path + "/" + std::to_string(version);
+  }
+
+  /// \brief Adds a version, storing the chunks modified since its parent version.
+  /// The version becomes visible when this function returns true.
+  /// \param version A number returned by next_version()
+  /// \param parent The parent version or k_no_version; all chunks are stored if there is no parent
+  /// \param segment The address of the segment
+  /// \param segment_size The size of the segment; must be a multiple of the chunk size
+  /// \param modified A function that takes a chunk number and returns true if the chunk has to be stored
+  /// \return Returns true on success; otherwise, false.
+  template <typename predicate_type>
+  bool add(const version_type version, const version_type parent, const void *const segment,
+           const std::size_t segment_size, predicate_type &&modified) {
+    if (find(version) || (parent != k_no_version && !find(parent))) {
+      std::cerr << "Invalid version: " << version << std::endl;
+      return false;
+    }
+    const auto dir_path = version_dir_path(version);
+    if (!util::directory_exist(dir_path) && !util::create_directory(dir_path)) {
+      std::cerr << "Failed to create directory: " << dir_path << std::endl;
+      return false;
+    }
+
+    const int fd = ::open(priv_delta_file_path(version).c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+      ::perror("open");
+      std::cerr << "Failed to create: " << priv_delta_file_path(version) << std::endl;
+      return false;
+    }
+    std::map<uint64_t, int64_t> chunks; // Chunk number -> offset in the delta file (-1 means zeros)
+    uint64_t delta_size = 0;
+    bool ret = true;
+    for (std::size_t chunk_no = 0; chunk_no < segment_size / m_chunk_size && ret; ++chunk_no) {
+      if (parent != k_no_version && !modified(chunk_no)) continue;
+      const char *const chunk = static_cast<const char *>(segment) + chunk_no * m_chunk_size;
+      if (priv_all_zero(chunk)) {
+        chunks[chunk_no] = -1;
+        continue;
+      }
+      ret = priv_pwrite(fd, chunk, m_chunk_size, delta_size);
+      chunks[chunk_no] = delta_size;
+      delta_size += m_chunk_size;
+    }
+    ret = ret && util::os_fsync(fd);
+    ret &= util::os_close(fd);
+    if (!ret || !priv_store_chunk_map(version, segment_size, chunks)) {
+      std::cerr << "Failed to store version " << version << std::endl;
+      return false;
+    }
+
+    const auto old_next_version = m_next_version;
+    m_versions.emplace_back(version_info{version, parent, segment_size});
+    m_next_version = std::max(m_next_version, version + 1);
+    if (!priv_store_catalog()) {
+      m_versions.pop_back();
+      m_next_version = old_next_version;
+      return false;
+    }
+    return true;
+  }
+
+  /// \brief Finds where each chunk of a version is stored, following its ancestors
+  /// \return Returns true on success; otherwise, false.
+  bool locate(const version_type version, std::vector<chunk_location> *const locations) const {
+    const auto *info = find(version);
+    if (!info) {
+      std::cerr << "Version does not exist: " << version << std::endl;
+      return false;
+    }
+
+    const std::size_t num_chunks = info->segment_size / m_chunk_size;
+    locations->assign(num_chunks, chunk_location{std::string(), 0});
+    std::vector<bool> found(num_chunks, false);
+    for (; info; info = (info->parent == k_no_version) ? nullptr : find(info->parent)) {
+      uint64_t segment_size;
+      std::map<uint64_t, int64_t> chunks;
+      if (!priv_load_chunk_map(info->version, &segment_size, &chunks)) {
+        return false;
+      }
+      for (const auto &[chunk_no, offset] : chunks) {
+        if (chunk_no >= num_chunks || found[chunk_no]) continue;
+        found[chunk_no] = true;
+        if (offset >= 0) {
+          (*locations)[chunk_no] = chunk_location{priv_delta_file_path(info->version), (uint64_t)offset};
+        }
+      }
+      if (info->parent != k_no_version && !find(info->parent)) {
+        std::cerr << "The parent of version " << info->version << " does not exist" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// \brief Removes a version. The chunks that its children take from it are moved to the children.
+  /// \param removed_chunks If not nullptr, the chunk numbers stored in the removed version are stored
+  /// \return Returns true on success; otherwise, false.
+  bool remove(const version_type version, std::vector<uint64_t> *const removed_chunks = nullptr) {
+    const auto *const info = find(version);
+    if (!info) {
+      std::cerr << "Version does not exist: " << version << std::endl;
+      return false;
+    }
+    const version_type parent = info->parent;
+
+    uint64_t segment_size;
+    std::map<uint64_t, int64_t> chunks;
+    if (!priv_load_chunk_map(version, &segment_size, &chunks)) {
+      return false;
+    }
+    for (auto &child : m_versions) {
+      if (child.parent != version) continue;
+      if (!priv_merge_chunks(version, chunks, child.version)) {
+        return false;
+      }
+      child.parent = parent;
+    }
+
+    // The merged children are valid either way; make the removal visible
+    m_versions.erase(std::find_if(m_versions.begin(), m_versions.end(),
+                                  [version](const version_info &v) { return v.version == version; }));
+    if (!priv_store_catalog()) {
+      return false;
+    }
+    util::remove_file(version_dir_path(version));
+
+    if (removed_chunks) {
+      removed_chunks->clear();
+      for (const auto &item : chunks) removed_chunks->push_back(item.first);
+    }
+    return true;
+  }
+
+  /// \brief Stores the state of the working data store (head): its parent version
+  /// and the chunks modified since the parent version.
+  /// \param parent The version the head derives from
+  /// \param modified_chunks The chunk numbers modified since the parent version;
+  /// nullptr if they are unknown, e.g., the head is being modified.
+  /// \return Returns true on success; otherwise, false.
+  bool store_head(const version_type parent, const std::vector<uint64_t> *const modified_chunks) const {
+    return priv_replace_file(priv_head_file_path(), [&](std::ofstream &ofs) {
+      ofs << ((parent == k_no_version) ? -1 : (int64_t)parent) << " "
+          << (modified_chunks ? (int64_t)modified_chunks->size() : -1) << "\n";
+      if (modified_chunks) {
+        for (const auto chunk_no : *modified_chunks) ofs << chunk_no << "\n";
+      }
+    });
+  }
+
+  /// \brief Loads the state stored by store_head()
+  /// \param parent The version the head derives from; k_no_version if there is no head state
+  /// \param known Set to false if the modified chunks are unknown
+  /// \return Returns true on success; otherwise, false.
+  bool load_head(version_type *const parent, bool *const known, std::vector<uint64_t> *const modified_chunks) const {
+    *parent = k_no_version;
+    *known = false;
+    modified_chunks->clear();
+    const auto path = priv_head_file_path();
+    if (!util::file_exist(path)) return true;
+
+    std::ifstream ifs(path);
+    int64_t p;
+    int64_t num_chunks;
+    if (!(ifs >> p >> num_chunks)) {
+      std::cerr << "Cannot read a file: " << path << std::endl;
+      return false;
+    }
+    *parent = (p < 0) ? k_no_version : p;
+    if (num_chunks < 0) return true;
+    modified_chunks->resize(num_chunks);
+    for (auto &chunk_no : *modified_chunks) {
+      if (!(ifs >> chunk_no)) {
+        std::cerr << "Cannot read a file: " << path << std::endl;
+        modified_chunks->clear();
+        return false;
+      }
+    }
+    *known = true;
+    return true;
+  }
+
+ private:
+  // -------------------------------------------------------------------------------- //
+  // Private methods
+  // -------------------------------------------------------------------------------- //
+  std::string priv_catalog_file_path() const {
+    return m_dir_path + "/catalog";
+  }
+
+  std::string priv_head_file_path() const {
+    return m_dir_path + "/head";
+  }
+
+  std::string priv_delta_file_path(const version_type version) const {
+    return version_dir_path(version) + "/segment_delta";
+  }
+
+  std::string priv_chunk_map_file_path(const version_type version) const {
+    return version_dir_path(version) + "/segment_chunks";
+  }
+
+  bool priv_all_zero(const char *const chunk) const {
+    for (std::size_t i = 0; i < m_chunk_size; i += sizeof(uint64_t)) {
+      if (*reinterpret_cast<const uint64_t *>(chunk + i)) return false;
+    }
+    return true;
+  }
+
+  static bool priv_pwrite(const int fd, const void *const buf, const std::size_t size, const uint64_t offset) {
+    for (std::size_t done = 0; done < size;) {
+      const auto ret = ::pwrite(fd, static_cast<const char *>(buf) + done, size - done, offset + done);
+      if (ret == -1) {
+        if (errno == EINTR) continue;
+        ::perror("pwrite");
+        return false;
+      }
+      done += ret;
+    }
+    return true;
+  }
+
+  static bool priv_pread(const int fd, void *const buf, const std::size_t size, const uint64_t offset) {
+    for (std::size_t done = 0; done < size;) {
+      const auto ret = ::pread(fd, static_cast<char *>(buf) + done, size - done, offset + done);
+      if (ret <= 0) {
+        if (ret == -1 && errno == EINTR) continue;
+        ::perror("pread");
+        return false;
+      }
+      done += ret;
+    }
+    return true;
+  }
+
+  /// \brief Writes a file to a temporary path and renames it so that a crash leaves either the old or the new one
+  template <typename writer_type>
+  static bool priv_replace_file(const std::string &path, writer_type &&writer) {
+    const std::string tmp_path = path + ".tmp";
+    {
+      std::ofstream ofs(tmp_path);
+      if (!ofs.is_open()) {
+        std::cerr << "Cannot open: " << tmp_path << std::endl;
+        return false;
+      }
+      writer(ofs);
+      ofs.close();
+      if (!ofs) {
+        std::cerr << "Failed to write: " << tmp_path << std::endl;
+        return false;
+      }
+    }
+    if (!util::fsync(tmp_path) || ::rename(tmp_path.c_str(), path.c_str()) == -1) {
+      std::cerr << "Failed to replace: " << path << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool priv_store_catalog() const {
+    return priv_replace_file(priv_catalog_file_path(), [this](std::ofstream &ofs) {
+      ofs << m_next_version << "\n";
+      for (const auto &info : m_versions) {
+        ofs << info.version << " " << ((info.parent == k_no_version) ? -1 : (int64_t)info.parent) << " "
+            << info.segment_size << "\n";
+      }
+    });
+  }
+
+  bool priv_store_chunk_map(const version_type version, const uint64_t segment_size,
+                            const std::map<uint64_t, int64_t> &chunks) const {
+    return priv_replace_file(priv_chunk_map_file_path(version), [&](std::ofstream &ofs) {
+      ofs << segment_size << " " << m_chunk_size << " " << chunks.size() << "\n";
+      for (const auto &[chunk_no, offset] : chunks) {
+        ofs << chunk_no << " " << offset << "\n";
+      }
+    });
+  }
+
+  bool priv_load_chunk_map(const version_type version, uint64_t *const segment_size,
+                           std::map<uint64_t, int64_t> *const chunks) const {
+    const auto path = priv_chunk_map_file_path(version);
+    std::ifstream ifs(path);
+    if (!ifs.is_open()) {
+      std::cerr << "Cannot open: " << path << std::endl;
+      return false;
+    }
+    std::size_t chunk_size;
+    std::size_t num_chunks;
+    if (!(ifs >> *segment_size >> chunk_size >> num_chunks) || chunk_size != m_chunk_size) {
+      std::cerr << "Invalid chunk map: " << path << std::endl;
+      return false;
+    }
+    chunks->clear();
+    for (std::size_t i = 0; i < num_chunks; ++i) {
+      uint64_t chunk_no;
+      int64_t offset;
+      if (!(ifs >> chunk_no >> offset)) {
+        std::cerr << "Cannot read a file: " << path << std::endl;
+        return false;
+      }
+      (*chunks)[chunk_no] = offset;
+    }
+    return true;
+  }
+
+  /// \brief Copies the chunks of a version that a child version does not have into the child
+  bool priv_merge_chunks(const version_type version, const std::map<uint64_t, int64_t> &chunks,
+                         const version_type child) const {
+    uint64_t child_segment_size;
+    std::map<uint64_t, int64_t> child_chunks;
+    if (!priv_load_chunk_map(child, &child_segment_size, &child_chunks)) {
+      return false;
+    }
+
+    const int src_fd = ::open(priv_delta_file_path(version).c_str(), O_RDONLY);
+    const int dst_fd = ::open(priv_delta_file_path(child).c_str(), O_RDWR);
+    bool ret = (src_fd != -1 && dst_fd != -1);
+    if (ret) {
+      uint64_t delta_size = util::get_file_size(priv_delta_file_path(child));
+      std::vector<char> buf(m_chunk_size);
+      for (const auto &[chunk_no, offset] : chunks) {
+        if (child_chunks.count(chunk_no) || !ret) continue;
+        if (offset < 0) {
+          child_chunks[chunk_no] = -1;
+          continue;
+        }
+        ret = priv_pread(src_fd, buf.data(), m_chunk_size, offset)
+            && priv_pwrite(dst_fd, buf.data(), m_chunk_size, delta_size);
+        child_chunks[chunk_no] = delta_size;
+        delta_size += m_chunk_size;
+      }
+      ret = ret && util::os_fsync(dst_fd);
+    }
+    if (src_fd != -1) util::os_close(src_fd);
+    if (dst_fd != -1) util::os_close(dst_fd);
+
+    // The chunk map is replaced after the data is durable
+    if (!ret || !priv_store_chunk_map(child, child_segment_size, child_chunks)) {
+      std::cerr << "Failed to merge version " << version << " into " << child << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // -------------------------------------------------------------------------------- //
+  // Private fields
+  // -------------------------------------------------------------------------------- //
+  std::string m_dir_path;
+  std::size_t m_chunk_size;
+  std::vector<version_info> m_versions;
+  version_type m_next_version;
+};
+
+} // namespace kernel
+} // namespace metall
+
+#endif //METALL_KERNEL_VERSION_CATALOG_HPP
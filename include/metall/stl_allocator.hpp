@@ -126,15 +126,24 @@ class stl_allocator
   };
 
   pointer allocate_impl(const size_type n) const {
+    // Node-based containers allocate one element at a time;
+    // the kernel is resolved once per thread and the bin number is resolved at compile time
+    if (n == 1) {
+      const auto &path = manager_kernel_type::fast_allocation_path(get_pointer_to_manager_kernel());
+      if (path.allocator) {
+        return pointer(reinterpret_cast<value_type *>(path.segment
+            + path.allocator->template allocate<sizeof(T)>()));
+      }
+    }
     auto manager_kernel = *get_pointer_to_manager_kernel();
     assert(manager_kernel);
     return pointer(static_cast<value_type *>(manager_kernel->allocate(n * sizeof(T))));
   }
 
-  void deallocate_impl(pointer ptr, [[maybe_unused]] const size_type size) const noexcept {
-    auto manager_kernel = *get_pointer_to_manager_kernel();
-    assert(manager_kernel);
-    manager_kernel->deallocate(to_raw_pointer(ptr));
+  void deallocate_impl(pointer ptr, const size_type size) const noexcept {
+    const auto &path = manager_kernel_type::fast_allocation_path(get_pointer_to_manager_kernel());
+    if (!path.allocator || !ptr) return; // Nothing is deallocated in the read-only mode
+    path.allocator->deallocate(reinterpret_cast<char *>(to_raw_pointer(ptr)) - path.segment, size * sizeof(T));
   }
 
   size_type max_size_impl() const noexcept {
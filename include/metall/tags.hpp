@@ -27,6 +27,11 @@ struct open_or_create_t {};
 struct open_read_only_t {};
 [[maybe_unused]] static const open_read_only_t open_read_only{};
 
+/// \brief Tag to open an already created segment as read only at a fixed address.
+/// Multiple processes can open the same segment at the same agreed-on address.
+struct open_read_only_shared_t {};
+[[maybe_unused]] static const open_read_only_shared_t open_read_only_shared{};
+
 /// \brief Tag to construct anonymous instances.
 [[maybe_unused]] static const detail::utility::anonymous_instance_t *anonymous_instance = nullptr;
 
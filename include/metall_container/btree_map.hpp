@@ -0,0 +1,786 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_COTAINER_BTREE_MAP_HPP
+#define METALL_COTAINER_BTREE_MAP_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if (defined(__x86_64__) && defined(__GNUC__)) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <metall_utility/mutex.hpp>
+
+namespace metall::container {
+
+namespace btree_map_detail {
+
+/// \brief A version lock for optimistic lock coupling.
+/// Readers do not write the lock; they read the version before and after reading a node
+/// and restart if it has changed or was locked.
+/// Writers lock a node by making its version odd and unlock it by making the version even again.
+class optimistic_lock {
+ public:
+  /// \brief Returns the current version. Sets restart to true if the node is locked.
+  uint64_t read_lock_or_restart(bool &restart) const {
+    const uint64_t version = m_version.load(std::memory_order_acquire);
+    if (version & k_locked) {
+      std::this_thread::yield();
+      restart = true;
+    }
+    return version;
+  }
+
+  /// \brief Sets restart to true if the node has been modified since version was read
+  void check_or_restart(const uint64_t version, bool &restart) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_version.load(std::memory_order_relaxed) != version) {
+      restart = true;
+    }
+  }
+
+  /// \brief Locks the node if it has not been modified since version was read. Otherwise, sets restart to true.
+  void upgrade_to_write_lock_or_restart(uint64_t &version, bool &restart) {
+    if (m_version.compare_exchange_strong(version, version + k_locked, std::memory_order_acquire)) {
+      version += k_locked;
+    } else {
+      restart = true;
+    }
+  }
+
+  void write_unlock() {
+    m_version.fetch_add(k_locked, std::memory_order_release);
+  }
+
+ private:
+  static constexpr uint64_t k_locked = 1;
+  std::atomic<uint64_t> m_version{0};
+};
+
+struct node_header {
+  uint64_t node_no; // Selects the lock of the node; assigned when the node is allocated and never changes
+  uint16_t count;
+  bool is_leaf;
+};
+
+/// \brief The number of bytes in a node reserved for its header, pointers, and padding
+constexpr std::size_t k_node_overhead = 64;
+
+template <typename key_type, typename mapped_type, typename node_pointer, std::size_t node_size>
+struct leaf_node {
+  static constexpr std::size_t k_capacity = (node_size - k_node_overhead) / (sizeof(key_type) + sizeof(mapped_type));
+
+  node_header header;
+  node_pointer next;
+  key_type keys[k_capacity];
+  mapped_type values[k_capacity];
+};
+
+template <typename key_type, typename node_pointer, std::size_t node_size>
+struct inner_node {
+  static constexpr std::size_t k_capacity = (node_size - k_node_overhead) / (sizeof(key_type) + sizeof(node_pointer));
+
+  node_header header;
+  key_type keys[k_capacity];
+  node_pointer children[k_capacity + 1];
+};
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/// \brief Returns true if the CPU supports SSE4.2, which has the 64-bit integer comparison instruction
+inline bool sse42_supported() {
+#ifdef __SSE4_2__
+  return true;
+#else
+  static const bool supported = __builtin_cpu_supports("sse4.2");
+  return supported;
+#endif
+}
+
+/// \brief Counts the 64-bit integer keys in [*i, length) that are less than key, two at a time,
+/// and advances *i to the first key that has not been compared.
+/// Compiled for SSE4.2 regardless of the compile options; call it only if sse42_supported() returns true.
+template <typename key_type>
+__attribute__((target("sse4.2")))
+inline std::size_t count_less_sse42(const key_type *const keys, const std::size_t length, const key_type &key,
+                                    std::size_t *const i) {
+  // Flips the sign bits to compare unsigned integers with the signed comparison instruction
+  const __m128i sign = _mm_set1_epi64x(std::is_signed_v<key_type> ? 0 : INT64_MIN);
+  const __m128i target = _mm_xor_si128(_mm_set1_epi64x(static_cast<int64_t>(key)), sign);
+  std::size_t count = 0;
+  for (; *i + 2 <= length; *i += 2) {
+    const __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + *i)), sign);
+    const int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(target, block)));
+    count += __builtin_popcount(mask);
+  }
+  return count;
+}
+#endif
+
+/// \brief Returns the number of keys that are less than key.
+/// Uses SSE4.2 (64-bit integer keys; detected at runtime) or SSE2 (32-bit integer keys) if they are available and
+/// the comparator is std::less; otherwise, uses a branchless loop that compilers can vectorize.
+template <typename key_type, typename compare_type>
+inline std::size_t count_less(const key_type *const keys, const std::size_t length, const key_type &key,
+                              const compare_type &compare) {
+  std::size_t i = 0;
+  std::size_t count = 0;
+  [[maybe_unused]] constexpr bool k_simd_comparable = std::is_same_v<compare_type, std::less<key_type>>
+      && std::is_integral_v<key_type> && !std::is_same_v<key_type, bool>;
+#if defined(__x86_64__) && defined(__GNUC__)
+  if constexpr (k_simd_comparable && sizeof(key_type) == 8) {
+    if (sse42_supported()) count += count_less_sse42(keys, length, key, &i);
+  }
+#endif
+#ifdef __SSE2__
+  if constexpr (k_simd_comparable && sizeof(key_type) == 4) {
+    const __m128i sign = _mm_set1_epi32(std::is_signed_v<key_type> ? 0 : INT32_MIN);
+    const __m128i target = _mm_xor_si128(_mm_set1_epi32(static_cast<int32_t>(key)), sign);
+    for (; i + 4 <= length; i += 4) {
+      const __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i)), sign);
+      const int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(target, block)));
+      count += __builtin_popcount(mask);
+    }
+  }
+#endif
+  for (; i < length; ++i) {
+    count += compare(keys[i], key);
+  }
+  return count;
+}
+
+/// \brief Returns the index of the first key that is not less than key in sorted keys.
+/// Narrows the range by binary search and scans the rest linearly.
+template <typename key_type, typename compare_type>
+inline std::size_t lower_bound(const key_type *const keys, const std::size_t length, const key_type &key,
+                               const compare_type &compare) {
+  constexpr std::size_t k_linear_search_length = 32;
+  std::size_t first = 0;
+  std::size_t last = length;
+  while (last - first > k_linear_search_length) {
+    const std::size_t middle = first + (last - first) / 2;
+    if (compare(keys[middle], key)) {
+      first = middle + 1;
+    } else {
+      last = middle;
+    }
+  }
+  return first + count_less(keys + first, last - first, key, compare);
+}
+
+} // namespace btree_map_detail
+
+/// \brief A concurrent B+-tree map for ordered lookups and range scans.
+/// Each node is a single k_node_size-byte allocation, i.e., a leaf stores many elements contiguously
+/// and leaves are linked so that range scans go through them sequentially.
+/// In Metall, the default node size (4 KiB) is one of the small object sizes.
+/// All pointers are the pointer type of the allocator (e.g., offset_ptr) so that the map can be stored in Metall.
+/// Modifiers and readers are thread-safe and use optimistic lock coupling:
+/// readers do not write any lock, and writers lock only the nodes they modify.
+/// The locks are not stored in the nodes but in DRAM (one per node, selected by the number stored in the node), i.e.,
+/// a map in a data store opened with read only mode can be read,
+/// and a node locked when a process crashed is not locked when the data store is reopened.
+/// Full nodes are split on the way down. The root node never moves; when it splits, its elements are moved to two new
+/// children. Nodes are not merged, i.e., erase() does not deallocate nodes.
+/// Iterators do not take locks, i.e., must not be used concurrently with modifiers.
+/// This is an experimental implementation.
+/// \tparam _key_type A key type. Must be trivially copyable.
+/// \tparam _mapped_type A mapped type. Must be trivially copyable.
+/// \tparam _compare A function object that compares keys.
+/// \tparam _allocator An allocator type.
+/// \tparam k_node_size The size of a node in bytes.
+template <typename _key_type,
+          typename _mapped_type,
+          typename _compare = std::less<_key_type>,
+          typename _allocator = std::allocator<std::pair<const _key_type, _mapped_type>>,
+          std::size_t k_node_size = 4096>
+class btree_map {
+  // Readers copy elements out of nodes that might be being modified and validate them afterward
+  static_assert(std::is_trivially_copyable_v<_key_type>, "Key type must be trivially copyable");
+  static_assert(std::is_trivially_copyable_v<_mapped_type>, "Mapped type must be trivially copyable");
+
+ private:
+  template <typename T>
+  using other_allocator_type = typename std::allocator_traits<_allocator>::template rebind_alloc<T>;
+
+  struct node_storage {
+    uint64_t data[k_node_size / sizeof(uint64_t)];
+  };
+  using node_allocator_type = other_allocator_type<node_storage>;
+  using node_pointer = typename std::allocator_traits<node_allocator_type>::pointer;
+
+  using header_type = btree_map_detail::node_header;
+  using lock_type = btree_map_detail::optimistic_lock;
+  using lock_table_type = metall::utility::mutex::instance_lock_array<lock_type>;
+  using leaf_type = btree_map_detail::leaf_node<_key_type, _mapped_type, node_pointer, k_node_size>;
+  using inner_type = btree_map_detail::inner_node<_key_type, node_pointer, k_node_size>;
+
+  static_assert(sizeof(leaf_type) <= sizeof(node_storage), "Leaf node does not fit in a node");
+  static_assert(sizeof(inner_type) <= sizeof(node_storage), "Inner node does not fit in a node");
+  static_assert(alignof(leaf_type) <= alignof(node_storage) && alignof(inner_type) <= alignof(node_storage),
+                "Keys or values require a larger alignment than nodes");
+  static_assert(leaf_type::k_capacity >= 2 && inner_type::k_capacity >= 3, "Node size is too small");
+
+  class impl_const_iterator;
+
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Public types and static values
+  // -------------------------------------------------------------------------------- //
+  using key_type = _key_type;
+  using mapped_type = _mapped_type;
+  using value_type = std::pair<const key_type, mapped_type>;
+  using size_type = std::size_t;
+  using key_compare = _compare;
+  using allocator_type = _allocator;
+  using const_iterator = impl_const_iterator;
+
+  static constexpr size_type k_leaf_capacity = leaf_type::k_capacity;
+  static constexpr size_type k_inner_capacity = inner_type::k_capacity;
+
+  // -------------------------------------------------------------------------------- //
+  // Constructor & assign operator
+  // -------------------------------------------------------------------------------- //
+  explicit btree_map(const _allocator &allocator = _allocator())
+      : m_allocator(allocator),
+        m_num_nodes(0),
+        m_root(priv_new_inner()),
+        m_size(0) {
+    priv_inner(m_root)->children[0] = priv_new_leaf();
+  }
+
+  btree_map(const btree_map &) = delete;
+  btree_map &operator=(const btree_map &) = delete;
+
+  ~btree_map() {
+    priv_destroy_subtree(m_root);
+    lock_table_type::release(this);
+  }
+
+  // -------------------------------------------------------------------------------- //
+  // Public methods
+  // -------------------------------------------------------------------------------- //
+  size_type size() const {
+    return m_size.load(std::memory_order_relaxed);
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  /// \brief Returns the number of levels, including the leaf level
+  size_type height() const {
+    size_type height = 1;
+    for (const header_type *node = priv_header(m_root); !node->is_leaf; ++height) {
+      node = priv_header(reinterpret_cast<const inner_type *>(node)->children[0]);
+    }
+    return height;
+  }
+
+  // ---------------------------------------- Modifier ---------------------------------------- //
+  /// \brief Inserts an element if its key does not exist.
+  /// \return True if the element was inserted.
+  bool insert(const value_type &value) {
+    return priv_insert_retry(value.first, value.second, false);
+  }
+
+  /// \brief Inserts an element or assigns value to the existing element.
+  /// \return True if the element was inserted.
+  bool insert_or_assign(const key_type &key, const mapped_type &value) {
+    return priv_insert_retry(key, value, true);
+  }
+
+  /// \brief Erases the element of key.
+  /// \return True if the element was erased.
+  bool erase(const key_type &key) {
+    while (true) {
+      bool restart = false;
+      uint64_t version = 0;
+      header_type *const node = const_cast<header_type *>(priv_find_leaf(key, &version, restart));
+      if (restart) continue;
+
+      priv_lock(node).upgrade_to_write_lock_or_restart(version, restart);
+      if (restart) continue;
+
+      auto *const leaf = reinterpret_cast<leaf_type *>(node);
+      const size_type pos = priv_lower_bound(leaf->keys, leaf->header.count, key);
+      const bool found = (pos < leaf->header.count && !m_compare(key, leaf->keys[pos]));
+      if (found) {
+        const size_type num_moves = leaf->header.count - pos - 1;
+        std::memmove(&leaf->keys[pos], &leaf->keys[pos + 1], num_moves * sizeof(key_type));
+        std::memmove(&leaf->values[pos], &leaf->values[pos + 1], num_moves * sizeof(mapped_type));
+        --leaf->header.count;
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+      }
+      priv_lock(node).write_unlock();
+      return found;
+    }
+  }
+
+  /// \brief Erases all elements and deallocates all nodes except the root.
+  /// This function is not thread-safe.
+  void clear() {
+    inner_type *const root = priv_inner(m_root);
+    for (size_type i = 0; i <= root->header.count; ++i) {
+      priv_destroy_subtree(root->children[i]);
+    }
+    root->header.count = 0;
+    m_num_nodes.store(root->header.node_no + 1, std::memory_order_relaxed);
+    root->children[0] = priv_new_leaf();
+    m_size.store(0, std::memory_order_relaxed);
+  }
+
+  // ---------------------------------------- Look up ---------------------------------------- //
+  size_type count(const key_type &key) const {
+    mapped_type value;
+    return get(key, &value) ? 1 : 0;
+  }
+
+  /// \brief Copies the value of key.
+  /// \return True if key exists.
+  bool get(const key_type &key, mapped_type *const value) const {
+    while (true) {
+      bool restart = false;
+      uint64_t version = 0;
+      const header_type *const node = priv_find_leaf(key, &version, restart);
+      if (restart) continue;
+
+      const auto *const leaf = reinterpret_cast<const leaf_type *>(node);
+      const size_type count = std::min<size_type>(leaf->header.count, k_leaf_capacity);
+      const size_type pos = priv_lower_bound(leaf->keys, count, key);
+      const bool found = (pos < count && !m_compare(key, leaf->keys[pos]));
+      mapped_type tmp;
+      if (found) tmp = leaf->values[pos];
+      priv_lock(node).check_or_restart(version, restart);
+      if (restart) continue;
+
+      if (found) *value = tmp;
+      return found;
+    }
+  }
+
+  /// \brief Calls function(key, value) for each element whose key is in [first, last), in order of the keys.
+  /// The elements are copied out of each leaf and then given to function, i.e., function does not hold any lock.
+  /// Each key is visited at most once even if the scan is restarted by concurrent modifications.
+  /// If function returns bool, the scan stops when it returns false.
+  template <typename function_type>
+  void for_each(const key_type &first, const key_type &last, const function_type &function) const {
+    std::vector<key_type> keys(k_leaf_capacity);
+    std::vector<mapped_type> values(k_leaf_capacity);
+
+    key_type lower = first;
+    bool inclusive = true; // False after lower has been visited
+    while (true) {
+      bool restart = false;
+      uint64_t version = 0;
+      const header_type *node = priv_find_leaf(lower, &version, restart);
+      if (restart) continue;
+
+      while (true) {
+        const auto *const leaf = reinterpret_cast<const leaf_type *>(node);
+        const size_type count = std::min<size_type>(leaf->header.count, k_leaf_capacity);
+        size_type pos = priv_lower_bound(leaf->keys, count, lower);
+        if (!inclusive && pos < count && !m_compare(lower, leaf->keys[pos])) ++pos;
+        const size_type num_copies = count - pos;
+        std::copy(&leaf->keys[pos], &leaf->keys[count], keys.begin());
+        std::copy(&leaf->values[pos], &leaf->values[count], values.begin());
+        const node_pointer next = leaf->next;
+        priv_lock(node).check_or_restart(version, restart);
+        if (restart) break;
+
+        for (size_type i = 0; i < num_copies; ++i) {
+          if (!m_compare(keys[i], last)) return;
+          lower = keys[i];
+          inclusive = false;
+          if constexpr (std::is_same_v<decltype(function(keys[i], values[i])), bool>) {
+            if (!function(keys[i], values[i])) return;
+          } else {
+            function(keys[i], values[i]);
+          }
+        }
+
+        if (!next) return;
+        node = priv_header(next);
+        version = priv_lock(node).read_lock_or_restart(restart);
+        if (restart) break;
+      }
+    }
+  }
+
+  // ---------------------------------------- Iterator ---------------------------------------- //
+  const_iterator cbegin() const {
+    const header_type *node = priv_header(m_root);
+    while (!node->is_leaf) {
+      node = priv_header(reinterpret_cast<const inner_type *>(node)->children[0]);
+    }
+    return const_iterator(reinterpret_cast<const leaf_type *>(node), 0);
+  }
+
+  const_iterator cend() const {
+    return const_iterator(nullptr, 0);
+  }
+
+  const_iterator begin() const {
+    return cbegin();
+  }
+
+  const_iterator end() const {
+    return cend();
+  }
+
+  /// \brief Returns an iterator to the first element whose key is not less than key
+  const_iterator lower_bound(const key_type &key) const {
+    const header_type *node = priv_header(m_root);
+    while (!node->is_leaf) {
+      const auto *const inner = reinterpret_cast<const inner_type *>(node);
+      node = priv_header(inner->children[priv_lower_bound(inner->keys, inner->header.count, key)]);
+    }
+    const auto *const leaf = reinterpret_cast<const leaf_type *>(node);
+    return const_iterator(leaf, priv_lower_bound(leaf->keys, leaf->header.count, key));
+  }
+
+  // ---------------------------------------- Allocator ---------------------------------------- //
+  allocator_type get_allocator() const {
+    return m_allocator;
+  }
+
+ private:
+  // -------------------------------------------------------------------------------- //
+  // Private methods
+  // -------------------------------------------------------------------------------- //
+  static header_type *priv_header(const node_pointer &node) {
+    return reinterpret_cast<header_type *>(std::addressof(*node));
+  }
+
+  static inner_type *priv_inner(const node_pointer &node) {
+    return reinterpret_cast<inner_type *>(std::addressof(*node));
+  }
+
+  static leaf_type *priv_leaf(const node_pointer &node) {
+    return reinterpret_cast<leaf_type *>(std::addressof(*node));
+  }
+
+  /// \brief Returns the lock of a node.
+  /// The locks are allocated in DRAM for each instance, one per node,
+  /// i.e., a lock held when a process crashed does not remain in the map.
+  lock_type &priv_lock(const header_type *const node) const {
+    return lock_table_type::get(this, node->node_no);
+  }
+
+  size_type priv_lower_bound(const key_type *const keys, const size_type length, const key_type &key) const {
+    return btree_map_detail::lower_bound(keys, length, key, m_compare);
+  }
+
+  node_pointer priv_new_leaf() {
+    node_allocator_type allocator(m_allocator);
+    node_pointer node = std::allocator_traits<node_allocator_type>::allocate(allocator, 1);
+    auto *const leaf = new(std::addressof(*node)) leaf_type;
+    leaf->header.node_no = m_num_nodes.fetch_add(1, std::memory_order_relaxed);
+    leaf->header.count = 0;
+    leaf->header.is_leaf = true;
+    leaf->next = nullptr;
+    return node;
+  }
+
+  node_pointer priv_new_inner() {
+    node_allocator_type allocator(m_allocator);
+    node_pointer node = std::allocator_traits<node_allocator_type>::allocate(allocator, 1);
+    auto *const inner = new(std::addressof(*node)) inner_type;
+    inner->header.node_no = m_num_nodes.fetch_add(1, std::memory_order_relaxed);
+    inner->header.count = 0;
+    inner->header.is_leaf = false;
+    return node;
+  }
+
+  void priv_destroy_subtree(const node_pointer &node) {
+    if (!priv_header(node)->is_leaf) {
+      inner_type *const inner = priv_inner(node);
+      for (size_type i = 0; i <= inner->header.count; ++i) {
+        priv_destroy_subtree(inner->children[i]);
+      }
+      inner->~inner_type();
+    } else {
+      priv_leaf(node)->~leaf_type();
+    }
+    node_allocator_type allocator(m_allocator);
+    std::allocator_traits<node_allocator_type>::deallocate(allocator, node, 1);
+  }
+
+  /// \brief Finds the leaf that would contain key without locking nodes.
+  /// Sets the version of the leaf to *version. Sets restart to true if a node on the path was modified.
+  const header_type *priv_find_leaf(const key_type &key, uint64_t *const version, bool &restart) const {
+    const header_type *node = priv_header(m_root);
+    *version = priv_lock(node).read_lock_or_restart(restart);
+    if (restart) return nullptr;
+
+    while (!node->is_leaf) {
+      const auto *const inner = reinterpret_cast<const inner_type *>(node);
+      const size_type count = std::min<size_type>(inner->header.count, k_inner_capacity);
+      const node_pointer child = inner->children[priv_lower_bound(inner->keys, count, key)];
+      // The child pointer is valid only if the parent has not been modified
+      priv_lock(&inner->header).check_or_restart(*version, restart);
+      if (restart) return nullptr;
+
+      const uint64_t parent_version = *version;
+      node = priv_header(child);
+      *version = priv_lock(node).read_lock_or_restart(restart);
+      if (restart) return nullptr;
+      // Makes sure that the child was not split before its version was read
+      priv_lock(&inner->header).check_or_restart(parent_version, restart);
+      if (restart) return nullptr;
+    }
+    return node;
+  }
+
+  bool priv_insert_retry(const key_type &key, const mapped_type &value, const bool assign) {
+    while (true) {
+      bool restart = false;
+      const bool inserted = priv_insert(key, value, assign, restart);
+      if (!restart) return inserted;
+    }
+  }
+
+  /// \brief Inserts or assigns an element. Splits full nodes on the way down and restarts after a split.
+  bool priv_insert(const key_type &key, const mapped_type &value, const bool assign, bool &restart) {
+    header_type *node = priv_header(m_root);
+    uint64_t version = priv_lock(node).read_lock_or_restart(restart);
+    if (restart) return false;
+
+    header_type *parent = nullptr;
+    uint64_t parent_version = 0;
+    while (!node->is_leaf) {
+      auto *const inner = reinterpret_cast<inner_type *>(node);
+      if (inner->header.count == k_inner_capacity) {
+        priv_lock_and_split(parent, parent_version, node, version, restart);
+        restart = true;
+        return false;
+      }
+
+      const node_pointer child = inner->children[priv_lower_bound(inner->keys, inner->header.count, key)];
+      priv_lock(node).check_or_restart(version, restart);
+      if (restart) return false;
+
+      parent = node;
+      parent_version = version;
+      node = priv_header(child);
+      version = priv_lock(node).read_lock_or_restart(restart);
+      if (restart) return false;
+      priv_lock(parent).check_or_restart(parent_version, restart);
+      if (restart) return false;
+    }
+
+    auto *const leaf = reinterpret_cast<leaf_type *>(node);
+    if (leaf->header.count == k_leaf_capacity) {
+      priv_lock_and_split(parent, parent_version, node, version, restart);
+      restart = true;
+      return false;
+    }
+
+    priv_lock(node).upgrade_to_write_lock_or_restart(version, restart);
+    if (restart) return false;
+
+    const size_type count = leaf->header.count;
+    const size_type pos = priv_lower_bound(leaf->keys, count, key);
+    if (pos < count && !m_compare(key, leaf->keys[pos])) {
+      if (assign) leaf->values[pos] = value;
+      priv_lock(node).write_unlock();
+      return false;
+    }
+
+    std::memmove(&leaf->keys[pos + 1], &leaf->keys[pos], (count - pos) * sizeof(key_type));
+    std::memmove(&leaf->values[pos + 1], &leaf->values[pos], (count - pos) * sizeof(mapped_type));
+    leaf->keys[pos] = key;
+    leaf->values[pos] = value;
+    ++leaf->header.count;
+    priv_lock(node).write_unlock();
+    m_size.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /// \brief Locks parent (if it is not nullptr) and node, and splits node.
+  /// Does nothing if either of them has been modified since its version was read.
+  void priv_lock_and_split(header_type *const parent, uint64_t parent_version,
+                           header_type *const node, uint64_t version, bool &restart) {
+    lock_type *const parent_lock = parent ? &priv_lock(parent) : nullptr;
+    lock_type &node_lock = priv_lock(node);
+    if (parent) {
+      parent_lock->upgrade_to_write_lock_or_restart(parent_version, restart);
+      if (restart) return;
+    }
+    node_lock.upgrade_to_write_lock_or_restart(version, restart);
+    if (restart) {
+      if (parent) parent_lock->write_unlock();
+      return;
+    }
+
+    if (!parent) {
+      priv_split_root();
+    } else if (node->is_leaf) {
+      priv_split_leaf(reinterpret_cast<inner_type *>(parent), reinterpret_cast<leaf_type *>(node));
+    } else {
+      priv_split_inner(reinterpret_cast<inner_type *>(parent), reinterpret_cast<inner_type *>(node));
+    }
+
+    node_lock.write_unlock();
+    if (parent) parent_lock->write_unlock();
+  }
+
+  /// \brief Moves the upper half of a full leaf to a new leaf. Parent must not be full.
+  void priv_split_leaf(inner_type *const parent, leaf_type *const leaf) {
+    const node_pointer right_node = priv_new_leaf();
+    leaf_type *const right = priv_leaf(right_node);
+    const size_type middle = leaf->header.count / 2;
+    const size_type num_moves = leaf->header.count - middle;
+    std::memcpy(right->keys, &leaf->keys[middle], num_moves * sizeof(key_type));
+    std::memcpy(right->values, &leaf->values[middle], num_moves * sizeof(mapped_type));
+    right->header.count = num_moves;
+    right->next = leaf->next;
+    leaf->next = right_node;
+    leaf->header.count = middle;
+    priv_insert_child(parent, leaf->keys[middle - 1], right_node);
+  }
+
+  /// \brief Moves the upper half of a full inner node to a new inner node. Parent must not be full.
+  void priv_split_inner(inner_type *const parent, inner_type *const inner) {
+    const node_pointer right_node = priv_new_inner();
+    const size_type middle = inner->header.count / 2;
+    priv_move_upper_half(inner, middle, priv_inner(right_node));
+    inner->header.count = middle;
+    priv_insert_child(parent, inner->keys[middle], right_node);
+  }
+
+  /// \brief Moves the elements of the full root to two new inner nodes so that the root does not move
+  void priv_split_root() {
+    inner_type *const root = priv_inner(m_root);
+    const node_pointer left_node = priv_new_inner();
+    const node_pointer right_node = priv_new_inner();
+    const size_type middle = root->header.count / 2;
+
+    inner_type *const left = priv_inner(left_node);
+    std::memcpy(left->keys, root->keys, middle * sizeof(key_type));
+    std::copy(&root->children[0], &root->children[middle + 1], &left->children[0]);
+    left->header.count = middle;
+    priv_move_upper_half(root, middle, priv_inner(right_node));
+
+    root->keys[0] = root->keys[middle];
+    root->children[0] = left_node;
+    root->children[1] = right_node;
+    root->header.count = 1;
+  }
+
+  /// \brief Copies the keys after keys[middle] and their children to the empty inner node right
+  static void priv_move_upper_half(const inner_type *const inner, const size_type middle, inner_type *const right) {
+    const size_type num_moves = inner->header.count - middle - 1;
+    std::memcpy(right->keys, &inner->keys[middle + 1], num_moves * sizeof(key_type));
+    // Pointers are copied one by one since offset pointers cannot be copied bytewise
+    std::copy(&inner->children[middle + 1], &inner->children[inner->header.count + 1], &right->children[0]);
+    right->header.count = num_moves;
+  }
+
+  /// \brief Inserts a separator key and the child on its right side into a locked inner node
+  void priv_insert_child(inner_type *const inner, const key_type &key, const node_pointer &child) {
+    const size_type count = inner->header.count;
+    assert(count < k_inner_capacity);
+    const size_type pos = priv_lower_bound(inner->keys, count, key);
+    std::memmove(&inner->keys[pos + 1], &inner->keys[pos], (count - pos) * sizeof(key_type));
+    std::copy_backward(&inner->children[pos + 1], &inner->children[count + 1], &inner->children[count + 2]);
+    inner->keys[pos] = key;
+    inner->children[pos + 1] = child;
+    ++inner->header.count;
+  }
+
+  // -------------------------------------------------------------------------------- //
+  // Private fields
+  // -------------------------------------------------------------------------------- //
+  allocator_type m_allocator;
+  key_compare m_compare;
+  std::atomic<uint64_t> m_num_nodes; // The number of node numbers assigned so far
+  node_pointer m_root;
+  std::atomic<size_type> m_size;
+};
+
+/// \brief A forward iterator over the elements in order of the keys.
+/// Dereferencing it returns a pair of references to the key and value.
+template <typename _key_type, typename _mapped_type, typename _compare, typename _allocator, std::size_t k_node_size>
+class btree_map<_key_type, _mapped_type, _compare, _allocator, k_node_size>::impl_const_iterator {
+ public:
+  using value_type = std::pair<const _key_type &, const _mapped_type &>;
+  using difference_type = std::ptrdiff_t;
+  using reference = value_type;
+  using iterator_category = std::forward_iterator_tag;
+
+  class pointer {
+   public:
+    explicit pointer(const value_type &value)
+        : m_value(value) {}
+
+    const value_type *operator->() const {
+      return &m_value;
+    }
+
+   private:
+    value_type m_value;
+  };
+
+  impl_const_iterator(const leaf_type *const leaf, const size_type pos)
+      : m_leaf(leaf),
+        m_pos(pos) {
+    priv_skip_empty_leaves();
+  }
+
+  bool operator==(const impl_const_iterator &other) const {
+    return m_leaf == other.m_leaf && m_pos == other.m_pos;
+  }
+
+  bool operator!=(const impl_const_iterator &other) const {
+    return !(*this == other);
+  }
+
+  reference operator*() const {
+    return value_type(m_leaf->keys[m_pos], m_leaf->values[m_pos]);
+  }
+
+  pointer operator->() const {
+    return pointer(**this);
+  }
+
+  impl_const_iterator &operator++() {
+    ++m_pos;
+    priv_skip_empty_leaves();
+    return *this;
+  }
+
+  impl_const_iterator operator++(int) {
+    impl_const_iterator tmp(*this);
+    ++(*this);
+    return tmp;
+  }
+
+ private:
+  void priv_skip_empty_leaves() {
+    while (m_leaf && m_pos >= m_leaf->header.count) {
+      m_leaf = m_leaf->next ? priv_leaf(m_leaf->next) : nullptr;
+      m_pos = 0;
+    }
+  }
+
+  const leaf_type *m_leaf;
+  size_type m_pos;
+};
+
+} // namespace metall::container
+
+#endif //METALL_COTAINER_BTREE_MAP_HPP
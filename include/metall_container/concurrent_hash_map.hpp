@@ -0,0 +1,598 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_COTAINER_CONCURRENT_HASH_MAP_HPP
+#define METALL_COTAINER_CONCURRENT_HASH_MAP_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <metall/detail/utility/builtin_functions.hpp>
+#include <metall/detail/utility/parallel_for.hpp>
+#include <metall_utility/hash.hpp>
+#include <metall_utility/mutex.hpp>
+
+namespace metall::container {
+
+namespace concurrent_hash_map_detail {
+
+/// \brief A group of control bytes probed at once.
+/// A control byte is k_empty, k_deleted, or the lower 7 bits of the hash value of the key stored in the slot.
+/// Uses SSE2 to compare 16 control bytes at a time if it is available.
+class control_group {
+ public:
+  static constexpr std::size_t k_width = 16;
+  static constexpr int8_t k_empty = -128;
+  static constexpr int8_t k_deleted = -2;
+
+  explicit control_group(const int8_t *const ctrl) {
+#ifdef __SSE2__
+    m_ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+#else
+    std::memcpy(m_ctrl, ctrl, k_width);
+#endif
+  }
+
+  /// \brief Returns a bitmask of the slots whose control byte is h2
+  uint32_t match(const int8_t h2) const {
+#ifdef __SSE2__
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), m_ctrl)));
+#else
+    uint32_t mask = 0;
+    for (std::size_t i = 0; i < k_width; ++i) {
+      mask |= static_cast<uint32_t>(m_ctrl[i] == h2) << i;
+    }
+    return mask;
+#endif
+  }
+
+  uint32_t match_empty() const {
+    return match(k_empty);
+  }
+
+  /// \brief Returns a bitmask of the empty or deleted slots, i.e., the slots whose control byte has the sign bit
+  uint32_t match_empty_or_deleted() const {
+#ifdef __SSE2__
+    return static_cast<uint32_t>(_mm_movemask_epi8(m_ctrl));
+#else
+    uint32_t mask = 0;
+    for (std::size_t i = 0; i < k_width; ++i) {
+      mask |= static_cast<uint32_t>(m_ctrl[i] < 0) << i;
+    }
+    return mask;
+#endif
+  }
+
+ private:
+#ifdef __SSE2__
+  __m128i m_ctrl;
+#else
+  int8_t m_ctrl[k_width];
+#endif
+};
+
+/// \brief Returns the index of the lowest set bit and clears it
+inline std::size_t pop_lowest_bit(uint32_t &mask) {
+  const auto index = static_cast<std::size_t>(metall::detail::utility::ctzll(mask));
+  mask &= mask - 1;
+  return index;
+}
+
+} // namespace concurrent_hash_map_detail
+
+/// \brief A concurrent open-addressing hash map that stores values inline (Swiss table style).
+/// Keys are distributed over k_num_shards shards by their hash values.
+/// Each shard is a power-of-two number of groups of 16 slots;
+/// its control bytes and slots are two contiguous arrays, i.e., no per-element allocation.
+/// All pointers are the pointer type of the allocator (e.g., offset_ptr) so that the map can be stored in Metall.
+/// Modifiers are thread-safe; they lock the shard of the key only.
+/// count() and find() take the shared lock of the shard; size() and capacity() take those of all shards in turn;
+/// iterators do not take locks, i.e., must not be used concurrently with modifiers.
+/// This is an experimental implementation.
+/// \tparam _key_type A key type.
+/// \tparam _mapped_type A mapped type.
+/// \tparam _hasher A hash function that returns 64-bit values. The lower 7 bits are stored in the control bytes.
+/// \tparam _key_equal A function object that compares keys.
+/// \tparam _allocator An allocator type.
+/// \tparam k_num_shards The number of shards.
+template <typename _key_type,
+          typename _mapped_type,
+          typename _hasher = metall::utility::hash<_key_type>,
+          typename _key_equal = std::equal_to<_key_type>,
+          typename _allocator = std::allocator<std::pair<const _key_type, _mapped_type>>,
+          int k_num_shards = 1024>
+class concurrent_hash_map {
+ private:
+  template <typename T>
+  using other_allocator_type = typename std::allocator_traits<_allocator>::template rebind_alloc<T>;
+
+  using control_group = concurrent_hash_map_detail::control_group;
+  using ctrl_allocator_type = other_allocator_type<int8_t>;
+  using ctrl_pointer = typename std::allocator_traits<ctrl_allocator_type>::pointer;
+  using lock_table_type = metall::utility::mutex::instance_lock_table<k_num_shards>;
+
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Public types and static values
+  // -------------------------------------------------------------------------------- //
+  using key_type = _key_type;
+  using mapped_type = _mapped_type;
+  using value_type = std::pair<const key_type, mapped_type>;
+  using size_type = std::size_t;
+  using hasher = _hasher;
+  using key_equal = _key_equal;
+  using allocator_type = _allocator;
+  using mutex_type = metall::utility::mutex::shared_spin_mutex;
+
+  class const_iterator;
+
+ private:
+  using slot_allocator_type = other_allocator_type<value_type>;
+  using slot_pointer = typename std::allocator_traits<slot_allocator_type>::pointer;
+
+  // The maximum load factor is k_max_load_numerator / k_max_load_denominator
+  static constexpr size_type k_max_load_numerator = 7;
+  static constexpr size_type k_max_load_denominator = 8;
+
+  struct shard_type {
+    ctrl_pointer ctrl{nullptr};
+    slot_pointer slots{nullptr};
+    size_type num_groups{0};
+    size_type size{0};
+    size_type growth_left{0}; // The number of empty slots that can be used before rehashing
+
+    size_type capacity() const {
+      return num_groups * control_group::k_width;
+    }
+  };
+
+ public:
+  /// \brief Forward iterator over the elements of all shards
+  class const_iterator {
+   public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = typename concurrent_hash_map::value_type;
+    using pointer = const value_type *;
+    using reference = const value_type &;
+    using iterator_category = std::forward_iterator_tag;
+
+    const_iterator() = default;
+
+    const_iterator(const concurrent_hash_map *const map, const size_type shard_no, const size_type slot_no)
+        : m_map(map),
+          m_shard_no(shard_no),
+          m_slot_no(slot_no) {}
+
+    const_iterator &operator++() {
+      ++m_slot_no;
+      skip_empty_slots();
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator tmp(*this);
+      operator++();
+      return tmp;
+    }
+
+    reference operator*() const {
+      return m_map->priv_slots(m_map->m_shards[m_shard_no])[m_slot_no];
+    }
+
+    pointer operator->() const {
+      return &(operator*());
+    }
+
+    bool operator==(const const_iterator &other) const {
+      return m_shard_no == other.m_shard_no && m_slot_no == other.m_slot_no;
+    }
+
+    bool operator!=(const const_iterator &other) const {
+      return !(*this == other);
+    }
+
+   private:
+    friend class concurrent_hash_map;
+
+    /// \brief Moves to the next full slot or the end
+    void skip_empty_slots() {
+      for (; m_shard_no < (size_type)k_num_shards; ++m_shard_no, m_slot_no = 0) {
+        const auto &shard = m_map->m_shards[m_shard_no];
+        const int8_t *const ctrl = m_map->priv_ctrl(shard);
+        for (; m_slot_no < shard.capacity(); ++m_slot_no) {
+          if (ctrl[m_slot_no] >= 0) return;
+        }
+      }
+      m_slot_no = 0;
+    }
+
+    const concurrent_hash_map *m_map{nullptr};
+    size_type m_shard_no{k_num_shards};
+    size_type m_slot_no{0};
+  };
+
+  // -------------------------------------------------------------------------------- //
+  // Constructor & assign operator
+  // -------------------------------------------------------------------------------- //
+  explicit concurrent_hash_map(const _allocator &allocator = _allocator())
+      : m_allocator(allocator),
+        m_shards() {}
+
+  concurrent_hash_map(const concurrent_hash_map &) = delete;
+  concurrent_hash_map &operator=(const concurrent_hash_map &) = delete;
+
+  ~concurrent_hash_map() {
+    clear();
+    lock_table_type::release(this);
+  }
+
+  // -------------------------------------------------------------------------------- //
+  // Public methods
+  // -------------------------------------------------------------------------------- //
+  size_type count(const key_type &key) const {
+    const auto hash = hasher()(key);
+    const auto shard_no = priv_shard_no(hash);
+    std::shared_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+    return (priv_find(m_shards[shard_no], key, hash) != k_not_found) ? 1 : 0;
+  }
+
+  /// \brief Returns the number of elements.
+  /// Takes the shared lock of each shard in turn, i.e., can be called concurrently with modifiers;
+  /// the result is not a snapshot of the whole map then.
+  size_type size() const {
+    size_type total = 0;
+    for (size_type shard_no = 0; shard_no < (size_type)k_num_shards; ++shard_no) {
+      std::shared_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+      total += m_shards[shard_no].size;
+    }
+    return total;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  /// \brief Returns the total number of slots. Takes the shared lock of each shard in turn as size() does.
+  size_type capacity() const {
+    size_type total = 0;
+    for (size_type shard_no = 0; shard_no < (size_type)k_num_shards; ++shard_no) {
+      std::shared_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+      total += m_shards[shard_no].capacity();
+    }
+    return total;
+  }
+
+  // ---------------------------------------- Modifier ---------------------------------------- //
+  bool insert(value_type &&value) {
+    const auto hash = hasher()(value.first);
+    const auto shard_no = priv_shard_no(hash);
+    std::unique_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+    return priv_emplace(m_shards[shard_no], hash, value.first, std::move(value.second)).second;
+  }
+
+  template <typename... args_type>
+  bool try_emplace(const key_type &key, args_type &&... args) {
+    const auto hash = hasher()(key);
+    const auto shard_no = priv_shard_no(hash);
+    std::unique_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+    return priv_emplace(m_shards[shard_no], hash, key, std::forward<args_type>(args)...).second;
+  }
+
+  /// \brief Returns a reference to the mapped value of key, inserting a default-constructed one if needed.
+  /// The reference is valid while the lock is held.
+  std::pair<mapped_type &, std::unique_lock<mutex_type>>
+  scoped_edit(const key_type &key) {
+    const auto hash = hasher()(key);
+    const auto shard_no = priv_shard_no(hash);
+    std::unique_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+    auto &shard = m_shards[shard_no];
+    const auto slot_no = priv_emplace(shard, hash, key).first;
+    return std::make_pair(std::ref(priv_slots(shard)[slot_no].second), std::move(lock));
+  }
+
+  void edit(const key_type &key, const std::function<void(mapped_type &value)> &editor) {
+    const auto hash = hasher()(key);
+    const auto shard_no = priv_shard_no(hash);
+    std::unique_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+    auto &shard = m_shards[shard_no];
+    const auto slot_no = priv_emplace(shard, hash, key).first;
+    editor(priv_slots(shard)[slot_no].second);
+  }
+
+  size_type erase(const key_type &key) {
+    const auto hash = hasher()(key);
+    const auto shard_no = priv_shard_no(hash);
+    std::unique_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+    auto &shard = m_shards[shard_no];
+    const auto slot_no = priv_find(shard, key, hash);
+    if (slot_no == k_not_found) return 0;
+
+    slot_allocator_type slot_allocator(m_allocator);
+    std::allocator_traits<slot_allocator_type>::destroy(slot_allocator, &priv_slots(shard)[slot_no]);
+    int8_t *const ctrl = priv_ctrl(shard);
+    const size_type group_begin = slot_no - slot_no % control_group::k_width;
+    // If the group still has an empty slot, it has never been full since the last rehash,
+    // i.e., no probe sequence went through it; the slot can be reused as an empty slot.
+    if (control_group(ctrl + group_begin).match_empty()) {
+      ctrl[slot_no] = control_group::k_empty;
+      ++shard.growth_left;
+    } else {
+      ctrl[slot_no] = control_group::k_deleted;
+    }
+    --shard.size;
+    return 1;
+  }
+
+  /// \brief Allocates enough slots to hold n elements in total without rehashing,
+  /// assuming that the elements are evenly distributed over the shards.
+  /// This function is not thread-safe.
+  void reserve(const size_type n) {
+    const size_type per_shard = (n + k_num_shards - 1) / k_num_shards;
+    for (auto &shard : m_shards) {
+      const auto num_groups = priv_num_groups_for(per_shard);
+      if (num_groups > shard.num_groups) {
+        priv_rehash(shard, num_groups);
+      }
+    }
+  }
+
+  /// \brief Destroys all elements and deallocates all slots.
+  /// This function is not thread-safe.
+  void clear() {
+    for (auto &shard : m_shards) {
+      priv_release_shard(shard);
+    }
+  }
+
+  // ---------------------------------------- Iterator ---------------------------------------- //
+  const_iterator cbegin() const {
+    const_iterator itr(this, 0, 0);
+    itr.skip_empty_slots();
+    return itr;
+  }
+
+  const_iterator cend() const {
+    return const_iterator(this, k_num_shards, 0);
+  }
+
+  const_iterator begin() const {
+    return cbegin();
+  }
+
+  const_iterator end() const {
+    return cend();
+  }
+
+  /// \brief Calls function(element) for all elements using num_threads threads.
+  /// Each thread takes a shard at a time and holds the shared lock of the shard while visiting its elements,
+  /// i.e., this function can be called concurrently with modifiers, but function must not modify this map.
+  template <typename function_type>
+  void for_each_parallel(const function_type &function,
+                         const size_type num_threads = metall::detail::utility::default_num_threads()) const {
+    metall::detail::utility::parallel_for((size_type)k_num_shards, num_threads, [this, &function](const size_type shard_no) {
+      std::shared_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+      const auto &shard = m_shards[shard_no];
+      const int8_t *const ctrl = priv_ctrl(shard);
+      const value_type *const slots = priv_slots(shard);
+      for (size_type slot_no = 0; slot_no < shard.capacity(); ++slot_no) {
+        if (ctrl[slot_no] >= 0) function(slots[slot_no]);
+      }
+    });
+  }
+
+  // ---------------------------------------- Look up ---------------------------------------- //
+  /// \brief Finds an element. The shard of the key is locked only during the search,
+  /// i.e., the returned iterator must not be used concurrently with modifiers.
+  const_iterator find(const key_type &key) const {
+    const auto hash = hasher()(key);
+    const auto shard_no = priv_shard_no(hash);
+    std::shared_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+    const auto slot_no = priv_find(m_shards[shard_no], key, hash);
+    if (slot_no == k_not_found) return cend();
+    return const_iterator(this, shard_no, slot_no);
+  }
+
+  // ---------------------------------------- Allocator ---------------------------------------- //
+  allocator_type get_allocator() const {
+    return m_allocator;
+  }
+
+ private:
+  static constexpr size_type k_not_found = ~static_cast<size_type>(0);
+
+  /// \brief Returns the lock of a shard. The locks are allocated in DRAM for each instance.
+  mutex_type &priv_shard_mutex(const size_type shard_no) const {
+    return lock_table_type::get(this, shard_no);
+  }
+
+  static size_type priv_shard_no(const uint64_t hash) {
+    return (hash >> 7ULL) % k_num_shards;
+  }
+
+  static int8_t priv_h2(const uint64_t hash) {
+    return static_cast<int8_t>(hash & 0x7FULL);
+  }
+
+  /// \brief Returns the first group to probe
+  static size_type priv_h1(const uint64_t hash) {
+    return (hash >> 7ULL) / k_num_shards;
+  }
+
+  /// \brief Returns the number of groups (a power of two) that can hold n elements
+  static size_type priv_num_groups_for(const size_type n) {
+    if (n == 0) return 0;
+    const size_type min_capacity = (n * k_max_load_denominator + k_max_load_numerator - 1) / k_max_load_numerator;
+    size_type num_groups = 1;
+    while (num_groups * control_group::k_width < min_capacity) num_groups *= 2;
+    return num_groups;
+  }
+
+  static size_type priv_max_load(const size_type capacity) {
+    return capacity * k_max_load_numerator / k_max_load_denominator;
+  }
+
+  static int8_t *priv_ctrl(const shard_type &shard) {
+    return shard.ctrl ? std::addressof(*shard.ctrl) : nullptr;
+  }
+
+  static value_type *priv_slots(const shard_type &shard) {
+    return shard.slots ? std::addressof(*shard.slots) : nullptr;
+  }
+
+  /// \brief Visits the groups of a shard in the triangular probe sequence,
+  /// which visits every group once as the number of groups is a power of two.
+  /// Stops when the visitor returns true.
+  template <typename visitor_type>
+  static void priv_probe(const shard_type &shard, const uint64_t hash, visitor_type visitor) {
+    const size_type mask = shard.num_groups - 1;
+    size_type group_no = priv_h1(hash) & mask;
+    for (size_type i = 1; i <= shard.num_groups; ++i) {
+      if (visitor(group_no * control_group::k_width)) return;
+      group_no = (group_no + i) & mask;
+    }
+  }
+
+  size_type priv_find(const shard_type &shard, const key_type &key, const uint64_t hash) const {
+    if (shard.num_groups == 0) return k_not_found;
+    const int8_t *const ctrl = priv_ctrl(shard);
+    const value_type *const slots = priv_slots(shard);
+    const int8_t h2 = priv_h2(hash);
+    size_type found = k_not_found;
+    priv_probe(shard, hash, [&](const size_type group_begin) {
+      const control_group group(ctrl + group_begin);
+      for (uint32_t mask = group.match(h2); mask;) {
+        const auto slot_no = group_begin + concurrent_hash_map_detail::pop_lowest_bit(mask);
+        if (key_equal()(slots[slot_no].first, key)) {
+          found = slot_no;
+          return true;
+        }
+      }
+      return group.match_empty() != 0;
+    });
+    return found;
+  }
+
+  /// \brief Returns the first empty or deleted slot in the probe sequence
+  static size_type priv_find_insert_slot(const shard_type &shard, const uint64_t hash) {
+    const int8_t *const ctrl = priv_ctrl(shard);
+    size_type slot_no = k_not_found;
+    priv_probe(shard, hash, [&](const size_type group_begin) {
+      uint32_t mask = control_group(ctrl + group_begin).match_empty_or_deleted();
+      if (!mask) return false;
+      slot_no = group_begin + concurrent_hash_map_detail::pop_lowest_bit(mask);
+      return true;
+    });
+    assert(slot_no != k_not_found);
+    return slot_no;
+  }
+
+  /// \brief Inserts an element if key does not exist. The lock of the shard must be held.
+  /// \return A pair of the slot number of the element and a bool denoting whether the insertion took place.
+  template <typename... args_type>
+  std::pair<size_type, bool> priv_emplace(shard_type &shard, const uint64_t hash, const key_type &key,
+                                          args_type &&... args) {
+    const auto found = priv_find(shard, key, hash);
+    if (found != k_not_found) return std::make_pair(found, false);
+
+    if (shard.growth_left == 0) {
+      // Grows the shard unless there are many deleted slots to reclaim
+      const bool grow = (shard.size + 1) * 2 > priv_max_load(shard.capacity());
+      priv_rehash(shard, (shard.num_groups == 0) ? 1 : (grow ? shard.num_groups * 2 : shard.num_groups));
+    }
+
+    const auto slot_no = priv_find_insert_slot(shard, hash);
+    int8_t *const ctrl = priv_ctrl(shard);
+    slot_allocator_type slot_allocator(m_allocator);
+    std::allocator_traits<slot_allocator_type>::construct(slot_allocator,
+                                                          &priv_slots(shard)[slot_no],
+                                                          std::piecewise_construct,
+                                                          std::forward_as_tuple(key),
+                                                          std::forward_as_tuple(std::forward<args_type>(args)...));
+    if (ctrl[slot_no] == control_group::k_empty) --shard.growth_left;
+    ctrl[slot_no] = priv_h2(hash);
+    ++shard.size;
+    return std::make_pair(slot_no, true);
+  }
+
+  /// \brief Moves all elements of a shard into new arrays that have num_groups groups, dropping deleted slots.
+  void priv_rehash(shard_type &shard, const size_type num_groups) {
+    assert(num_groups > 0);
+    ctrl_allocator_type ctrl_allocator(m_allocator);
+    slot_allocator_type slot_allocator(m_allocator);
+
+    shard_type new_shard;
+    new_shard.num_groups = num_groups;
+    new_shard.ctrl = std::allocator_traits<ctrl_allocator_type>::allocate(ctrl_allocator, new_shard.capacity());
+    new_shard.slots = std::allocator_traits<slot_allocator_type>::allocate(slot_allocator, new_shard.capacity());
+    std::memset(priv_ctrl(new_shard), control_group::k_empty, new_shard.capacity());
+
+    int8_t *const old_ctrl = priv_ctrl(shard);
+    value_type *const old_slots = priv_slots(shard);
+    int8_t *const new_ctrl = priv_ctrl(new_shard);
+    value_type *const new_slots = priv_slots(new_shard);
+    for (size_type i = 0; i < shard.capacity(); ++i) {
+      if (old_ctrl[i] < 0) continue;
+      const auto hash = hasher()(old_slots[i].first);
+      const auto slot_no = priv_find_insert_slot(new_shard, hash);
+      std::allocator_traits<slot_allocator_type>::construct(slot_allocator, &new_slots[slot_no], std::move(old_slots[i]));
+      std::allocator_traits<slot_allocator_type>::destroy(slot_allocator, &old_slots[i]);
+      new_ctrl[slot_no] = priv_h2(hash);
+    }
+    new_shard.size = shard.size;
+    new_shard.growth_left = priv_max_load(new_shard.capacity()) - new_shard.size;
+
+    priv_deallocate_arrays(shard);
+    shard.ctrl = new_shard.ctrl;
+    shard.slots = new_shard.slots;
+    shard.num_groups = new_shard.num_groups;
+    shard.size = new_shard.size;
+    shard.growth_left = new_shard.growth_left;
+  }
+
+  void priv_release_shard(shard_type &shard) {
+    slot_allocator_type slot_allocator(m_allocator);
+    const int8_t *const ctrl = priv_ctrl(shard);
+    value_type *const slots = priv_slots(shard);
+    for (size_type i = 0; i < shard.capacity(); ++i) {
+      if (ctrl[i] >= 0) {
+        std::allocator_traits<slot_allocator_type>::destroy(slot_allocator, &slots[i]);
+      }
+    }
+    priv_deallocate_arrays(shard);
+    shard.ctrl = nullptr;
+    shard.slots = nullptr;
+    shard.num_groups = 0;
+    shard.size = 0;
+    shard.growth_left = 0;
+  }
+
+  void priv_deallocate_arrays(shard_type &shard) {
+    if (shard.num_groups == 0) return;
+    ctrl_allocator_type ctrl_allocator(m_allocator);
+    slot_allocator_type slot_allocator(m_allocator);
+    std::allocator_traits<ctrl_allocator_type>::deallocate(ctrl_allocator, shard.ctrl, shard.capacity());
+    std::allocator_traits<slot_allocator_type>::deallocate(slot_allocator, shard.slots, shard.capacity());
+  }
+
+  allocator_type m_allocator;
+  shard_type m_shards[k_num_shards];
+};
+
+} // namespace metall::container
+
+#endif //METALL_COTAINER_CONCURRENT_HASH_MAP_HPP
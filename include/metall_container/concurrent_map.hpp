@@ -7,10 +7,19 @@
 #define METALL_COTAINER_CONCURRENT_MAP_HPP
 
 #include <functional>
+#include <iterator>
 #include <memory>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
 #include <boost/container/vector.hpp>
 #include <boost/container/map.hpp>
 #include <boost/container/scoped_allocator.hpp>
+#include <metall/detail/utility/parallel_for.hpp>
 #include <metall_utility/mutex.hpp>
 #include <metall_utility/container_of_containers_iterator_adaptor.hpp>
 
@@ -28,6 +37,7 @@ class concurrent_map {
   using other_allocator_type = typename std::allocator_traits<_allocator>::template rebind_alloc<T>;
 
   using internal_map_type = boost::container::map<_key_type, _mapped_type, _compare, _allocator>;
+  using lock_table_type = metall::utility::mutex::instance_lock_table<k_num_banks>;
   using banked_map_allocator_type = other_allocator_type<internal_map_type>;
   using banked_map_type = std::vector<internal_map_type,
                                       boost::container::scoped_allocator_adaptor<banked_map_allocator_type>>;
@@ -41,6 +51,10 @@ class concurrent_map {
   using value_type = typename internal_map_type::value_type;
   using size_type = typename internal_map_type::size_type;
   using allocator_type = _allocator;
+  using mutex_type = metall::utility::mutex::shared_spin_mutex;
+  /// \brief The type of the lock returned by scoped_edit().
+  /// It was std::unique_lock<std::mutex> when the locks were shared by all instances.
+  using scoped_edit_lock_type = std::unique_lock<mutex_type>;
 
   using const_iterator = metall::utility::container_of_containers_iterator_adaptor<typename banked_map_type::const_iterator,
                                                                                   typename internal_map_type::const_iterator>;
@@ -52,50 +66,152 @@ class concurrent_map {
       : m_banked_map(k_num_banks, allocator),
         m_num_items(0) {}
 
+  /// \brief Copy constructor. Holds the locks of all banks of other while copying them.
+  concurrent_map(const concurrent_map &other)
+      : m_banked_map(other.priv_locked_copy()),
+        m_num_items(0) {
+    m_num_items.store(priv_count_items(), std::memory_order_relaxed);
+  }
+
+  /// \brief Copy assignment operator. Holds the locks of all banks of both instances while copying.
+  concurrent_map &operator=(const concurrent_map &other) {
+    if (this == &other) return *this;
+    // Lock the instances in the order of their addresses so that assignments in both directions do not deadlock
+    std::vector<std::unique_lock<mutex_type>> locks;
+    std::vector<std::shared_lock<mutex_type>> other_locks;
+    if (this < &other) {
+      locks = priv_lock_all_banks();
+      other_locks = other.priv_lock_all_banks_shared();
+    } else {
+      other_locks = other.priv_lock_all_banks_shared();
+      locks = priv_lock_all_banks();
+    }
+    m_banked_map = other.m_banked_map;
+    m_num_items.store(priv_count_items(), std::memory_order_relaxed);
+    return *this;
+  }
+
+  ~concurrent_map() {
+    lock_table_type::release(this);
+  }
+
   // -------------------------------------------------------------------------------- //
   // Public methods
   // -------------------------------------------------------------------------------- //
   size_type count(const key_type &key) const {
     const auto bank_no = calc_bank_no(key);
+    std::shared_lock<mutex_type> lock(bank_mutex(bank_no));
     return m_banked_map[bank_no].count(key);
   }
 
   size_type size() const {
-    return m_num_items;
+    return m_num_items.load(std::memory_order_relaxed);
   }
 
   // ---------------------------------------- Modifier ---------------------------------------- //
   bool insert(value_type &&value) {
     const auto bank_no = calc_bank_no(value.first);
-    auto lock = metall::utility::mutex::mutex_lock<k_num_banks>(bank_no);
+    std::unique_lock<mutex_type> lock(bank_mutex(bank_no));
     const bool ret = m_banked_map[bank_no].insert(std::forward<value_type>(value)).second;
-    m_num_items += (ret) ? 1 : 0;
+    if (ret) m_num_items.fetch_add(1, std::memory_order_relaxed);
     return ret;
   }
 
-  std::pair<mapped_type &, std::unique_lock<std::mutex>>
+  /// \brief Returns a reference to the value of a key, inserting the key if it does not exist,
+  /// with the lock of the key's bank held.
+  /// The lock type is scoped_edit_lock_type, not std::unique_lock<std::mutex>;
+  /// use auto or scoped_edit_lock_type to name it.
+  std::pair<mapped_type &, scoped_edit_lock_type>
   scoped_edit(const key_type &key) {
     const auto bank_no = calc_bank_no(key);
-    auto lock = metall::utility::mutex::mutex_lock<k_num_banks>(bank_no);
-    if (!count(key)) {
-      [[maybe_unused]] const bool ret = register_key_no_lock(key);
-      assert(ret);
-      ++m_num_items;
+    scoped_edit_lock_type lock(bank_mutex(bank_no));
+    if (register_key_no_lock(key)) {
+      m_num_items.fetch_add(1, std::memory_order_relaxed);
     }
     return std::make_pair(std::ref(m_banked_map[bank_no].at(key)), std::move(lock));
   }
 
   void edit(const key_type &key, const std::function<void(mapped_type &value)> &editor) {
     const auto bank_no = calc_bank_no(key);
-    auto lock = metall::utility::mutex::mutex_lock<k_num_banks>(bank_no);
-    if (!count(key)) {
-      [[maybe_unused]] const bool ret = register_key_no_lock(key);
-      assert(ret);
-      ++m_num_items;
+    std::unique_lock<mutex_type> lock(bank_mutex(bank_no));
+    if (register_key_no_lock(key)) {
+      m_num_items.fetch_add(1, std::memory_order_relaxed);
     }
     editor(m_banked_map[bank_no].at(key));
   }
 
+  /// \brief Inserts many elements at once.
+  /// First, counting-sorts the elements by bank into a buffer in DRAM.
+  /// Then, each thread takes whole banks, sorts each bank's elements by key,
+  /// and inserts them in order with a hint, taking the bank's lock only once.
+  /// If a key is given more than once or already exists, the first or existing element is kept, as in insert().
+  /// \tparam random_access_iterator A random access iterator whose value type is convertible to value_type.
+  /// \param first The first element.
+  /// \param last The end of the elements.
+  /// \param num_threads The number of threads to use. 0 is treated as 1.
+  /// \return The number of inserted elements.
+  template <typename random_access_iterator>
+  size_type bulk_insert(random_access_iterator first, random_access_iterator last,
+                        std::size_t num_threads = metall::detail::utility::default_num_threads()) {
+    static_assert(std::is_base_of_v<std::random_access_iterator_tag,
+                                    typename std::iterator_traits<random_access_iterator>::iterator_category>,
+                  "bulk_insert() requires a random access iterator");
+    using pair_type = std::pair<key_type, mapped_type>;
+    const auto length = static_cast<std::size_t>(std::distance(first, last));
+    num_threads = std::max(num_threads, (std::size_t)1);
+
+    // -- Count the elements of each (bank, thread); the counters of a bank are contiguous -- //
+    std::vector<std::size_t> offsets(k_num_banks * num_threads + 1, 0);
+    metall::detail::utility::parallel_for_ranges(length, num_threads, [&](const std::size_t thread_no,
+                                                                         const std::size_t begin,
+                                                                         const std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+        ++offsets[calc_bank_no(first[i].first) * num_threads + thread_no + 1];
+      }
+    });
+    for (std::size_t i = 1; i < offsets.size(); ++i) offsets[i] += offsets[i - 1];
+
+    // -- Scatter the elements so that the elements of each bank are contiguous -- //
+    std::vector<pair_type> buffer(length);
+    metall::detail::utility::parallel_for_ranges(length, num_threads, [&](const std::size_t thread_no,
+                                                                         const std::size_t begin,
+                                                                         const std::size_t end) {
+      std::vector<std::size_t> cursor(k_num_banks);
+      for (std::size_t b = 0; b < k_num_banks; ++b) cursor[b] = offsets[b * num_threads + thread_no];
+      for (std::size_t i = begin; i < end; ++i) {
+        buffer[cursor[calc_bank_no(first[i].first)]++] = pair_type(first[i]);
+      }
+    });
+
+    // -- Insert the elements of each bank by a single thread -- //
+    std::atomic<size_type> num_inserted(0);
+    metall::detail::utility::parallel_run(num_threads, [&](const std::size_t thread_no) {
+      size_type local_num_inserted = 0;
+      for (std::size_t b = thread_no; b < k_num_banks; b += num_threads) {
+        const auto bank_first = buffer.begin() + offsets[b * num_threads];
+        const auto bank_last = buffer.begin() + offsets[(b + 1) * num_threads];
+        if (bank_first == bank_last) continue;
+        std::stable_sort(bank_first, bank_last, [](const pair_type &lhs, const pair_type &rhs) {
+          return _compare()(lhs.first, rhs.first);
+        });
+
+        std::unique_lock<mutex_type> lock(bank_mutex(b));
+        auto &map = m_banked_map[b];
+        auto hint = map.lower_bound(bank_first->first);
+        for (auto itr = bank_first; itr != bank_last; ++itr) {
+          if (itr != bank_first && !_compare()(std::prev(itr)->first, itr->first)) continue; // Duplicate key
+          const auto old_size = map.size();
+          hint = std::next(map.emplace_hint(hint, std::move(itr->first), std::move(itr->second)));
+          local_num_inserted += map.size() - old_size;
+        }
+      }
+      num_inserted.fetch_add(local_num_inserted, std::memory_order_relaxed);
+    });
+
+    m_num_items.fetch_add(num_inserted.load(), std::memory_order_relaxed);
+    return num_inserted.load();
+  }
+
   // ---------------------------------------- Iterator ---------------------------------------- //
   const_iterator cbegin() const {
     return const_iterator(m_banked_map.cbegin(), m_banked_map.cend());
@@ -105,9 +221,34 @@ class concurrent_map {
     return const_iterator(m_banked_map.cend(), m_banked_map.cend());
   }
 
+  /// \brief Returns the begin and end iterators of the partition_no-th of num_partitions disjoint ranges
+  /// that cover all elements. Each range consists of whole banks, i.e., the ranges can be iterated by different threads.
+  /// Like cbegin(), the iterators do not take locks.
+  std::pair<const_iterator, const_iterator> partition_range(const size_type partition_no,
+                                                            const size_type num_partitions) const {
+    return const_iterator::partition(m_banked_map.cbegin(), m_banked_map.cend(), partition_no, num_partitions);
+  }
+
+  /// \brief Calls function(element) for all elements using num_threads threads (0 is treated as 1).
+  /// Each thread takes a bank at a time and holds the shared lock of the bank while visiting its elements,
+  /// i.e., this function can be called concurrently with modifiers, but function must not modify this map.
+  template <typename function_type>
+  void for_each_parallel(const function_type &function,
+                         const std::size_t num_threads = metall::detail::utility::default_num_threads()) const {
+    metall::detail::utility::parallel_for(k_num_banks, num_threads, [this, &function](const std::size_t bank_no) {
+      std::shared_lock<mutex_type> lock(bank_mutex(bank_no));
+      for (const auto &element : m_banked_map[bank_no]) {
+        function(element);
+      }
+    });
+  }
+
   // ---------------------------------------- Look up ---------------------------------------- //
+  /// \brief Finds an element. The bank of the key is locked only during the search,
+  /// i.e., the returned iterator must not be used concurrently with modifiers.
   const_iterator find(const key_type &key) const {
     const auto bank_no = calc_bank_no(key);
+    std::shared_lock<mutex_type> lock(bank_mutex(bank_no));
     auto itr = m_banked_map[bank_no].find(key);
     if (itr != m_banked_map[bank_no].end()) {
       return const_iterator(m_banked_map.cbegin(), itr, m_banked_map.cend());
@@ -125,13 +266,49 @@ class concurrent_map {
     return _bank_no_hasher()(key) % k_num_banks;
   }
 
+  /// \brief Returns the lock of a bank.
+  /// The locks are allocated in DRAM for each instance and are not stored in the map itself.
+  mutex_type &bank_mutex(const uint64_t bank_no) const {
+    return lock_table_type::get(this, bank_no);
+  }
+
+  std::vector<std::unique_lock<mutex_type>> priv_lock_all_banks() const {
+    std::vector<std::unique_lock<mutex_type>> locks;
+    locks.reserve(k_num_banks);
+    for (std::size_t bank_no = 0; bank_no < k_num_banks; ++bank_no) {
+      locks.emplace_back(bank_mutex(bank_no));
+    }
+    return locks;
+  }
+
+  std::vector<std::shared_lock<mutex_type>> priv_lock_all_banks_shared() const {
+    std::vector<std::shared_lock<mutex_type>> locks;
+    locks.reserve(k_num_banks);
+    for (std::size_t bank_no = 0; bank_no < k_num_banks; ++bank_no) {
+      locks.emplace_back(bank_mutex(bank_no));
+    }
+    return locks;
+  }
+
+  banked_map_type priv_locked_copy() const {
+    const auto locks = priv_lock_all_banks_shared();
+    return m_banked_map;
+  }
+
+  /// \brief Counts the elements of all banks; the banks must not be modified during the call
+  size_type priv_count_items() const {
+    size_type num_items = 0;
+    for (const auto &map : m_banked_map) num_items += map.size();
+    return num_items;
+  }
+
   bool register_key_no_lock(const key_type &key) {
     const auto bank_no = calc_bank_no(key);
     return m_banked_map[bank_no].try_emplace(key).second;
   }
 
   banked_map_type m_banked_map;
-  size_type m_num_items;
+  std::atomic<size_type> m_num_items;
 };
 
 } // namespace metall::container
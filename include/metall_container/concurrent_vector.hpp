@@ -0,0 +1,446 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_COTAINER_CONCURRENT_VECTOR_HPP
+#define METALL_COTAINER_CONCURRENT_VECTOR_HPP
+
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include <metall/detail/utility/builtin_functions.hpp>
+
+namespace metall::container {
+
+/// \brief A vector that many threads can append to at the same time.
+/// Elements are stored in segments whose sizes double, i.e.,
+/// growing the vector never copies elements and the addresses of elements never change.
+/// The segment table is a part of the vector object so that it is stored in Metall with the vector.
+/// Appending threads reserve indices with an atomic counter;
+/// a thread waits only when another thread is allocating the segment that it appends to.
+/// Each segment has a bitmap of its constructed elements. After constructing elements,
+/// an appending thread advances size() over the constructed prefix as far as it can,
+/// i.e., appending threads do not wait for each other and
+/// elements [0, size()) can be read while other threads append.
+/// The constructor of value_type must not throw.
+/// This is an experimental implementation.
+/// \tparam _value_type A value type.
+/// \tparam _allocator An allocator type.
+/// \tparam k_first_segment_bits The size of the first segment is 2^k_first_segment_bits.
+template <typename _value_type,
+          typename _allocator = std::allocator<_value_type>,
+          int k_first_segment_bits = 5>
+class concurrent_vector {
+ private:
+  using allocator_traits = std::allocator_traits<typename std::allocator_traits<_allocator>::template rebind_alloc<_value_type>>;
+  using flag_word_type = std::atomic<uint64_t>;
+  using flag_allocator_traits =
+  std::allocator_traits<typename std::allocator_traits<_allocator>::template rebind_alloc<flag_word_type>>;
+  static constexpr std::size_t k_flag_word_bits = 64;
+
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Public types and static values
+  // -------------------------------------------------------------------------------- //
+  using value_type = _value_type;
+  using allocator_type = typename allocator_traits::allocator_type;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = value_type &;
+  using const_reference = const value_type &;
+
+  static constexpr size_type k_first_segment_size = 1ULL << k_first_segment_bits;
+  static constexpr size_type k_max_num_segments = 64 - k_first_segment_bits;
+
+ private:
+  template <bool is_const>
+  class iterator_impl {
+   public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = typename concurrent_vector::value_type;
+    using pointer = std::conditional_t<is_const, const value_type *, value_type *>;
+    using reference = std::conditional_t<is_const, const value_type &, value_type &>;
+    using iterator_category = std::random_access_iterator_tag;
+    using vector_pointer = std::conditional_t<is_const, const concurrent_vector *, concurrent_vector *>;
+
+    iterator_impl() = default;
+
+    iterator_impl(const vector_pointer vector, const size_type index)
+        : m_vector(vector),
+          m_index(index) {}
+
+    reference operator*() const {
+      return (*m_vector)[m_index];
+    }
+
+    pointer operator->() const {
+      return &(operator*());
+    }
+
+    reference operator[](const difference_type n) const {
+      return (*m_vector)[m_index + n];
+    }
+
+    iterator_impl &operator++() {
+      ++m_index;
+      return *this;
+    }
+
+    iterator_impl operator++(int) {
+      iterator_impl tmp(*this);
+      ++m_index;
+      return tmp;
+    }
+
+    iterator_impl &operator--() {
+      --m_index;
+      return *this;
+    }
+
+    iterator_impl operator--(int) {
+      iterator_impl tmp(*this);
+      --m_index;
+      return tmp;
+    }
+
+    iterator_impl &operator+=(const difference_type n) {
+      m_index += n;
+      return *this;
+    }
+
+    iterator_impl &operator-=(const difference_type n) {
+      m_index -= n;
+      return *this;
+    }
+
+    iterator_impl operator+(const difference_type n) const {
+      return iterator_impl(m_vector, m_index + n);
+    }
+
+    iterator_impl operator-(const difference_type n) const {
+      return iterator_impl(m_vector, m_index - n);
+    }
+
+    difference_type operator-(const iterator_impl &other) const {
+      return (difference_type)m_index - (difference_type)other.m_index;
+    }
+
+    bool operator==(const iterator_impl &other) const {
+      return m_index == other.m_index;
+    }
+
+    bool operator!=(const iterator_impl &other) const {
+      return m_index != other.m_index;
+    }
+
+    bool operator<(const iterator_impl &other) const {
+      return m_index < other.m_index;
+    }
+
+    bool operator>(const iterator_impl &other) const {
+      return m_index > other.m_index;
+    }
+
+    bool operator<=(const iterator_impl &other) const {
+      return m_index <= other.m_index;
+    }
+
+    bool operator>=(const iterator_impl &other) const {
+      return m_index >= other.m_index;
+    }
+
+   private:
+    vector_pointer m_vector{nullptr};
+    size_type m_index{0};
+  };
+
+ public:
+  using iterator = iterator_impl<false>;
+  using const_iterator = iterator_impl<true>;
+
+  // -------------------------------------------------------------------------------- //
+  // Constructor & assign operator
+  // -------------------------------------------------------------------------------- //
+  explicit concurrent_vector(const _allocator &allocator = _allocator())
+      : m_allocator(allocator),
+        m_num_reserved(0),
+        m_size(0) {
+    for (auto &segment : m_segments) {
+      segment.store(0, std::memory_order_relaxed);
+    }
+    for (auto &flags : m_flags) {
+      flags.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  concurrent_vector(const concurrent_vector &) = delete;
+  concurrent_vector &operator=(const concurrent_vector &) = delete;
+
+  ~concurrent_vector() {
+    clear();
+  }
+
+  // -------------------------------------------------------------------------------- //
+  // Public methods
+  // -------------------------------------------------------------------------------- //
+  /// \brief Returns the number of the published elements, i.e.,
+  /// neither the elements that other threads are still constructing nor the ones after them are included
+  size_type size() const {
+    return m_size.load(std::memory_order_acquire);
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  /// \brief Returns the number of elements that can be stored without allocating a new segment
+  size_type capacity() const {
+    size_type num_segments = 0;
+    while (num_segments < k_max_num_segments && priv_segment(num_segments)) ++num_segments;
+    return priv_segment_first_index(num_segments);
+  }
+
+  // ---------------------------------------- Modifier ---------------------------------------- //
+  /// \brief Appends an element. This function is thread-safe.
+  /// \return The index of the element.
+  size_type push_back(const value_type &value) {
+    return emplace_back(value);
+  }
+
+  size_type push_back(value_type &&value) {
+    return emplace_back(std::move(value));
+  }
+
+  /// \brief Constructs an element at the end. This function is thread-safe.
+  /// \return The index of the element.
+  template <typename... args_type>
+  size_type emplace_back(args_type &&... args) {
+    const size_type index = m_num_reserved.fetch_add(1, std::memory_order_relaxed);
+    priv_prepare_segments(index, index + 1);
+    allocator_type allocator(m_allocator);
+    allocator_traits::construct(allocator, &(*this)[index], std::forward<args_type>(args)...);
+    priv_publish(index, index + 1);
+    return index;
+  }
+
+  /// \brief Appends n copies of value at once. This function is thread-safe.
+  /// \return The index of the first appended element.
+  size_type grow_by(const size_type n, const value_type &value = value_type()) {
+    const size_type begin = m_num_reserved.fetch_add(n, std::memory_order_relaxed);
+    if (n == 0) return begin;
+    priv_prepare_segments(begin, begin + n);
+    allocator_type allocator(m_allocator);
+    for (size_type i = begin; i < begin + n; ++i) {
+      allocator_traits::construct(allocator, &(*this)[i], value);
+    }
+    priv_publish(begin, begin + n);
+    return begin;
+  }
+
+  /// \brief Allocates segments to hold n elements. This function is not thread-safe.
+  void reserve(const size_type n) {
+    if (n == 0) return;
+    const auto last_segment_no = priv_segment_no(n - 1);
+    for (size_type s = 0; s <= last_segment_no; ++s) {
+      if (!priv_segment(s)) priv_allocate_segment(s);
+    }
+  }
+
+  /// \brief Destroys all elements and deallocates all segments. This function is not thread-safe.
+  void clear() {
+    allocator_type allocator(m_allocator);
+    const size_type num_elements = size();
+    for (size_type i = 0; i < num_elements; ++i) {
+      allocator_traits::destroy(allocator, &(*this)[i]);
+    }
+    for (size_type s = 0; s < k_max_num_segments; ++s) {
+      value_type *const segment = priv_segment(s);
+      if (!segment) continue;
+      allocator_traits::deallocate(allocator,
+                                   std::pointer_traits<typename allocator_traits::pointer>::pointer_to(*segment),
+                                   priv_segment_size(s));
+      m_segments[s].store(0, std::memory_order_relaxed);
+
+      typename flag_allocator_traits::allocator_type flag_allocator(m_allocator);
+      flag_allocator_traits::deallocate(flag_allocator,
+                                        std::pointer_traits<typename flag_allocator_traits::pointer>::pointer_to(
+                                            *priv_flags(s)),
+                                        priv_num_flag_words(s));
+      m_flags[s].store(0, std::memory_order_relaxed);
+    }
+    m_num_reserved.store(0, std::memory_order_relaxed);
+    m_size.store(0, std::memory_order_release);
+  }
+
+  // ---------------------------------------- Element access ---------------------------------------- //
+  reference operator[](const size_type index) {
+    const auto segment_no = priv_segment_no(index);
+    return priv_segment(segment_no)[index - priv_segment_first_index(segment_no)];
+  }
+
+  const_reference operator[](const size_type index) const {
+    const auto segment_no = priv_segment_no(index);
+    return priv_segment(segment_no)[index - priv_segment_first_index(segment_no)];
+  }
+
+  // ---------------------------------------- Iterator ---------------------------------------- //
+  iterator begin() {
+    return iterator(this, 0);
+  }
+
+  iterator end() {
+    return iterator(this, size());
+  }
+
+  const_iterator begin() const {
+    return const_iterator(this, 0);
+  }
+
+  const_iterator end() const {
+    return const_iterator(this, size());
+  }
+
+  const_iterator cbegin() const {
+    return begin();
+  }
+
+  const_iterator cend() const {
+    return end();
+  }
+
+  // ---------------------------------------- Allocator ---------------------------------------- //
+  allocator_type get_allocator() const {
+    return m_allocator;
+  }
+
+ private:
+  static size_type priv_segment_no(const size_type index) {
+    return 63 - metall::detail::utility::clzll((index >> k_first_segment_bits) + 1);
+  }
+
+  static size_type priv_segment_first_index(const size_type segment_no) {
+    return k_first_segment_size * ((1ULL << segment_no) - 1);
+  }
+
+  static size_type priv_segment_size(const size_type segment_no) {
+    return k_first_segment_size << segment_no;
+  }
+
+  static size_type priv_num_flag_words(const size_type segment_no) {
+    return (priv_segment_size(segment_no) + k_flag_word_bits - 1) / k_flag_word_bits;
+  }
+
+  /// \brief Converts an entry of the segment or flag table to the address it points to, or nullptr if it is 0.
+  /// Each entry holds the offset from itself to the array,
+  /// which is an atomic variable and is valid wherever the vector is mapped.
+  template <typename T>
+  static T *priv_to_pointer(const std::atomic<difference_type> &entry) {
+    const auto offset = entry.load(std::memory_order_acquire);
+    if (offset == 0) return nullptr;
+    return reinterpret_cast<T *>(const_cast<char *>(reinterpret_cast<const char *>(&entry)) + offset);
+  }
+
+  template <typename pointer_type>
+  static difference_type priv_to_offset(const std::atomic<difference_type> &entry, pointer_type pointer) {
+    const auto offset = reinterpret_cast<const char *>(std::addressof(*pointer))
+        - reinterpret_cast<const char *>(&entry);
+    assert(offset != 0);
+    return offset;
+  }
+
+  /// \brief Returns the address of a segment or nullptr if it is not allocated
+  value_type *priv_segment(const size_type segment_no) const {
+    return priv_to_pointer<value_type>(m_segments[segment_no]);
+  }
+
+  /// \brief Returns the bitmap of the constructed elements of a segment or nullptr if it is not allocated
+  flag_word_type *priv_flags(const size_type segment_no) const {
+    return priv_to_pointer<flag_word_type>(m_flags[segment_no]);
+  }
+
+  /// \brief Allocates a segment. Its bitmap is allocated and cleared first,
+  /// i.e., the bitmap of an allocated segment is always available.
+  void priv_allocate_segment(const size_type segment_no) {
+    typename flag_allocator_traits::allocator_type flag_allocator(m_allocator);
+    auto flags = flag_allocator_traits::allocate(flag_allocator, priv_num_flag_words(segment_no));
+    for (size_type w = 0; w < priv_num_flag_words(segment_no); ++w) {
+      flag_allocator_traits::construct(flag_allocator, std::addressof(flags[w]), 0);
+    }
+    m_flags[segment_no].store(priv_to_offset(m_flags[segment_no], flags), std::memory_order_release);
+
+    allocator_type allocator(m_allocator);
+    auto pointer = allocator_traits::allocate(allocator, priv_segment_size(segment_no));
+    m_segments[segment_no].store(priv_to_offset(m_segments[segment_no], pointer), std::memory_order_release);
+  }
+
+  /// \brief Makes sure that the segments that hold [begin, end) are allocated.
+  /// The thread that reserved the first element of a segment allocates it; other threads wait for it.
+  void priv_prepare_segments(const size_type begin, const size_type end) {
+    for (size_type s = priv_segment_no(begin); s <= priv_segment_no(end - 1); ++s) {
+      const auto first_index = priv_segment_first_index(s);
+      if (begin <= first_index && first_index < end) {
+        if (!priv_segment(s)) priv_allocate_segment(s);
+      } else {
+        while (!priv_segment(s)) {
+          std::this_thread::yield();
+        }
+      }
+    }
+  }
+
+  /// \brief Marks [begin, end) as constructed and advances the number of the published elements.
+  /// The bitmaps and m_size are accessed with the sequentially consistent order so that
+  /// the thread that constructs the last element of a gap always sees the elements constructed after the gap,
+  /// i.e., m_size covers all constructed elements when no thread is appending.
+  void priv_publish(const size_type begin, const size_type end) {
+    for (size_type index = begin; index < end;) {
+      const auto segment_no = priv_segment_no(index);
+      const auto local_index = index - priv_segment_first_index(segment_no);
+      const auto bit = local_index % k_flag_word_bits;
+      const auto len = std::min({end - index, k_flag_word_bits - bit, priv_segment_size(segment_no) - local_index});
+      const uint64_t mask = (len == k_flag_word_bits) ? ~0ULL : ((1ULL << len) - 1) << bit;
+      priv_flags(segment_no)[local_index / k_flag_word_bits].fetch_or(mask);
+      index += len;
+    }
+
+    size_type published = m_size.load();
+    while (true) {
+      const auto new_size = priv_find_unconstructed(published);
+      if (new_size == published) return; // Another thread has advanced m_size over the elements
+      if (m_size.compare_exchange_weak(published, new_size)) return;
+    }
+  }
+
+  /// \brief Returns the index of the first element that is not constructed at or after index
+  size_type priv_find_unconstructed(size_type index) const {
+    while (true) {
+      const auto segment_no = priv_segment_no(index);
+      const flag_word_type *const flags = priv_flags(segment_no);
+      if (!flags) return index;
+      const auto local_index = index - priv_segment_first_index(segment_no);
+      const auto bit = local_index % k_flag_word_bits;
+      const auto len = std::min(k_flag_word_bits - bit, priv_segment_size(segment_no) - local_index);
+      const uint64_t unset = ~flags[local_index / k_flag_word_bits].load() >> bit;
+      const size_type num_set = (unset == 0) ? k_flag_word_bits - bit : metall::detail::utility::ctzll(unset);
+      if (num_set < len) return index + num_set;
+      index += len;
+    }
+  }
+
+  allocator_type m_allocator;
+  std::atomic<size_type> m_num_reserved; // The number of reserved indices
+  std::atomic<size_type> m_size; // The number of published elements
+  std::atomic<difference_type> m_segments[k_max_num_segments];
+  std::atomic<difference_type> m_flags[k_max_num_segments]; // The bitmaps of the constructed elements
+};
+
+} // namespace metall::container
+
+#endif //METALL_COTAINER_CONCURRENT_VECTOR_HPP
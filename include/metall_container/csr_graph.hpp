@@ -0,0 +1,332 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_COTAINER_CSR_GRAPH_HPP
+#define METALL_COTAINER_CSR_GRAPH_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <metall/detail/utility/parallel_for.hpp>
+
+namespace metall::container {
+
+/// \brief A read-only view of a CSR graph.
+/// Holds raw pointers to the arrays of a csr_graph, i.e., is valid while the graph is mapped and is not modified.
+/// In addition to its own API, provides the API of the adjacency lists used in the benchmarks
+/// (num_values(), values_begin(), and values_end()).
+/// \tparam _vertex_id_type A vertex ID type.
+/// \tparam _index_type An edge index type.
+template <typename _vertex_id_type, typename _index_type>
+class csr_graph_view {
+ public:
+  using vertex_id_type = _vertex_id_type;
+  using index_type = _index_type;
+  using size_type = std::size_t;
+  using key_type = vertex_id_type;
+  using value_type = vertex_id_type;
+  using const_value_iterator = const vertex_id_type *;
+
+  csr_graph_view() = default;
+
+  csr_graph_view(const size_type num_vertices, const index_type *const offsets, const vertex_id_type *const targets)
+      : m_num_vertices(num_vertices),
+        m_offsets(offsets),
+        m_targets(targets) {}
+
+  size_type num_vertices() const {
+    return m_num_vertices;
+  }
+
+  size_type num_edges() const {
+    return (m_num_vertices == 0) ? 0 : m_offsets[m_num_vertices];
+  }
+
+  size_type degree(const vertex_id_type vertex) const {
+    assert((size_type)vertex < m_num_vertices);
+    return m_offsets[vertex + 1] - m_offsets[vertex];
+  }
+
+  const_value_iterator neighbors_begin(const vertex_id_type vertex) const {
+    return m_targets + m_offsets[vertex];
+  }
+
+  const_value_iterator neighbors_end(const vertex_id_type vertex) const {
+    return m_targets + m_offsets[vertex + 1];
+  }
+
+  /// \brief Returns the offsets array, which has num_vertices() + 1 elements
+  const index_type *offsets() const {
+    return m_offsets;
+  }
+
+  /// \brief Returns the targets array, which has num_edges() elements
+  const vertex_id_type *targets() const {
+    return m_targets;
+  }
+
+  // ---------------------------------------- Adjacency list API ---------------------------------------- //
+  size_type num_values(const key_type &vertex) const {
+    return ((size_type)vertex < m_num_vertices) ? degree(vertex) : 0;
+  }
+
+  const_value_iterator values_begin(const key_type &vertex) const {
+    return neighbors_begin(vertex);
+  }
+
+  const_value_iterator values_end(const key_type &vertex) const {
+    return neighbors_end(vertex);
+  }
+
+ private:
+  size_type m_num_vertices{0};
+  const index_type *m_offsets{nullptr};
+  const vertex_id_type *m_targets{nullptr};
+};
+
+/// \brief A static graph in the compressed sparse row (CSR) format.
+/// The offsets and targets arrays are each allocated as a single large array by the allocator,
+/// i.e., they start at chunk boundaries when they are allocated in Metall.
+/// The graph is built from an edge list in two passes:
+/// counting the degrees, computing their prefix sum, and scattering the targets.
+/// Read the graph through view(), which does not convert pointers in every access.
+/// This is an experimental implementation.
+/// \tparam _vertex_id_type A vertex ID type.
+/// \tparam _index_type An edge index type.
+/// \tparam _allocator An allocator type.
+template <typename _vertex_id_type = uint64_t,
+          typename _index_type = uint64_t,
+          typename _allocator = std::allocator<std::byte>>
+class csr_graph {
+ private:
+  template <typename T>
+  using other_allocator_type = typename std::allocator_traits<_allocator>::template rebind_alloc<T>;
+
+  using index_allocator_type = other_allocator_type<_index_type>;
+  using index_pointer = typename std::allocator_traits<index_allocator_type>::pointer;
+  using target_allocator_type = other_allocator_type<_vertex_id_type>;
+  using target_pointer = typename std::allocator_traits<target_allocator_type>::pointer;
+
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Public types and static values
+  // -------------------------------------------------------------------------------- //
+  using vertex_id_type = _vertex_id_type;
+  using index_type = _index_type;
+  using size_type = std::size_t;
+  using allocator_type = _allocator;
+  using view_type = csr_graph_view<vertex_id_type, index_type>;
+
+  // -------------------------------------------------------------------------------- //
+  // Constructor & assign operator
+  // -------------------------------------------------------------------------------- //
+  explicit csr_graph(const _allocator &allocator = _allocator())
+      : m_allocator(allocator),
+        m_num_vertices(0),
+        m_num_edges(0),
+        m_offsets(nullptr),
+        m_targets(nullptr) {}
+
+  csr_graph(const csr_graph &) = delete;
+  csr_graph &operator=(const csr_graph &) = delete;
+
+  ~csr_graph() {
+    clear();
+  }
+
+  // -------------------------------------------------------------------------------- //
+  // Public methods
+  // -------------------------------------------------------------------------------- //
+  /// \brief Builds the graph from edges, replacing the current graph.
+  /// Reads the edges twice (counting the degrees, and scattering the targets),
+  /// i.e., the edges do not have to be stored in memory as a whole; an iterator can read them from anywhere.
+  /// The passes are done in parallel only if edge_iterator is a random access iterator;
+  /// use build_partitioned() to read other kinds of edge sources in parallel.
+  /// \tparam edge_iterator A forward iterator whose value type has 'first' (source) and 'second' (target).
+  /// \param num_vertices The number of vertices. Vertex IDs must be smaller than this value.
+  /// \param first The first edge.
+  /// \param last The end of the edges.
+  /// \param num_threads The number of threads to use. 0 is treated as 1.
+  /// \param sort_neighbors If true, sorts the targets of each vertex.
+  /// Otherwise, their order depends on the order the threads scatter them.
+  template <typename edge_iterator>
+  void build(const size_type num_vertices, edge_iterator first, edge_iterator last,
+             size_type num_threads = metall::detail::utility::default_num_threads(),
+             const bool sort_neighbors = false) {
+    if constexpr (std::is_base_of_v<std::random_access_iterator_tag,
+                                    typename std::iterator_traits<edge_iterator>::iterator_category>) {
+      using difference_type = typename std::iterator_traits<edge_iterator>::difference_type;
+      const auto length = static_cast<size_type>(std::distance(first, last));
+      const size_type num_partitions = std::max(num_threads, (size_type)1);
+      build_partitioned(num_vertices, num_partitions, [first, length, num_partitions](const size_type partition_no) {
+        return std::make_pair(first + static_cast<difference_type>(length * partition_no / num_partitions),
+                              first + static_cast<difference_type>(length * (partition_no + 1) / num_partitions));
+      }, num_threads, sort_neighbors);
+    } else {
+      build_partitioned(num_vertices, 1, [first, last](const size_type) {
+        return std::make_pair(first, last);
+      }, num_threads, sort_neighbors);
+    }
+  }
+
+  /// \brief Builds the graph from disjoint partitions of the edges, replacing the current graph.
+  /// Each thread takes a partition at a time in each of the two passes,
+  /// i.e., the edges are read in parallel even if they are read with forward iterators, e.g.,
+  /// the partitions can be the banks of a hash table or the ranges made by
+  /// metall::utility::container_of_containers_iterator_adaptor::partition().
+  /// \tparam partition_function_type A function type that takes a partition number and returns
+  /// a std::pair of forward iterators (the first and the end of the edges of the partition) as build() takes.
+  /// \param num_vertices The number of vertices. Vertex IDs must be smaller than this value.
+  /// \param num_partitions The number of partitions.
+  /// \param partition A function that returns the same edges every time for a partition number.
+  /// Is called by multiple threads at the same time.
+  /// \param num_threads The number of threads to use. 0 is treated as 1.
+  /// \param sort_neighbors If true, sorts the targets of each vertex.
+  template <typename partition_function_type>
+  void build_partitioned(const size_type num_vertices, const size_type num_partitions,
+                         const partition_function_type &partition,
+                         size_type num_threads = metall::detail::utility::default_num_threads(),
+                         const bool sort_neighbors = false) {
+    num_threads = std::max(num_threads, (size_type)1);
+    clear();
+    priv_allocate_offsets(num_vertices);
+    index_type *const offsets = priv_offsets();
+
+    // 1. Count the degree of vertex v in offsets[v + 1]
+    std::memset(offsets, 0, (num_vertices + 1) * sizeof(index_type));
+    metall::detail::utility::parallel_for(
+        num_partitions, num_threads, [&partition, offsets, num_vertices](const size_type partition_no) {
+      const auto range = partition(partition_no);
+      for (auto itr = range.first; itr != range.second; ++itr) {
+        const auto &edge = *itr;
+        assert((size_type)edge.first < num_vertices && (size_type)edge.second < num_vertices);
+        __atomic_fetch_add(&offsets[edge.first + 1], 1, __ATOMIC_RELAXED);
+      }
+    });
+
+    // 2. Prefix sum; offsets[v] is now the first index of vertex v
+    priv_parallel_inclusive_scan(offsets, num_vertices + 1, num_threads);
+    priv_allocate_targets(offsets[num_vertices]);
+    vertex_id_type *const targets = priv_targets();
+
+    // 3. Scatter the targets; offsets[v] is used as the cursor of vertex v and becomes the first index of v + 1
+    metall::detail::utility::parallel_for(
+        num_partitions, num_threads, [&partition, offsets, targets](const size_type partition_no) {
+      const auto range = partition(partition_no);
+      for (auto itr = range.first; itr != range.second; ++itr) {
+        const auto &edge = *itr;
+        const auto pos = __atomic_fetch_add(&offsets[edge.first], 1, __ATOMIC_RELAXED);
+        targets[pos] = edge.second;
+      }
+    });
+    std::memmove(offsets + 1, offsets, num_vertices * sizeof(index_type));
+    offsets[0] = 0;
+
+    if (sort_neighbors) {
+      metall::detail::utility::parallel_for_ranges(
+          num_vertices, num_threads, [offsets, targets](const size_type, const size_type begin, const size_type end) {
+        for (size_type v = begin; v < end; ++v) {
+          std::sort(targets + offsets[v], targets + offsets[v + 1]);
+        }
+      });
+    }
+  }
+
+  /// \brief Deallocates the graph
+  void clear() {
+    if (m_offsets) {
+      index_allocator_type index_allocator(m_allocator);
+      std::allocator_traits<index_allocator_type>::deallocate(index_allocator, m_offsets, m_num_vertices + 1);
+      m_offsets = nullptr;
+    }
+    if (m_targets) {
+      target_allocator_type target_allocator(m_allocator);
+      std::allocator_traits<target_allocator_type>::deallocate(target_allocator, m_targets, m_num_edges);
+      m_targets = nullptr;
+    }
+    m_num_vertices = 0;
+    m_num_edges = 0;
+  }
+
+  size_type num_vertices() const {
+    return m_num_vertices;
+  }
+
+  size_type num_edges() const {
+    return m_num_edges;
+  }
+
+  /// \brief Returns a read-only view of the graph
+  view_type view() const {
+    return view_type(m_num_vertices, priv_offsets(), priv_targets());
+  }
+
+  // ---------------------------------------- Allocator ---------------------------------------- //
+  allocator_type get_allocator() const {
+    return m_allocator;
+  }
+
+ private:
+  index_type *priv_offsets() const {
+    return m_offsets ? std::addressof(*m_offsets) : nullptr;
+  }
+
+  vertex_id_type *priv_targets() const {
+    return m_targets ? std::addressof(*m_targets) : nullptr;
+  }
+
+  void priv_allocate_offsets(const size_type num_vertices) {
+    index_allocator_type index_allocator(m_allocator);
+    m_offsets = std::allocator_traits<index_allocator_type>::allocate(index_allocator, num_vertices + 1);
+    m_num_vertices = num_vertices;
+  }
+
+  void priv_allocate_targets(const size_type num_edges) {
+    if (num_edges > 0) {
+      target_allocator_type target_allocator(m_allocator);
+      m_targets = std::allocator_traits<target_allocator_type>::allocate(target_allocator, num_edges);
+    }
+    m_num_edges = num_edges;
+  }
+
+  /// \brief Computes the inclusive prefix sum of an array in place.
+  /// Each thread sums up its block, the block sums are scanned, and then each thread scans its block.
+  static void priv_parallel_inclusive_scan(index_type *const array, const size_type length,
+                                           const size_type num_threads) {
+    std::vector<index_type> block_sums(num_threads + 1, 0);
+    metall::detail::utility::parallel_for_ranges(
+        length, num_threads, [array, &block_sums](const size_type block_no, const size_type begin, const size_type end) {
+      index_type sum = 0;
+      for (size_type i = begin; i < end; ++i) sum += array[i];
+      block_sums[block_no + 1] = sum;
+    });
+    for (size_type t = 1; t <= num_threads; ++t) block_sums[t] += block_sums[t - 1];
+    metall::detail::utility::parallel_for_ranges(
+        length, num_threads, [array, &block_sums](const size_type block_no, const size_type begin, const size_type end) {
+      index_type sum = block_sums[block_no];
+      for (size_type i = begin; i < end; ++i) {
+        sum += array[i];
+        array[i] = sum;
+      }
+    });
+  }
+
+  allocator_type m_allocator;
+  size_type m_num_vertices;
+  size_type m_num_edges;
+  index_pointer m_offsets;
+  target_pointer m_targets;
+};
+
+} // namespace metall::container
+
+#endif //METALL_COTAINER_CSR_GRAPH_HPP
@@ -0,0 +1,339 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#ifndef METALL_COTAINER_STRING_POOL_HPP
+#define METALL_COTAINER_STRING_POOL_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include <metall/detail/utility/logger.hpp>
+#include <metall_utility/hash.hpp>
+#include <metall_utility/mutex.hpp>
+#include <metall_container/concurrent_vector.hpp>
+
+namespace metall::container {
+
+/// \brief A pool of interned strings.
+/// Each distinct string is stored only once and is identified by a compact handle,
+/// which is a sequential number starting at 0, e.g., maps can use handles as their keys instead of strings.
+/// Strings are appended to large arenas (k_arena_size bytes each), i.e., interning a string does not allocate memory
+/// unless the current arena is full. A string longer than an arena gets its own block.
+/// Strings are never moved or removed until clear() is called;
+/// view() and c_str() return pointers into the arenas, which are valid while the pool is mapped.
+/// The index from strings to handles is an open-addressing hash table split into k_num_shards shards.
+/// All pointers are the pointer type of the allocator (e.g., offset_ptr) so that the pool can be stored in Metall.
+/// intern() and find() are thread-safe; they lock the shard of the string only.
+/// The locks are not stored in the pool, i.e., a pool in a data store opened with read only mode can be read.
+/// view() and c_str() do not take locks.
+/// This is an experimental implementation.
+/// \tparam _handle_type An unsigned integer type of handles.
+/// The maximum value is reserved, i.e., a pool can contain up to std::numeric_limits<_handle_type>::max() strings.
+/// \tparam _allocator An allocator type.
+/// \tparam k_num_shards The number of shards of the index.
+/// \tparam k_arena_size The size of an arena in bytes. Must be a power of two.
+template <typename _handle_type = uint32_t,
+          typename _allocator = std::allocator<char>,
+          int k_num_shards = 256,
+          std::size_t k_arena_size = (1ULL << 20ULL)>
+class string_pool {
+  static_assert(std::is_unsigned_v<_handle_type>, "Handle type must be an unsigned integer type");
+  static_assert((k_arena_size & (k_arena_size - 1)) == 0, "Arena size must be a power of two");
+
+ private:
+  template <typename T>
+  using other_allocator_type = typename std::allocator_traits<_allocator>::template rebind_alloc<T>;
+
+  using char_allocator_type = other_allocator_type<char>;
+  using char_pointer = typename std::allocator_traits<char_allocator_type>::pointer;
+  using length_type = uint32_t; // Stored in front of each string
+  // The last stripe is the lock of the arenas
+  using lock_table_type = metall::utility::mutex::instance_lock_table<k_num_shards + 1>;
+
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Public types and static values
+  // -------------------------------------------------------------------------------- //
+  using handle_type = _handle_type;
+  using size_type = std::size_t;
+  using allocator_type = _allocator;
+  using mutex_type = metall::utility::mutex::shared_spin_mutex;
+
+  static constexpr handle_type k_invalid_handle = std::numeric_limits<handle_type>::max();
+
+ private:
+  struct slot_type {
+    uint32_t tag; // The lower 32 bits of the hash value
+    handle_type handle;
+  };
+  using slot_allocator_type = other_allocator_type<slot_type>;
+  using slot_pointer = typename std::allocator_traits<slot_allocator_type>::pointer;
+
+  struct shard_type {
+    slot_pointer slots{nullptr};
+    size_type capacity{0};
+    size_type size{0};
+  };
+
+  struct block_type {
+    char_pointer data;
+    size_type size;
+  };
+
+ public:
+  // -------------------------------------------------------------------------------- //
+  // Constructor & assign operator
+  // -------------------------------------------------------------------------------- //
+  explicit string_pool(const _allocator &allocator = _allocator())
+      : m_allocator(allocator),
+        m_locations(allocator),
+        m_blocks(allocator),
+        m_current_block(0),
+        m_current_block_used(k_arena_size) {}
+
+  string_pool(const string_pool &) = delete;
+  string_pool &operator=(const string_pool &) = delete;
+
+  ~string_pool() {
+    clear();
+    lock_table_type::release(this);
+  }
+
+  // -------------------------------------------------------------------------------- //
+  // Public methods
+  // -------------------------------------------------------------------------------- //
+  /// \brief Returns the number of interned strings.
+  /// Only counts handles whose locations have been written,
+  /// i.e., view() can be called for any handle smaller than size() while other threads intern strings.
+  size_type size() const {
+    return m_locations.size();
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  /// \brief Returns the handle of a string, adding the string to the pool if it does not exist.
+  /// Looks up the string with the shared lock of its shard first,
+  /// i.e., interning an existing string does not block other readers.
+  handle_type intern(const std::string_view &str) {
+    const uint64_t hash = priv_hash(str);
+    const auto shard_no = priv_shard_no(hash);
+    {
+      std::shared_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+      const auto handle = priv_find(m_shards[shard_no], str, hash);
+      if (handle != k_invalid_handle) return handle;
+    }
+
+    std::unique_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+    auto &shard = m_shards[shard_no];
+    auto handle = priv_find(shard, str, hash); // Another thread might have added it
+    if (handle != k_invalid_handle) return handle;
+
+    handle = priv_append(str);
+    priv_insert_slot(shard, static_cast<uint32_t>(hash), handle);
+    return handle;
+  }
+
+  /// \brief Finds the handle of a string.
+  /// \return The handle of the string if it exists; otherwise, k_invalid_handle.
+  handle_type find(const std::string_view &str) const {
+    const uint64_t hash = priv_hash(str);
+    const auto shard_no = priv_shard_no(hash);
+    std::shared_lock<mutex_type> lock(priv_shard_mutex(shard_no));
+    return priv_find(m_shards[shard_no], str, hash);
+  }
+
+  /// \brief Returns the string of a handle
+  std::string_view view(const handle_type handle) const {
+    const char *const record = priv_record(handle);
+    length_type length;
+    std::memcpy(&length, record, sizeof(length_type));
+    return std::string_view(record + sizeof(length_type), length);
+  }
+
+  /// \brief Returns the null-terminated string of a handle
+  const char *c_str(const handle_type handle) const {
+    return priv_record(handle) + sizeof(length_type);
+  }
+
+  /// \brief Removes all strings and deallocates all memory. Handles become invalid.
+  /// This function is not thread-safe.
+  void clear() {
+    for (auto &shard : m_shards) {
+      if (shard.slots) {
+        slot_allocator_type allocator(m_allocator);
+        std::allocator_traits<slot_allocator_type>::deallocate(allocator, shard.slots, shard.capacity);
+      }
+      shard = shard_type();
+    }
+
+    for (auto &block : m_blocks) {
+      char_allocator_type allocator(m_allocator);
+      std::allocator_traits<char_allocator_type>::deallocate(allocator, block.data, block.size);
+    }
+    m_blocks.clear();
+    m_locations.clear();
+    m_current_block = 0;
+    m_current_block_used = k_arena_size;
+  }
+
+  // ---------------------------------------- Allocator ---------------------------------------- //
+  allocator_type get_allocator() const {
+    return m_allocator;
+  }
+
+ private:
+  // -------------------------------------------------------------------------------- //
+  // Private methods
+  // -------------------------------------------------------------------------------- //
+  static uint64_t priv_hash(const std::string_view &str) {
+    return metall::utility::MurmurHash64A(str.data(), static_cast<int>(str.length()), 123);
+  }
+
+  /// \brief Uses the upper bits of a hash value; the lower 32 bits are the tag in the shard
+  static size_type priv_shard_no(const uint64_t hash) {
+    return (hash >> 32ULL) % k_num_shards;
+  }
+
+  mutex_type &priv_shard_mutex(const size_type shard_no) const {
+    return lock_table_type::get(this, shard_no);
+  }
+
+  mutex_type &priv_arena_mutex() const {
+    return lock_table_type::get(this, k_num_shards);
+  }
+
+  /// \brief Returns the address of the record of a handle, i.e., its length followed by the null-terminated string
+  const char *priv_record(const handle_type handle) const {
+    assert(handle < m_locations.size());
+    const uint64_t location = m_locations[handle];
+    const auto &block = m_blocks[location / k_arena_size];
+    return std::addressof(*block.data) + location % k_arena_size;
+  }
+
+  handle_type priv_find(const shard_type &shard, const std::string_view &str, const uint64_t hash) const {
+    if (shard.capacity == 0) return k_invalid_handle;
+
+    const auto tag = static_cast<uint32_t>(hash);
+    const slot_type *const slots = std::addressof(*shard.slots);
+    for (size_type pos = tag & (shard.capacity - 1);; pos = (pos + 1) & (shard.capacity - 1)) {
+      const auto &slot = slots[pos];
+      if (slot.handle == k_invalid_handle) return k_invalid_handle;
+      if (slot.tag == tag && view(slot.handle) == str) return slot.handle;
+    }
+  }
+
+  /// \brief Inserts a slot into a locked shard, doubling its capacity if its load factor exceeds 3/4
+  void priv_insert_slot(shard_type &shard, const uint32_t tag, const handle_type handle) {
+    if ((shard.size + 1) * 4 > shard.capacity * 3) {
+      priv_rehash(shard, std::max(shard.capacity * 2, (size_type)16));
+    }
+    slot_type *const slots = std::addressof(*shard.slots);
+    size_type pos = tag & (shard.capacity - 1);
+    while (slots[pos].handle != k_invalid_handle) {
+      pos = (pos + 1) & (shard.capacity - 1);
+    }
+    slots[pos] = slot_type{tag, handle};
+    ++shard.size;
+  }
+
+  /// \brief Reallocates the slots of a shard. The tags are used as the hash values, i.e., strings are not read.
+  void priv_rehash(shard_type &shard, const size_type new_capacity) {
+    slot_allocator_type allocator(m_allocator);
+    slot_pointer new_slots = std::allocator_traits<slot_allocator_type>::allocate(allocator, new_capacity);
+    slot_type *const new_slots_raw = std::addressof(*new_slots);
+    for (size_type i = 0; i < new_capacity; ++i) {
+      new_slots_raw[i] = slot_type{0, k_invalid_handle};
+    }
+
+    if (shard.slots) {
+      const slot_type *const old_slots = std::addressof(*shard.slots);
+      for (size_type i = 0; i < shard.capacity; ++i) {
+        if (old_slots[i].handle == k_invalid_handle) continue;
+        size_type pos = old_slots[i].tag & (new_capacity - 1);
+        while (new_slots_raw[pos].handle != k_invalid_handle) {
+          pos = (pos + 1) & (new_capacity - 1);
+        }
+        new_slots_raw[pos] = old_slots[i];
+      }
+      std::allocator_traits<slot_allocator_type>::deallocate(allocator, shard.slots, shard.capacity);
+    }
+
+    shard.slots = new_slots;
+    shard.capacity = new_capacity;
+  }
+
+  /// \brief Appends a string to the arenas and returns its new handle
+  handle_type priv_append(const std::string_view &str) {
+    if (str.length() > std::numeric_limits<length_type>::max()) {
+      priv_abort("Too long string: " + std::to_string(str.length()));
+    }
+    const size_type record_size = sizeof(length_type) + str.length() + 1;
+
+    // Reserve space in the arenas; the string is copied without holding the lock
+    uint64_t location;
+    char *record;
+    {
+      std::lock_guard<mutex_type> lock(priv_arena_mutex());
+      if (record_size > k_arena_size) {
+        location = priv_allocate_block(record_size) * k_arena_size;
+      } else {
+        if (m_current_block_used + record_size > k_arena_size) {
+          m_current_block = priv_allocate_block(k_arena_size);
+          m_current_block_used = 0;
+        }
+        location = m_current_block * k_arena_size + m_current_block_used;
+        m_current_block_used += record_size;
+      }
+      record = std::addressof(*m_blocks[location / k_arena_size].data) + location % k_arena_size;
+    }
+
+    const auto length = static_cast<length_type>(str.length());
+    std::memcpy(record, &length, sizeof(length_type));
+    std::memcpy(record + sizeof(length_type), str.data(), str.length());
+    record[sizeof(length_type) + str.length()] = '\0';
+
+    const auto handle = m_locations.push_back(location);
+    if (handle >= k_invalid_handle) {
+      priv_abort("Too many strings for the handle type");
+    }
+    return static_cast<handle_type>(handle);
+  }
+
+  static void priv_abort(const std::string &message) {
+    metall::detail::utility::logger::out(metall::detail::utility::logger::log_level::critical, "string_pool", message);
+    std::abort();
+  }
+
+  /// \brief Allocates a block and returns its index. Must be called with the arena lock.
+  size_type priv_allocate_block(const size_type size) {
+    char_allocator_type allocator(m_allocator);
+    return m_blocks.push_back(block_type{std::allocator_traits<char_allocator_type>::allocate(allocator, size), size});
+  }
+
+  // -------------------------------------------------------------------------------- //
+  // Private fields
+  // -------------------------------------------------------------------------------- //
+  allocator_type m_allocator;
+  shard_type m_shards[k_num_shards];
+  concurrent_vector<uint64_t, other_allocator_type<uint64_t>> m_locations; // Handle -> location in the arenas
+  concurrent_vector<block_type, other_allocator_type<block_type>> m_blocks;
+  size_type m_current_block;
+  size_type m_current_block_used;
+};
+
+} // namespace metall::container
+
+#endif //METALL_COTAINER_STRING_POOL_HPP
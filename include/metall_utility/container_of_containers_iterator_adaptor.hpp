@@ -7,11 +7,16 @@
 #define METALL_UTILITY_CONTAINER_OF_CONTAINERS_ITERATOR_ADAPTOR_HPP
 
 #include <iterator>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
 
 namespace metall::utility {
 
 /// \brief Utility class that provides an iterator for a contaner of containers, e.g., map of vectors
-/// This is an experimental implementation and only support forward iterator for now
+/// This is an experimental implementation and the adaptor itself is only a forward iterator for now.
+/// Use partition() to split the elements into ranges that can be iterated in parallel;
+/// partition() requires outer_iterator_type to be a random access iterator.
 /// \tparam outer_iterator_type
 /// \tparam inner_iterator_type
 template <typename outer_iterator_type, typename inner_iterator_type>
@@ -71,6 +76,27 @@ class container_of_containers_iterator_adaptor {
     return (*m_inner_iterator);
   }
 
+  /// \brief Returns the begin and end iterators of the partition_no-th of num_partitions disjoint ranges
+  /// that cover all inner elements of [outer_begin, outer_end).
+  /// Each range consists of a contiguous block of outer containers,
+  /// i.e., the ranges can be iterated independently, e.g., by different threads.
+  /// \param outer_begin The first outer container. Must be a random access iterator.
+  /// \param outer_end The end of the outer containers.
+  /// \param partition_no A partition number.
+  /// \param num_partitions The number of partitions.
+  static std::pair<container_of_containers_iterator_adaptor, container_of_containers_iterator_adaptor>
+  partition(outer_iterator_type outer_begin, outer_iterator_type outer_end,
+            const std::size_t partition_no, const std::size_t num_partitions) {
+    static_assert(std::is_base_of_v<std::random_access_iterator_tag,
+                                    typename std::iterator_traits<outer_iterator_type>::iterator_category>,
+                  "partition() requires a random access outer iterator");
+    const auto length = static_cast<std::size_t>(std::distance(outer_begin, outer_end));
+    const auto first = outer_begin + length * partition_no / num_partitions;
+    const auto last = outer_begin + length * (partition_no + 1) / num_partitions;
+    return std::make_pair(container_of_containers_iterator_adaptor(first, last),
+                          container_of_containers_iterator_adaptor(last, last));
+  }
+
   bool equal(const container_of_containers_iterator_adaptor &other) const {
     return (m_outer_iterator == m_outer_end && other.m_outer_iterator == other.m_outer_end)
         || (m_outer_iterator == other.m_outer_iterator && m_inner_iterator == other.m_inner_iterator);
@@ -7,8 +7,16 @@
 #define METALL_MUTEX_HPP
 
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <array>
+#include <utility>
+#include <cstdint>
 #include <cassert>
 
+#include <metall/detail/utility/instance_lock_registry.hpp>
+
 namespace metall::utility {
 namespace mutex {
 
@@ -21,6 +29,228 @@ inline std::unique_lock<std::mutex> mutex_lock(const std::size_t index) {
   return std::unique_lock<std::mutex>(mutexes[index]);
 }
 
+/// \brief A reader-writer spin lock that satisfies the SharedMutex requirements,
+/// i.e., can be used with std::unique_lock and std::shared_lock.
+/// A waiting writer blocks new readers so that writers are not starved.
+class shared_spin_mutex {
+ public:
+  shared_spin_mutex() = default;
+  shared_spin_mutex(const shared_spin_mutex &) = delete;
+  shared_spin_mutex &operator=(const shared_spin_mutex &) = delete;
+
+  void lock() {
+    uint32_t state = m_state.load(std::memory_order_relaxed);
+    while ((state & k_writer)
+        || !m_state.compare_exchange_weak(state, state | k_writer, std::memory_order_acquire,
+                                          std::memory_order_relaxed)) {
+      std::this_thread::yield();
+      state = m_state.load(std::memory_order_relaxed);
+    }
+    // Wait for the readers to leave
+    while (m_state.load(std::memory_order_acquire) != k_writer) {
+      std::this_thread::yield();
+    }
+  }
+
+  bool try_lock() {
+    uint32_t expected = 0;
+    return m_state.compare_exchange_strong(expected, k_writer, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  void unlock() {
+    m_state.store(0, std::memory_order_release);
+  }
+
+  void lock_shared() {
+    while (!try_lock_shared()) {
+      std::this_thread::yield();
+    }
+  }
+
+  bool try_lock_shared() {
+    uint32_t state = m_state.load(std::memory_order_relaxed);
+    while (!(state & k_writer)) {
+      if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void unlock_shared() {
+    m_state.fetch_sub(1, std::memory_order_release);
+  }
+
+ private:
+  static constexpr uint32_t k_writer = 1U << 31U;
+
+  std::atomic<uint32_t> m_state{0};
+};
+
+/// \brief The registry of the lock tables of instance_lock_table (see metall::detail::utility::instance_lock_registry)
+using instance_lock_registry = metall::detail::utility::instance_lock_registry;
+
+/// \brief Striped locks allocated in DRAM for each instance of a container.
+/// Containers allocated in Metall cannot hold locks inside themselves,
+/// e.g., a data store opened with open_read_only is mapped without write permission.
+/// Instead, this class associates a table of num_stripes locks with the address of an instance.
+/// The tables are released when the instances are destructed or the data stores containing them are closed.
+/// Each thread caches the tables it used recently to avoid taking the global lock of the registry.
+/// This is an experimental implementation
+/// \tparam num_stripes The number of locks per instance.
+/// \tparam lock_type A lock type.
+template <int num_stripes, typename lock_type = shared_spin_mutex>
+class instance_lock_table {
+ public:
+  /// \brief Returns the stripe_no-th lock of an instance. Allocates the locks if they do not exist.
+  static lock_type &get(const void *const instance, const std::size_t stripe_no) {
+    assert(stripe_no < (std::size_t)num_stripes);
+    thread_local cache_entry cache[k_num_cache_entries];
+    thread_local std::size_t next_victim = 0;
+
+    const auto epoch = instance_lock_registry::epoch();
+    for (auto &entry : cache) {
+      if (entry.instance == instance && entry.epoch == epoch) {
+        return (*entry.table)[stripe_no].lock;
+      }
+    }
+
+    auto &entry = cache[next_victim];
+    next_victim = (next_victim + 1) % k_num_cache_entries;
+    entry.table = std::static_pointer_cast<table_type>(
+        instance_lock_registry::find_or_create(instance, type_tag(), make_table));
+    entry.instance = instance;
+    entry.epoch = epoch;
+    return (*entry.table)[stripe_no].lock;
+  }
+
+  /// \brief Deallocates the locks of an instance. Must be called when the instance is destroyed.
+  static void release(const void *const instance) {
+    instance_lock_registry::release(instance, type_tag());
+  }
+
+ private:
+  static constexpr std::size_t k_num_cache_entries = 4;
+
+  // Avoids false sharing between locks
+  struct alignas(64) padded_lock {
+    lock_type lock;
+  };
+  using table_type = std::array<padded_lock, num_stripes>;
+
+  struct cache_entry {
+    const void *instance{nullptr};
+    uint64_t epoch{0};
+    std::shared_ptr<table_type> table{nullptr};
+  };
+
+  static std::shared_ptr<void> make_table() {
+    return std::make_shared<table_type>();
+  }
+
+  static const void *type_tag() {
+    static const char tag = 0;
+    return &tag;
+  }
+};
+
+/// \brief A growable array of locks allocated in DRAM for each instance of a container,
+/// e.g., one lock per node whose number is stored in the node.
+/// Unlike instance_lock_table, the index selects its own lock, i.e., locks are not shared by indices.
+/// The array consists of segments whose sizes double; a segment is allocated when one of its locks is used first.
+/// The locks do not move once they are allocated, so references to them stay valid while the array grows.
+/// The arrays are released when the instances are destructed or the data stores containing them are closed.
+/// This is an experimental implementation
+/// \tparam lock_type A lock type. Must be default constructible.
+template <typename lock_type = shared_spin_mutex>
+class instance_lock_array {
+ public:
+  /// \brief Returns the index-th lock of an instance. Allocates the locks if they do not exist.
+  static lock_type &get(const void *const instance, const std::size_t index) {
+    thread_local cache_entry cache[k_num_cache_entries];
+    thread_local std::size_t next_victim = 0;
+
+    const auto epoch = instance_lock_registry::epoch();
+    for (auto &entry : cache) {
+      if (entry.instance == instance && entry.epoch == epoch) {
+        return entry.array->get(index);
+      }
+    }
+
+    auto &entry = cache[next_victim];
+    next_victim = (next_victim + 1) % k_num_cache_entries;
+    entry.array = std::static_pointer_cast<array_type>(
+        instance_lock_registry::find_or_create(instance, type_tag(), make_array));
+    entry.instance = instance;
+    entry.epoch = epoch;
+    return entry.array->get(index);
+  }
+
+  /// \brief Deallocates the locks of an instance. Must be called when the instance is destroyed.
+  static void release(const void *const instance) {
+    instance_lock_registry::release(instance, type_tag());
+  }
+
+ private:
+  static constexpr std::size_t k_num_cache_entries = 4;
+  static constexpr std::size_t k_first_segment_size = 1024;
+  static constexpr std::size_t k_num_segments = 48;
+
+  // Avoids false sharing between locks
+  struct alignas(64) padded_lock {
+    lock_type lock;
+  };
+
+  class array_type {
+   public:
+    array_type() = default;
+    array_type(const array_type &) = delete;
+    array_type &operator=(const array_type &) = delete;
+
+    ~array_type() {
+      for (auto &segment : m_segments) {
+        delete[] segment.load(std::memory_order_relaxed);
+      }
+    }
+
+    lock_type &get(const std::size_t index) {
+      // Segment s holds the locks in [k_first_segment_size * (2^s - 1), k_first_segment_size * (2^(s+1) - 1))
+      const std::size_t segment_no = 63 - __builtin_clzll(index / k_first_segment_size + 1);
+      assert(segment_no < k_num_segments);
+      const std::size_t offset = index - k_first_segment_size * ((1ULL << segment_no) - 1);
+
+      padded_lock *segment = m_segments[segment_no].load(std::memory_order_acquire);
+      if (!segment) {
+        auto *const new_segment = new padded_lock[k_first_segment_size << segment_no]();
+        if (m_segments[segment_no].compare_exchange_strong(segment, new_segment, std::memory_order_acq_rel)) {
+          segment = new_segment;
+        } else {
+          delete[] new_segment; // Another thread has allocated the segment
+        }
+      }
+      return segment[offset].lock;
+    }
+
+   private:
+    std::array<std::atomic<padded_lock *>, k_num_segments> m_segments{};
+  };
+
+  struct cache_entry {
+    const void *instance{nullptr};
+    uint64_t epoch{0};
+    std::shared_ptr<array_type> array{nullptr};
+  };
+
+  static std::shared_ptr<void> make_array() {
+    return std::make_shared<array_type>();
+  }
+
+  static const void *type_tag() {
+    static const char tag = 0;
+    return &tag;
+  }
+};
+
 }
 }
 
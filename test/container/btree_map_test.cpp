@@ -0,0 +1,271 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <map>
+#include <random>
+#include <limits>
+
+#include <metall/metall.hpp>
+#include <metall_container/btree_map.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+
+// Uses small nodes so that trees have several levels
+template <typename key_type, typename mapped_type = uint64_t>
+using small_btree_map = metall::container::btree_map<key_type, mapped_type, std::less<key_type>,
+                                                     std::allocator<std::pair<const key_type, mapped_type>>, 256>;
+
+template <typename map_type, typename ref_map_type>
+void validate(const map_type &map, const ref_map_type &ref_map) {
+  GTEST_ASSERT_EQ(map.size(), ref_map.size());
+  auto ref_itr = ref_map.begin();
+  for (auto itr = map.begin(); itr != map.end(); ++itr, ++ref_itr) {
+    GTEST_ASSERT_NE(ref_itr, ref_map.end());
+    GTEST_ASSERT_EQ(itr->first, ref_itr->first);
+    GTEST_ASSERT_EQ(itr->second, ref_itr->second);
+  }
+  GTEST_ASSERT_EQ(ref_itr, ref_map.end());
+}
+
+TEST (BtreeMapTest, Insert) {
+  small_btree_map<uint64_t> map;
+  std::map<uint64_t, uint64_t> ref_map;
+  ASSERT_TRUE(map.empty());
+
+  std::mt19937_64 rand_engine(123);
+  for (int i = 0; i < 10000; ++i) {
+    const uint64_t key = rand_engine() % 5000;
+    GTEST_ASSERT_EQ(map.insert(std::make_pair(key, i)), ref_map.emplace(key, i).second);
+  }
+  GTEST_ASSERT_GE(map.height(), 3);
+  validate(map, ref_map);
+
+  for (uint64_t key = 0; key < 5000; ++key) {
+    uint64_t value = 0;
+    GTEST_ASSERT_EQ(map.get(key, &value), ref_map.count(key) == 1);
+    GTEST_ASSERT_EQ(map.count(key), ref_map.count(key));
+    if (ref_map.count(key)) {
+      GTEST_ASSERT_EQ(value, ref_map.at(key));
+    }
+  }
+}
+
+TEST (BtreeMapTest, InsertOrAssign) {
+  small_btree_map<uint64_t> map;
+  for (uint64_t i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(map.insert_or_assign(i, i));
+  }
+  for (uint64_t i = 0; i < 1000; ++i) {
+    ASSERT_FALSE(map.insert_or_assign(i, i * 2));
+  }
+  GTEST_ASSERT_EQ(map.size(), 1000);
+  for (uint64_t i = 0; i < 1000; ++i) {
+    uint64_t value = 0;
+    ASSERT_TRUE(map.get(i, &value));
+    GTEST_ASSERT_EQ(value, i * 2);
+  }
+}
+
+TEST (BtreeMapTest, SignedAndSmallKeys) {
+  small_btree_map<int64_t> map64;
+  small_btree_map<int32_t> map32;
+  small_btree_map<uint32_t> mapu32;
+  std::map<int64_t, uint64_t> ref_map64;
+  std::map<int32_t, uint64_t> ref_map32;
+  std::map<uint32_t, uint64_t> ref_mapu32;
+
+  std::mt19937_64 rand_engine(123);
+  for (uint64_t i = 0; i < 5000; ++i) {
+    const auto key = rand_engine();
+    map64.insert(std::make_pair((int64_t)key, i));
+    ref_map64.emplace((int64_t)key, i);
+    map32.insert(std::make_pair((int32_t)key, i));
+    ref_map32.emplace((int32_t)key, i);
+    mapu32.insert(std::make_pair((uint32_t)key, i));
+    ref_mapu32.emplace((uint32_t)key, i);
+  }
+  validate(map64, ref_map64);
+  validate(map32, ref_map32);
+  validate(mapu32, ref_mapu32);
+
+  for (const auto &elem : ref_map32) {
+    GTEST_ASSERT_EQ(map32.lower_bound(elem.first)->first, elem.first);
+    GTEST_ASSERT_EQ(map32.count(elem.first), 1);
+  }
+}
+
+TEST (BtreeMapTest, CountLess) {
+  std::mt19937_64 rand_engine(123);
+  for (std::size_t length = 0; length < 40; ++length) {
+    std::vector<uint64_t> ukeys(length);
+    std::vector<int64_t> skeys(length);
+    for (std::size_t i = 0; i < length; ++i) {
+      ukeys[i] = rand_engine();
+      skeys[i] = (int64_t)ukeys[i];
+    }
+    for (int k = 0; k < 10; ++k) {
+      const uint64_t key = (k == 0) ? 0 : (k == 1) ? std::numeric_limits<uint64_t>::max() : rand_engine();
+      std::size_t ucount = 0;
+      std::size_t scount = 0;
+      for (std::size_t i = 0; i < length; ++i) {
+        ucount += ukeys[i] < key;
+        scount += skeys[i] < (int64_t)key;
+      }
+      GTEST_ASSERT_EQ(metall::container::btree_map_detail::count_less(ukeys.data(), length, key,
+                                                                     std::less<uint64_t>()), ucount);
+      GTEST_ASSERT_EQ(metall::container::btree_map_detail::count_less(skeys.data(), length, (int64_t)key,
+                                                                     std::less<int64_t>()), scount);
+    }
+  }
+}
+
+TEST (BtreeMapTest, Erase) {
+  small_btree_map<uint64_t> map;
+  std::map<uint64_t, uint64_t> ref_map;
+  for (uint64_t i = 0; i < 3000; ++i) {
+    map.insert(std::make_pair(i, i));
+    ref_map.emplace(i, i);
+  }
+
+  for (uint64_t i = 0; i < 3000; i += 3) {
+    ASSERT_TRUE(map.erase(i));
+    ASSERT_FALSE(map.erase(i));
+    ref_map.erase(i);
+  }
+  // Leaves that become empty are skipped
+  for (uint64_t i = 1000; i < 2000; ++i) {
+    map.erase(i);
+    ref_map.erase(i);
+  }
+  validate(map, ref_map);
+  GTEST_ASSERT_EQ(map.lower_bound(1000)->first, 2000);
+
+  map.clear();
+  ASSERT_TRUE(map.empty());
+  GTEST_ASSERT_EQ(map.begin(), map.end());
+  ASSERT_TRUE(map.insert(std::make_pair(1, 1)));
+  GTEST_ASSERT_EQ(map.size(), 1);
+}
+
+TEST (BtreeMapTest, RangeScan) {
+  small_btree_map<uint64_t> map;
+  for (uint64_t i = 0; i < 10000; i += 2) {
+    map.insert(std::make_pair(i, i * 10));
+  }
+
+  std::vector<uint64_t> keys;
+  map.for_each(101, 500, [&keys](const uint64_t key, const uint64_t value) {
+    GTEST_ASSERT_EQ(value, key * 10);
+    keys.push_back(key);
+  });
+  GTEST_ASSERT_EQ(keys.size(), 199);
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    GTEST_ASSERT_EQ(keys[i], 102 + i * 2);
+  }
+
+  std::size_t count = 0;
+  map.for_each(0, 100000, [&count](const uint64_t, const uint64_t) { ++count; });
+  GTEST_ASSERT_EQ(count, 5000);
+
+  count = 0;
+  map.for_each(500, 500, [&count](const uint64_t, const uint64_t) { ++count; });
+  GTEST_ASSERT_EQ(count, 0);
+
+  // Stops when the function returns false
+  count = 0;
+  map.for_each(0, 100000, [&count](const uint64_t, const uint64_t) { return ++count < 10; });
+  GTEST_ASSERT_EQ(count, 10);
+}
+
+TEST (BtreeMapTest, ConcurrentInsertAndScan) {
+  small_btree_map<uint64_t> map;
+
+  constexpr uint64_t k_num_keys = 20000;
+  constexpr int k_num_threads = 4;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < k_num_threads; ++t) {
+    threads.emplace_back([&map, t]() {
+      for (uint64_t i = t; i < k_num_keys; i += k_num_threads) {
+        ASSERT_TRUE(map.insert(std::make_pair(i, i)));
+        uint64_t value = 0;
+        ASSERT_TRUE(map.get(i, &value));
+        GTEST_ASSERT_EQ(value, i);
+      }
+    });
+  }
+  // Scans must see keys in order while other threads insert
+  threads.emplace_back([&map]() {
+    for (int n = 0; n < 20; ++n) {
+      bool first = true;
+      uint64_t previous = 0;
+      map.for_each(0, std::numeric_limits<uint64_t>::max(),
+                   [&first, &previous](const uint64_t key, const uint64_t value) {
+                     GTEST_ASSERT_EQ(key, value);
+                     if (!first) {
+                       GTEST_ASSERT_GT(key, previous);
+                     }
+                     first = false;
+                     previous = key;
+                   });
+    }
+  });
+  for (auto &th : threads) th.join();
+
+  GTEST_ASSERT_EQ(map.size(), k_num_keys);
+  uint64_t expected = 0;
+  for (auto itr = map.begin(); itr != map.end(); ++itr) {
+    GTEST_ASSERT_EQ(itr->first, expected++);
+  }
+  GTEST_ASSERT_EQ(expected, k_num_keys);
+}
+
+TEST (BtreeMapTest, Persistence) {
+  using map_type = metall::container::btree_map<uint64_t, uint64_t, std::less<uint64_t>,
+                                                metall::manager::allocator_type<std::pair<const uint64_t, uint64_t>>>;
+
+  const std::string dir_path(test_utility::make_test_dir_path("BtreeMapTest"));
+  metall::manager::remove(dir_path.c_str());
+
+  constexpr uint64_t k_num_keys = 100000;
+  {
+    metall::manager manager(metall::create_only, dir_path.c_str());
+    auto pmap = manager.construct<map_type>("map")(manager.get_allocator());
+    for (uint64_t i = 0; i < k_num_keys; ++i) {
+      pmap->insert(std::make_pair(k_num_keys - i, i));
+    }
+  }
+
+  // Readers do not write locks, i.e., a map in a data store opened with read only mode can be read
+  {
+    metall::manager manager(metall::open_read_only, dir_path.c_str());
+    const auto pmap = manager.find<map_type>("map").first;
+    GTEST_ASSERT_NE(pmap, nullptr);
+    GTEST_ASSERT_EQ(pmap->size(), k_num_keys);
+    for (uint64_t i = 0; i < k_num_keys; ++i) {
+      uint64_t value = 0;
+      ASSERT_TRUE(pmap->get(k_num_keys - i, &value));
+      GTEST_ASSERT_EQ(value, i);
+    }
+    std::size_t count = 0;
+    pmap->for_each(1, k_num_keys + 1, [&count](const uint64_t, const uint64_t) { ++count; });
+    GTEST_ASSERT_EQ(count, k_num_keys);
+  }
+
+  {
+    metall::manager manager(metall::open_only, dir_path.c_str());
+    auto pmap = manager.find<map_type>("map").first;
+    ASSERT_TRUE(pmap->erase(1));
+    ASSERT_TRUE(pmap->insert(std::make_pair(0, 0)));
+    GTEST_ASSERT_EQ(pmap->begin()->first, 0);
+    ASSERT_TRUE(manager.destroy<map_type>("map"));
+  }
+}
+}
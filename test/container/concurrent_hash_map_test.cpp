@@ -0,0 +1,200 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+
+#include <metall/metall.hpp>
+#include <metall_container/concurrent_hash_map.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+
+using map_type = metall::container::concurrent_hash_map<uint64_t, uint64_t>;
+
+TEST (ConcurrentHashMapTest, SequentialInsert) {
+  std::unordered_map<char, int> ref_map;
+  metall::container::concurrent_hash_map<char, int> map;
+
+  const auto v1 = std::make_pair('a', 0);
+  const auto v1_2 = std::make_pair('a', 1);
+  GTEST_ASSERT_EQ(ref_map.insert(v1).second, map.insert(v1));
+  GTEST_ASSERT_EQ(ref_map.insert(v1).second, map.insert(v1)); // Check unique insertion
+  GTEST_ASSERT_EQ(ref_map.insert(v1_2).second, map.insert(v1_2)); // Duplicate key
+  GTEST_ASSERT_EQ(map.find('a')->second, 0);
+
+  const auto v2 = std::make_pair('b', 1);
+  GTEST_ASSERT_EQ(ref_map.insert(v2).second, map.insert(v2)); // Another key
+  GTEST_ASSERT_EQ(map.size(), 2);
+}
+
+TEST (ConcurrentHashMapTest, Edit) {
+  metall::container::concurrent_hash_map<char, int> map;
+
+  {
+    auto ret = map.scoped_edit('a');
+    ret.first = 10;
+  }
+  GTEST_ASSERT_EQ(map.find('a')->second, 10);
+
+  map.edit('a', [](int &v) { v += 1; });
+  map.edit('b', [](int &v) { v = 2; });
+  GTEST_ASSERT_EQ(map.find('a')->second, 11);
+  GTEST_ASSERT_EQ(map.find('b')->second, 2);
+  GTEST_ASSERT_EQ(map.size(), 2);
+}
+
+// Inserts and erases enough keys to trigger growth and rehashing with deleted slots
+TEST (ConcurrentHashMapTest, InsertErase) {
+  std::unordered_map<uint64_t, uint64_t> ref_map;
+  metall::container::concurrent_hash_map<uint64_t, uint64_t, metall::utility::hash<uint64_t>,
+                                         std::equal_to<uint64_t>,
+                                         std::allocator<std::pair<const uint64_t, uint64_t>>, 4> map;
+
+  for (uint64_t i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(map.insert(std::make_pair(i, i * 2)));
+    ref_map.emplace(i, i * 2);
+  }
+  for (uint64_t i = 0; i < 10000; i += 3) {
+    GTEST_ASSERT_EQ(map.erase(i), 1);
+    GTEST_ASSERT_EQ(map.erase(i), 0);
+    ref_map.erase(i);
+  }
+  for (uint64_t i = 10000; i < 20000; ++i) {
+    ASSERT_TRUE(map.try_emplace(i, i * 2));
+    ref_map.emplace(i, i * 2);
+  }
+
+  GTEST_ASSERT_EQ(map.size(), ref_map.size());
+  for (uint64_t i = 0; i < 20000; ++i) {
+    GTEST_ASSERT_EQ(map.count(i), ref_map.count(i));
+    if (ref_map.count(i)) {
+      GTEST_ASSERT_EQ(map.find(i)->second, ref_map.at(i));
+    } else {
+      GTEST_ASSERT_EQ(map.find(i), map.cend());
+    }
+  }
+
+  std::size_t num_elems = 0;
+  for (const auto &elem : map) {
+    GTEST_ASSERT_EQ(ref_map.at(elem.first), elem.second);
+    ++num_elems;
+  }
+  GTEST_ASSERT_EQ(num_elems, ref_map.size());
+
+  map.clear();
+  GTEST_ASSERT_EQ(map.size(), 0);
+  GTEST_ASSERT_EQ(map.cbegin(), map.cend());
+}
+
+TEST (ConcurrentHashMapTest, Reserve) {
+  map_type map;
+  map.reserve(100000);
+  const auto capacity = map.capacity();
+  GTEST_ASSERT_GE(capacity, 100000);
+  for (uint64_t i = 0; i < 50000; ++i) {
+    map.insert(std::make_pair(i, i));
+  }
+  GTEST_ASSERT_EQ(map.capacity(), capacity);
+}
+
+TEST (ConcurrentHashMapTest, ConcurrentInsert) {
+  map_type map;
+
+  constexpr uint64_t k_num_keys = 100000;
+  constexpr int k_num_threads = 4;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < k_num_threads; ++t) {
+    // Every thread inserts every key; only one insertion per key must succeed
+    threads.emplace_back([&map]() {
+      for (uint64_t i = 0; i < k_num_keys; ++i) {
+        map.insert(std::make_pair(i, i));
+        map.edit(k_num_keys + i % 100, [](uint64_t &v) { ++v; });
+      }
+    });
+  }
+  // size() can be called concurrently with insertions; elements are never erased here
+  std::atomic<bool> done(false);
+  std::thread reader([&map, &done]() {
+    std::size_t last_size = 0;
+    while (!done.load()) {
+      const auto size = map.size();
+      GTEST_ASSERT_GE(size, last_size);
+      GTEST_ASSERT_LE(size, k_num_keys + 100);
+      last_size = size;
+    }
+  });
+  for (auto &th : threads) th.join();
+  done.store(true);
+  reader.join();
+
+  GTEST_ASSERT_EQ(map.size(), k_num_keys + 100);
+  for (uint64_t i = 0; i < k_num_keys; ++i) {
+    GTEST_ASSERT_EQ(map.find(i)->second, i);
+  }
+  for (uint64_t i = k_num_keys; i < k_num_keys + 100; ++i) {
+    GTEST_ASSERT_EQ(map.find(i)->second, k_num_keys * k_num_threads / 100);
+  }
+}
+
+TEST (ConcurrentHashMapTest, ForEachParallel) {
+  map_type map;
+  uint64_t ref_sum = 0;
+  for (uint64_t i = 0; i < 10000; ++i) {
+    map.insert(std::make_pair(i, i * 2));
+    ref_sum += i * 2;
+  }
+  map.erase(0);
+  map.erase(1);
+
+  for (const std::size_t num_threads : {0, 1, 3, 8}) {
+    std::atomic<uint64_t> sum(0);
+    std::atomic<std::size_t> count(0);
+    map.for_each_parallel([&sum, &count](const auto &element) {
+      GTEST_ASSERT_EQ(element.second, element.first * 2);
+      sum += element.second;
+      ++count;
+    }, num_threads);
+    GTEST_ASSERT_EQ(count.load(), map.size());
+    GTEST_ASSERT_EQ(sum.load(), ref_sum - 2);
+  }
+}
+
+TEST (ConcurrentHashMapTest, Persistence) {
+  using allocator_type = metall::manager::allocator_type<std::pair<const uint64_t, uint64_t>>;
+  using persistent_map_type = metall::container::concurrent_hash_map<uint64_t, uint64_t,
+                                                                     metall::utility::hash<uint64_t>,
+                                                                     std::equal_to<uint64_t>,
+                                                                     allocator_type>;
+
+  const std::string dir_path(test_utility::make_test_dir_path("ConcurrentHashMapTest"));
+  metall::manager::remove(dir_path.c_str());
+
+  constexpr uint64_t k_num_keys = 100000;
+  {
+    metall::manager manager(metall::create_only, dir_path.c_str());
+    auto pmap = manager.construct<persistent_map_type>("map")(manager.get_allocator());
+    for (uint64_t i = 0; i < k_num_keys; ++i) {
+      pmap->insert(std::make_pair(i, i + 1));
+    }
+  }
+
+  {
+    metall::manager manager(metall::open_only, dir_path.c_str());
+    auto pmap = manager.find<persistent_map_type>("map").first;
+    GTEST_ASSERT_NE(pmap, nullptr);
+    GTEST_ASSERT_EQ(pmap->size(), k_num_keys);
+    for (uint64_t i = 0; i < k_num_keys; ++i) {
+      GTEST_ASSERT_EQ(pmap->find(i)->second, i + 1);
+    }
+    ASSERT_TRUE(manager.destroy<persistent_map_type>("map"));
+  }
+}
+}
@@ -5,9 +5,15 @@
 
 #include "gtest/gtest.h"
 
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
 #include <boost/interprocess/managed_mapped_file.hpp>
 #include <boost/interprocess/allocators/allocator.hpp>
 #include <boost/container/map.hpp>
+#include <metall/metall.hpp>
 #include <metall_container/concurrent_map.hpp>
 #include <metall/detail/utility/file.hpp>
 #include "../test_utility.hpp"
@@ -79,6 +85,31 @@ TEST (ConcurrentMapTest, SequentialEdit) {
   GTEST_ASSERT_EQ(ref_map.count(v2.first), map.count(v2.first));
 }
 
+TEST (ConcurrentMapTest, Copy) {
+  metall::container::concurrent_map<char, int> map;
+  map.insert(std::make_pair('a', 0));
+  map.insert(std::make_pair('b', 1));
+
+  metall::container::concurrent_map<char, int> copied_map(map);
+  GTEST_ASSERT_EQ(copied_map.size(), 2);
+  GTEST_ASSERT_EQ(copied_map.find('b')->second, 1);
+
+  map.insert(std::make_pair('c', 2));
+  GTEST_ASSERT_EQ(copied_map.size(), 2);
+  GTEST_ASSERT_EQ(copied_map.count('c'), 0);
+
+  copied_map = map;
+  GTEST_ASSERT_EQ(copied_map.size(), 3);
+  GTEST_ASSERT_EQ(copied_map.find('c')->second, 2);
+
+  {
+    metall::container::concurrent_map<char, int>::scoped_edit_lock_type lock = copied_map.scoped_edit('d').second;
+    GTEST_ASSERT_TRUE(lock.owns_lock());
+  }
+  GTEST_ASSERT_EQ(copied_map.size(), 4);
+  GTEST_ASSERT_EQ(map.size(), 3);
+}
+
 TEST (ConcurrentMapTest, Find) {
   boost::container::map<char, int> ref_map;
   metall::container::concurrent_map<char, int> map;
@@ -161,4 +192,141 @@ TEST (ConcurrentMapTest, Persistence) {
     }
   }
 }
+
+TEST (ConcurrentMapTest, ConcurrentEditAndCount) {
+  using map_type = metall::container::concurrent_map<uint64_t, uint64_t>;
+  map_type map0;
+  map_type map1;
+
+  constexpr uint64_t k_num_keys = 10000;
+  constexpr int k_num_threads = 4;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < k_num_threads; ++t) {
+    threads.emplace_back([&map0, &map1, t]() {
+      auto &map = (t % 2) ? map1 : map0;
+      for (uint64_t i = 0; i < k_num_keys; ++i) {
+        map.edit(i, [](uint64_t &v) { ++v; });
+        GTEST_ASSERT_EQ(map.count(i), 1);
+      }
+    });
+  }
+  for (auto &th : threads) th.join();
+
+  for (const auto *map : {&map0, &map1}) {
+    GTEST_ASSERT_EQ(map->size(), k_num_keys);
+    for (uint64_t i = 0; i < k_num_keys; ++i) {
+      GTEST_ASSERT_EQ(map->find(i)->second, k_num_threads / 2);
+    }
+  }
+}
+
+TEST (ConcurrentMapTest, BulkInsert) {
+  using map_type = metall::container::concurrent_map<uint64_t, uint64_t>;
+
+  // Has duplicate keys; the first element of each key is kept
+  std::vector<std::pair<uint64_t, uint64_t>> inputs;
+  for (uint64_t i = 0; i < 100000; ++i) {
+    inputs.emplace_back((i * 7919) % 30000, i);
+  }
+
+  for (const std::size_t num_threads : {0, 1, 3, 8}) {
+    map_type map;
+    map.insert(std::make_pair(5, 123)); // An existing element is not overwritten
+    boost::container::map<uint64_t, uint64_t> ref_map{{5, 123}};
+    for (const auto &elem : inputs) ref_map.insert(elem);
+
+    GTEST_ASSERT_EQ(map.bulk_insert(inputs.begin(), inputs.end(), num_threads), ref_map.size() - 1);
+    GTEST_ASSERT_EQ(map.size(), ref_map.size());
+    for (const auto &elem : ref_map) {
+      GTEST_ASSERT_EQ(map.find(elem.first)->second, elem.second);
+    }
+
+    GTEST_ASSERT_EQ(map.bulk_insert(inputs.begin(), inputs.end(), num_threads), 0);
+    GTEST_ASSERT_EQ(map.size(), ref_map.size());
+  }
+}
+
+TEST (ConcurrentMapTest, PartitionRangeAndForEachParallel) {
+  metall::container::concurrent_map<uint64_t, uint64_t> map;
+  uint64_t ref_sum = 0;
+  for (uint64_t i = 0; i < 10000; ++i) {
+    map.insert(std::make_pair(i, i * 2));
+    ref_sum += i * 2;
+  }
+
+  for (const std::size_t num_partitions : {1, 3, 7, 2000}) {
+    std::vector<uint64_t> keys;
+    for (std::size_t p = 0; p < num_partitions; ++p) {
+      const auto range = map.partition_range(p, num_partitions);
+      for (auto itr = range.first; itr != range.second; ++itr) {
+        keys.push_back(itr->first);
+      }
+    }
+    std::sort(keys.begin(), keys.end());
+    GTEST_ASSERT_EQ(keys.size(), 10000);
+    for (uint64_t i = 0; i < 10000; ++i) {
+      GTEST_ASSERT_EQ(keys[i], i);
+    }
+  }
+
+  for (const std::size_t num_threads : {0, 1, 3, 8}) {
+    std::atomic<uint64_t> sum(0);
+    std::atomic<std::size_t> count(0);
+    map.for_each_parallel([&sum, &count](const auto &element) {
+      GTEST_ASSERT_EQ(element.second, element.first * 2);
+      sum += element.second;
+      ++count;
+    }, num_threads);
+    GTEST_ASSERT_EQ(count.load(), 10000);
+    GTEST_ASSERT_EQ(sum.load(), ref_sum);
+  }
+}
+
+// The locks are not stored in the map, i.e., a map in a data store opened with read only mode can be read
+TEST (ConcurrentMapTest, ReadOnly) {
+  using allocator_type = metall::manager::allocator_type<std::pair<const char, int>>;
+  using map_type = metall::container::concurrent_map<char, int, std::less<char>, std::hash<char>, allocator_type>;
+
+  const std::string dir_path(test_utility::make_test_dir_path("concurrent_map_read_only"));
+  metall::manager::remove(dir_path.c_str());
+  {
+    metall::manager manager(metall::create_only, dir_path.c_str());
+    auto pmap = manager.construct<map_type>("map")(manager.get_allocator());
+    pmap->insert(std::make_pair('a', 1));
+  }
+
+  {
+    metall::manager manager(metall::open_read_only, dir_path.c_str());
+    const auto pmap = manager.find<map_type>("map").first;
+    GTEST_ASSERT_NE(pmap, nullptr);
+    GTEST_ASSERT_EQ(pmap->count('a'), 1);
+    GTEST_ASSERT_EQ(pmap->find('a')->second, 1);
+    GTEST_ASSERT_EQ(pmap->count('b'), 0);
+  }
+}
+
+// The locks of a map in a data store are released when the data store is closed
+TEST (ConcurrentMapTest, ReleaseLocksOnClose) {
+  using allocator_type = metall::manager::allocator_type<std::pair<const char, int>>;
+  using map_type = metall::container::concurrent_map<char, int, std::less<char>, std::hash<char>, allocator_type>;
+
+  const std::string dir_path(test_utility::make_test_dir_path("concurrent_map_release_locks"));
+  metall::manager::remove(dir_path.c_str());
+  const auto num_tables = metall::utility::mutex::instance_lock_registry::size();
+  {
+    metall::manager manager(metall::create_only, dir_path.c_str());
+    auto pmap = manager.construct<map_type>("map")(manager.get_allocator());
+    pmap->insert(std::make_pair('a', 1));
+    GTEST_ASSERT_EQ(metall::utility::mutex::instance_lock_registry::size(), num_tables + 1);
+  }
+  GTEST_ASSERT_EQ(metall::utility::mutex::instance_lock_registry::size(), num_tables);
+
+  for (int i = 0; i < 3; ++i) {
+    metall::manager manager(metall::open_only, dir_path.c_str());
+    auto pmap = manager.find<map_type>("map").first;
+    pmap->insert(std::make_pair('b' + i, i));
+    GTEST_ASSERT_EQ(pmap->count('a'), 1);
+  }
+  GTEST_ASSERT_EQ(metall::utility::mutex::instance_lock_registry::size(), num_tables);
+}
 }
@@ -0,0 +1,217 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include <metall/metall.hpp>
+#include <metall_container/concurrent_vector.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+
+TEST (ConcurrentVectorTest, PushBack) {
+  metall::container::concurrent_vector<int> vec;
+  ASSERT_TRUE(vec.empty());
+
+  std::vector<const int *> addresses;
+  for (int i = 0; i < 10000; ++i) {
+    GTEST_ASSERT_EQ(vec.push_back(i), (std::size_t)i);
+    addresses.push_back(&vec[i]);
+  }
+  GTEST_ASSERT_EQ(vec.size(), 10000);
+  GTEST_ASSERT_GE(vec.capacity(), 10000);
+
+  for (int i = 0; i < 10000; ++i) {
+    GTEST_ASSERT_EQ(vec[i], i);
+    GTEST_ASSERT_EQ(&vec[i], addresses[i]); // Elements are never moved
+  }
+
+  int expected = 0;
+  for (const auto value : vec) {
+    GTEST_ASSERT_EQ(value, expected++);
+  }
+  GTEST_ASSERT_EQ(vec.cend() - vec.cbegin(), 10000);
+
+  vec.clear();
+  GTEST_ASSERT_EQ(vec.size(), 0);
+  GTEST_ASSERT_EQ(vec.capacity(), 0);
+}
+
+TEST (ConcurrentVectorTest, GrowBy) {
+  metall::container::concurrent_vector<std::string> vec;
+  vec.push_back("a");
+  GTEST_ASSERT_EQ(vec.grow_by(100, "b"), 1);
+  GTEST_ASSERT_EQ(vec.emplace_back(3, 'c'), 101);
+  GTEST_ASSERT_EQ(vec.size(), 102);
+  GTEST_ASSERT_EQ(vec[0], "a");
+  for (std::size_t i = 1; i <= 100; ++i) {
+    GTEST_ASSERT_EQ(vec[i], "b");
+  }
+  GTEST_ASSERT_EQ(vec[101], "ccc");
+}
+
+TEST (ConcurrentVectorTest, GrowByZero) {
+  metall::container::concurrent_vector<int> vec;
+  GTEST_ASSERT_EQ(vec.grow_by(0), 0);
+  GTEST_ASSERT_EQ(vec.size(), 0);
+  GTEST_ASSERT_EQ(vec.capacity(), 0);
+
+  vec.push_back(1);
+  GTEST_ASSERT_EQ(vec.grow_by(0), 1);
+  GTEST_ASSERT_EQ(vec.size(), 1);
+}
+
+TEST (ConcurrentVectorTest, Reserve) {
+  metall::container::concurrent_vector<int> vec;
+  vec.reserve(1000);
+  const auto capacity = vec.capacity();
+  GTEST_ASSERT_GE(capacity, 1000);
+  for (int i = 0; i < 1000; ++i) {
+    vec.push_back(i);
+  }
+  GTEST_ASSERT_EQ(vec.capacity(), capacity);
+}
+
+TEST (ConcurrentVectorTest, ConcurrentAppend) {
+  metall::container::concurrent_vector<uint64_t> vec;
+
+  constexpr uint64_t k_num_appends = 100000;
+  constexpr int k_num_threads = 4;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < k_num_threads; ++t) {
+    threads.emplace_back([&vec, t]() {
+      for (uint64_t i = 0; i < k_num_appends; ++i) {
+        if (i % 100 == 0) {
+          const auto begin = vec.grow_by(10, t * k_num_appends + i);
+          for (std::size_t k = begin; k < begin + 10; ++k) {
+            GTEST_ASSERT_EQ(vec[k], t * k_num_appends + i);
+          }
+        } else {
+          const auto index = vec.push_back(t * k_num_appends + i);
+          GTEST_ASSERT_EQ(vec[index], t * k_num_appends + i);
+        }
+      }
+    });
+  }
+  for (auto &th : threads) th.join();
+
+  GTEST_ASSERT_EQ(vec.size(), k_num_threads * (k_num_appends + k_num_appends / 100 * 9));
+  std::vector<uint64_t> values(vec.begin(), vec.end());
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+  GTEST_ASSERT_EQ(values.size(), k_num_threads * k_num_appends);
+}
+
+// Elements [0, size()) are constructed while other threads append
+TEST (ConcurrentVectorTest, ReadWhileAppending) {
+  metall::container::concurrent_vector<std::string> vec;
+
+  constexpr std::size_t k_num_appends = 20000;
+  constexpr int k_num_threads = 3;
+  const std::string value(64, 'a'); // Not stored in the string object
+  std::atomic<bool> done{false};
+  std::thread reader([&vec, &value, &done]() {
+    while (!done.load()) {
+      const auto size = vec.size();
+      for (std::size_t i = 0; i < size; ++i) {
+        GTEST_ASSERT_EQ(vec[i], value);
+      }
+      const auto end = vec.end(); // size() can grow between two calls
+      GTEST_ASSERT_EQ(std::count(vec.begin(), end, value), end - vec.begin());
+    }
+  });
+
+  std::vector<std::thread> writers;
+  for (int t = 0; t < k_num_threads; ++t) {
+    writers.emplace_back([&vec, &value]() {
+      for (std::size_t i = 0; i < k_num_appends; ++i) {
+        if (i % 100 == 0) {
+          vec.grow_by(10, value);
+        } else {
+          vec.push_back(value);
+        }
+      }
+    });
+  }
+  for (auto &th : writers) th.join();
+  done.store(true);
+  reader.join();
+
+  GTEST_ASSERT_EQ(vec.size(), k_num_threads * (k_num_appends + k_num_appends / 100 * 9));
+}
+
+// An element whose constructor waits until the gate is opened
+struct gated_value {
+  gated_value() = default;
+
+  gated_value(std::atomic<bool> *const entered, const std::atomic<bool> *const gate) {
+    entered->store(true);
+    while (!gate->load()) std::this_thread::yield();
+  }
+};
+
+// An appending thread does not wait for a thread that is still constructing a preceding element
+TEST (ConcurrentVectorTest, AppendWhileConstructing) {
+  metall::container::concurrent_vector<gated_value> vec;
+  vec.push_back(gated_value());
+
+  std::atomic<bool> entered{false};
+  std::atomic<bool> gate{false};
+  std::thread slow([&vec, &entered, &gate]() {
+    GTEST_ASSERT_EQ(vec.emplace_back(&entered, &gate), 1);
+  });
+  while (!entered.load()) std::this_thread::yield();
+
+  constexpr std::size_t k_num_appends = 1000; // Also allocates new segments
+  for (std::size_t i = 0; i < k_num_appends; ++i) {
+    vec.push_back(gated_value());
+  }
+  GTEST_ASSERT_EQ(vec.size(), 1); // Not published until the preceding element is constructed
+
+  gate.store(true);
+  slow.join();
+  GTEST_ASSERT_EQ(vec.size(), k_num_appends + 2);
+}
+
+TEST (ConcurrentVectorTest, Persistence) {
+  using vector_type = metall::container::concurrent_vector<uint64_t, metall::manager::allocator_type<uint64_t>>;
+
+  const std::string dir_path(test_utility::make_test_dir_path("ConcurrentVectorTest"));
+  metall::manager::remove(dir_path.c_str());
+
+  constexpr uint64_t k_num_elements = 100000;
+  {
+    metall::manager manager(metall::create_only, dir_path.c_str());
+    auto pvec = manager.construct<vector_type>("vec")(manager.get_allocator());
+    for (uint64_t i = 0; i < k_num_elements; ++i) {
+      pvec->push_back(i);
+    }
+  }
+
+  {
+    metall::manager manager(metall::open_read_only, dir_path.c_str());
+    const auto pvec = manager.find<vector_type>("vec").first;
+    GTEST_ASSERT_NE(pvec, nullptr);
+    GTEST_ASSERT_EQ(pvec->size(), k_num_elements);
+    for (uint64_t i = 0; i < k_num_elements; ++i) {
+      GTEST_ASSERT_EQ((*pvec)[i], i);
+    }
+  }
+
+  {
+    metall::manager manager(metall::open_only, dir_path.c_str());
+    auto pvec = manager.find<vector_type>("vec").first;
+    pvec->push_back(k_num_elements);
+    GTEST_ASSERT_EQ((*pvec)[k_num_elements], k_num_elements);
+    ASSERT_TRUE(manager.destroy<vector_type>("vec"));
+  }
+}
+}
@@ -0,0 +1,145 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+#include <forward_list>
+#include <random>
+#include <algorithm>
+
+#include <metall/metall.hpp>
+#include <metall_container/csr_graph.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+
+using edge_list_type = std::vector<std::pair<uint64_t, uint64_t>>;
+
+edge_list_type generate_edges(const uint64_t num_vertices, const std::size_t num_edges) {
+  edge_list_type edges;
+  std::mt19937_64 rand_engine(123);
+  std::uniform_int_distribution<uint64_t> dist(0, num_vertices - 1);
+  for (std::size_t i = 0; i < num_edges; ++i) {
+    edges.emplace_back(dist(rand_engine), dist(rand_engine));
+  }
+  return edges;
+}
+
+template <typename view_type>
+void validate(const view_type &view, const uint64_t num_vertices, edge_list_type edges) {
+  GTEST_ASSERT_EQ(view.num_vertices(), num_vertices);
+  GTEST_ASSERT_EQ(view.num_edges(), edges.size());
+
+  std::sort(edges.begin(), edges.end());
+  edge_list_type csr_edges;
+  for (uint64_t v = 0; v < num_vertices; ++v) {
+    GTEST_ASSERT_EQ(view.neighbors_end(v) - view.neighbors_begin(v), (std::ptrdiff_t)view.degree(v));
+    GTEST_ASSERT_EQ(view.num_values(v), view.degree(v));
+    for (auto itr = view.values_begin(v); itr != view.values_end(v); ++itr) {
+      csr_edges.emplace_back(v, *itr);
+    }
+  }
+  std::sort(csr_edges.begin(), csr_edges.end());
+  GTEST_ASSERT_EQ(csr_edges, edges);
+}
+
+TEST (CsrGraphTest, Build) {
+  constexpr uint64_t k_num_vertices = 1000;
+  const auto edges = generate_edges(k_num_vertices, 20000);
+
+  for (const std::size_t num_threads : {0, 1, 3, 8}) {
+    metall::container::csr_graph<> graph;
+    graph.build(k_num_vertices, edges.begin(), edges.end(), num_threads);
+    GTEST_ASSERT_EQ(graph.num_vertices(), k_num_vertices);
+    GTEST_ASSERT_EQ(graph.num_edges(), edges.size());
+    validate(graph.view(), k_num_vertices, edges);
+  }
+}
+
+// Edges that can only be read sequentially
+TEST (CsrGraphTest, BuildFromForwardIterator) {
+  constexpr uint64_t k_num_vertices = 1000;
+  const auto edges = generate_edges(k_num_vertices, 20000);
+  const std::forward_list<std::pair<uint64_t, uint64_t>> edge_stream(edges.begin(), edges.end());
+
+  metall::container::csr_graph<> graph;
+  graph.build(k_num_vertices, edge_stream.begin(), edge_stream.end(), 3);
+  validate(graph.view(), k_num_vertices, edges);
+}
+
+// Partitions of sequential edge sources are read in parallel
+TEST (CsrGraphTest, BuildPartitioned) {
+  constexpr uint64_t k_num_vertices = 1000;
+  const auto edges = generate_edges(k_num_vertices, 20000);
+  constexpr std::size_t k_num_partitions = 7;
+  std::vector<std::forward_list<std::pair<uint64_t, uint64_t>>> edge_streams(k_num_partitions);
+  for (std::size_t i = 0; i < edges.size(); ++i) {
+    edge_streams[edges[i].first % k_num_partitions].push_front(edges[i]);
+  }
+
+  for (const std::size_t num_threads : {0, 1, 3, 8}) {
+    metall::container::csr_graph<> graph;
+    graph.build_partitioned(k_num_vertices, k_num_partitions, [&edge_streams](const std::size_t partition_no) {
+      return std::make_pair(edge_streams[partition_no].begin(), edge_streams[partition_no].end());
+    }, num_threads);
+    validate(graph.view(), k_num_vertices, edges);
+  }
+}
+
+TEST (CsrGraphTest, SortNeighbors) {
+  constexpr uint64_t k_num_vertices = 100;
+  const auto edges = generate_edges(k_num_vertices, 5000);
+
+  metall::container::csr_graph<> graph;
+  graph.build(k_num_vertices, edges.begin(), edges.end(), 4, true);
+  const auto view = graph.view();
+  for (uint64_t v = 0; v < k_num_vertices; ++v) {
+    ASSERT_TRUE(std::is_sorted(view.neighbors_begin(v), view.neighbors_end(v)));
+  }
+  validate(view, k_num_vertices, edges);
+}
+
+TEST (CsrGraphTest, Rebuild) {
+  metall::container::csr_graph<uint32_t, uint32_t> graph;
+  const std::vector<std::pair<uint32_t, uint32_t>> edges0{{0, 1}, {0, 2}, {2, 0}};
+  graph.build(3, edges0.begin(), edges0.end(), 2);
+  GTEST_ASSERT_EQ(graph.view().degree(0), 2);
+  GTEST_ASSERT_EQ(graph.view().degree(1), 0);
+  GTEST_ASSERT_EQ(graph.view().num_values(10), 0); // Out of range
+
+  const std::vector<std::pair<uint32_t, uint32_t>> edges1;
+  graph.build(5, edges1.begin(), edges1.end(), 2);
+  GTEST_ASSERT_EQ(graph.num_vertices(), 5);
+  GTEST_ASSERT_EQ(graph.num_edges(), 0);
+
+  graph.clear();
+  GTEST_ASSERT_EQ(graph.num_vertices(), 0);
+  GTEST_ASSERT_EQ(graph.view().num_edges(), 0);
+}
+
+TEST (CsrGraphTest, Persistence) {
+  using graph_type = metall::container::csr_graph<uint64_t, uint64_t, metall::manager::allocator_type<std::byte>>;
+
+  const std::string dir_path(test_utility::make_test_dir_path("CsrGraphTest"));
+  metall::manager::remove(dir_path.c_str());
+
+  constexpr uint64_t k_num_vertices = 1000;
+  const auto edges = generate_edges(k_num_vertices, 20000);
+  {
+    metall::manager manager(metall::create_only, dir_path.c_str());
+    auto graph = manager.construct<graph_type>("graph")(manager.get_allocator());
+    graph->build(k_num_vertices, edges.begin(), edges.end(), 4);
+  }
+
+  {
+    metall::manager manager(metall::open_read_only, dir_path.c_str());
+    const auto graph = manager.find<graph_type>("graph").first;
+    GTEST_ASSERT_NE(graph, nullptr);
+    validate(graph->view(), k_num_vertices, edges);
+  }
+}
+}
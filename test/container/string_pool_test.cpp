@@ -0,0 +1,163 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <metall/metall.hpp>
+#include <metall_container/string_pool.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+
+TEST (StringPoolTest, Intern) {
+  metall::container::string_pool<> pool;
+  ASSERT_TRUE(pool.empty());
+
+  const auto a = pool.intern("apple");
+  const auto b = pool.intern("banana");
+  GTEST_ASSERT_EQ(a, 0);
+  GTEST_ASSERT_EQ(b, 1);
+  GTEST_ASSERT_EQ(pool.intern("apple"), a);
+  GTEST_ASSERT_EQ(pool.intern(std::string("banana")), b);
+  GTEST_ASSERT_EQ(pool.size(), 2);
+
+  GTEST_ASSERT_EQ(pool.view(a), "apple");
+  GTEST_ASSERT_EQ(std::string(pool.c_str(b)), "banana");
+
+  GTEST_ASSERT_EQ(pool.find("apple"), a);
+  GTEST_ASSERT_EQ(pool.find("cherry"), decltype(pool)::k_invalid_handle);
+
+  // Empty strings and strings with null characters
+  const auto empty = pool.intern("");
+  GTEST_ASSERT_EQ(pool.view(empty), "");
+  const std::string with_null("a\0b", 3);
+  const auto null_handle = pool.intern(with_null);
+  GTEST_ASSERT_NE(null_handle, pool.intern("a"));
+  GTEST_ASSERT_EQ(pool.view(null_handle), with_null);
+}
+
+TEST (StringPoolTest, ManyStrings) {
+  // Uses small arenas to allocate many arenas and a block for a long string
+  metall::container::string_pool<uint64_t, std::allocator<char>, 4, 64> pool;
+
+  std::vector<std::string> strings;
+  for (int i = 0; i < 10000; ++i) {
+    strings.push_back("label-" + std::to_string(i));
+  }
+  strings.push_back(std::string(1000, 'x'));
+
+  for (std::size_t i = 0; i < strings.size(); ++i) {
+    GTEST_ASSERT_EQ(pool.intern(strings[i]), i);
+  }
+  for (std::size_t i = 0; i < strings.size(); ++i) {
+    GTEST_ASSERT_EQ(pool.intern(strings[i]), i);
+    GTEST_ASSERT_EQ(pool.view(i), strings[i]);
+  }
+  GTEST_ASSERT_EQ(pool.size(), strings.size());
+
+  pool.clear();
+  ASSERT_TRUE(pool.empty());
+  GTEST_ASSERT_EQ(pool.find(strings[0]), decltype(pool)::k_invalid_handle);
+  GTEST_ASSERT_EQ(pool.intern(strings[1]), 0);
+}
+
+TEST (StringPoolTest, ConcurrentIntern) {
+  metall::container::string_pool<> pool;
+
+  constexpr int k_num_strings = 10000;
+  constexpr int k_num_threads = 4;
+  std::vector<std::vector<uint32_t>> handles(k_num_threads, std::vector<uint32_t>(k_num_strings));
+  std::vector<std::thread> threads;
+  for (int t = 0; t < k_num_threads; ++t) {
+    threads.emplace_back([&pool, &handles, t]() {
+      // All threads intern the same strings in different orders
+      for (int i = 0; i < k_num_strings; ++i) {
+        const int n = (t % 2) ? i : k_num_strings - i - 1;
+        const std::string str = "label-" + std::to_string(n);
+        handles[t][n] = pool.intern(str);
+        GTEST_ASSERT_EQ(pool.view(handles[t][n]), str);
+      }
+    });
+  }
+  for (auto &th : threads) th.join();
+
+  GTEST_ASSERT_EQ(pool.size(), k_num_strings);
+  for (int t = 1; t < k_num_threads; ++t) {
+    GTEST_ASSERT_EQ(handles[t], handles[0]);
+  }
+}
+
+TEST (StringPoolTest, ViewWhileInterning) {
+  metall::container::string_pool<> pool;
+
+  constexpr int k_num_strings = 10000;
+  constexpr int k_num_threads = 3;
+  std::atomic<bool> done{false};
+  std::thread reader([&pool, &done]() {
+    while (!done.load()) {
+      const auto size = pool.size();
+      for (std::size_t h = 0; h < size; ++h) {
+        GTEST_ASSERT_EQ(pool.view(h).substr(0, 6), "label-");
+      }
+    }
+  });
+
+  std::vector<std::thread> writers;
+  for (int t = 0; t < k_num_threads; ++t) {
+    writers.emplace_back([&pool, t]() {
+      for (int i = 0; i < k_num_strings; ++i) {
+        pool.intern("label-" + std::to_string(t) + "-" + std::to_string(i));
+      }
+    });
+  }
+  for (auto &th : writers) th.join();
+  done.store(true);
+  reader.join();
+
+  GTEST_ASSERT_EQ(pool.size(), k_num_threads * k_num_strings);
+}
+
+TEST (StringPoolTest, Persistence) {
+  using pool_type = metall::container::string_pool<uint32_t, metall::manager::allocator_type<char>>;
+
+  const std::string dir_path(test_utility::make_test_dir_path("StringPoolTest"));
+  metall::manager::remove(dir_path.c_str());
+
+  constexpr int k_num_strings = 10000;
+  {
+    metall::manager manager(metall::create_only, dir_path.c_str());
+    auto pool = manager.construct<pool_type>("pool")(manager.get_allocator());
+    for (int i = 0; i < k_num_strings; ++i) {
+      pool->intern("label-" + std::to_string(i));
+    }
+  }
+
+  // The locks are not stored in the pool, i.e., a pool in a data store opened with read only mode can be read
+  {
+    metall::manager manager(metall::open_read_only, dir_path.c_str());
+    const auto pool = manager.find<pool_type>("pool").first;
+    GTEST_ASSERT_NE(pool, nullptr);
+    GTEST_ASSERT_EQ(pool->size(), k_num_strings);
+    for (int i = 0; i < k_num_strings; ++i) {
+      const std::string str = "label-" + std::to_string(i);
+      GTEST_ASSERT_EQ(pool->find(str), (uint32_t)i);
+      GTEST_ASSERT_EQ(pool->view(i), str);
+    }
+  }
+
+  {
+    metall::manager manager(metall::open_only, dir_path.c_str());
+    auto pool = manager.find<pool_type>("pool").first;
+    GTEST_ASSERT_EQ(pool->intern("label-0"), 0);
+    GTEST_ASSERT_EQ(pool->intern("new label"), k_num_strings);
+    ASSERT_TRUE(manager.destroy<pool_type>("pool"));
+  }
+}
+}
@@ -0,0 +1,176 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#define METALL_ENABLE_CHECKSUM
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include <metall/metall.hpp>
+#include <metall/detail/utility/crc32c.hpp>
+#include <metall/detail/utility/write_tracker.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+namespace util = metall::detail::utility;
+
+using chunk_no_type = uint32_t;
+static constexpr std::size_t k_chunk_size = 1 << 21;
+using manager_type = metall::basic_manager<chunk_no_type, k_chunk_size>;
+
+const std::string &dir_path() {
+  const static std::string path(test_utility::make_test_dir_path("ChecksumTest"));
+  return path;
+}
+
+std::string datastore_file_path(const std::string &name) {
+  return dir_path() + "/metall_datastore/" + name;
+}
+
+/// \brief Flips a byte of a file
+void corrupt_file(const std::string &path, const std::size_t offset) {
+  std::fstream fs(path, std::ios::in | std::ios::out | std::ios::binary);
+  ASSERT_TRUE(fs.is_open());
+  fs.seekg(offset);
+  char c;
+  fs.read(&c, 1);
+  c = static_cast<char>(~c);
+  fs.seekp(offset);
+  fs.write(&c, 1);
+  ASSERT_TRUE(fs.good());
+}
+
+void create_data_store() {
+  manager_type::remove(dir_path().c_str());
+  manager_type manager(metall::create_only, dir_path().c_str());
+  auto *const array = manager.construct<char>("array")[k_chunk_size * 2]('a');
+  ASSERT_NE(array, nullptr);
+}
+
+TEST(ChecksumTest, Crc32c) {
+  const char *const message = "123456789";
+  ASSERT_EQ(util::crc32c(message, std::strlen(message)), 0xE3069283U);
+
+  // Long enough for the interleaved streams
+  std::string data(100000, '\0');
+  for (std::size_t i = 0; i < data.size(); ++i) data[i] = static_cast<char>(i * 7);
+  const auto crc = util::crc32c(data.data(), data.size());
+  const auto crc1 = util::crc32c(data.data(), 12345);
+  ASSERT_EQ(util::crc32c(data.data() + 12345, data.size() - 12345, crc1), crc);
+  ASSERT_EQ(util::crc32c_combine(crc1, util::crc32c(data.data() + 12345, data.size() - 12345), data.size() - 12345),
+            crc);
+}
+
+TEST(ChecksumTest, WriteTracker) {
+  const std::size_t granularity = util::get_page_size() * 4;
+  const std::size_t size = granularity * 8;
+  auto *const region = static_cast<char *>(util::map_anonymous_write_mode(nullptr, size));
+  ASSERT_NE(region, nullptr);
+  {
+    util::write_tracker tracker(region, size, granularity);
+    ASSERT_TRUE(tracker.start());
+    for (std::size_t i = 0; i < 8; ++i) ASSERT_TRUE(tracker.dirty(i));
+
+    ASSERT_TRUE(tracker.clean(size));
+    for (std::size_t i = 0; i < 8; ++i) ASSERT_FALSE(tracker.dirty(i));
+
+    region[granularity * 3 + 1] = 1;
+    region[granularity * 3 + 2] = 2; // Does not fault again
+    ASSERT_EQ(region[granularity * 3 + 1], 1);
+    for (std::size_t i = 0; i < 8; ++i) ASSERT_EQ(tracker.dirty(i), i == 3);
+
+    tracker.mark_dirty(granularity * 5, 1);
+    ASSERT_TRUE(tracker.dirty(5));
+    region[granularity * 5] = 1;
+    ASSERT_TRUE(tracker.dirty(8)); // Beyond the tracked range
+  }
+  region[0] = 1; // Writable after the tracker is destructed
+  util::munmap(region, size, false);
+}
+
+TEST(ChecksumTest, Verify) {
+  create_data_store();
+  ASSERT_TRUE(manager_type::verify(dir_path().c_str()));
+  ASSERT_TRUE(manager_type::verify(dir_path().c_str(), 1));
+}
+
+TEST(ChecksumTest, IncrementalUpdate) {
+  create_data_store();
+  for (int i = 0; i < 2; ++i) {
+    {
+      manager_type manager(metall::open_only, dir_path().c_str());
+      auto *const array = manager.find<char>("array").first;
+      ASSERT_NE(array, nullptr);
+      array[k_chunk_size + i] = 'b';
+      manager.construct<int>(std::to_string(i).c_str())(i);
+    }
+    ASSERT_TRUE(manager_type::verify(dir_path().c_str()));
+  }
+
+  {
+    manager_type manager(metall::open_only, dir_path().c_str());
+    auto *const array = manager.find<char>("array").first;
+    array[0] = 'c';
+    manager.flush();
+    ASSERT_FALSE(manager_type::verify(dir_path().c_str())); // Not closed yet
+    array[1] = 'c';
+  }
+  ASSERT_TRUE(manager_type::verify(dir_path().c_str()));
+
+  {
+    manager_type manager(metall::open_read_only, dir_path().c_str());
+    ASSERT_EQ(manager.find<char>("array").first[1], 'c');
+  }
+  ASSERT_TRUE(manager_type::verify(dir_path().c_str()));
+}
+
+TEST(ChecksumTest, Snapshot) {
+  create_data_store();
+  const std::string snapshot_dir_path(test_utility::make_test_dir_path("ChecksumTest_Snapshot"));
+  manager_type::remove(snapshot_dir_path.c_str());
+  {
+    manager_type manager(metall::open_only, dir_path().c_str());
+    manager.find<char>("array").first[0] = 'b';
+    ASSERT_TRUE(manager.snapshot(snapshot_dir_path.c_str()));
+  }
+  ASSERT_TRUE(manager_type::verify(snapshot_dir_path.c_str()));
+  ASSERT_TRUE(manager_type::verify(dir_path().c_str()));
+}
+
+TEST(ChecksumTest, SnapshotAsync) {
+  create_data_store();
+  const std::string snapshot_dir_path(test_utility::make_test_dir_path("ChecksumTest_SnapshotAsync"));
+  manager_type::remove(snapshot_dir_path.c_str());
+  {
+    manager_type manager(metall::open_only, dir_path().c_str());
+    auto *const array = manager.find<char>("array").first;
+    array[0] = 'b';
+    auto result = manager.snapshot_async(snapshot_dir_path.c_str());
+    array[1] = 'b'; // Not in the snapshot
+    ASSERT_TRUE(result.get());
+  }
+  ASSERT_TRUE(manager_type::verify(snapshot_dir_path.c_str()));
+  ASSERT_TRUE(manager_type::verify(dir_path().c_str()));
+}
+
+TEST(ChecksumTest, DetectCorruption) {
+  create_data_store();
+  corrupt_file(datastore_file_path("segment_block-0"), k_chunk_size + 10);
+  ASSERT_FALSE(manager_type::verify(dir_path().c_str()));
+
+  create_data_store();
+  corrupt_file(datastore_file_path("named_object_directory"), 0);
+  ASSERT_FALSE(manager_type::verify(dir_path().c_str()));
+}
+
+TEST(ChecksumTest, NoChecksums) {
+  create_data_store();
+  ASSERT_TRUE(util::remove_file(datastore_file_path("checksums")));
+  ASSERT_FALSE(manager_type::verify(dir_path().c_str()));
+}
+}
@@ -71,6 +71,32 @@ TEST(ChunkDirectoryTest, MarkSlot) {
   }
 }
 
+TEST(ChunkDirectoryTest, InsertAtAndMarkSlot) {
+  std::allocator<char> allocator;
+  chunk_directory_type directory(allocator);
+  directory.allocate(1 << 10);
+
+  const auto large_bin_no = static_cast<typename bin_no_mngr::bin_no_type>(k_num_small_bins + 1);
+  const std::size_t num_large_chunks = (bin_no_mngr::to_object_size(large_bin_no) + k_chunk_size - 1) / k_chunk_size;
+  directory.insert_at(10, 1);
+  directory.insert_at(11, large_bin_no); // Overwrite
+  directory.insert_at(11, 2);
+  ASSERT_EQ(directory.size(), 11 + num_large_chunks); // Tail chunks remain until they are overwritten or erased
+  ASSERT_EQ(directory.bin_no(10), 1);
+  ASSERT_EQ(directory.bin_no(11), 2);
+  ASSERT_EQ(directory.occupied_slots(11), 0);
+
+  ASSERT_TRUE(directory.mark_slot(11, 5));
+  ASSERT_FALSE(directory.mark_slot(11, 5));
+  ASSERT_TRUE(directory.slot_marked(11, 5));
+  ASSERT_EQ(directory.occupied_slots(11), 1);
+  ASSERT_NE(directory.find_and_mark_slot(11), 5);
+
+  directory.erase(11);
+  ASSERT_TRUE(directory.empty_chunk(11));
+  ASSERT_FALSE(directory.empty_chunk(10));
+}
+
 TEST(ChunkDirectoryTest, UnmarkSlot) {
   std::allocator<char> allocator;
   chunk_directory_type directory(allocator);
@@ -0,0 +1,176 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#define METALL_USE_COMPRESSION
+#define METALL_ENABLE_CHECKSUM
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+
+#include <sys/mman.h>
+
+#include <metall/metall.hpp>
+#include <metall/detail/utility/compressed_file.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+namespace util = metall::detail::utility;
+
+using chunk_no_type = uint32_t;
+static constexpr std::size_t k_chunk_size = 1 << 21;
+using manager_type = metall::basic_manager<chunk_no_type, k_chunk_size>;
+
+const std::string &dir_path() {
+  const static std::string path(test_utility::make_test_dir_path("CompressionTest"));
+  return path;
+}
+
+std::string block_file_path(const std::string &base_dir_path, const std::size_t n) {
+  return base_dir_path + "/metall_datastore/segment_block-" + std::to_string(n);
+}
+
+void create_data_store(const std::size_t length) {
+  manager_type::remove(dir_path().c_str());
+  manager_type manager(metall::create_only, dir_path().c_str());
+  auto *const array = manager.construct<uint64_t>("array")[length]();
+  for (std::size_t i = 0; i < length; ++i) array[i] = i % 1024;
+}
+
+void check_data_store(const std::string &base_dir_path, const std::size_t length, const bool read_only) {
+  std::unique_ptr<manager_type> manager;
+  if (read_only) {
+    manager = std::make_unique<manager_type>(metall::open_read_only, base_dir_path.c_str());
+  } else {
+    manager = std::make_unique<manager_type>(metall::open_only, base_dir_path.c_str());
+  }
+  auto result = manager->find<uint64_t>("array");
+  ASSERT_NE(result.first, nullptr);
+  ASSERT_EQ(result.second, length);
+  for (std::size_t i = 0; i < length; ++i) {
+    ASSERT_EQ(result.first[i], i % 1024);
+  }
+}
+
+TEST(CompressionTest, CompressedFile) {
+  ASSERT_TRUE(test_utility::create_test_dir());
+  const std::string path(test_utility::make_test_file_path("CompressionTest_CompressedFile"));
+  const std::size_t frame_size = 1 << 16;
+  const std::size_t size = frame_size * 10 + 100; // The last frame is partial
+
+  std::vector<char> data(size, 0);
+  for (std::size_t i = 0; i < size; ++i) {
+    if (i / frame_size != 3) data[i] = static_cast<char>(i % 7); // Frame 3 is a zero frame
+  }
+  {
+    std::ofstream ofs(path + ".raw", std::ios::binary);
+    ofs.write(data.data(), data.size());
+  }
+
+  ASSERT_TRUE(util::compressed_file::compress(path + ".raw", path, frame_size, 3));
+  ASSERT_EQ(util::compressed_file::get_original_size(path), (ssize_t)size);
+  ASSERT_LT(util::get_file_size(path), (ssize_t)size / 4);
+
+  std::vector<char> buf(size, 0);
+  ASSERT_TRUE(util::compressed_file::decompress(path, buf.data(), buf.size(), 2));
+  ASSERT_EQ(buf, data);
+
+  ASSERT_TRUE(util::compressed_file::decompress(path, path + ".out", 2));
+  std::ifstream ifs(path + ".out", std::ios::binary);
+  std::vector<char> out(size + 1, 1);
+  ifs.read(out.data(), out.size());
+  ASSERT_EQ(ifs.gcount(), (std::streamsize)size);
+  out.resize(size);
+  ASSERT_EQ(out, data);
+}
+
+TEST(CompressionTest, Compress) {
+  const std::size_t length = k_chunk_size; // Spans multiple chunks
+  create_data_store(length);
+  const auto raw_size = util::get_file_size(block_file_path(dir_path(), 0));
+
+  ASSERT_TRUE(manager_type::compress(dir_path().c_str()));
+  ASSERT_FALSE(util::file_exist(block_file_path(dir_path(), 0)));
+  ASSERT_LT(util::get_file_size(block_file_path(dir_path(), 0) + ".z"), raw_size);
+  ASSERT_TRUE(manager_type::verify(dir_path().c_str()));
+
+  check_data_store(dir_path(), length, true);
+  ASSERT_FALSE(util::file_exist(block_file_path(dir_path(), 0))); // Read-only mode does not decompress files
+
+  check_data_store(dir_path(), length, false);
+  ASSERT_TRUE(util::file_exist(block_file_path(dir_path(), 0)));
+  ASSERT_FALSE(util::file_exist(block_file_path(dir_path(), 0) + ".z"));
+  ASSERT_TRUE(manager_type::verify(dir_path().c_str()));
+}
+
+TEST(CompressionTest, OpenOnDemand) {
+  const std::size_t length = k_chunk_size * 2;
+  create_data_store(length);
+  ASSERT_TRUE(manager_type::compress(dir_path().c_str()));
+
+  {
+    manager_type manager(metall::open_read_only, dir_path().c_str());
+    auto *const array = manager.find<uint64_t>("array").first;
+    ASSERT_EQ(array[1], 1);
+
+    // Only the frames that have been accessed are decompressed into memory
+    const std::size_t page_size = util::get_page_size();
+    char *const begin = reinterpret_cast<char *>(util::round_up(reinterpret_cast<uint64_t>(array), page_size));
+    const std::size_t num_pages = length * sizeof(uint64_t) / page_size - 1;
+    std::vector<unsigned char> residency(num_pages, 0);
+    ASSERT_EQ(::mincore(begin, num_pages * page_size, residency.data()), 0);
+    std::size_t num_resident_pages = 0;
+    for (const auto r : residency) num_resident_pages += r & 1;
+    ASSERT_LT(num_resident_pages, num_pages / 2);
+  }
+  ASSERT_FALSE(util::file_exist(block_file_path(dir_path(), 0)));
+
+  check_data_store(dir_path(), length, true);
+  check_data_store(dir_path(), length, false);
+  ASSERT_TRUE(manager_type::compress(dir_path().c_str()));
+  ASSERT_TRUE(manager_type::verify(dir_path().c_str()));
+  check_data_store(dir_path(), length, true);
+}
+
+TEST(CompressionTest, Snapshot) {
+  const std::size_t length = k_chunk_size;
+  create_data_store(length);
+  const std::string snapshot_dir_path(test_utility::make_test_dir_path("CompressionTest_Snapshot"));
+  const std::string async_snapshot_dir_path(test_utility::make_test_dir_path("CompressionTest_SnapshotAsync"));
+  manager_type::remove(snapshot_dir_path.c_str());
+  manager_type::remove(async_snapshot_dir_path.c_str());
+  {
+    manager_type manager(metall::open_only, dir_path().c_str());
+    ASSERT_TRUE(manager.snapshot(snapshot_dir_path.c_str()));
+    ASSERT_TRUE(manager.snapshot_async(async_snapshot_dir_path.c_str()).get());
+  }
+
+  for (const auto &path : {snapshot_dir_path, async_snapshot_dir_path}) {
+    ASSERT_TRUE(util::file_exist(block_file_path(path, 0) + ".z"));
+    ASSERT_FALSE(util::file_exist(block_file_path(path, 0)));
+    ASSERT_TRUE(manager_type::verify(path.c_str()));
+    check_data_store(path, length, true);
+  }
+}
+
+TEST(CompressionTest, CopyCompressed) {
+  const std::size_t length = 1024;
+  create_data_store(length);
+  ASSERT_TRUE(manager_type::compress(dir_path().c_str()));
+
+  const std::string copy_dir_path(test_utility::make_test_dir_path("CompressionTest_CopyCompressed"));
+  manager_type::remove(copy_dir_path.c_str());
+  ASSERT_TRUE(manager_type::copy(dir_path().c_str(), copy_dir_path.c_str()));
+  check_data_store(copy_dir_path, length, false);
+  {
+    manager_type manager(metall::open_only, copy_dir_path.c_str());
+    manager.construct<int>("int")(10);
+  }
+  check_data_store(dir_path(), length, true); // The source is not changed
+}
+}
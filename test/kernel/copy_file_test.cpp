@@ -12,6 +12,7 @@
 #include "../test_utility.hpp"
 
 namespace {
+namespace util = metall::detail::utility;
 
 void create(const std::string &dir_path) {
   metall::manager manager(metall::create_only, dir_path.c_str());
@@ -62,4 +63,50 @@ TEST(CopyFileTest, AsyncCopy) {
 
   open(copy_dir_path());
 }
-}
\ No newline at end of file
+
+TEST(CopyFileTest, ParallelCopy) {
+  metall::manager::remove(original_dir_path().c_str());
+  metall::manager::remove(copy_dir_path().c_str());
+
+  create(original_dir_path());
+
+  std::size_t num_copied = 0;
+  std::size_t num_files = 0;
+  ASSERT_TRUE(metall::manager::copy(original_dir_path().c_str(), copy_dir_path().c_str(), 3,
+                                    [&](const std::size_t done, const std::size_t total) {
+                                      ASSERT_EQ(done, num_copied + 1);
+                                      num_copied = done;
+                                      num_files = total;
+                                    }));
+  ASSERT_GT(num_files, 0);
+  ASSERT_EQ(num_copied, num_files);
+  open(copy_dir_path());
+
+  // Holes in block files are kept
+  const std::string block_file_path("/metall_datastore/segment_block-0");
+  ASSERT_LE(util::get_actual_file_size(copy_dir_path() + block_file_path),
+            util::get_actual_file_size(original_dir_path() + block_file_path)
+                + (ssize_t)util::get_page_size());
+
+  // Overwrites an existing data store without leaving extra files
+  const std::string extra_file_path(copy_dir_path() + "/metall_datastore/segment_block-100");
+  ASSERT_TRUE(util::create_file(extra_file_path));
+  ASSERT_TRUE(metall::manager::copy_async(original_dir_path().c_str(), copy_dir_path().c_str(), 2).get());
+  ASSERT_FALSE(util::file_exist(extra_file_path));
+  open(copy_dir_path());
+}
+
+TEST(CopyFileTest, ParallelRemove) {
+  metall::manager::remove(original_dir_path().c_str());
+  create(original_dir_path());
+
+  std::size_t num_removed = 0;
+  ASSERT_TRUE(metall::manager::remove_async(original_dir_path().c_str(), 3,
+                                            [&](const std::size_t done, const std::size_t) {
+                                              num_removed = done;
+                                            }).get());
+  ASSERT_GT(num_removed, 0);
+  ASSERT_FALSE(util::file_exist(original_dir_path()));
+  ASSERT_FALSE(metall::manager::remove(original_dir_path().c_str()));
+}
+}
@@ -0,0 +1,82 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#define METALL_USE_IO_URING_SYNC
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include <metall/metall.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+
+using manager_type = metall::manager;
+
+const std::string &dir_path() {
+  const static std::string path(test_utility::make_test_dir_path("IoUringSyncTest"));
+  return path;
+}
+
+// Sizes that make the segment consist of several blocks; touches only a few pages as block files are sparse
+const std::vector<std::size_t> &allocation_sizes() {
+  const static std::vector<std::size_t> sizes{1ULL << 20ULL, 1ULL << 29ULL, 1ULL << 30ULL};
+  return sizes;
+}
+
+void allocate(manager_type &manager, const std::size_t size) {
+  auto *const array = static_cast<char *>(manager.allocate(size));
+  array[0] = 'a';
+  array[size - 1] = 'b';
+  manager.construct<metall::offset_ptr<char>>(std::to_string(size).c_str())(array);
+}
+
+void check(const std::string &path = dir_path()) {
+  manager_type manager(metall::open_read_only, path.c_str());
+  for (const std::size_t size : allocation_sizes()) {
+    const auto *const ptr = manager.find<metall::offset_ptr<char>>(std::to_string(size).c_str()).first;
+    ASSERT_NE(ptr, nullptr);
+    ASSERT_EQ((*ptr)[0], 'a');
+    ASSERT_EQ((*ptr)[size - 1], 'b');
+  }
+}
+
+TEST(IoUringSyncTest, FlushWhileExtending) {
+  manager_type::remove(dir_path().c_str());
+  {
+    manager_type manager(metall::create_only, dir_path().c_str());
+    for (const std::size_t size : allocation_sizes()) {
+      allocate(manager, size);
+      manager.flush(false); // Does not wait; the segment is extended while the block files are synchronized
+    }
+    ASSERT_TRUE(manager.flush_async().get());
+  }
+  check();
+}
+
+TEST(IoUringSyncTest, FlushReopened) {
+  manager_type::remove(dir_path().c_str());
+  {
+    manager_type manager(metall::create_only, dir_path().c_str());
+    allocate(manager, allocation_sizes()[0]);
+  }
+  {
+    // The block files of an existing segment are also held
+    manager_type manager(metall::open_only, dir_path().c_str());
+    for (std::size_t i = 1; i < allocation_sizes().size(); ++i) {
+      allocate(manager, allocation_sizes()[i]);
+    }
+    ASSERT_TRUE(manager.flush_async().get());
+    manager.flush(false);
+  }
+  check();
+}
+
+TEST(IoUringSyncTest, Remove) {
+  ASSERT_TRUE(manager_type::remove(dir_path().c_str()));
+}
+}
@@ -7,6 +7,12 @@
 #include "gtest/gtest.h"
 
 #include <unordered_set>
+#include <sstream>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <boost/container/scoped_allocator.hpp>
 #include <boost/interprocess/containers/vector.hpp>
 #include <boost/unordered_map.hpp>
@@ -262,6 +268,32 @@ TEST(ManagerTest, LargeAllocation) {
   }
 }
 
+TEST(ManagerTest, GrowVMRegion) {
+  // Reserves a VM region smaller than the data to allocate
+  constexpr std::size_t capacity = 1ULL << 30ULL;
+  constexpr std::size_t size = capacity * 2;
+  manager_type::remove(dir_path().c_str());
+  {
+    manager_type manager(metall::create_only, dir_path().c_str(), capacity);
+    auto *const small = static_cast<char *>(manager.allocate(8));
+    auto *const large = static_cast<char *>(manager.allocate(size));
+    ASSERT_NE(large, nullptr);
+    small[0] = 'a';
+    large[0] = 'b';
+    large[size - 1] = 'c';
+    ASSERT_EQ(small[0], 'a'); // The segment did not move
+    manager.construct<metall::offset_ptr<char>>("small")(small);
+    manager.construct<metall::offset_ptr<char>>("large")(large);
+  }
+
+  manager_type manager(metall::open_read_only, dir_path().c_str());
+  const char *const small = manager.find<metall::offset_ptr<char>>("small").first->get();
+  const char *const large = manager.find<metall::offset_ptr<char>>("large").first->get();
+  ASSERT_EQ(small[0], 'a');
+  ASSERT_EQ(large[0], 'b');
+  ASSERT_EQ(large[size - 1], 'c');
+}
+
 TEST(ManagerTest, StlAllocator) {
   manager_type manager(metall::create_only, dir_path().c_str());
 
@@ -281,6 +313,80 @@ TEST(ManagerTest, StlAllocator) {
   }
 }
 
+TEST(ManagerTest, StlAllocatorSizedDeallocation) {
+  manager_type manager(metall::create_only, dir_path().c_str());
+
+  // Single objects are allocated through the fixed size path and deallocated with their sizes
+  struct large_type {
+    char buf[k_chunk_size * 2];
+  };
+  allocator_type<large_type> large_allocator(manager.get_allocator<large_type>());
+  auto *const large1 = large_allocator.allocate(1).get();
+  auto *const large2 = large_allocator.allocate(1).get();
+  ASSERT_EQ(large2 - large1, 1);
+  large_allocator.deallocate(large1, 1);
+  ASSERT_EQ(large_allocator.allocate(1).get(), large1);
+
+  allocator_type<uint64_t> small_allocator(manager.get_allocator<uint64_t>());
+  std::unordered_set<uint64_t *> set;
+  for (std::size_t n = 1; n <= 64; ++n) {
+    auto *const addr = small_allocator.allocate(n).get();
+    ASSERT_EQ(set.count(addr), 0);
+    set.insert(addr);
+    small_allocator.deallocate(addr, n);
+    ASSERT_EQ(small_allocator.allocate(n).get(), addr);
+  }
+}
+
+TEST(ManagerTest, StlAllocatorMultipleManagers) {
+  // The allocation path cached per thread follows the manager of each allocator, also after reopening
+  const std::string other_dir_path(test_utility::make_test_dir_path("ManagerTest_Other"));
+  for (const bool reopen : {false, true}) {
+    auto manager = reopen ? std::make_unique<manager_type>(metall::open_only, dir_path().c_str())
+                          : std::make_unique<manager_type>(metall::create_only, dir_path().c_str());
+    manager_type other_manager(metall::create_only, other_dir_path.c_str());
+    allocator_type<uint64_t> allocator(manager->get_allocator<uint64_t>());
+    allocator_type<uint64_t> other_allocator(other_manager.get_allocator<uint64_t>());
+
+    // Each segment follows its header, in which the kernel address is stored
+    const auto *const header = reinterpret_cast<const char *>(allocator.get_pointer_to_manager_kernel());
+    const auto *const other_header = reinterpret_cast<const char *>(other_allocator.get_pointer_to_manager_kernel());
+    const auto owned = [](const char *const addr, const char *const self, const char *const other) {
+      return self < addr && (other < self || addr < other);
+    };
+    for (int i = 0; i < 16; ++i) {
+      auto *const addr = allocator.allocate(1).get();
+      auto *const other_addr = other_allocator.allocate(1).get();
+      ASSERT_TRUE(owned(reinterpret_cast<char *>(addr), header, other_header));
+      ASSERT_TRUE(owned(reinterpret_cast<char *>(other_addr), other_header, header));
+      allocator.deallocate(addr, 1);
+      other_allocator.deallocate(other_addr, 1);
+    }
+  }
+}
+
+TEST(ManagerTest, AllocateFixed) {
+  // The size class is resolved at compile time
+  static_assert(object_size_mngr::index(8) == object_size_mngr::index(k_min_object_size));
+  static_assert(object_size_mngr::at(object_size_mngr::index(k_chunk_size * 3)) >= k_chunk_size * 3);
+
+  manager_type manager(metall::create_only, dir_path().c_str());
+  std::unordered_set<void *> set;
+  for (std::size_t i = 0; i < k_chunk_size / 64; ++i) {
+    void *const addr = manager.allocate_fixed<64>();
+    ASSERT_NE(addr, nullptr);
+    ASSERT_EQ(set.count(addr), 0);
+    set.insert(addr);
+  }
+  void *const large = manager.allocate_fixed<k_chunk_size * 3>();
+  ASSERT_EQ(set.count(large), 0);
+  static_cast<char *>(large)[k_chunk_size * 3 - 1] = 1;
+
+  for (void *const addr : set) manager.deallocate(addr);
+  manager.deallocate(large);
+  ASSERT_EQ(manager.allocate_fixed<k_chunk_size * 3>(), large);
+}
+
 TEST(ManagerTest, Container) {
   manager_type manager(metall::create_only, dir_path().c_str());
   using element_type = std::pair<uint64_t, uint64_t>;
@@ -446,6 +552,138 @@ TEST(ManagerTest, Flush) {
   ASSERT_FALSE(manager_type::consistent(dir_path().c_str()));
 }
 
+TEST(ManagerTest, FlushAsync) {
+  using element_type = uint64_t;
+  using vector_type = boost::interprocess::vector<element_type, typename manager_type::allocator_type<element_type>>;
+
+  {
+    manager_type manager(metall::create_only, dir_path().c_str());
+    auto *vec = manager.construct<vector_type>("vec")(manager.get_allocator<>());
+    for (element_type i = 0; i < 1024 * 1024; ++i) {
+      vec->push_back(i);
+    }
+
+    auto future = manager.flush_async();
+    ASSERT_TRUE(future.get());
+    ASSERT_FALSE(manager_type::consistent(dir_path().c_str()));
+
+    // Multiple asynchronous flushes at the same time
+    auto future1 = manager.flush_async();
+    (*vec)[0] = 10;
+    auto future2 = manager.flush_async();
+    manager.flush(false);
+    ASSERT_TRUE(future1.get());
+    ASSERT_TRUE(future2.get());
+  }
+
+  {
+    manager_type manager(metall::open_read_only, dir_path().c_str());
+    const auto *vec = manager.find<vector_type>("vec").first;
+    ASSERT_EQ(vec->size(), 1024 * 1024);
+    ASSERT_EQ((*vec)[0], 10);
+    for (element_type i = 1; i < vec->size(); ++i) {
+      ASSERT_EQ((*vec)[i], i);
+    }
+  }
+}
+
+TEST(ManagerTest, OpenReadOnlyShared) {
+  manager_type::remove(dir_path().c_str());
+  {
+    manager_type manager(metall::create_only, dir_path().c_str());
+    manager.construct<int>("int")(10);
+  }
+
+  // Find an address that is not used
+  const std::size_t vm_size = 1ULL << 36ULL;
+  void *const addr = metall::detail::utility::reserve_aligned_vm_region(1ULL << 21ULL, vm_size);
+  ASSERT_NE(addr, nullptr);
+  ASSERT_TRUE(metall::detail::utility::munmap(addr, vm_size, false));
+
+  const pid_t pid = ::fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) { // Child
+    manager_type manager(metall::open_read_only_shared, dir_path().c_str(), addr, true);
+    const auto ret = manager.find<int>("int");
+    const bool correct = (ret.first && *ret.first == 10 && static_cast<void *>(manager.get_kernel()->get_segment_header()) == addr);
+    std::_Exit(correct ? 0 : 1);
+  }
+
+  {
+    manager_type manager(metall::open_read_only_shared, dir_path().c_str(), addr);
+    ASSERT_EQ(static_cast<void *>(manager.get_kernel()->get_segment_header()), addr);
+    const auto ret = manager.find<int>("int");
+    ASSERT_NE(ret.first, nullptr);
+    ASSERT_EQ(*ret.first, 10);
+    ASSERT_EQ(manager.allocate(sizeof(int)), nullptr); // Read only
+  }
+
+  int status;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+}
+
+TEST(ManagerTest, LazyLoadAllocatorState) {
+  manager_type::remove(dir_path().c_str());
+  {
+    manager_type manager(metall::create_only, dir_path().c_str());
+    manager.construct<int>("int")(10);
+  }
+
+  // Read-only open does not need the allocator state
+  const std::string chunk_directory_path(dir_path() + "/metall_datastore/segment_memory_allocator_chunk_directory");
+  const std::string backup_path(chunk_directory_path + "_backup");
+  ASSERT_EQ(std::rename(chunk_directory_path.c_str(), backup_path.c_str()), 0);
+  {
+    manager_type manager(metall::open_read_only, dir_path().c_str());
+    ASSERT_EQ(*(manager.find<int>("int").first), 10);
+  }
+  ASSERT_EQ(std::rename(backup_path.c_str(), chunk_directory_path.c_str()), 0);
+
+  // The allocator state is loaded on demand
+  {
+    manager_type manager(metall::open_read_only, dir_path().c_str());
+    std::stringstream ss;
+    manager.profile(&ss);
+    ASSERT_FALSE(ss.str().empty());
+  }
+
+  {
+    manager_type manager(metall::open_only, dir_path().c_str());
+    ASSERT_EQ(*(manager.find<int>("int").first), 10);
+    ASSERT_NE(manager.construct<int>("int2")(20), nullptr);
+  }
+}
+
+TEST(ManagerTest, OpenManyBlocks) {
+  manager_type::remove(dir_path().c_str());
+  // The segment doubles from 256 MB to 1 GB, i.e., it consists of three blocks;
+  // only a few pages are touched as block files are sparse
+  constexpr std::size_t k_object_size = 1ULL << 27ULL;
+  constexpr std::size_t k_num_objects = 7;
+  using pointer_type = metall::offset_ptr<std::size_t>; // The data store could be mapped at a different address
+  {
+    manager_type manager(metall::create_only, dir_path().c_str());
+    for (std::size_t i = 0; i < k_num_objects; ++i) {
+      auto *const buf = static_cast<std::size_t *>(manager.allocate(k_object_size));
+      buf[0] = i;
+      buf[k_object_size / sizeof(std::size_t) - 1] = i;
+      manager.construct<pointer_type>(std::to_string(i).c_str())(buf);
+    }
+  }
+  ASSERT_TRUE(utility::file_exist(dir_path() + "/metall_datastore/segment_block-2"));
+
+  {
+    manager_type manager(metall::open_read_only, dir_path().c_str());
+    for (std::size_t i = 0; i < k_num_objects; ++i) {
+      const std::size_t *const buf = manager.find<pointer_type>(std::to_string(i).c_str()).first->get();
+      ASSERT_EQ(buf[0], i);
+      ASSERT_EQ(buf[k_object_size / sizeof(std::size_t) - 1], i);
+    }
+  }
+}
+
 TEST(ManagerTest, AnonymousConstruct) {
   manager_type *manager;
   manager = new manager_type(metall::create_only, dir_path().c_str());
@@ -489,5 +727,104 @@ TEST(ManagerTest, UniqueConstruct) {
   delete manager;
 }
 
+
+TEST(ManagerTest, Recover) {
+  struct node_type {
+    metall::offset_ptr<node_type> next;
+    uint64_t value;
+  };
+  constexpr std::size_t k_num_nodes = 10000;
+  constexpr std::size_t k_leak_size = k_chunk_size * 32;
+
+  manager_type::remove(dir_path().c_str());
+  {
+    manager_type manager(metall::create_only, dir_path().c_str());
+    auto *const head = manager.construct<metall::offset_ptr<node_type>>("head")(nullptr);
+    for (std::size_t i = 0; i < k_num_nodes; ++i) {
+      auto *const node = static_cast<node_type *>(manager.allocate(sizeof(node_type)));
+      node->value = i;
+      node->next = *head;
+      *head = node;
+    }
+  }
+
+  int pipe_fds[2];
+  ASSERT_EQ(::pipe(pipe_fds), 0);
+  const pid_t pid = ::fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) { // Child; crashes without closing the data store
+    manager_type manager(metall::open_only, dir_path().c_str());
+    auto *const head = manager.find<metall::offset_ptr<node_type>>("head").first;
+
+    // Allocations that are never reachable
+    char *const leak = static_cast<char *>(manager.allocate(k_leak_size));
+    for (std::size_t i = 0; i < k_num_nodes; ++i) {
+      manager.allocate(sizeof(node_type));
+    }
+
+    // Remove a half of the nodes and add new ones
+    for (std::size_t i = 0; i < k_num_nodes / 2; ++i) {
+      auto next = (*head)->next;
+      manager.deallocate(head->get());
+      *head = next;
+    }
+    for (std::size_t i = 0; i < k_num_nodes; ++i) {
+      auto *const node = static_cast<node_type *>(manager.allocate(sizeof(node_type)));
+      node->value = k_num_nodes + i;
+      node->next = *head;
+      *head = node;
+    }
+
+    const std::ptrdiff_t leak_offset = leak - reinterpret_cast<char *>(head);
+    const bool written = (::write(pipe_fds[1], &leak_offset, sizeof(leak_offset)) == sizeof(leak_offset));
+    std::_Exit(written ? 0 : 1);
+  }
+
+  std::ptrdiff_t leak_offset = 0;
+  ASSERT_EQ(::read(pipe_fds[0], &leak_offset, sizeof(leak_offset)), sizeof(leak_offset));
+  ::close(pipe_fds[0]);
+  ::close(pipe_fds[1]);
+  int status;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+  ASSERT_FALSE(manager_type::consistent(dir_path().c_str()));
+
+  std::size_t num_visited_nodes = 0;
+  auto visitor = [&num_visited_nodes](manager_type::reachability_marker_type &marker) {
+    auto *const head = marker.find<metall::offset_ptr<node_type>>("head");
+    for (node_type *node = head->get(); node; node = node->next.get()) {
+      // Nodes allocated after the last close need the size
+      if (!marker.mark(node, sizeof(node_type))) break;
+      ++num_visited_nodes;
+    }
+  };
+  ASSERT_TRUE(manager_type::recover(dir_path().c_str(), visitor, 2));
+  ASSERT_EQ(num_visited_nodes, k_num_nodes + k_num_nodes / 2);
+  ASSERT_TRUE(manager_type::consistent(dir_path().c_str()));
+
+  {
+    manager_type manager(metall::open_only, dir_path().c_str());
+    auto *const head = manager.find<metall::offset_ptr<node_type>>("head").first;
+
+    // The leaked space is reused
+    char *const large_object = static_cast<char *>(manager.allocate(k_leak_size));
+    ASSERT_EQ(large_object - reinterpret_cast<char *>(head), leak_offset);
+
+    // New allocations do not overwrite the reachable nodes
+    for (std::size_t i = 0; i < k_num_nodes * 2; ++i) {
+      auto *const node = static_cast<node_type *>(manager.allocate(sizeof(node_type)));
+      node->value = std::numeric_limits<uint64_t>::max();
+    }
+    std::size_t count = 0;
+    for (node_type *node = head->get(); node; node = node->next.get()) {
+      const uint64_t expected = (count < k_num_nodes) ? 2 * k_num_nodes - 1 - count
+                                                      : k_num_nodes - 1 - (count - k_num_nodes / 2);
+      ASSERT_EQ(node->value, expected);
+      ++count;
+    }
+    ASSERT_EQ(count, k_num_nodes + k_num_nodes / 2);
+  }
 }
 
+}
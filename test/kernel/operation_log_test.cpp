@@ -0,0 +1,326 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#define METALL_ENABLE_OPERATION_LOG
+
+#include "gtest/gtest.h"
+
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <limits>
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <metall/metall.hpp>
+#include <metall/kernel/operation_log.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+using chunk_no_type = uint32_t;
+static constexpr std::size_t k_chunk_size = 1 << 21;
+using manager_type = metall::basic_manager<chunk_no_type, k_chunk_size>;
+using log_type = metall::kernel::operation_log;
+
+const std::string &dir_path() {
+  const static std::string path(test_utility::make_test_dir_path("OperationLogTest"));
+  return path;
+}
+
+TEST(OperationLogTest, DiscardTornBatch) {
+  ASSERT_TRUE(test_utility::create_test_dir());
+  const std::string log_path(test_utility::make_test_file_path("OperationLogTest_DiscardTornBatch"));
+  {
+    log_type log;
+    ASSERT_TRUE(log.open(log_path));
+    log.log_chunk_insert(1, 2);
+    log.log_slot_mark(1, 3);
+    log.log_named_object_insert("obj", 4, 5);
+    ASSERT_TRUE(log.commit());
+    log.log_chunk_erase(1); // Not committed but written by close()
+    log.log_named_object_erase("obj");
+  }
+  {
+    // Emulate a batch that was being written when the process crashed
+    std::ofstream ofs(log_path, std::ios::binary | std::ios::app);
+    ofs << "METLLOG1 torn";
+  }
+
+  for (int i = 0; i < 2; ++i) { // The torn batch is truncated at the first replay
+    std::vector<log_type::record> records;
+    ASSERT_TRUE(log_type::replay(log_path, [&records](const log_type::record &rec) {
+      records.push_back(rec);
+      return true;
+    }));
+    ASSERT_EQ(records.size(), 5);
+    ASSERT_EQ(records[0].type, log_type::record_type::chunk_insert);
+    ASSERT_EQ(records[0].value0, 1);
+    ASSERT_EQ(records[0].value1, 2);
+    ASSERT_EQ(records[1].type, log_type::record_type::slot_mark);
+    ASSERT_EQ(records[1].value1, 3);
+    ASSERT_EQ(records[2].type, log_type::record_type::named_object_insert);
+    ASSERT_EQ(records[2].name, "obj");
+    ASSERT_EQ(records[2].value0, 4);
+    ASSERT_EQ(records[2].value1, 5);
+    ASSERT_EQ(records[3].type, log_type::record_type::chunk_erase);
+    ASSERT_EQ(records[3].value0, 1);
+    ASSERT_EQ(records[4].type, log_type::record_type::named_object_erase);
+    ASSERT_EQ(records[4].name, "obj");
+  }
+}
+
+TEST(OperationLogTest, ConcurrentAppend) {
+  ASSERT_TRUE(test_utility::create_test_dir());
+  const std::string log_path(test_utility::make_test_file_path("OperationLogTest_ConcurrentAppend"));
+  constexpr std::size_t k_num_threads = 4;
+  constexpr std::size_t k_num_records = 10000;
+  {
+    log_type log(64, 3); // Small buffers to hand many batches to the writer thread
+    ASSERT_TRUE(log.open(log_path));
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < k_num_threads; ++t) {
+      threads.emplace_back([&log, t]() {
+        for (std::size_t i = 0; i < k_num_records; ++i) {
+          log.log_slot_mark(t, i);
+        }
+      });
+    }
+    for (auto &th : threads) th.join();
+    ASSERT_TRUE(log.commit());
+  }
+
+  // Records are replayed in the logged order
+  std::vector<std::size_t> next(k_num_threads, 0);
+  std::size_t num_records = 0;
+  ASSERT_TRUE(log_type::replay(log_path, [&next, &num_records](const log_type::record &rec) {
+    if (rec.sequence_no != num_records++ || rec.value1 != next[rec.value0]++) return false;
+    return true;
+  }));
+  ASSERT_EQ(num_records, k_num_threads * k_num_records);
+}
+
+TEST(OperationLogTest, RecoverAfterCrash) {
+  manager_type::remove(dir_path().c_str());
+
+  constexpr std::size_t k_num_small_objects = 4096;
+  constexpr std::size_t k_large_object_size = k_chunk_size * 3;
+
+  const pid_t pid = ::fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) { // Child; crashes without closing the data store
+    manager_type manager(metall::create_only, dir_path().c_str());
+    auto *const small_objects = manager.construct<uint64_t *>("small_objects")[k_num_small_objects](nullptr);
+    for (std::size_t i = 0; i < k_num_small_objects; ++i) {
+      small_objects[i] = static_cast<uint64_t *>(manager.allocate(sizeof(uint64_t)));
+      *small_objects[i] = i;
+    }
+    for (std::size_t i = 0; i < k_num_small_objects; i += 2) { // Free a half
+      manager.deallocate(small_objects[i]);
+      small_objects[i] = nullptr;
+    }
+
+    auto *const large_object = manager.construct<char>("large_object")[k_large_object_size]('a');
+    large_object[k_large_object_size - 1] = 'b';
+
+    manager.construct<int>("destroyed")(10);
+    manager.destroy<int>("destroyed");
+
+    manager.flush();
+    std::_Exit(0);
+  }
+
+  int status;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+  ASSERT_FALSE(manager_type::consistent(dir_path().c_str()));
+
+  for (int n = 0; n < 2; ++n) { // The second open makes sure that the recovered state was stored
+    {
+      manager_type manager(metall::open_only, dir_path().c_str());
+
+      auto *const small_objects = manager.find<uint64_t *>("small_objects").first;
+      ASSERT_NE(small_objects, nullptr);
+      for (std::size_t i = 1; i < k_num_small_objects; i += 2) {
+        ASSERT_EQ(*small_objects[i], i);
+      }
+
+      const auto large_object = manager.find<char>("large_object");
+      ASSERT_NE(large_object.first, nullptr);
+      ASSERT_EQ(large_object.second, k_large_object_size);
+      ASSERT_EQ(large_object.first[0], 'a');
+      ASSERT_EQ(large_object.first[k_large_object_size - 1], 'b');
+
+      ASSERT_EQ(manager.find<int>("destroyed").first, nullptr);
+
+      // New allocations must not overlap with the live objects
+      std::vector<uint64_t *> new_objects;
+      for (std::size_t i = 0; i < k_num_small_objects; ++i) {
+        auto *const object = static_cast<uint64_t *>(manager.allocate(sizeof(uint64_t)));
+        ASSERT_NE(object, nullptr);
+        const char *const address = reinterpret_cast<const char *>(object);
+        ASSERT_TRUE(address < large_object.first || large_object.first + k_large_object_size <= address);
+        *object = k_num_small_objects;
+        new_objects.push_back(object);
+      }
+      for (std::size_t i = 1; i < k_num_small_objects; i += 2) {
+        ASSERT_EQ(*small_objects[i], i);
+      }
+      for (auto *const object : new_objects) {
+        manager.deallocate(object);
+      }
+    }
+    ASSERT_TRUE(manager_type::consistent(dir_path().c_str()));
+  }
+}
+
+// A read-only open recovers the data store only in memory; the log must be kept for the next read-write open
+TEST(OperationLogTest, RecoverReadOnly) {
+  manager_type::remove(dir_path().c_str());
+
+  const pid_t pid = ::fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    manager_type manager(metall::create_only, dir_path().c_str());
+    manager.construct<int>("object")(10);
+    manager.flush();
+    std::_Exit(0);
+  }
+
+  int status;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+  ASSERT_FALSE(manager_type::consistent(dir_path().c_str()));
+
+  for (int n = 0; n < 2; ++n) {
+    {
+      manager_type manager(metall::open_read_only, dir_path().c_str());
+      const auto object = manager.find<int>("object").first;
+      ASSERT_NE(object, nullptr);
+      ASSERT_EQ(*object, 10);
+    }
+    ASSERT_FALSE(manager_type::consistent(dir_path().c_str()));
+  }
+
+  for (int n = 0; n < 2; ++n) { // The second open makes sure that the recovered state was stored
+    {
+      manager_type manager(metall::open_only, dir_path().c_str());
+      const auto object = manager.find<int>("object").first;
+      ASSERT_NE(object, nullptr);
+      ASSERT_EQ(*object, 10);
+    }
+    ASSERT_TRUE(manager_type::consistent(dir_path().c_str()));
+  }
+}
+
+// Kills a process while its threads are allocating and deallocating objects,
+// i.e., the log has unflushed records and could end with a torn batch
+TEST(OperationLogTest, RecoverAfterKill) {
+  manager_type::remove(dir_path().c_str());
+
+  constexpr std::size_t k_num_threads = 4;
+  constexpr std::size_t k_num_objects_per_thread = 1ULL << 14ULL;
+  constexpr int k_num_flushes = 5;
+  using pointer_type = metall::offset_ptr<uint64_t>;
+
+  int pipe_fds[2];
+  ASSERT_EQ(::pipe(pipe_fds), 0);
+  const pid_t pid = ::fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    ::close(pipe_fds[0]);
+    manager_type manager(metall::create_only, dir_path().c_str());
+    auto *const objects = manager.construct<pointer_type>("objects")[k_num_threads * k_num_objects_per_thread](nullptr);
+
+    // Writes to the segment must be stopped during flush(); the threads pause only then
+    std::atomic<bool> pause(false);
+    std::mutex running[k_num_threads];
+    uint64_t progress[k_num_threads] = {0};
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < k_num_threads; ++t) {
+      threads.emplace_back([&manager, &pause, &running, &progress, objects, t]() {
+        for (std::size_t i = 0;; ++i) {
+          while (pause.load()) std::this_thread::yield();
+          std::lock_guard<std::mutex> guard(running[t]);
+          if (i < k_num_objects_per_thread) {
+            const std::size_t index = t * k_num_objects_per_thread + i;
+            auto *const object = static_cast<uint64_t *>(manager.allocate(sizeof(uint64_t)));
+            *object = index;
+            objects[index] = object;
+            progress[t] = i + 1;
+          }
+          manager.deallocate(manager.allocate(64 + (i % 4096)));
+        }
+      });
+    }
+
+    // Tell the parent which objects were allocated before each flush; runs until killed
+    while (true) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      uint64_t snapshot[k_num_threads];
+      pause = true;
+      for (std::size_t t = 0; t < k_num_threads; ++t) {
+        running[t].lock();
+        snapshot[t] = progress[t];
+      }
+      manager.flush();
+      for (std::size_t t = 0; t < k_num_threads; ++t) running[t].unlock();
+      pause = false;
+      if (::write(pipe_fds[1], snapshot, sizeof(snapshot)) != sizeof(snapshot)) std::_Exit(1);
+    }
+  }
+
+  ::close(pipe_fds[1]);
+  uint64_t snapshot[k_num_threads];
+  for (int n = 0; n < k_num_flushes; ++n) {
+    std::size_t read = 0;
+    while (read < sizeof(snapshot)) {
+      const ssize_t ret = ::read(pipe_fds[0], reinterpret_cast<char *>(snapshot) + read, sizeof(snapshot) - read);
+      ASSERT_GT(ret, 0);
+      read += ret;
+    }
+  }
+  ASSERT_EQ(::kill(pid, SIGKILL), 0);
+  int status;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFSIGNALED(status));
+  ::close(pipe_fds[0]);
+  ASSERT_FALSE(manager_type::consistent(dir_path().c_str()));
+
+  {
+    manager_type manager(metall::open_only, dir_path().c_str());
+    auto *const objects = manager.find<pointer_type>("objects").first;
+    ASSERT_NE(objects, nullptr);
+    const auto check = [objects, &snapshot]() {
+      for (std::size_t t = 0; t < k_num_threads; ++t) {
+        for (std::size_t i = 0; i < snapshot[t]; ++i) {
+          const std::size_t index = t * k_num_objects_per_thread + i;
+          ASSERT_NE(objects[index], nullptr);
+          ASSERT_EQ(*objects[index], index);
+        }
+      }
+    };
+    check();
+
+    // The objects allocated before the last flush must not be allocated again
+    std::vector<uint64_t *> new_objects;
+    for (std::size_t i = 0; i < k_num_threads * k_num_objects_per_thread; ++i) {
+      auto *const object = static_cast<uint64_t *>(manager.allocate(sizeof(uint64_t)));
+      *object = std::numeric_limits<uint64_t>::max();
+      new_objects.push_back(object);
+    }
+    check();
+    for (auto *const object : new_objects) {
+      manager.deallocate(object);
+    }
+  }
+  ASSERT_TRUE(manager_type::consistent(dir_path().c_str()));
+}
+}
@@ -9,6 +9,9 @@
 #include <string>
 #include <algorithm>
 #include <random>
+#include <atomic>
+#include <thread>
+#include <chrono>
 
 #include <boost/container/vector.hpp>
 
@@ -51,6 +54,103 @@ TEST(SnapshotTest, Open) {
   ASSERT_EQ(*b, 2);
 }
 
+TEST(SnapshotTest, SnapshotAsync) {
+  metall::manager::remove(original_dir_path().c_str());
+  metall::manager::remove(snapshot_dir_path().c_str());
+
+  constexpr std::size_t k_num_elements = 1ULL << 22ULL;
+  {
+    metall::manager manager(metall::create_only, original_dir_path().c_str());
+    auto *const array = manager.construct<uint64_t>("array")[k_num_elements](0);
+    for (std::size_t i = 0; i < k_num_elements; ++i) {
+      array[i] = i;
+    }
+    manager.construct<uint64_t>("freed")[k_num_elements](1);
+
+    auto future = manager.snapshot_async(snapshot_dir_path().c_str());
+
+    // Keep modifying the data while the snapshot is taken
+    manager.destroy<uint64_t>("freed");
+    manager.construct<uint64_t>("added")(3);
+    for (std::size_t i = 0; i < k_num_elements; ++i) {
+      array[i] = k_num_elements - i;
+    }
+    ASSERT_TRUE(future.get());
+  }
+
+  {
+    metall::manager manager(metall::open_only, snapshot_dir_path().c_str());
+    auto *const array = manager.find<uint64_t>("array").first;
+    ASSERT_NE(array, nullptr);
+    for (std::size_t i = 0; i < k_num_elements; ++i) {
+      ASSERT_EQ(array[i], i);
+    }
+    const auto freed = manager.find<uint64_t>("freed");
+    ASSERT_EQ(freed.second, k_num_elements);
+    for (std::size_t i = 0; i < k_num_elements; ++i) {
+      ASSERT_EQ(freed.first[i], 1);
+    }
+    ASSERT_EQ(manager.find<uint64_t>("added").first, nullptr);
+  }
+
+  {
+    metall::manager manager(metall::open_only, original_dir_path().c_str());
+    auto *const array = manager.find<uint64_t>("array").first;
+    for (std::size_t i = 0; i < k_num_elements; ++i) {
+      ASSERT_EQ(array[i], k_num_elements - i);
+    }
+    ASSERT_EQ(*manager.find<uint64_t>("added").first, 3);
+  }
+}
+
+TEST(SnapshotTest, SnapshotAsyncWhileWriting) {
+  metall::manager::remove(original_dir_path().c_str());
+  metall::manager::remove(snapshot_dir_path().c_str());
+
+  constexpr std::size_t k_num_elements = 1ULL << 22ULL;
+  {
+    metall::manager manager(metall::create_only, original_dir_path().c_str());
+    auto *const array = manager.construct<uint64_t>("array")[k_num_elements](0);
+
+    // Fill the array round by round; any point of time has a round number before a position and the previous after it
+    std::atomic<bool> done(false);
+    std::thread writer([&]() {
+      for (uint64_t round = 1; !done.load(); ++round) {
+        for (std::size_t i = 0; i < k_num_elements; ++i) {
+          array[i] = round;
+        }
+      }
+    });
+    std::thread allocator([&]() {
+      while (!done.load()) {
+        manager.deallocate(manager.allocate(64));
+        manager.deallocate(manager.allocate(1ULL << 21ULL));
+      }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto future = manager.snapshot_async(snapshot_dir_path().c_str());
+    manager.flush(); // Does not wait for the snapshot
+    ASSERT_TRUE(future.get());
+    done.store(true);
+    writer.join();
+    allocator.join();
+  }
+
+  ASSERT_TRUE(metall::manager::consistent(snapshot_dir_path().c_str()));
+  {
+    metall::manager manager(metall::open_only, snapshot_dir_path().c_str());
+    auto *const array = manager.find<uint64_t>("array").first;
+    ASSERT_NE(array, nullptr);
+    const uint64_t round = array[0];
+    std::size_t i = 0;
+    while (i < k_num_elements && array[i] == round) ++i;
+    for (; i < k_num_elements; ++i) {
+      ASSERT_EQ(array[i], round - 1);
+    }
+  }
+}
+
 // -------------------------------------------------------------------------------- //
 // Randomly update some spots in a contiguous region multiple times
 // -------------------------------------------------------------------------------- //
@@ -0,0 +1,153 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include <metall/metall.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+namespace util = metall::detail::utility;
+
+using manager_type = metall::manager;
+
+const std::string &dir_path() {
+  const static std::string path(test_utility::make_test_dir_path("StripeTest"));
+  return path;
+}
+
+const std::vector<std::string> &stripe_dir_paths() {
+  const static std::vector<std::string> paths{test_utility::make_test_dir_path("StripeTest_0"),
+                                              test_utility::make_test_dir_path("StripeTest_1"),
+                                              test_utility::make_test_dir_path("StripeTest_2")};
+  return paths;
+}
+
+std::string block_file_path(const std::string &dir, const std::size_t n) {
+  return dir + "/segment_block-" + std::to_string(n);
+}
+
+// Returns the directory made for a data store in each stripe directory
+std::vector<std::string> stripe_sub_dir_paths(const std::string &base_dir_path) {
+  std::vector<std::string> paths;
+  std::ifstream ifs(base_dir_path + "/metall_datastore/segment_stripes");
+  std::size_t weight;
+  std::string path;
+  while (ifs >> weight >> path) paths.push_back(path);
+  return paths;
+}
+
+// Makes a segment that consists of three blocks; touches only a few pages as block files are sparse
+void create(const manager_type::stripe_placement placement, const std::string &base_dir_path = dir_path()) {
+  manager_type::remove(base_dir_path.c_str());
+  manager_type manager(metall::create_only, base_dir_path.c_str(), stripe_dir_paths(), placement);
+  for (const std::size_t size : {1ULL << 29ULL, 1ULL << 30ULL}) {
+    auto *const array = static_cast<char *>(manager.allocate(size));
+    array[0] = 'a';
+    array[size - 1] = 'b';
+    manager.construct<metall::offset_ptr<char>>(std::to_string(size).c_str())(array);
+  }
+}
+
+void check(const std::string &path = dir_path()) {
+  manager_type manager(metall::open_read_only, path.c_str());
+  for (const std::size_t size : {1ULL << 29ULL, 1ULL << 30ULL}) {
+    const auto *const ptr = manager.find<metall::offset_ptr<char>>(std::to_string(size).c_str()).first;
+    ASSERT_NE(ptr, nullptr);
+    ASSERT_EQ((*ptr)[0], 'a');
+    ASSERT_EQ((*ptr)[size - 1], 'b');
+  }
+}
+
+TEST(StripeTest, RoundRobin) {
+  create(manager_type::stripe_placement::round_robin);
+  ASSERT_FALSE(util::file_exist(block_file_path(dir_path() + "/metall_datastore", 0)));
+  const auto sub_dir_paths = stripe_sub_dir_paths(dir_path());
+  ASSERT_EQ(sub_dir_paths.size(), 3);
+  for (std::size_t n = 0; n < 3; ++n) {
+    ASSERT_EQ(sub_dir_paths[n].find(stripe_dir_paths()[n] + "/"), 0);
+    ASSERT_TRUE(util::file_exist(block_file_path(sub_dir_paths[n], n)));
+  }
+  check(dir_path());
+
+  {
+    manager_type manager(metall::open_only, dir_path().c_str());
+    auto *const ptr = manager.find<metall::offset_ptr<char>>(std::to_string(1ULL << 29ULL).c_str()).first;
+    (*ptr)[1] = 'c';
+  }
+  {
+    manager_type manager(metall::open_read_only, dir_path().c_str());
+    const auto *const ptr = manager.find<metall::offset_ptr<char>>(std::to_string(1ULL << 29ULL).c_str()).first;
+    ASSERT_EQ((*ptr)[1], 'c');
+  }
+}
+
+TEST(StripeTest, Capacity) {
+  create(manager_type::stripe_placement::capacity);
+  const auto sub_dir_paths = stripe_sub_dir_paths(dir_path());
+  ASSERT_EQ(sub_dir_paths.size(), 3);
+  for (std::size_t n = 0; n < 3; ++n) {
+    ASSERT_TRUE(util::file_exist(block_file_path(sub_dir_paths[n], n))); // Same file system
+  }
+  check(dir_path());
+}
+
+TEST(StripeTest, CopyAndSnapshot) {
+  create(manager_type::stripe_placement::round_robin);
+
+  // Copies gather the block files into a single directory
+  const std::string copy_dir_path(test_utility::make_test_dir_path("StripeTest_Copy"));
+  manager_type::remove(copy_dir_path.c_str());
+  ASSERT_TRUE(manager_type::copy(dir_path().c_str(), copy_dir_path.c_str()));
+  for (std::size_t n = 0; n < 3; ++n) {
+    ASSERT_TRUE(util::file_exist(block_file_path(copy_dir_path + "/metall_datastore", n)));
+  }
+  check(copy_dir_path);
+
+  const std::string snapshot_dir_path(test_utility::make_test_dir_path("StripeTest_Snapshot"));
+  manager_type::remove(snapshot_dir_path.c_str());
+  {
+    manager_type manager(metall::open_only, dir_path().c_str());
+    ASSERT_TRUE(manager.snapshot(snapshot_dir_path.c_str()));
+  }
+  check(snapshot_dir_path);
+}
+
+TEST(StripeTest, Remove) {
+  create(manager_type::stripe_placement::round_robin);
+  const auto sub_dir_paths = stripe_sub_dir_paths(dir_path());
+  ASSERT_TRUE(manager_type::remove(dir_path().c_str()));
+  for (std::size_t n = 0; n < 3; ++n) {
+    ASSERT_FALSE(util::directory_exist(sub_dir_paths[n]));
+    ASSERT_TRUE(util::directory_exist(stripe_dir_paths()[n])); // Given directories are kept
+  }
+
+  // The block files of the old data store are removed when a data store is created at the same path
+  create(manager_type::stripe_placement::round_robin);
+  const auto old_sub_dir_paths = stripe_sub_dir_paths(dir_path());
+  {
+    manager_type manager(metall::create_only, dir_path().c_str(), stripe_dir_paths());
+  }
+  for (std::size_t n = 0; n < 3; ++n) {
+    ASSERT_FALSE(util::directory_exist(old_sub_dir_paths[n]));
+  }
+}
+
+TEST(StripeTest, ShareDirectories) {
+  // Data stores that share the stripe directories do not touch each other's block files
+  const std::string other_dir_path(test_utility::make_test_dir_path("StripeTest_Other"));
+  create(manager_type::stripe_placement::round_robin);
+  create(manager_type::stripe_placement::round_robin, other_dir_path);
+  check();
+  check(other_dir_path);
+
+  ASSERT_TRUE(manager_type::remove(other_dir_path.c_str()));
+  check();
+}
+}
@@ -0,0 +1,137 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#define METALL_TIERING_INTERVAL_MS 50
+
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include <metall/metall.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+namespace util = metall::detail::utility;
+
+using manager_type = metall::manager;
+
+constexpr std::size_t k_array_size = 1ULL << 23ULL;
+constexpr std::size_t k_hot_size = 1ULL << 20ULL;
+constexpr std::size_t k_hot_capacity = 1ULL << 22ULL;
+
+const std::string &dir_path() {
+  const static std::string path(test_utility::make_test_dir_path("TieringTest"));
+  return path;
+}
+
+const std::string &hot_dir_path() {
+  const static std::string path(test_utility::make_test_dir_path("TieringTest_hot"));
+  return path;
+}
+
+std::string hot_file_path() {
+  return hot_dir_path() + "/segment_block-0";
+}
+
+// Writes to the first part of the array repeatedly so that it becomes hot
+void heat(char *const array, const char value) {
+  for (int epoch = 0; epoch < 20; ++epoch) {
+    std::memset(array, value, k_hot_size);
+    std::this_thread::sleep_for(std::chrono::milliseconds(METALL_TIERING_INTERVAL_MS / 2));
+  }
+}
+
+// Returns true if a block file contains the string
+bool file_contains(const std::string &file_path, const std::string &str) {
+  const int fd = ::open(file_path.c_str(), O_RDONLY);
+  if (fd == -1) return false;
+  const off_t file_size = ::lseek(fd, 0, SEEK_END);
+  std::vector<char> buf(1ULL << 20ULL);
+  bool found = false;
+  for (off_t offset = 0; offset < file_size && !found;) {
+    off_t data = ::lseek(fd, offset, SEEK_DATA);
+    if (data == -1) break;
+    const ssize_t n = ::pread(fd, buf.data(), buf.size(), data);
+    if (n <= 0) break;
+    found = (::memmem(buf.data(), n, str.data(), str.size()) != nullptr);
+    offset = data + n - str.size();
+  }
+  ::close(fd);
+  return found;
+}
+
+TEST(TieringTest, MoveHotPart) {
+  manager_type::remove(dir_path().c_str());
+  {
+    manager_type manager(metall::create_only, dir_path().c_str());
+    auto *const array = static_cast<char *>(manager.allocate(k_array_size));
+    std::memset(array, 'a', k_array_size);
+    manager.construct<metall::offset_ptr<char>>("array")(array);
+
+    ASSERT_TRUE(manager.start_tiering(hot_dir_path().c_str(), k_hot_capacity));
+    heat(array, 'b');
+    ASSERT_GT(manager.hot_tier_size(), 0);
+    ASSERT_LE(manager.hot_tier_size(), k_hot_capacity);
+    ASSERT_TRUE(util::file_exist(hot_file_path()));
+
+    // Written while being moved
+    heat(array, 'c');
+    for (std::size_t i = 0; i < k_array_size; ++i) {
+      ASSERT_EQ(array[i], (i < k_hot_size) ? 'c' : 'a');
+    }
+
+    ASSERT_TRUE(manager.stop_tiering());
+    ASSERT_EQ(manager.hot_tier_size(), 0);
+    ASSERT_FALSE(util::file_exist(hot_file_path()));
+  }
+
+  manager_type manager(metall::open_read_only, dir_path().c_str());
+  const char *const array = manager.find<metall::offset_ptr<char>>("array").first->get();
+  for (std::size_t i = 0; i < k_array_size; ++i) {
+    ASSERT_EQ(array[i], (i < k_hot_size) ? 'c' : 'a');
+  }
+}
+
+TEST(TieringTest, WriteBack) {
+  manager_type::remove(dir_path().c_str());
+  const std::string marker("TieringTest::WriteBack marker");
+  {
+    manager_type manager(metall::create_only, dir_path().c_str());
+    auto *const array = static_cast<char *>(manager.allocate(k_array_size));
+    manager.construct<metall::offset_ptr<char>>("array")(array);
+
+    ASSERT_TRUE(manager.start_tiering(hot_dir_path().c_str(), k_hot_capacity));
+    heat(array, 'b');
+    ASSERT_GT(manager.hot_tier_size(), 0);
+
+    // The block file is updated by flush() while the hot part stays in the hot directory
+    std::memcpy(array + k_hot_size / 2, marker.data(), marker.size());
+    manager.flush();
+    ASSERT_TRUE(file_contains(dir_path() + "/metall_datastore/segment_block-0", marker));
+    ASSERT_GT(manager.hot_tier_size(), 0);
+  } // Tiering is stopped when the manager is closed
+  ASSERT_FALSE(util::file_exist(hot_file_path()));
+
+  manager_type manager(metall::open_read_only, dir_path().c_str());
+  const char *const array = manager.find<metall::offset_ptr<char>>("array").first->get();
+  ASSERT_EQ(std::memcmp(array + k_hot_size / 2, marker.data(), marker.size()), 0);
+}
+
+TEST(TieringTest, ReadOnly) {
+  manager_type::remove(dir_path().c_str());
+  {
+    manager_type manager(metall::create_only, dir_path().c_str());
+  }
+  manager_type manager(metall::open_read_only, dir_path().c_str());
+  ASSERT_FALSE(manager.start_tiering(hot_dir_path().c_str(), k_hot_capacity));
+}
+}
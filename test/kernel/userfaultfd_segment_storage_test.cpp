@@ -0,0 +1,165 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+// A page buffer smaller than a chunk, i.e., pages of a chunk are evicted while the chunk is written to a version
+#define METALL_USERFAULTFD_BUFFER_SIZE (1ULL << 18ULL)
+
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#include <cerrno>
+
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <metall/metall.hpp>
+#include <metall/kernel/segment_storage/userfaultfd_segment_storage.hpp>
+#include <metall/detail/utility/mmap.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+namespace util = metall::detail::utility;
+
+using storage_type = metall::kernel::userfaultfd_segment_storage<std::ptrdiff_t, std::size_t>;
+
+constexpr std::size_t k_page_size = 1ULL << 16ULL;
+constexpr std::size_t k_buffer_size = k_page_size * 4;
+constexpr std::size_t k_segment_size = k_page_size * 32;
+constexpr std::size_t k_vm_size = k_segment_size * 4;
+
+std::string base_path() {
+  return test_utility::make_test_dir_path(::testing::UnitTest::GetInstance()->current_test_info()->name()) + "/segment";
+}
+
+/// \brief Returns false if userfaultfd(2) is not available or not permitted,
+/// e.g., vm.unprivileged_userfaultfd=0 or in a container
+bool userfaultfd_available() {
+  const int fd = ::syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+  if (fd == -1) {
+    return !(errno == EPERM || errno == ENOSYS);
+  }
+  ::close(fd);
+  return true;
+}
+
+void prepare_dir() {
+  const auto dir = test_utility::make_test_dir_path(::testing::UnitTest::GetInstance()->current_test_info()->name());
+  util::remove_file(dir);
+  ASSERT_TRUE(util::create_directory(dir));
+}
+
+TEST(UserfaultfdSegmentStorageTest, Evict) {
+  if (!userfaultfd_available()) {
+    GTEST_SKIP() << "userfaultfd is not available";
+  }
+  prepare_dir();
+  void *const vm = util::reserve_aligned_vm_region(k_page_size, k_vm_size);
+  ASSERT_NE(vm, nullptr);
+
+  {
+    storage_type storage(k_buffer_size, k_page_size);
+    ASSERT_TRUE(storage.create(base_path(), k_vm_size, vm, k_segment_size));
+    ASSERT_EQ(storage.page_size(), k_page_size);
+    ASSERT_EQ(storage.buffer_capacity(), k_buffer_size / k_page_size);
+
+    auto *const buf = static_cast<uint64_t *>(storage.get_segment());
+    const std::size_t num_elements = k_segment_size / sizeof(uint64_t);
+    for (std::size_t i = 0; i < num_elements; ++i) {
+      buf[i] = i;
+    }
+    ASSERT_LE(storage.num_resident_pages(), storage.buffer_capacity());
+
+    // Read back values that have been evicted and written to the file
+    for (std::size_t i = 0; i < num_elements; ++i) {
+      ASSERT_EQ(buf[i], i);
+    }
+    ASSERT_LE(storage.num_resident_pages(), storage.buffer_capacity());
+
+    storage.sync(true);
+    storage.destroy();
+  }
+
+  {
+    storage_type storage(k_buffer_size, k_page_size);
+    ASSERT_TRUE(storage.open(base_path(), k_vm_size, vm, true));
+    ASSERT_EQ(storage.size(), k_segment_size);
+    const auto *const buf = static_cast<const uint64_t *>(storage.get_segment());
+    for (std::size_t i = 0; i < k_segment_size / sizeof(uint64_t); ++i) {
+      ASSERT_EQ(buf[i], i);
+    }
+  }
+
+  util::munmap(vm, k_vm_size, false);
+}
+
+TEST(UserfaultfdSegmentStorageTest, Extend) {
+  if (!userfaultfd_available()) {
+    GTEST_SKIP() << "userfaultfd is not available";
+  }
+  prepare_dir();
+  void *const vm = util::reserve_aligned_vm_region(k_page_size, k_vm_size);
+  ASSERT_NE(vm, nullptr);
+
+  {
+    storage_type storage(k_buffer_size, k_page_size);
+    ASSERT_TRUE(storage.create(base_path(), k_vm_size, vm, k_segment_size));
+    ASSERT_TRUE(storage.extend(k_segment_size * 2));
+    ASSERT_EQ(storage.size(), k_segment_size * 2);
+
+    auto *const buf = static_cast<char *>(storage.get_segment());
+    for (std::size_t i = 0; i < storage.size(); i += k_page_size) {
+      buf[i] = static_cast<char>(i / k_page_size + 1);
+    }
+    storage.sync(false); // Asynchronous writeback
+  }
+
+  {
+    storage_type storage(k_buffer_size, k_page_size);
+    ASSERT_TRUE(storage.open(base_path(), k_vm_size, vm, false));
+    ASSERT_EQ(storage.size(), k_segment_size * 2);
+    auto *const buf = static_cast<char *>(storage.get_segment());
+    for (std::size_t i = 0; i < storage.size(); i += k_page_size) {
+      ASSERT_EQ(buf[i], static_cast<char>(i / k_page_size + 1));
+    }
+
+    // Freed pages are read as zero
+    storage.free_region(0, k_page_size);
+    ASSERT_EQ(buf[0], 0);
+  }
+
+  util::munmap(vm, k_vm_size, false);
+}
+
+TEST(UserfaultfdSegmentStorageTest, SnapshotVersion) {
+  if (!userfaultfd_available()) {
+    GTEST_SKIP() << "userfaultfd is not available";
+  }
+  const auto dir = test_utility::make_test_dir_path(::testing::UnitTest::GetInstance()->current_test_info()->name());
+  metall::manager::remove(dir.c_str());
+  constexpr std::size_t k_length = k_segment_size * 8;
+  {
+    metall::manager manager(metall::create_only, dir.c_str());
+    manager.construct<char>("array")[k_length]('x');
+  }
+
+  // The chunks are written to the version with pwrite(2) from the segment, i.e., the kernel raises page faults
+  {
+    metall::manager manager(metall::open_only, dir.c_str());
+    metall::manager::version_type version;
+    ASSERT_TRUE(manager.snapshot_version(&version));
+    ASSERT_EQ(version, 0);
+  }
+
+  // The versions of this storage cannot be opened; check the delta file instead
+  std::ifstream ifs(dir + "/metall_versions/0/segment_delta", std::ios::binary);
+  ASSERT_TRUE(ifs.is_open());
+  const auto num_x = std::count(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>(), 'x');
+  ASSERT_EQ(num_x, (std::ptrdiff_t)k_length);
+}
+}
@@ -0,0 +1,128 @@
+// Copyright 2019 Lawrence Livermore National Security, LLC and other Metall Project Developers.
+// See the top-level COPYRIGHT file for details.
+//
+// SPDX-License-Identifier: (Apache-2.0 OR MIT)
+
+#define METALL_ENABLE_VERSION_TRACKING
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+#include <metall/metall.hpp>
+#include "../test_utility.hpp"
+
+namespace {
+namespace util = metall::detail::utility;
+
+using chunk_no_type = uint32_t;
+static constexpr std::size_t k_chunk_size = 1 << 21;
+using manager_type = metall::basic_manager<chunk_no_type, k_chunk_size>;
+static constexpr std::size_t k_length = k_chunk_size * 8;
+
+const std::string &dir_path() {
+  const static std::string path(test_utility::make_test_dir_path("VersionTest"));
+  return path;
+}
+
+std::string delta_file_path(const manager_type::version_type version) {
+  return dir_path() + "/metall_versions/" + std::to_string(version) + "/segment_delta";
+}
+
+void check_version(const manager_type::version_type version, const char a, const char b) {
+  manager_type manager(metall::open_read_only, dir_path().c_str(), version);
+  const auto result = manager.find<char>("array");
+  ASSERT_NE(result.first, nullptr);
+  ASSERT_EQ(result.second, k_length);
+  ASSERT_EQ(result.first[0], a);
+  ASSERT_EQ(result.first[k_length - 1], b);
+  ASSERT_EQ(result.first[k_length / 2], 'x');
+}
+
+TEST(VersionTest, SnapshotVersion) {
+  manager_type::remove(dir_path().c_str());
+  {
+    manager_type manager(metall::create_only, dir_path().c_str());
+    auto *const array = manager.construct<char>("array")[k_length]('x');
+    array[0] = 'a';
+    array[k_length - 1] = 'a';
+
+    manager_type::version_type version;
+    ASSERT_TRUE(manager.snapshot_version(&version));
+    ASSERT_EQ(version, 0);
+    ASSERT_GE(util::get_file_size(delta_file_path(0)), (ssize_t)k_length);
+
+    array[0] = 'b'; // Modifies only one chunk
+    ASSERT_TRUE(manager.snapshot_version(&version));
+    ASSERT_EQ(version, 1);
+    ASSERT_LT(util::get_file_size(delta_file_path(1)), (ssize_t)k_length / 2);
+
+    array[k_length - 1] = 'c'; // Not in any version
+  }
+
+  const auto versions = manager_type::versions(dir_path().c_str());
+  ASSERT_EQ(versions.size(), 2);
+  ASSERT_EQ(versions[1].version, 1);
+  ASSERT_EQ(versions[1].parent, 0);
+
+  check_version(0, 'a', 'a');
+  check_version(1, 'b', 'a');
+  {
+    manager_type manager(metall::open_read_only, dir_path().c_str());
+    ASSERT_EQ(manager.find<char>("array").first[k_length - 1], 'c');
+  }
+}
+
+TEST(VersionTest, ReopenAndRemove) {
+  // The modified chunks are known across a close
+  {
+    manager_type manager(metall::open_only, dir_path().c_str());
+    manager.find<char>("array").first[0] = 'd';
+    manager_type::version_type version;
+    ASSERT_TRUE(manager.snapshot_version(&version));
+    ASSERT_EQ(version, 2);
+  }
+  ASSERT_LT(util::get_file_size(delta_file_path(2)), (ssize_t)k_length / 2);
+  check_version(2, 'd', 'c');
+
+  // Versions can be removed without affecting the others
+  ASSERT_TRUE(manager_type::remove_version(dir_path().c_str(), 0));
+  ASSERT_FALSE(util::file_exist(delta_file_path(0)));
+  ASSERT_EQ(manager_type::versions(dir_path().c_str()).size(), 2);
+  check_version(1, 'b', 'a');
+  check_version(2, 'd', 'c');
+
+  ASSERT_TRUE(manager_type::remove_version(dir_path().c_str(), 2));
+  {
+    manager_type manager(metall::open_only, dir_path().c_str());
+    manager.find<char>("array").first[0] = 'e';
+    manager_type::version_type version;
+    ASSERT_TRUE(manager.snapshot_version(&version));
+    ASSERT_EQ(version, 3);
+    ASSERT_EQ(manager.find<char>("array").first[0], 'e'); // Still writable
+  }
+  check_version(1, 'b', 'a');
+  check_version(3, 'e', 'c');
+}
+
+TEST(VersionTest, OpenMissingVersion) {
+  // A version whose delta file is missing is reported instead of aborting
+  ASSERT_TRUE(util::remove_file(delta_file_path(3)));
+  manager_type::manager_kernel_type kernel{std::allocator<std::byte>()};
+  ASSERT_FALSE(kernel.open_version(dir_path().c_str(), 3));
+
+  // The kernel can open another version after the failure
+  ASSERT_TRUE(kernel.open_version(dir_path().c_str(), 1));
+  kernel.close();
+  check_version(1, 'b', 'a');
+}
+
+TEST(VersionTest, Create) {
+  // Versions of an old data store are removed
+  manager_type::remove(dir_path().c_str());
+  {
+    manager_type manager(metall::create_only, dir_path().c_str());
+  }
+  ASSERT_TRUE(manager_type::versions(dir_path().c_str()).empty());
+}
+}